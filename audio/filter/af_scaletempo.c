@@ -35,6 +35,26 @@
 #include <limits.h>
 #include <assert.h>
 
+#include <libavcodec/avfft.h>
+#include <libavutil/cpu.h>
+#include <libavutil/mem.h>
+
+#include "config.h"
+
+#if HAVE_ASM && defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define HAVE_DOT_X86 1
+#include <immintrin.h>
+#else
+#define HAVE_DOT_X86 0
+#endif
+
+#if HAVE_ASM && defined(__ARM_NEON)
+#define HAVE_DOT_NEON 1
+#include <arm_neon.h>
+#else
+#define HAVE_DOT_NEON 0
+#endif
+
 #include "audio/aframe.h"
 #include "audio/audio_format.h"
 #include "common/common.h"
@@ -89,6 +109,17 @@ struct priv {
     void *buf_pre_corr;
     void *table_window;
     int (*best_overlap_offset)(struct priv *s);
+    // vectorized search (NULL if not available)
+    // sum(a[i] * b[i]), in unspecified order
+    float (*dot_float)(const float *a, const float *b, int n);
+    // sum((256 * hi[i] + lo[i]) * b[i]), exact
+    int64_t (*dot_s16)(const int16_t *hi, const int16_t *lo,
+                       const int16_t *b, int n);
+    int16_t *buf_pre_corr_split;
+    // FFT search
+    int fft_bits;
+    RDFTContext *rdft, *irdft;
+    float *fft_buf;
 };
 
 static bool reinit(struct mp_filter *f);
@@ -202,6 +233,305 @@ static int best_overlap_offset_s16(struct priv *s)
     return best_off * 2 * s->num_channels;
 }
 
+// The functions below compute the same correlations as the ones above, using
+// the dot product kernels selected by init_dot_fns().
+
+// Number of vector iterations after which the 32 bit accumulators of the s16
+// kernels are flushed. Each lane sums 2 products of at most 2^8 * 2^15 per
+// iteration, so they can't overflow.
+#define DOT_S16_BLOCK 64
+
+#if HAVE_DOT_X86
+
+static __attribute__((target("sse2")))
+float dot_float_sse2(const float *a, const float *b, int n)
+{
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i),
+                                           _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4),
+                                           _mm_loadu_ps(b + i + 4)));
+    }
+    float t[4];
+    _mm_storeu_ps(t, _mm_add_ps(acc0, acc1));
+    float sum = t[0] + t[1] + t[2] + t[3];
+    for (; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+static __attribute__((target("sse2")))
+int64_t dot_s16_sse2(const int16_t *hi, const int16_t *lo, const int16_t *b,
+                     int n)
+{
+    int64_t sum = 0;
+    int i = 0;
+    while (i + 8 <= n) {
+        int end = MPMIN(n & ~7, i + DOT_S16_BLOCK * 8);
+        __m128i acc_h = _mm_setzero_si128(), acc_l = _mm_setzero_si128();
+        for (; i < end; i += 8) {
+            __m128i vb = _mm_loadu_si128((const void *)(b + i));
+            acc_h = _mm_add_epi32(acc_h,
+                _mm_madd_epi16(_mm_loadu_si128((const void *)(hi + i)), vb));
+            acc_l = _mm_add_epi32(acc_l,
+                _mm_madd_epi16(_mm_loadu_si128((const void *)(lo + i)), vb));
+        }
+        int32_t th[4], tl[4];
+        _mm_storeu_si128((void *)th, acc_h);
+        _mm_storeu_si128((void *)tl, acc_l);
+        for (int k = 0; k < 4; k++)
+            sum += 256 * (int64_t)th[k] + tl[k];
+    }
+    for (; i < n; i++)
+        sum += (int64_t)(256 * hi[i] + lo[i]) * b[i];
+    return sum;
+}
+
+static __attribute__((target("avx2")))
+float dot_float_avx2(const float *a, const float *b, int n)
+{
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(a + i),
+                                                 _mm256_loadu_ps(b + i)));
+        acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8),
+                                                 _mm256_loadu_ps(b + i + 8)));
+    }
+    float t[8];
+    _mm256_storeu_ps(t, _mm256_add_ps(acc0, acc1));
+    float sum = 0;
+    for (int k = 0; k < 8; k++)
+        sum += t[k];
+    for (; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+static __attribute__((target("avx2")))
+int64_t dot_s16_avx2(const int16_t *hi, const int16_t *lo, const int16_t *b,
+                     int n)
+{
+    int64_t sum = 0;
+    int i = 0;
+    while (i + 16 <= n) {
+        int end = MPMIN(n & ~15, i + DOT_S16_BLOCK * 16);
+        __m256i acc_h = _mm256_setzero_si256(), acc_l = _mm256_setzero_si256();
+        for (; i < end; i += 16) {
+            __m256i vb = _mm256_loadu_si256((const void *)(b + i));
+            acc_h = _mm256_add_epi32(acc_h,
+                _mm256_madd_epi16(_mm256_loadu_si256((const void *)(hi + i)), vb));
+            acc_l = _mm256_add_epi32(acc_l,
+                _mm256_madd_epi16(_mm256_loadu_si256((const void *)(lo + i)), vb));
+        }
+        int32_t th[8], tl[8];
+        _mm256_storeu_si256((void *)th, acc_h);
+        _mm256_storeu_si256((void *)tl, acc_l);
+        for (int k = 0; k < 8; k++)
+            sum += 256 * (int64_t)th[k] + tl[k];
+    }
+    for (; i < n; i++)
+        sum += (int64_t)(256 * hi[i] + lo[i]) * b[i];
+    return sum;
+}
+
+#endif /* HAVE_DOT_X86 */
+
+#if HAVE_DOT_NEON
+
+static float dot_float_neon(const float *a, const float *b, int n)
+{
+    float32x4_t acc0 = vdupq_n_f32(0), acc1 = vdupq_n_f32(0);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    float t[4];
+    vst1q_f32(t, vaddq_f32(acc0, acc1));
+    float sum = t[0] + t[1] + t[2] + t[3];
+    for (; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+static int64_t dot_s16_neon(const int16_t *hi, const int16_t *lo,
+                            const int16_t *b, int n)
+{
+    int64_t sum = 0;
+    int i = 0;
+    while (i + 8 <= n) {
+        int end = MPMIN(n & ~7, i + DOT_S16_BLOCK * 8);
+        int32x4_t acc_h = vdupq_n_s32(0), acc_l = vdupq_n_s32(0);
+        for (; i < end; i += 8) {
+            int16x8_t vb = vld1q_s16(b + i);
+            int16x8_t vh = vld1q_s16(hi + i);
+            int16x8_t vl = vld1q_s16(lo + i);
+            acc_h = vmlal_s16(acc_h, vget_low_s16(vh), vget_low_s16(vb));
+            acc_h = vmlal_s16(acc_h, vget_high_s16(vh), vget_high_s16(vb));
+            acc_l = vmlal_s16(acc_l, vget_low_s16(vl), vget_low_s16(vb));
+            acc_l = vmlal_s16(acc_l, vget_high_s16(vl), vget_high_s16(vb));
+        }
+        int32_t th[4], tl[4];
+        vst1q_s32(th, acc_h);
+        vst1q_s32(tl, acc_l);
+        for (int k = 0; k < 4; k++)
+            sum += 256 * (int64_t)th[k] + tl[k];
+    }
+    for (; i < n; i++)
+        sum += (int64_t)(256 * hi[i] + lo[i]) * b[i];
+    return sum;
+}
+
+#endif /* HAVE_DOT_NEON */
+
+static void init_dot_fns(struct priv *s)
+{
+    int flags = av_get_cpu_flags();
+    (void)flags;
+#if HAVE_DOT_X86
+    if (flags & AV_CPU_FLAG_SSE2) {
+        s->dot_float = dot_float_sse2;
+        s->dot_s16 = dot_s16_sse2;
+    }
+    if (flags & AV_CPU_FLAG_AVX2) {
+        s->dot_float = dot_float_avx2;
+        s->dot_s16 = dot_s16_avx2;
+    }
+#endif
+#if HAVE_DOT_NEON
+    if (flags & AV_CPU_FLAG_NEON) {
+        s->dot_float = dot_float_neon;
+        s->dot_s16 = dot_s16_neon;
+    }
+#endif
+}
+
+static int best_overlap_offset_float_dot(struct priv *s)
+{
+    float best_corr = INT_MIN;
+    int best_off = 0;
+    int n = s->samples_overlap - s->num_channels;
+
+    float *pw  = s->table_window;
+    float *po  = (float *)s->buf_overlap + s->num_channels;
+    float *ppc = s->buf_pre_corr;
+    for (int i = 0; i < n; i++)
+        ppc[i] = pw[i] * po[i];
+
+    float *search_start = (float *)s->buf_queue + s->num_channels;
+    for (int off = 0; off < s->frames_search; off++) {
+        float corr = s->dot_float(ppc, search_start, n);
+        if (corr > best_corr) {
+            best_corr = corr;
+            best_off  = off;
+        }
+        search_start += s->num_channels;
+    }
+
+    return best_off * 4 * s->num_channels;
+}
+
+static int best_overlap_offset_s16_dot(struct priv *s)
+{
+    int64_t best_corr = INT64_MIN;
+    int best_off = 0;
+    int n = s->samples_overlap - s->num_channels;
+
+    // The pre-correlation values need 17 bits. Split them into 2 parts that
+    // fit into int16_t, so the kernels can use 16 bit multiplies.
+    int32_t *pw  = s->table_window;
+    int16_t *po  = (int16_t *)s->buf_overlap + s->num_channels;
+    int16_t *phi = s->buf_pre_corr_split;
+    int16_t *plo = phi + n;
+    for (int i = 0; i < n; i++) {
+        int32_t v = (pw[i] * po[i]) >> 15;
+        phi[i] = v >> 8;
+        plo[i] = v - phi[i] * 256;
+    }
+
+    int16_t *search_start = (int16_t *)s->buf_queue + s->num_channels;
+    for (int off = 0; off < s->frames_search; off++) {
+        int64_t corr = s->dot_s16(phi, plo, search_start, n);
+        if (corr > best_corr) {
+            best_corr = corr;
+            best_off  = off;
+        }
+        search_start += s->num_channels;
+    }
+
+    return best_off * 2 * s->num_channels;
+}
+
+// Compute the correlation for all offsets at once with FFTs. Channels are
+// transformed separately (offsets are whole frames), and the cross spectra are
+// summed before the inverse transform.
+static int best_overlap_offset_float_fft(struct priv *s)
+{
+    float best_corr = INT_MIN;
+    int best_off = 0;
+    int nch = s->num_channels;
+    int n = s->samples_overlap - nch;
+    int len = 1 << s->fft_bits;
+    int frames_pre = n / nch;
+    int frames_in = s->frames_search + frames_pre - 1;
+
+    float *pw  = s->table_window;
+    float *po  = (float *)s->buf_overlap + nch;
+    float *ppc = s->buf_pre_corr;
+    for (int i = 0; i < n; i++)
+        ppc[i] = pw[i] * po[i];
+
+    float *ps  = (float *)s->buf_queue + nch;
+    float *a   = s->fft_buf;
+    float *b   = a + len;
+    float *acc = b + len;
+    memset(acc, 0, len * sizeof(float));
+    for (int ch = 0; ch < nch; ch++) {
+        for (int i = 0; i < len; i++) {
+            a[i] = i < frames_pre ? ppc[i * nch + ch] : 0;
+            b[i] = i < frames_in ? ps[i * nch + ch] : 0;
+        }
+        av_rdft_calc(s->rdft, a);
+        av_rdft_calc(s->rdft, b);
+        // acc += conj(a) * b; elements 0 and 1 are the real DC and Nyquist bins
+        acc[0] += a[0] * b[0];
+        acc[1] += a[1] * b[1];
+        for (int i = 2; i < len; i += 2) {
+            acc[i]     += a[i] * b[i]     + a[i + 1] * b[i + 1];
+            acc[i + 1] += a[i] * b[i + 1] - a[i + 1] * b[i];
+        }
+    }
+    av_rdft_calc(s->irdft, acc);
+
+    for (int off = 0; off < s->frames_search; off++) {
+        if (acc[off] > best_corr) {
+            best_corr = acc[off];
+            best_off  = off;
+        }
+    }
+
+    return best_off * 4 * nch;
+}
+
+// Return the FFT size (log2) to use for the float correlation, or 0 if the
+// direct search is expected to be faster. Both cost estimates are per channel;
+// the factor accounts for the direct search being a plain vectorized loop.
+static int get_fft_bits(int frames_search, int frames_overlap)
+{
+    int frames_in = frames_search + frames_overlap - 2;
+    int bits = 4;
+    while ((1 << bits) < frames_in)
+        bits++;
+    if (bits > 16)
+        return 0;
+    int64_t direct = (int64_t)frames_search * (frames_overlap - 1);
+    int64_t fft = 2 * 16 * ((int64_t)1 << bits) * bits;
+    return direct > fft ? bits : 0;
+}
+
 static void output_overlap_float(struct priv *s, void *buf_out,
                                  int bytes_off)
 {
@@ -376,6 +706,15 @@ static void update_speed(struct priv *s, float speed)
     s->frames_stride_error = MPMIN(s->frames_stride_error, s->frames_stride_scaled);
 }
 
+static void uninit_fft(struct priv *s)
+{
+    av_rdft_end(s->rdft);
+    av_rdft_end(s->irdft);
+    av_freep(&s->fft_buf);
+    s->rdft = s->irdft = NULL;
+    s->fft_bits = 0;
+}
+
 static bool reinit(struct mp_filter *f)
 {
     struct priv *s = f->priv;
@@ -453,8 +792,11 @@ static bool reinit(struct mp_filter *f)
                 MP_FATAL(f, "Out of memory\n");
                 return false;
             }
-            memset((char *)s->buf_pre_corr + s->bytes_overlap * 2, 0,
-                    UNROLL_PADDING);
+            // best_overlap_offset_s16() reads up to 3 values past the end of
+            // the pre-correlation data (which is 1 frame shorter than the
+            // overlap), so clear everything after it.
+            memset((char *)s->buf_pre_corr + s->bytes_overlap * 2 - nch * 4, 0,
+                    nch * 4 + UNROLL_PADDING);
             int32_t *pw = s->table_window;
             for (int i = 1; i < frames_overlap; i++) {
                 int32_t v = (i * (t - i) * n) >> 15;
@@ -462,6 +804,15 @@ static bool reinit(struct mp_filter *f)
                     *pw++ = v;
             }
             s->best_overlap_offset = best_overlap_offset_s16;
+            if (s->dot_s16) {
+                s->buf_pre_corr_split = realloc(s->buf_pre_corr_split,
+                                                s->bytes_overlap * 2);
+                if (!s->buf_pre_corr_split) {
+                    MP_FATAL(f, "Out of memory\n");
+                    return false;
+                }
+                s->best_overlap_offset = best_overlap_offset_s16_dot;
+            }
         } else {
             s->buf_pre_corr = realloc(s->buf_pre_corr, s->bytes_overlap);
             s->table_window = realloc(s->table_window,
@@ -477,6 +828,25 @@ static bool reinit(struct mp_filter *f)
                     *pw++ = v;
             }
             s->best_overlap_offset = best_overlap_offset_float;
+            if (s->dot_float)
+                s->best_overlap_offset = best_overlap_offset_float_dot;
+            int bits = get_fft_bits(s->frames_search, frames_overlap);
+            if (bits != s->fft_bits) {
+                uninit_fft(s);
+                if (bits) {
+                    s->rdft = av_rdft_init(bits, DFT_R2C);
+                    s->irdft = av_rdft_init(bits, IDFT_C2R);
+                    s->fft_buf = av_malloc(3 * (sizeof(float) << bits));
+                    if (!s->rdft || !s->irdft || !s->fft_buf) {
+                        MP_FATAL(f, "Out of memory\n");
+                        uninit_fft(s);
+                        return false;
+                    }
+                    s->fft_bits = bits;
+                }
+            }
+            if (s->fft_bits)
+                s->best_overlap_offset = best_overlap_offset_float_fft;
         }
     }
 
@@ -496,12 +866,13 @@ static bool reinit(struct mp_filter *f)
 
     MP_DBG(f, ""
            "%.2f stride_in, %i stride_out, %i standing, "
-           "%i overlap, %i search, %i queue, %s mode\n",
+           "%i overlap, %i search%s, %i queue, %s mode\n",
            s->frames_stride_scaled,
            (int)(s->bytes_stride / nch / bps),
            (int)(s->bytes_standing / nch / bps),
            (int)(s->bytes_overlap / nch / bps),
            s->frames_search,
+           s->best_overlap_offset == best_overlap_offset_float_fft ? " (fft)" : "",
            (int)(s->bytes_queue / nch / bps),
            (use_int ? "s16" : "float"));
 
@@ -549,6 +920,8 @@ static void destroy(struct mp_filter *f)
     free(s->buf_pre_corr);
     free(s->table_blend);
     free(s->table_window);
+    free(s->buf_pre_corr_split);
+    uninit_fft(s);
     TA_FREEP(&s->in);
     mp_filter_free_children(f);
 }
@@ -579,6 +952,7 @@ static struct mp_filter *af_scaletempo_create(struct mp_filter *parent,
     s->speed = 1.0;
     s->cur_format = talloc_steal(s, mp_aframe_create());
     s->out_pool = mp_aframe_pool_create(s);
+    init_dot_fns(s);
 
     struct mp_autoconvert *conv = mp_autoconvert_create(f);
     if (!conv)
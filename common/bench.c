@@ -0,0 +1,143 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Aggregated timing and throughput counters for --benchmark. Unlike the
+// MP_STATS() event log, this only sums up time spent per stage, so it can
+// stay enabled for whole runs without affecting the results much.
+//
+// If benchmarking is disabled, mpv_global.bench is NULL, and all functions
+// taking mpv_global are no-ops.
+
+#include <stdio.h>
+
+#include "config.h"
+
+#if HAVE_POSIX
+#include <sys/resource.h>
+#endif
+
+#include "mpv_talloc.h"
+#include "osdep/atomic.h"
+#include "osdep/timer.h"
+#include "misc/node.h"
+#include "libmpv/client.h"
+#include "global.h"
+#include "bench.h"
+
+static const char *const stage_names[MP_BENCH_STAGE_COUNT] = {
+    [MP_BENCH_DEMUX]        = "demux",
+    [MP_BENCH_DECODE]       = "decode",
+    [MP_BENCH_FILTER]       = "filter",
+    [MP_BENCH_VO_QUEUE]     = "vo-queue",
+    [MP_BENCH_VO]           = "vo",
+};
+
+static const char *const counter_names[MP_BENCH_COUNTER_COUNT] = {
+    [MP_BENCH_PACKETS]      = "packets",
+    [MP_BENCH_VIDEO_FRAMES] = "video-frames",
+    [MP_BENCH_AUDIO_FRAMES] = "audio-frames",
+    [MP_BENCH_VO_FRAMES]    = "vo-frames",
+};
+
+struct mp_bench {
+    int64_t start_time;
+    uint64_t start_allocs;
+    mp_atomic_int64 stage_time[MP_BENCH_STAGE_COUNT];   // in microseconds
+    mp_atomic_int64 stage_calls[MP_BENCH_STAGE_COUNT];
+    mp_atomic_int64 counters[MP_BENCH_COUNTER_COUNT];
+};
+
+struct mp_bench *mp_bench_create(void *ta_parent)
+{
+    struct mp_bench *b = talloc_zero(ta_parent, struct mp_bench);
+    talloc_enable_alloc_count();
+    b->start_allocs = talloc_get_alloc_count();
+    b->start_time = mp_time_us();
+    return b;
+}
+
+// Return the start time to pass to mp_bench_end().
+int64_t mp_bench_start(struct mpv_global *global)
+{
+    return global->bench ? mp_time_us() : 0;
+}
+
+// Add the time passed since mp_bench_start() to the given stage.
+void mp_bench_end(struct mpv_global *global, enum mp_bench_stage stage,
+                  int64_t start)
+{
+    struct mp_bench *b = global->bench;
+    if (!b)
+        return;
+    atomic_fetch_add(&b->stage_time[stage], mp_time_us() - start);
+    atomic_fetch_add(&b->stage_calls[stage], 1);
+}
+
+void mp_bench_add(struct mpv_global *global, enum mp_bench_counter counter,
+                  int64_t n)
+{
+    struct mp_bench *b = global->bench;
+    if (b)
+        atomic_fetch_add(&b->counters[counter], n);
+}
+
+static int64_t get_peak_rss(void)
+{
+#if HAVE_POSIX
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) == 0) {
+#ifdef __APPLE__
+        return ru.ru_maxrss;
+#else
+        return ru.ru_maxrss * (int64_t)1024;
+#endif
+    }
+#endif
+    return -1;
+}
+
+// Write a summary of the current state as MPV_FORMAT_NODE_MAP to dst.
+// m_option_type_node memory management rules apply.
+void mp_bench_get_node(struct mp_bench *b, struct mpv_node *dst)
+{
+    double wall = (mp_time_us() - b->start_time) / 1e6;
+
+    node_init(dst, MPV_FORMAT_NODE_MAP, NULL);
+
+    node_map_add_double(dst, "wall-time", wall);
+
+    struct mpv_node *stages = node_map_add(dst, "stages", MPV_FORMAT_NODE_MAP);
+    for (int n = 0; n < MP_BENCH_STAGE_COUNT; n++) {
+        struct mpv_node *st =
+            node_map_add(stages, stage_names[n], MPV_FORMAT_NODE_MAP);
+        node_map_add_double(st, "time",
+                            atomic_load(&b->stage_time[n]) / 1e6);
+        node_map_add_int64(st, "calls", atomic_load(&b->stage_calls[n]));
+    }
+
+    for (int n = 0; n < MP_BENCH_COUNTER_COUNT; n++) {
+        int64_t v = atomic_load(&b->counters[n]);
+        node_map_add_int64(dst, counter_names[n], v);
+        char rate[80];
+        snprintf(rate, sizeof(rate), "%s-per-second", counter_names[n]);
+        node_map_add_double(dst, rate, wall > 0 ? v / wall : 0);
+    }
+
+    node_map_add_int64(dst, "peak-rss", get_peak_rss());
+    node_map_add_int64(dst, "allocations",
+                       talloc_get_alloc_count() - b->start_allocs);
+}
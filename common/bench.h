@@ -0,0 +1,53 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_BENCH_H_
+#define MP_BENCH_H_
+
+#include <stdint.h>
+
+struct mpv_global;
+struct mpv_node;
+
+enum mp_bench_stage {
+    MP_BENCH_DEMUX,         // demuxer reading packets (demux thread)
+    MP_BENCH_DECODE,        // audio and video decoders
+    MP_BENCH_FILTER,        // running the player's filter graph (incl. decoders)
+    MP_BENCH_VO_QUEUE,      // time frames wait in the VO queue
+    MP_BENCH_VO,            // VO drawing and flipping frames (VO thread)
+    MP_BENCH_STAGE_COUNT
+};
+
+enum mp_bench_counter {
+    MP_BENCH_PACKETS,       // demuxed packets
+    MP_BENCH_VIDEO_FRAMES,  // decoded video frames
+    MP_BENCH_AUDIO_FRAMES,  // decoded audio frames
+    MP_BENCH_VO_FRAMES,     // frames rendered by the VO
+    MP_BENCH_COUNTER_COUNT
+};
+
+struct mp_bench;
+
+struct mp_bench *mp_bench_create(void *ta_parent);
+int64_t mp_bench_start(struct mpv_global *global);
+void mp_bench_end(struct mpv_global *global, enum mp_bench_stage stage,
+                  int64_t start);
+void mp_bench_add(struct mpv_global *global, enum mp_bench_counter counter,
+                  int64_t n);
+void mp_bench_get_node(struct mp_bench *b, struct mpv_node *dst);
+
+#endif
@@ -9,6 +9,12 @@ struct mpv_global {
     struct m_config_shadow *config;
     struct mp_client_api *client_api;
 
+    // Set if benchmarking is enabled (--benchmark), NULL otherwise.
+    struct mp_bench *bench;
+
+    // Span tracing (--trace-file). Can be NULL.
+    struct mp_trace *trace;
+
     // Using this is deprecated and should be avoided (missing synchronization).
     // Use m_config_cache to access mpv_global.config instead.
     struct MPOpts *opts;
@@ -16,6 +16,8 @@
  */
 
 #include <assert.h>
+#include <string.h>
+
 #include "build/config.h"
 #include "playlist.h"
 #include "common/common.h"
@@ -49,32 +51,62 @@ void playlist_entry_add_params(struct playlist_entry *e,
         playlist_entry_add_param(e, params[n].name, params[n].value);
 }
 
+// Recompute pl_index and the prev/next links of entries[start] up to
+// entries[end - 1], as well as the links of the entries adjacent to that range.
+static void playlist_update_entries(struct playlist *pl, int start, int end)
+{
+    int num = pl->num_entries;
+    end = MPMIN(end, num);
+    for (int n = start; n < end; n++) {
+        struct playlist_entry *e = pl->entries[n];
+        e->pl_index = n;
+        e->prev = n > 0 ? pl->entries[n - 1] : NULL;
+        e->next = n + 1 < num ? pl->entries[n + 1] : NULL;
+    }
+    if (start > 0 && start <= num)
+        pl->entries[start - 1]->next = start < num ? pl->entries[start] : NULL;
+    if (end > 0 && end < num)
+        pl->entries[end]->prev = pl->entries[end - 1];
+    pl->first = num ? pl->entries[0] : NULL;
+    pl->last = num ? pl->entries[num - 1] : NULL;
+}
+
+static void playlist_insert_at(struct playlist *pl, int pos,
+                               struct playlist_entry **add, int num_add)
+{
+    assert(pos >= 0 && pos <= pl->num_entries);
+    for (int n = 0; n < num_add; n++) {
+        struct playlist_entry *e = add[n];
+        assert(e->pl == NULL && e->next == NULL && e->prev == NULL);
+        e->pl = pl;
+        talloc_steal(pl, e);
+    }
+    MP_TARRAY_GROW(pl, pl->entries, pl->num_entries + num_add);
+    memmove(&pl->entries[pos + num_add], &pl->entries[pos],
+            (pl->num_entries - pos) * sizeof(pl->entries[0]));
+    memcpy(&pl->entries[pos], add, num_add * sizeof(pl->entries[0]));
+    pl->num_entries += num_add;
+    playlist_update_entries(pl, pos, pl->num_entries);
+}
+
 // Add entry "add" after entry "after".
 // If "after" is NULL, add as first entry.
 // Post condition: add->prev == after
 void playlist_insert(struct playlist *pl, struct playlist_entry *after,
                      struct playlist_entry *add)
 {
-    assert(pl && add->pl == NULL && add->next == NULL && add->prev == NULL);
-    if (after) {
+    playlist_insert_entries(pl, after, &add, 1);
+}
+
+// Like playlist_insert(), but insert all num_add entries in the given order,
+// which is much cheaper than inserting them one by one.
+void playlist_insert_entries(struct playlist *pl, struct playlist_entry *after,
+                             struct playlist_entry **add, int num_add)
+{
+    assert(pl);
+    if (after)
         assert(after->pl == pl);
-        assert(pl->first && pl->last);
-    }
-    add->prev = after;
-    if (after) {
-        add->next = after->next;
-        after->next = add;
-    } else {
-        add->next = pl->first;
-        pl->first = add;
-    }
-    if (add->next) {
-        add->next->prev = add;
-    } else {
-        pl->last = add;
-    }
-    add->pl = pl;
-    talloc_steal(pl, add);
+    playlist_insert_at(pl, after ? after->pl_index + 1 : 0, add, num_add);
 }
 
 void playlist_add(struct playlist *pl, struct playlist_entry *add)
@@ -82,6 +114,13 @@ void playlist_add(struct playlist *pl, struct playlist_entry *add)
     playlist_insert(pl, pl->last, add);
 }
 
+static void playlist_detach(struct playlist_entry *entry)
+{
+    entry->next = entry->prev = NULL;
+    // xxx: we'd want to reset the talloc parent of entry
+    entry->pl = NULL;
+}
+
 static void playlist_unlink(struct playlist *pl, struct playlist_entry *entry)
 {
     assert(pl && entry->pl == pl);
@@ -91,19 +130,10 @@ static void playlist_unlink(struct playlist *pl, struct playlist_entry *entry)
         pl->current_was_replaced = true;
     }
 
-    if (entry->next) {
-        entry->next->prev = entry->prev;
-    } else {
-        pl->last = entry->prev;
-    }
-    if (entry->prev) {
-        entry->prev->next = entry->next;
-    } else {
-        pl->first = entry->next;
-    }
-    entry->next = entry->prev = NULL;
-    // xxx: we'd want to reset the talloc parent of entry
-    entry->pl = NULL;
+    int pos = entry->pl_index;
+    MP_TARRAY_REMOVE_AT(pl->entries, pl->num_entries, pos);
+    playlist_detach(entry);
+    playlist_update_entries(pl, pos, pl->num_entries);
 }
 
 void playlist_entry_unref(struct playlist_entry *e)
@@ -122,12 +152,38 @@ void playlist_remove(struct playlist *pl, struct playlist_entry *entry)
 
 void playlist_clear(struct playlist *pl)
 {
-    while (pl->first)
-        playlist_remove(pl, pl->first);
+    playlist_clear_except(pl, NULL);
     assert(!pl->current);
     pl->current_was_replaced = false;
 }
 
+// Remove all entries but keep (which can be NULL, to remove all entries).
+void playlist_clear_except(struct playlist *pl, struct playlist_entry *keep)
+{
+    assert(!keep || keep->pl == pl);
+
+    // Same as removing the entries one by one in playlist order.
+    if (pl->current && pl->current != keep) {
+        bool keep_follows = keep && keep->pl_index > pl->current->pl_index;
+        pl->current = keep_follows ? keep : NULL;
+        pl->current_was_replaced = true;
+    }
+
+    int num = pl->num_entries;
+    pl->num_entries = 0;
+    for (int n = 0; n < num; n++) {
+        struct playlist_entry *e = pl->entries[n];
+        if (e == keep) {
+            pl->entries[pl->num_entries++] = e;
+        } else {
+            playlist_detach(e);
+            e->removed = true;
+            playlist_entry_unref(e);
+        }
+    }
+    playlist_update_entries(pl, 0, pl->num_entries);
+}
+
 // Moves the entry so that it takes "at"'s place (or move to end, if at==NULL).
 void playlist_move(struct playlist *pl, struct playlist_entry *entry,
                    struct playlist_entry *at)
@@ -135,14 +191,21 @@ void playlist_move(struct playlist *pl, struct playlist_entry *entry,
     if (entry == at)
         return;
 
-    struct playlist_entry *save_current = pl->current;
-    bool save_replaced = pl->current_was_replaced;
-
-    playlist_unlink(pl, entry);
-    playlist_insert(pl, at ? at->prev : pl->last, entry);
+    assert(entry->pl == pl && (!at || at->pl == pl));
 
-    pl->current = save_current;
-    pl->current_was_replaced = save_replaced;
+    int from = entry->pl_index;
+    int to = at ? at->pl_index : pl->num_entries;
+    if (to > from)
+        to--;
+    if (from < to) {
+        memmove(&pl->entries[from], &pl->entries[from + 1],
+                (to - from) * sizeof(pl->entries[0]));
+    } else {
+        memmove(&pl->entries[to + 1], &pl->entries[to],
+                (from - to) * sizeof(pl->entries[0]));
+    }
+    pl->entries[to] = entry;
+    playlist_update_entries(pl, MPMIN(from, to), MPMAX(from, to) + 1);
 }
 
 void playlist_add_file(struct playlist *pl, const char *filename)
@@ -150,34 +213,14 @@ void playlist_add_file(struct playlist *pl, const char *filename)
     playlist_add(pl, playlist_entry_new(filename));
 }
 
-static int playlist_count(struct playlist *pl)
-{
-    int c = 0;
-    for (struct playlist_entry *e = pl->first; e; e = e->next)
-        c++;
-    return c;
-}
-
 void playlist_shuffle(struct playlist *pl)
 {
-    struct playlist_entry *save_current = pl->current;
-    bool save_replaced = pl->current_was_replaced;
-    int count = playlist_count(pl);
-    struct playlist_entry **arr = talloc_array(NULL, struct playlist_entry *,
-                                               count);
-    for (int n = 0; n < count; n++) {
-        arr[n] = pl->first;
-        playlist_unlink(pl, pl->first);
-    }
+    int count = pl->num_entries;
     for (int n = 0; n < count - 1; n++) {
         int j = (int)((double)(count - n) * rand() / (RAND_MAX + 1.0));
-        MPSWAP(struct playlist_entry *, arr[n], arr[n + j]);
+        MPSWAP(struct playlist_entry *, pl->entries[n], pl->entries[n + j]);
     }
-    for (int n = 0; n < count; n++)
-        playlist_add(pl, arr[n]);
-    talloc_free(arr);
-    pl->current = save_current;
-    pl->current_was_replaced = save_replaced;
+    playlist_update_entries(pl, 0, count);
 }
 
 struct playlist_entry *playlist_get_next(struct playlist *pl, int direction)
@@ -217,6 +260,28 @@ void playlist_add_redirect(struct playlist *pl, const char *redirected_from)
     }
 }
 
+// Move all entries from source_pl to pl at the given position, in one go.
+static void playlist_transfer_at(struct playlist *pl, int pos,
+                                 struct playlist *source_pl)
+{
+    struct playlist_entry **entries = source_pl->entries;
+    int num = source_pl->num_entries;
+
+    // Same as unlinking all entries from source_pl.
+    if (source_pl->current) {
+        source_pl->current = NULL;
+        source_pl->current_was_replaced = true;
+    }
+    source_pl->entries = NULL;
+    source_pl->num_entries = 0;
+    playlist_update_entries(source_pl, 0, 0);
+
+    for (int n = 0; n < num; n++)
+        playlist_detach(entries[n]);
+    playlist_insert_at(pl, pos, entries, num);
+    talloc_free(entries);
+}
+
 // Move all entries from source_pl to pl, appending them after the current entry
 // of pl. source_pl will be empty, and all entries have changed ownership to pl.
 //将所有条目从source_pl移到pl，并将它们附加到pl的当前条目之后。source_pl将为空，并且所有条目的所有权都已更改为pl。
@@ -228,53 +293,43 @@ void playlist_transfer_entries(struct playlist *pl, struct playlist *source_pl)
     if (!add_after)
         add_after = pl->last;
 
-    while (source_pl->first) {
-        struct playlist_entry *e = source_pl->first;
-        playlist_unlink(source_pl, e);
-        playlist_insert(pl, add_after, e);
-        add_after = e;
-    }
+    playlist_transfer_at(pl, add_after ? add_after->pl_index + 1 : 0, source_pl);
 }
 
 void playlist_append_entries(struct playlist *pl, struct playlist *source_pl)
 {
-    while (source_pl->first) {
-        struct playlist_entry *e = source_pl->first;
-        playlist_unlink(source_pl, e);
-        playlist_add(pl, e);
-    }
+    playlist_transfer_at(pl, pl->num_entries, source_pl);
+}
+
+// Like playlist_transfer_entries(), but insert the entries at dst_index.
+void playlist_transfer_entries_to(struct playlist *pl, int dst_index,
+                                  struct playlist *source_pl)
+{
+    assert(dst_index >= 0 && dst_index <= pl->num_entries);
+    playlist_transfer_at(pl, dst_index, source_pl);
 }
 
 // Return number of entries between list start and e.
 // Return -1 if e is not on the list, or if e is NULL.
 int playlist_entry_to_index(struct playlist *pl, struct playlist_entry *e)
 {
-    struct playlist_entry *cur = pl->first;
-    int pos = 0;
-    if (!e)
+    if (!e || e->pl != pl)
         return -1;
-    while (cur && cur != e) {
-        cur = cur->next;
-        pos++;
-    }
-    return cur == e ? pos : -1;
+    return e->pl_index;
 }
 
 int playlist_entry_count(struct playlist *pl)
 {
-    return playlist_entry_to_index(pl, pl->last) + 1;
+    return pl->num_entries;
 }
 
 // Return entry for which playlist_entry_to_index() would return index.
 // Return NULL if not found.
 struct playlist_entry *playlist_entry_from_index(struct playlist *pl, int index)
 {
-    struct playlist_entry *e = pl->first;
-    for (int n = 0; ; n++) {
-        if (!e || n == index)
-            return e;
-        e = e->next;
-    }
+    if (index < 0 || index >= pl->num_entries)
+        return NULL;
+    return pl->entries[index];
 }
 
 struct playlist *playlist_parse_file(const char *file, struct mpv_global *global)
@@ -28,6 +28,8 @@ struct playlist_param {
 struct playlist_entry {
     struct playlist_entry *prev, *next;
     struct playlist *pl;
+    // Position in pl->entries[]. Only valid if pl is set.
+    int pl_index;
 
     char *filename;
 
@@ -62,6 +64,11 @@ struct playlist_entry {
 };
 
 struct playlist {
+    // All entries in playlist order. first/last and the entries' prev/next
+    // links are kept consistent with this array, and can be used for plain
+    // iteration.
+    struct playlist_entry **entries;
+    int num_entries;
     struct playlist_entry *first, *last;
 
     // This provides some sort of stable iterator. If this entry is removed from
@@ -82,9 +89,12 @@ struct playlist_entry *playlist_entry_new(const char *filename);
 
 void playlist_insert(struct playlist *pl, struct playlist_entry *after,
                      struct playlist_entry *add);
+void playlist_insert_entries(struct playlist *pl, struct playlist_entry *after,
+                             struct playlist_entry **add, int num_add);
 void playlist_add(struct playlist *pl, struct playlist_entry *add);
 void playlist_remove(struct playlist *pl, struct playlist_entry *entry);
 void playlist_clear(struct playlist *pl);
+void playlist_clear_except(struct playlist *pl, struct playlist_entry *keep);
 
 void playlist_move(struct playlist *pl, struct playlist_entry *entry,
                    struct playlist_entry *at);
@@ -96,6 +106,8 @@ void playlist_add_base_path(struct playlist *pl, bstr base_path);
 void playlist_add_redirect(struct playlist *pl, const char *redirected_from);
 void playlist_transfer_entries(struct playlist *pl, struct playlist *source_pl);
 void playlist_append_entries(struct playlist *pl, struct playlist *source_pl);
+void playlist_transfer_entries_to(struct playlist *pl, int dst_index,
+                                  struct playlist *source_pl);
 
 int playlist_entry_to_index(struct playlist *pl, struct playlist_entry *e);
 int playlist_entry_count(struct playlist *pl);
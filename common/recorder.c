@@ -16,6 +16,7 @@
  */
 
 #include <math.h>
+#include <pthread.h>
 
 #include <libavformat/avformat.h>
 
@@ -47,6 +48,10 @@ struct mp_recorder {
     struct mpv_global *global;
     struct mp_log *log;
 
+    // Serializes access by the sinks, which can be fed from different threads
+    // (e.g. decoder threads).
+    pthread_mutex_t lock;
+
     struct mp_recorder_sink **streams;
     int num_streams;
 
@@ -129,6 +134,7 @@ struct mp_recorder *mp_recorder_create(struct mpv_global *global,
                                        int num_streams)
 {
     struct mp_recorder *priv = talloc_zero(NULL, struct mp_recorder);
+    pthread_mutex_init(&priv->lock, NULL);
 
     priv->global = global;
     priv->log = mp_log_new(priv, global->log, "recorder");
@@ -323,6 +329,7 @@ void mp_recorder_destroy(struct mp_recorder *priv)
     }
 
     flush_packets(priv);
+    pthread_mutex_destroy(&priv->lock);
     talloc_free(priv);
 }
 
@@ -330,6 +337,8 @@ void mp_recorder_destroy(struct mp_recorder *priv)
 //这是在seek时调用的，或者在录制中途开始时调用。
 void mp_recorder_mark_discontinuity(struct mp_recorder *priv)
 {
+    pthread_mutex_lock(&priv->lock);
+
     flush_packets(priv);
 
     for (int n = 0; n < priv->num_streams; n++) {
@@ -340,6 +349,8 @@ void mp_recorder_mark_discontinuity(struct mp_recorder *priv)
 
     priv->muxing = false;
     priv->muxing_from_start = false;
+
+    pthread_mutex_unlock(&priv->lock);
 }
 
 // Get a stream for writing. The pointer is valid until mp_recorder is
@@ -352,12 +363,7 @@ struct mp_recorder_sink *mp_recorder_get_sink(struct mp_recorder *r, int stream)
     return r->streams[stream];
 }
 
-// Pass a packet to the given stream. The function does not own the packet, but
-// can create a new reference to it if it needs to retain it. Can be NULL to
-// signal proper end of stream.
-//将数据包传递到给定的流。函数不拥有数据包，但如果需要保留它，可以创建对它的新引用。可以为NULL以表示流的正确结束。
-void mp_recorder_feed_packet(struct mp_recorder_sink *rst,
-                             struct demux_packet *pkt)
+static void feed_packet(struct mp_recorder_sink *rst, struct demux_packet *pkt)
 {
     struct mp_recorder *priv = rst->owner;
 
@@ -399,3 +405,17 @@ void mp_recorder_feed_packet(struct mp_recorder_sink *rst,
     check_restart(priv);
     mux_packets(rst, false);
 }
+
+// Pass a packet to the given stream. The function does not own the packet, but
+// can create a new reference to it if it needs to retain it. Can be NULL to
+// signal proper end of stream.
+//将数据包传递到给定的流。函数不拥有数据包，但如果需要保留它，可以创建对它的新引用。可以为NULL以表示流的正确结束。
+void mp_recorder_feed_packet(struct mp_recorder_sink *rst,
+                             struct demux_packet *pkt)
+{
+    struct mp_recorder *priv = rst->owner;
+
+    pthread_mutex_lock(&priv->lock);
+    feed_packet(rst, pkt);
+    pthread_mutex_unlock(&priv->lock);
+}
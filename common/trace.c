@@ -0,0 +1,229 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Span tracing for --trace-file and the trace-dump command. The output uses
+// the Chrome trace event format (load it in chrome://tracing or Perfetto).
+//
+// Every thread that records events gets its own ring buffer on first use, so
+// recording never takes a lock: the owning thread is the only writer, and
+// publishes events by advancing the write position. Readers copy the ring and
+// discard entries that might have been overwritten while copying. Old events
+// are overwritten once a ring is full.
+//
+// If tracing is disabled, each trace point costs a function call and an
+// atomic load.
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "mpv_talloc.h"
+#include "common/common.h"
+#include "osdep/atomic.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
+#include "global.h"
+#include "trace.h"
+
+// Events per thread (must be a power of 2).
+#define TRACE_RING_SIZE 16384
+
+struct trace_event {
+    const char *name;
+    int64_t ts;             // mp_time_us() at the start
+    int64_t dur;            // -1 for instant events
+    int64_t arg;
+    int tid;
+};
+
+struct trace_ring {
+    struct mp_trace *trace;
+    atomic_bool in_use;     // owned by a live thread
+    int tid;
+    char name[80];
+    atomic_ullong wpos;     // number of events ever written
+    struct trace_event events[TRACE_RING_SIZE];
+};
+
+struct mp_trace {
+    atomic_bool enabled;
+    pthread_key_t key;      // struct trace_ring of the calling thread
+
+    pthread_mutex_t lock;   // protects the fields below
+    struct trace_ring **rings;
+    int num_rings;
+    int next_tid;
+};
+
+static void release_ring(void *ptr)
+{
+    struct trace_ring *ring = ptr;
+    atomic_store(&ring->in_use, false);
+}
+
+static void trace_destroy(void *ptr)
+{
+    struct mp_trace *t = ptr;
+    pthread_key_delete(t->key);
+    pthread_mutex_destroy(&t->lock);
+}
+
+struct mp_trace *mp_trace_create(void *ta_parent)
+{
+    struct mp_trace *t = talloc_zero(ta_parent, struct mp_trace);
+    if (pthread_key_create(&t->key, release_ring)) {
+        talloc_free(t);
+        return NULL;
+    }
+    pthread_mutex_init(&t->lock, NULL);
+    talloc_set_destructor(t, trace_destroy);
+    return t;
+}
+
+void mp_trace_set_enabled(struct mp_trace *t, bool enable)
+{
+    atomic_store(&t->enabled, enable);
+}
+
+static struct trace_ring *get_ring(struct mp_trace *t)
+{
+    struct trace_ring *ring = pthread_getspecific(t->key);
+    if (ring)
+        return ring;
+
+    pthread_mutex_lock(&t->lock);
+    // Reuse the ring of a thread that exited. Its events are kept, but are
+    // tagged with the old thread's ID.
+    for (int n = 0; n < t->num_rings; n++) {
+        if (!atomic_load(&t->rings[n]->in_use)) {
+            ring = t->rings[n];
+            break;
+        }
+    }
+    if (!ring) {
+        ring = talloc_zero(t, struct trace_ring);
+        ring->trace = t;
+        MP_TARRAY_APPEND(t, t->rings, t->num_rings, ring);
+    }
+    atomic_store(&ring->in_use, true);
+    ring->tid = ++t->next_tid;
+    mpthread_get_name(ring->name, sizeof(ring->name));
+    pthread_mutex_unlock(&t->lock);
+
+    pthread_setspecific(t->key, ring);
+    return ring;
+}
+
+static void add_event(struct mp_trace *t, struct trace_event ev)
+{
+    struct trace_ring *ring = get_ring(t);
+    unsigned long long pos = atomic_load(&ring->wpos);
+    ev.tid = ring->tid;
+    ring->events[pos & (TRACE_RING_SIZE - 1)] = ev;
+    atomic_store(&ring->wpos, pos + 1);
+}
+
+// Return the start time for mp_trace_end(), or 0 if tracing is disabled.
+int64_t mp_trace_begin(struct mpv_global *global)
+{
+    struct mp_trace *t = global->trace;
+    return t && atomic_load_explicit(&t->enabled, memory_order_relaxed)
+           ? mp_time_us() : 0;
+}
+
+// Record a span from mp_trace_begin() until now.
+void mp_trace_end(struct mpv_global *global, const char *name, int64_t start)
+{
+    if (!start)
+        return;
+    int64_t now = mp_time_us();
+    add_event(global->trace, (struct trace_event){
+        .name = name, .ts = start, .dur = now - start});
+}
+
+// Record a single point in time, with an arbitrary value (e.g. a frame ID).
+void mp_trace_instant(struct mpv_global *global, const char *name,
+                      int64_t arg)
+{
+    int64_t now = mp_trace_begin(global);
+    if (!now)
+        return;
+    add_event(global->trace, (struct trace_event){
+        .name = name, .ts = now, .dur = -1, .arg = arg});
+}
+
+static void write_ring(FILE *f, struct trace_ring *ring, bool *first)
+{
+    unsigned long long end = atomic_load(&ring->wpos);
+    unsigned long long start = end > TRACE_RING_SIZE ? end - TRACE_RING_SIZE : 0;
+    int num = end - start;
+    struct trace_event *events = talloc_array(NULL, struct trace_event, num);
+    for (int n = 0; n < num; n++)
+        events[n] = ring->events[(start + n) & (TRACE_RING_SIZE - 1)];
+
+    // Skip events the owner thread may have overwritten while copying.
+    unsigned long long now = atomic_load(&ring->wpos);
+    int skip = now - start > TRACE_RING_SIZE ? now - start - TRACE_RING_SIZE : 0;
+
+    for (int n = MPMIN(skip, num); n < num; n++) {
+        struct trace_event *ev = &events[n];
+        fprintf(f, "%s\n{\"name\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%"PRId64,
+                *first ? "" : ",", ev->name, ev->tid, ev->ts);
+        if (ev->dur >= 0) {
+            fprintf(f, ",\"ph\":\"X\",\"dur\":%"PRId64"}", ev->dur);
+        } else {
+            fprintf(f, ",\"ph\":\"i\",\"s\":\"t\",\"args\":{\"value\":%"PRId64
+                    "}}", ev->arg);
+        }
+        *first = false;
+    }
+    talloc_free(events);
+
+    char name[sizeof(ring->name)];
+    int len = 0;
+    for (int n = 0; ring->name[n]; n++) {
+        char c = ring->name[n];
+        if (c >= 0x20 && c != '"' && c != '\\')
+            name[len++] = c;
+    }
+    name[len] = '\0';
+    if (len) {
+        fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                "\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                *first ? "" : ",", ring->tid, name);
+        *first = false;
+    }
+}
+
+// Write all recorded events as Chrome trace JSON. Can be called while other
+// threads are recording.
+bool mp_trace_write(struct mp_trace *t, const char *filename)
+{
+    FILE *f = fopen(filename, "wb");
+    if (!f)
+        return false;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    bool first = true;
+    pthread_mutex_lock(&t->lock);
+    for (int n = 0; n < t->num_rings; n++)
+        write_ring(f, t->rings[n], &first);
+    pthread_mutex_unlock(&t->lock);
+    fprintf(f, "\n]}\n");
+
+    return fclose(f) == 0;
+}
@@ -0,0 +1,37 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_TRACE_H_
+#define MP_TRACE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct mpv_global;
+struct mp_trace;
+
+struct mp_trace *mp_trace_create(void *ta_parent);
+void mp_trace_set_enabled(struct mp_trace *t, bool enable);
+bool mp_trace_write(struct mp_trace *t, const char *filename);
+
+// Event names must be static strings (only the pointer is stored).
+int64_t mp_trace_begin(struct mpv_global *global);
+void mp_trace_end(struct mpv_global *global, const char *name, int64_t start);
+void mp_trace_instant(struct mpv_global *global, const char *name,
+                      int64_t arg);
+
+#endif
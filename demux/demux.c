@@ -32,8 +32,10 @@
 #include "options/m_config.h"
 #include "options/m_option.h"
 #include "mpv_talloc.h"
+#include "common/bench.h"
 #include "common/msg.h"
 #include "common/global.h"
+#include "common/trace.h"
 #include "osdep/atomic.h"
 #include "osdep/threads.h"
 
@@ -42,6 +44,7 @@
 #include "timeline.h"
 #include "stheader.h"
 #include "cue.h"
+#include "spill.h"
 
 // Demuxer list
 extern const struct demuxer_desc demuxer_desc_edl;
@@ -86,6 +89,9 @@ const demuxer_desc_t *const demuxer_list[] = {
     NULL
 };
 
+// Upper bound for unused packet buffers kept by demuxer->packet_pool.
+#define MAX_PACKET_POOL_BYTES (8 * 1024 * 1024)
+
 struct demux_opts {
     int64_t max_bytes;
     int64_t max_bytes_bw;
@@ -95,6 +101,8 @@ struct demux_opts {
     int access_references;
     int seekable_cache;
     int create_ccs;
+    char *spill_file;
+    int64_t spill_max_bytes;
 };
 
 #define OPT_BASE_STRUCT struct demux_opts
@@ -110,6 +118,8 @@ const struct m_sub_options demux_conf = {
         OPT_CHOICE("demuxer-seekable-cache", seekable_cache, 0,
                    ({"auto", -1}, {"no", 0}, {"yes", 1})),
         OPT_FLAG("sub-create-cc-track", create_ccs, 0),
+        OPT_STRING("demuxer-spill-file", spill_file, M_OPT_FILE),
+        OPT_BYTE_SIZE("demuxer-spill-max-bytes", spill_max_bytes, 0, 0, INT64_MAX),
         {0}
     },
     .size = sizeof(struct demux_opts),
@@ -120,6 +130,7 @@ const struct m_sub_options demux_conf = {
         .min_secs_cache = 10.0 * 60 * 60,
         .seekable_cache = -1,
         .access_references = 1,
+        .spill_max_bytes = 1024 * 1024 * 1024,
     },
 };
 
@@ -207,6 +218,10 @@ struct demux_internal {
     size_t total_bytes;         // total sum of packet data buffered
     size_t fw_bytes;            // sum of forward packet data in current_range
 
+    // If non-NULL, pruned backbuffer packets are moved to this file, from
+    // where they can be restored on cached seeks. Only used with seekable_cache.
+    struct demux_spill *spill;
+
     // Range from which decoder is reading, and to which demuxer is appending.
     // This is never NULL. This is always ranges[num_ranges - 1].
     struct demux_cached_range *current_range;
@@ -242,7 +257,10 @@ struct demux_cached_range {
     bool is_eof;            // set if the file ends with this range
 };
 
-#define MAX_INDEX_ENTRIES 16
+struct index_entry {
+    double pts;                 // equals to pkt->kf_seek_pts
+    struct demux_packet *pkt;
+};
 
 // A continuous list of cached packets for a single stream/range. There is one
 // for each stream and range. Also contains some state for use during demuxing
@@ -274,11 +292,22 @@ struct demux_queue {
     bool is_bof;            // started demuxing at beginning of file
     bool is_eof;            // received true EOF here
 
-    // incomplete index to somewhat speed up seek operations
-    // the entries in index[] must be in packet queue append/removal order
-    int num_index;          // valid index[] entries
-    double index_distance;  // minimum keyframe distance to add index element
-    struct demux_packet *index[MAX_INDEX_ENTRIES];
+    // Packets pruned to the spill file. These always directly precede head
+    // (in the same order), so they can be prepended again on seeks. Entries
+    // before spill_first were dropped and are unused.
+    struct demux_spill_entry *spill;
+    int spill_first;
+    int num_spill;
+    double spill_seek_start;    // first seekable keyframe in spill[], or NOPTS
+    double spill_last_pruned;   // like last_pruned, for dropped spill entries
+
+    // Index of the keyframes with a seek PTS, for fast seek operations.
+    // The entries must be in packet queue append/removal order, and have
+    // strictly increasing PTS. index[index_first..num_index-1] are valid.
+    struct index_entry *index;
+    int index_first;
+    int num_index;
+    bool index_gaps;        // some keyframes were not added to the index
 };
 
 struct demux_stream {
@@ -380,7 +409,7 @@ static void check_queue_consistency(struct demux_internal *in)
             bool is_forward = false;
             bool kf_found = false;
             bool npt_found = false;
-            int next_index = 0;
+            int next_index = queue->index_first;
             for (struct demux_packet *dp = queue->head; dp; dp = dp->next) {
                 is_forward |= dp == queue->ds->reader_head;
                 kf_found |= dp == queue->keyframe_latest;
@@ -399,8 +428,12 @@ static void check_queue_consistency(struct demux_internal *in)
                 if (!dp->next)
                     assert(queue->tail == dp);
 
-                if (next_index < queue->num_index && queue->index[next_index] == dp)
+                if (next_index < queue->num_index &&
+                    queue->index[next_index].pkt == dp)
+                {
+                    assert(queue->index[next_index].pts == dp->kf_seek_pts);
                     next_index += 1;
+                }
             }
             if (!queue->head)
                 assert(!queue->tail);
@@ -516,6 +549,20 @@ static void set_current_range(struct demux_internal *in,
     MP_TARRAY_APPEND(in, in->ranges, in->num_ranges, range);
 }
 
+// Earliest keyframe seek target, including packets in the spill file.
+static double queue_seek_start(struct demux_queue *queue)
+{
+    return PTS_OR_DEF(queue->spill_seek_start, queue->seek_start);
+}
+
+// Timestamp of the last keyframe that was irrecoverably pruned.
+static double queue_last_pruned(struct demux_queue *queue)
+{
+    if (queue->spill_first < queue->num_spill)
+        return queue->spill_last_pruned;
+    return queue->last_pruned;
+}
+
 // Refresh range->seek_start/end.
 static void update_seek_ranges(struct demux_cached_range *range)
 {
@@ -527,13 +574,14 @@ static void update_seek_ranges(struct demux_cached_range *range)
         struct demux_queue *queue = range->streams[n];
 
         if (queue->ds->selected && queue->ds->eager) {
-            range->seek_start = MP_PTS_MAX(range->seek_start, queue->seek_start);
+            double seek_start = queue_seek_start(queue);
+            range->seek_start = MP_PTS_MAX(range->seek_start, seek_start);
             range->seek_end = MP_PTS_MIN(range->seek_end, queue->seek_end);
 
             range->is_eof &= queue->is_eof;
             range->is_bof &= queue->is_bof;
 
-            if (queue->seek_start >= queue->seek_end) {
+            if (seek_start >= queue->seek_end) {
                 range->seek_start = range->seek_end = MP_NOPTS_VALUE;
                 break;
             }
@@ -555,14 +603,15 @@ static void update_seek_ranges(struct demux_cached_range *range)
     // seekable range.
     for (int n = 0; n < range->num_streams; n++) {
         struct demux_queue *queue = range->streams[n];
+        double last_pruned = queue_last_pruned(queue);
         if (queue->ds->selected && !queue->ds->eager &&
-            queue->last_pruned != MP_NOPTS_VALUE &&
+            last_pruned != MP_NOPTS_VALUE &&
             range->seek_start != MP_NOPTS_VALUE)
         {
             // (last_pruned is _exclusive_ to the seekable range, so add a small
             // value to exclude it from the valid range.)
             range->seek_start =
-                MP_PTS_MAX(range->seek_start, queue->last_pruned + 0.1);
+                MP_PTS_MAX(range->seek_start, last_pruned + 0.1);
         }
     }
 
@@ -570,10 +619,245 @@ static void update_seek_ranges(struct demux_cached_range *range)
         range->seek_start = range->seek_end = MP_NOPTS_VALUE;
 }
 
+// Add the keyframe to the end of the index.
+static void add_index_entry(struct demux_queue *queue, struct demux_packet *dp)
+{
+    assert(dp->keyframe && dp->kf_seek_pts != MP_NOPTS_VALUE);
+
+    // Binary search requires sorted entries. Broken timestamps should be rare,
+    // so just fall back to walking the packet list in this case.
+    if (queue->index_first < queue->num_index &&
+        dp->kf_seek_pts <= queue->index[queue->num_index - 1].pts)
+    {
+        queue->index_gaps = true;
+        return;
+    }
+
+    struct index_entry e = {dp->kf_seek_pts, dp};
+    MP_TARRAY_APPEND(queue, queue->index, queue->num_index, e);
+}
+
+static void remove_index_head(struct demux_queue *queue)
+{
+    queue->index_first += 1;
+
+    // Compact lazily, so that pruning does not memmove the index every time.
+    if (queue->index_first == queue->num_index) {
+        queue->index_first = queue->num_index = 0;
+    } else if (queue->index_first > queue->num_index / 2) {
+        queue->num_index -= queue->index_first;
+        memmove(&queue->index[0], &queue->index[queue->index_first],
+                queue->num_index * sizeof(queue->index[0]));
+        queue->index_first = 0;
+    }
+}
+
+static void update_spill_seek_start(struct demux_queue *queue)
+{
+    queue->spill_seek_start = MP_NOPTS_VALUE;
+    for (int n = queue->spill_first; n < queue->num_spill; n++) {
+        struct demux_spill_entry *e = &queue->spill[n];
+        if (e->keyframe && e->kf_seek_pts != MP_NOPTS_VALUE) {
+            queue->spill_seek_start = e->kf_seek_pts;
+            break;
+        }
+    }
+}
+
+// Irrecoverably drop the spill entries before index end.
+static void drop_spill_entries(struct demux_queue *queue, int end)
+{
+    struct demux_internal *in = queue->ds->in;
+
+    for (int n = queue->spill_first; n < end; n++) {
+        struct demux_spill_entry *e = &queue->spill[n];
+        if (e->keyframe && e->kf_seek_pts != MP_NOPTS_VALUE) {
+            queue->spill_last_pruned =
+                MP_PTS_MAX(queue->spill_last_pruned, e->kf_seek_pts);
+        }
+        demux_spill_release(in->spill, e);
+    }
+    queue->spill_first = end;
+
+    if (queue->spill_first == queue->num_spill) {
+        queue->spill_first = queue->num_spill = 0;
+    } else if (queue->spill_first > queue->num_spill / 2) {
+        queue->num_spill -= queue->spill_first;
+        memmove(&queue->spill[0], &queue->spill[queue->spill_first],
+                queue->num_spill * sizeof(queue->spill[0]));
+        queue->spill_first = 0;
+    }
+
+    update_spill_seek_start(queue);
+    update_seek_ranges(queue->range);
+}
+
+static void clear_spill(struct demux_queue *queue)
+{
+    drop_spill_entries(queue, queue->num_spill);
+    queue->spill_last_pruned = MP_NOPTS_VALUE;
+}
+
+// Drop all entries whose data was overwritten by later writes. Since the spill
+// file is written sequentially, these are always at the start of each queue.
+static void drop_invalid_spill_entries(struct demux_internal *in)
+{
+    for (int r = 0; r < in->num_ranges; r++) {
+        struct demux_cached_range *range = in->ranges[r];
+        for (int n = 0; n < range->num_streams; n++) {
+            struct demux_queue *queue = range->streams[n];
+            int end = queue->spill_first;
+            while (end < queue->num_spill &&
+                   !demux_spill_entry_valid(in->spill, &queue->spill[end]))
+                end++;
+            if (end > queue->spill_first)
+                drop_spill_entries(queue, end);
+        }
+    }
+}
+
+// Move a pruned packet to the spill file. Returns true if the spill took
+// ownership of dp.
+static bool spill_packet(struct demux_queue *queue, struct demux_packet *dp)
+{
+    struct demux_internal *in = queue->ds->in;
+
+    struct demux_spill_entry e = {0};
+    if (!demux_spill_write(in->spill, dp, &e)) {
+        // Entries must be contiguous with the queue head, so a gap makes all
+        // of them useless.
+        drop_spill_entries(queue, queue->num_spill);
+        if (dp->keyframe && dp->kf_seek_pts != MP_NOPTS_VALUE) {
+            queue->spill_last_pruned =
+                MP_PTS_MAX(queue->spill_last_pruned, dp->kf_seek_pts);
+        }
+        return false;
+    }
+
+    MP_TARRAY_APPEND(queue, queue->spill, queue->num_spill, e);
+    if (queue->spill_seek_start == MP_NOPTS_VALUE &&
+        e.keyframe && e.kf_seek_pts != MP_NOPTS_VALUE)
+        queue->spill_seek_start = e.kf_seek_pts;
+
+    // (The write might have overwritten the oldest data of any queue.)
+    drop_invalid_spill_entries(in);
+    return true;
+}
+
+// Copy packets queued by spill_packet() to the spill file. This is done with
+// the lock released, because writing to the mapping can page fault.
+static bool flush_spill(struct demux_internal *in)
+{
+    if (!in->spill || !demux_spill_begin_flush(in->spill))
+        return false;
+    pthread_mutex_unlock(&in->lock);
+    demux_spill_flush(in->spill);
+    pthread_mutex_lock(&in->lock);
+    demux_spill_end_flush(in->spill);
+    return true;
+}
+
+// Prepend packets from the spill file back to the queue, so that a cached seek
+// to pts can be served from memory. Does nothing if pts is not before the first
+// keyframe in memory.
+static void restore_spilled_packets(struct demux_queue *queue, double pts)
+{
+    struct demux_internal *in = queue->ds->in;
+
+    if (queue->spill_seek_start == MP_NOPTS_VALUE)
+        return;
+    if (queue->seek_start != MP_NOPTS_VALUE && pts >= queue->seek_start)
+        return;
+
+    // Latest keyframe before or at pts, or the first keyframe.
+    int first = -1;
+    for (int n = queue->spill_first; n < queue->num_spill; n++) {
+        struct demux_spill_entry *e = &queue->spill[n];
+        if (e->keyframe && e->kf_seek_pts != MP_NOPTS_VALUE) {
+            if (first >= 0 && e->kf_seek_pts > pts)
+                break;
+            first = n;
+        }
+    }
+    assert(first >= 0); // implied by spill_seek_start
+
+    struct demux_packet *head = NULL, *tail = NULL;
+    size_t bytes = 0;
+    struct index_entry *index = NULL;
+    int num_index = 0;
+    for (int n = first; n < queue->num_spill; n++) {
+        struct demux_packet *dp = demux_spill_read(in->spill, &queue->spill[n]);
+        if (!dp) {
+            MP_ERR(in, "failed to restore packets from spill file\n");
+            talloc_free(index);
+            while (head) {
+                struct demux_packet *next = head->next;
+                talloc_free(head);
+                head = next;
+            }
+            return;
+        }
+        dp->stream = queue->ds->index;
+        dp->next = NULL;
+        bytes += demux_packet_estimate_total_size(dp);
+        if (dp->keyframe && dp->kf_seek_pts != MP_NOPTS_VALUE) {
+            struct index_entry e = {dp->kf_seek_pts, dp};
+            MP_TARRAY_APPEND(NULL, index, num_index, e);
+        }
+        if (tail) {
+            tail->next = dp;
+        } else {
+            head = dp;
+        }
+        tail = dp;
+    }
+
+    MP_VERBOSE(in, "stream %d: restored %d packets (%zd bytes) from spill file\n",
+               queue->ds->index, queue->num_spill - first, bytes);
+
+    // The entries are now packets again, so this is not pruning.
+    for (int n = first; n < queue->num_spill; n++)
+        demux_spill_release(in->spill, &queue->spill[n]);
+    queue->num_spill = first;
+    if (queue->spill_first == queue->num_spill)
+        queue->spill_first = queue->num_spill = 0;
+    update_spill_seek_start(queue);
+
+    tail->next = queue->head;
+    queue->head = head;
+    if (!queue->tail)
+        queue->tail = tail;
+    in->total_bytes += bytes;
+
+    // Prepend the restored keyframes to the index (keeping it sorted).
+    for (int n = queue->index_first; n < queue->num_index; n++)
+        MP_TARRAY_APPEND(NULL, index, num_index, queue->index[n]);
+    int num_sorted = 0;
+    for (int n = 0; n < num_index; n++) {
+        if (num_sorted && index[n].pts <= index[num_sorted - 1].pts) {
+            queue->index_gaps = true;
+            continue;
+        }
+        index[num_sorted++] = index[n];
+    }
+    talloc_free(queue->index);
+    queue->index = talloc_steal(queue, index);
+    queue->index_first = 0;
+    queue->num_index = num_sorted;
+
+    // Pruning has to start over, because the packets before the old
+    // next_prune_target have their keyframe again.
+    queue->next_prune_target = NULL;
+    queue->seek_start = head->kf_seek_pts;
+    update_seek_ranges(queue->range);
+}
+
 // Remove queue->head from the queue. Does not update in->fw_bytes/in->fw_packs.
-static void remove_head_packet(struct demux_queue *queue)
+// If spill is false, the packet is discarded even if a spill file is used.
+static void remove_head_packet(struct demux_queue *queue, bool spill)
 {
     struct demux_packet *dp = queue->head;
+    struct demux_internal *in = queue->ds->in;
 
     assert(queue->ds->reader_head != dp);
     if (queue->next_prune_target == dp)
@@ -582,15 +866,23 @@ static void remove_head_packet(struct demux_queue *queue)
         queue->keyframe_latest = NULL;
     queue->is_bof = false;
 
-    queue->ds->in->total_bytes -= demux_packet_estimate_total_size(dp);
+    in->total_bytes -= demux_packet_estimate_total_size(dp);
 
-    if (queue->num_index && queue->index[0] == dp)
-        MP_TARRAY_REMOVE_AT(queue->index, queue->num_index, 0);
+    if (queue->index_first < queue->num_index &&
+        queue->index[queue->index_first].pkt == dp)
+        remove_index_head(queue);
 
     queue->head = dp->next;
     if (!queue->head)
         queue->tail = NULL;
 
+    if (spill && in->spill && in->seekable_cache) {
+        if (spill_packet(queue, dp))
+            return;
+    } else if (queue->num_spill) {
+        drop_spill_entries(queue, queue->num_spill);
+    }
+
     talloc_free(dp);
 }
 
@@ -612,8 +904,10 @@ static void clear_queue(struct demux_queue *queue)
     queue->keyframe_latest = NULL;
     queue->seek_start = queue->seek_end = queue->last_pruned = MP_NOPTS_VALUE;
 
-    queue->num_index = 0;
-    queue->index_distance = 1.0;
+    clear_spill(queue);
+
+    queue->index_first = queue->num_index = 0;
+    queue->index_gaps = false;
 
     queue->correct_dts = queue->correct_pos = true;
     queue->last_pos = -1;
@@ -1062,28 +1356,6 @@ void demuxer_feed_caption(struct sh_stream *stream, demux_packet_t *dp)
     demux_add_packet(sh, dp);
 }
 
-// Add the keyframe to the end of the index. Not all packets are actually added.
-//将关键帧添加到索引的末尾。并不是所有的数据包都是实际添加的。
-static void add_index_entry(struct demux_queue *queue, struct demux_packet *dp)
-{
-    assert(dp->keyframe && dp->kf_seek_pts != MP_NOPTS_VALUE);
-
-    if (queue->num_index) {
-        double prev = queue->index[queue->num_index - 1]->kf_seek_pts;
-        if (dp->kf_seek_pts < prev + queue->index_distance)
-            return;
-    }
-
-    if (queue->num_index == MAX_INDEX_ENTRIES) {
-        for (int n = 0; n < MAX_INDEX_ENTRIES / 2; n++)
-            queue->index[n] = queue->index[n * 2];
-        queue->num_index = MAX_INDEX_ENTRIES / 2;
-        queue->index_distance *= 2;
-    }
-
-    queue->index[queue->num_index++] = dp;
-}
-
 // Check whether the next range in the list is, and if it appears to overlap,
 // try joining it into a single range.
 //检查列表中的下一个区域是否是，如果它看起来重叠，请尝试将其合并到单个区域中。
@@ -1165,8 +1437,10 @@ static void attempt_range_joining(struct demux_internal *in)
                     // we'd remove it and use q2's packet, but the linked list
                     // makes this hard, so copy this missing metadata instead.
                     end->kf_seek_pts = dp->kf_seek_pts;
+                    if (end->keyframe && end->kf_seek_pts != MP_NOPTS_VALUE)
+                        add_index_entry(q1, end);
 
-                    remove_head_packet(q2);
+                    remove_head_packet(q2, false);
                     join_point_found = true;
                     break;
                 }
@@ -1181,7 +1455,7 @@ static void attempt_range_joining(struct demux_internal *in)
                     (ds->global_correct_pos && dp->pos > end->pos))
                     break;
 
-                remove_head_packet(q2);
+                remove_head_packet(q2, false);
             }
         }
 
@@ -1227,9 +1501,10 @@ static void attempt_range_joining(struct demux_internal *in)
         q2->next_prune_target = NULL;
         q2->keyframe_latest = NULL;
 
-        for (int i = 0; i < q2->num_index; i++)
-            add_index_entry(q1, q2->index[i]);
-        q2->num_index = 0;
+        for (int i = q2->index_first; i < q2->num_index; i++)
+            add_index_entry(q1, q2->index[i].pkt);
+        q1->index_gaps |= q2->index_gaps;
+        q2->index_first = q2->num_index = 0;
 
         recompute_buffers(ds);
         in->fw_bytes += ds->fw_bytes;
@@ -1318,6 +1593,8 @@ void demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
         return;
     }
     struct demux_internal *in = ds->in;
+    mp_bench_add(in->d_thread->global, MP_BENCH_PACKETS, 1);
+    mp_trace_instant(in->d_thread->global, "demux-packet", ds->index);
     pthread_mutex_lock(&in->lock);
 
     in->initial_state = false;
@@ -1501,9 +1778,13 @@ static bool read_packet(struct demux_internal *in)
 
     struct demuxer *demux = in->d_thread;
 
+    int64_t bench_start = mp_bench_start(demux->global);
+    int64_t trace_start = mp_trace_begin(demux->global);
     bool eof = true;
     if (demux->desc->fill_buffer && !demux_cancel_test(demux))
         eof = demux->desc->fill_buffer(demux) <= 0;
+    mp_trace_end(demux->global, "demux-read", trace_start);
+    mp_bench_end(demux->global, MP_BENCH_DEMUX, bench_start);
     update_cache(in);
 
     pthread_mutex_lock(&in->lock);
@@ -1540,27 +1821,32 @@ static void prune_old_packets(struct demux_internal *in)
     // big.
     size_t max_bytes = in->seekable_cache ? in->max_bytes_bw : 0;
     while (in->total_bytes - in->fw_bytes > max_bytes) {
-        // (Start from least recently used range.)
-        struct demux_cached_range *range = in->ranges[0];
+        // (Start from least recently used range. With a spill file, ranges
+        // can stay valid without any packets in memory, so skip those.)
+        struct demux_cached_range *range = NULL;
         double earliest_ts = MP_NOPTS_VALUE;
         struct demux_stream *earliest_stream = NULL;
 
-        for (int n = 0; n < range->num_streams; n++) {
-            struct demux_queue *queue = range->streams[n];
-            struct demux_stream *ds = queue->ds;
-
-            if (queue->head && queue->head != ds->reader_head) {
-                struct demux_packet *dp = queue->head;
-                double ts = dp->kf_seek_pts;
-                // Note: in obscure cases, packets might have no timestamps set,
-                // in which case we still need to prune _something_.
-                bool prune_always =
-                    !in->seekable_cache || ts == MP_NOPTS_VALUE || !dp->keyframe;
-                if (prune_always || !earliest_stream || ts < earliest_ts) {
-                    earliest_ts = ts;
-                    earliest_stream = ds;
-                    if (prune_always)
-                        break;
+        for (int r = 0; r < in->num_ranges && !earliest_stream; r++) {
+            range = in->ranges[r];
+
+            for (int n = 0; n < range->num_streams; n++) {
+                struct demux_queue *queue = range->streams[n];
+                struct demux_stream *ds = queue->ds;
+
+                if (queue->head && queue->head != ds->reader_head) {
+                    struct demux_packet *dp = queue->head;
+                    double ts = dp->kf_seek_pts;
+                    // Note: in obscure cases, packets might have no timestamps
+                    // set, in which case we still need to prune _something_.
+                    bool prune_always = !in->seekable_cache ||
+                                        ts == MP_NOPTS_VALUE || !dp->keyframe;
+                    if (prune_always || !earliest_stream || ts < earliest_ts) {
+                        earliest_ts = ts;
+                        earliest_stream = ds;
+                        if (prune_always)
+                            break;
+                    }
                 }
             }
         }
@@ -1601,10 +1887,12 @@ static void prune_old_packets(struct demux_internal *in)
         bool done = false;
         while (!done && queue->head && queue->head != ds->reader_head) {
             done = queue->next_prune_target == queue->head;
-            remove_head_packet(queue);
+            remove_head_packet(queue, true);
         }
 
-        if (range != in->current_range && range->seek_start == MP_NOPTS_VALUE)
+        // (Spilling can invalidate the spilled data of any range.)
+        if (in->spill ||
+            (range != in->current_range && range->seek_start == MP_NOPTS_VALUE))
             free_empty_cached_ranges(in);
     }
 }
@@ -1670,6 +1958,8 @@ static bool thread_work(struct demux_internal *in)
         execute_seek(in);
         return true;
     }
+    if (flush_spill(in))
+        return true;
     if (!in->eof) {
         if (read_packet(in))
             return true; // read_packet unlocked, so recheck conditions
@@ -2028,6 +2318,7 @@ static void demux_copy(struct demuxer *dst, struct demuxer *src)
     dst->num_attachments = src->num_attachments;
     dst->matroska_data = src->matroska_data;
     dst->playlist = src->playlist;
+    dst->playlist_reader = src->playlist_reader;
     dst->seekable = src->seekable;
     dst->partially_seekable = src->partially_seekable;
     dst->filetype = src->filetype;
@@ -2226,6 +2517,11 @@ static struct demuxer *open_given_type(struct mpv_global *global,
         .events = DEMUX_EVENT_ALL,
         .duration = -1,
     };
+    // Unused buffers kept by the packet pool are not part of the packet queues,
+    // so take them out of the forward buffer size, to keep the total within
+    // the configured limits.
+    int64_t pool_bytes = MPMIN(opts->max_bytes / 16, MAX_PACKET_POOL_BYTES);
+    demuxer->packet_pool = demux_packet_pool_create(demuxer, pool_bytes);
     demuxer->seekable = stream->seekable;
     if (demuxer->stream->underlying && !demuxer->stream->underlying->seekable)
         demuxer->seekable = false;
@@ -2236,7 +2532,7 @@ static struct demuxer *open_given_type(struct mpv_global *global,
         .d_thread = talloc(demuxer, struct demuxer),
         .d_user = demuxer,
         .min_secs = opts->min_secs,
-        .max_bytes = opts->max_bytes,
+        .max_bytes = opts->max_bytes - pool_bytes,
         .max_bytes_bw = opts->max_bytes_bw,
         .initial_state = true,
         .highest_av_pts = MP_NOPTS_VALUE,
@@ -2302,6 +2598,10 @@ static struct demuxer *open_given_type(struct mpv_global *global,
                 seekable = 1;
         }
         in->seekable_cache = seekable == 1;
+        if (in->seekable_cache && opts->spill_file && opts->spill_file[0]) {
+            in->spill = demux_spill_create(in, in->log, opts->spill_file,
+                                           opts->spill_max_bytes);
+        }
         if (!(params && params->disable_timeline)) {
             struct timeline *tl = timeline_load(global, log, demuxer);
             if (tl) {
@@ -2449,7 +2749,7 @@ static void switch_current_range(struct demux_internal *in,
 
         // Remove all packets from head up until including next_prune_target.
         while (queue->next_prune_target)
-            remove_head_packet(queue);
+            remove_head_packet(queue, true);
     }
 
     // Exclude weird corner cases that break resuming.
@@ -2478,43 +2778,75 @@ static void switch_current_range(struct demux_internal *in,
     free_empty_cached_ranges(in);
 }
 
+struct seek_target {
+    struct demux_packet *pkt;
+    double diff;
+};
+
+// Consider dp as seek target. Returns false if no packet after dp can be a
+// better target.
+static bool update_seek_target(struct seek_target *t, struct demux_packet *dp,
+                               double pts, int flags)
+{
+    double range_pts = dp->kf_seek_pts;
+    if (!dp->keyframe || range_pts == MP_NOPTS_VALUE)
+        return true;
+
+    double diff = range_pts - pts;
+    if (flags & SEEK_FORWARD) {
+        diff = -diff;
+        if (diff > 0)
+            return true;
+    }
+    if (t->pkt) {
+        if (diff <= 0) {
+            if (t->diff <= 0 && diff <= t->diff)
+                return true;
+        } else if (diff >= t->diff)
+            return true;
+    }
+    t->diff = diff;
+    t->pkt = dp;
+    return range_pts <= pts;
+}
+
 static struct demux_packet *find_seek_target(struct demux_queue *queue,
                                              double pts, int flags)
 {
-    struct demux_packet *start = queue->head;
-    for (int n = 0; n < queue->num_index; n++) {
-        if (queue->index[n]->kf_seek_pts > pts)
-            break;
-        start = queue->index[n];
+    // Find the first index entry after pts.
+    int lo = queue->index_first, hi = queue->num_index;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (queue->index[mid].pts > pts) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
     }
+    // The last entry before or at pts, if there is one.
+    int start = MPMAX(lo - 1, queue->index_first);
 
-    struct demux_packet *target = NULL;
-    double target_diff = MP_NOPTS_VALUE;
-    for (struct demux_packet *dp = start; dp; dp = dp->next) {
-        double range_pts = dp->kf_seek_pts;
-        if (!dp->keyframe || range_pts == MP_NOPTS_VALUE)
-            continue;
+    struct seek_target t = {0};
 
-        double diff = range_pts - pts;
-        if (flags & SEEK_FORWARD) {
-            diff = -diff;
-            if (diff > 0)
-                continue;
+    if (!queue->index_gaps) {
+        // All possible targets are in the index. Since it is sorted, entries
+        // after the first one at or after pts can't be closer.
+        for (int n = start; n < queue->num_index; n++) {
+            update_seek_target(&t, queue->index[n].pkt, pts, flags);
+            if (queue->index[n].pts >= pts)
+                break;
         }
-        if (target) {
-            if (diff <= 0) {
-                if (target_diff <= 0 && diff <= target_diff)
-                    continue;
-            } else if (diff >= target_diff)
-                continue;
-        }
-        target_diff = diff;
-        target = dp;
-        if (range_pts > pts)
-            break;
+        return t.pkt;
     }
 
-    return target;
+    struct demux_packet *dp = queue->head;
+    if (start < queue->num_index && queue->index[start].pts <= pts)
+        dp = queue->index[start].pkt;
+    for (; dp; dp = dp->next) {
+        if (!update_seek_target(&t, dp, pts, flags))
+            break;
+    }
+    return t.pkt;
 }
 
 // must be called locked
@@ -2569,6 +2901,7 @@ static void execute_cache_seek(struct demux_internal *in,
             struct demux_stream *ds = in->streams[n]->ds;
             struct demux_queue *queue = range->streams[n];
             if (ds->selected && ds->type == STREAM_VIDEO) {
+                restore_spilled_packets(queue, pts);
                 struct demux_packet *target = find_seek_target(queue, pts, flags);
                 if (target) {
                     double target_pts = target->kf_seek_pts;
@@ -2590,6 +2923,7 @@ static void execute_cache_seek(struct demux_internal *in,
         struct demux_stream *ds = in->streams[n]->ds;
         struct demux_queue *queue = range->streams[n];
 
+        restore_spilled_packets(queue, pts);
         struct demux_packet *target = find_seek_target(queue, pts, flags);
         ds->reader_head = target;
         ds->skip_to_keyframe = !target;
@@ -2989,7 +3323,7 @@ static void update_cache(struct demux_internal *in)
 static int cached_stream_control(struct demux_internal *in, int cmd, void *arg)
 {
     // If the cache is active, wake up the thread to possibly update cache state.
-    if (in->stream_cache_info.size >= 0) {
+    if (in->stream_cache_info.size > 0) {
         in->force_cache_update = true;
         pthread_cond_signal(&in->wakeup);
     }
@@ -3050,6 +3384,15 @@ static int cached_demux_control(struct demux_internal *in, int cmd, void *arg)
             .low_level_seeks = in->low_level_seeks,
             .ts_last = in->demux_ts,
         };
+        if (in->spill) {
+            struct demux_spill_stats st;
+            demux_spill_get_stats(in->spill, &st);
+            r->spill_max_bytes = st.max_bytes;
+            r->spill_bytes = st.live_bytes;
+            r->spill_written_bytes = st.written_bytes;
+            r->spill_read_bytes = st.read_bytes;
+        }
+        r->pool_bytes = demux_packet_pool_get_bytes(in->d_thread->packet_pool);
         bool any_packets = false;
         for (int n = 0; n < in->num_streams; n++) {
             struct demux_stream *ds = in->streams[n]->ds;
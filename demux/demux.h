@@ -56,6 +56,12 @@ struct demux_ctrl_reader_state {
     double seeking; // current low level seek target, or NOPTS
     int low_level_seeks; // number of started low level seeks
     double ts_last; // approx. timestamp of demuxer position
+    // Spill file state (spill_max_bytes is 0 if disabled).
+    int64_t spill_max_bytes;
+    int64_t spill_bytes;
+    int64_t spill_written_bytes;
+    int64_t spill_read_bytes;
+    int64_t pool_bytes; // unused buffers kept by the packet pool
     // Positions that can be seeked to without incurring the latency of a low
     // level seek.
     int num_seek_ranges;
@@ -180,6 +186,9 @@ struct demuxer_params {
     // -- demux_open_url() only
     int stream_flags;
     bool disable_cache;
+    // Parse only the start of large line-based playlists, and leave the rest
+    // to demuxer.playlist_reader (which reopens the URL).
+    bool playlist_incremental;
     // result
     bool demuxer_failed;
 };
@@ -220,11 +229,16 @@ typedef struct demuxer {
 
     // If the file is a playlist file
     struct playlist *playlist;
+    // If playlist contains only the first entries; reads the remaining ones.
+    // The user can talloc_steal() it, and use it after the demuxer is freed.
+    struct playlist_reader *playlist_reader;
 
     struct mp_tags *metadata;
 
     void *priv;   // demuxer-specific internal data
     struct mpv_global *global;
+    // Recycles packet data buffers; see new_demux_packet_pool().
+    struct demux_packet_pool *packet_pool;
     struct mp_log *log, *glog;
     struct demuxer_params *params;
 
@@ -274,6 +288,11 @@ struct demuxer *demux_open_url(const char *url,
                                struct mp_cancel *cancel,
                                struct mpv_global *global);
 
+struct playlist;
+struct playlist_reader;
+bool playlist_reader_read(struct playlist_reader *r, struct playlist *pl,
+                          int max_entries, struct mp_cancel *cancel);
+
 void demux_start_thread(struct demuxer *demuxer);
 void demux_stop_thread(struct demuxer *demuxer);
 void demux_set_wakeup_cb(struct demuxer *demuxer, void (*cb)(void *ctx), void *ctx);
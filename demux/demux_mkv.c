@@ -26,6 +26,7 @@
 #include <stdbool.h>
 #include <math.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavutil/common.h>
 #include <libavutil/lzo.h>
@@ -52,6 +53,7 @@
 #include "demux.h"
 #include "stheader.h"
 #include "ebml.h"
+#include "index_cache.h"
 #include "matroska.h"
 #include "codec_tags.h"
 
@@ -154,6 +156,47 @@ typedef struct mkv_index {
     uint64_t filepos; // position of the cluster which contains the packet
 } mkv_index_t;
 
+// CuePoints are decoded in groups of this size.
+#define CUE_BLOCK_POINTS 64
+
+struct mkv_cue_block {
+    int64_t base_time;      // CueTime of the first CuePoint
+    int start, end;         // byte range in mkv_cues.data
+    int first_index;        // first entry in mkv_demuxer.indexes
+    int num_index;          // number of entries, -1 if not decoded yet
+};
+
+// Background decoding of all cues.
+struct mkv_cue_job {
+    pthread_t thread;
+    struct mp_log *log;
+    bstr data;
+    struct mkv_cue_block *blocks;
+    int num_blocks;
+    int64_t segment_start;
+
+    pthread_mutex_t lock;
+    // --- protected by lock
+    bool cancel;
+    bool done;
+    mkv_index_t *indexes;
+    size_t num_indexes;
+};
+
+// The Cues element is kept in its raw form, and decoded into index entries
+// in blocks of CUE_BLOCK_POINTS CuePoints only when a seek needs them.
+struct mkv_cues {
+    bstr data;              // Cues element payload
+    int num_points;
+    struct mkv_cue_block *blocks;
+    int num_blocks;
+    int num_decoded;        // number of decoded blocks
+    size_t num_pre_indexes; // index entries not from the cues
+    bool has_durations;
+    bool unsorted;          // CueTimes not monotonic (binary search impossible)
+    struct mkv_cue_job *job;
+};
+
 struct block_info {
     uint64_t duration, discardpadding;
     bool simple, keyframe, duration_known;
@@ -186,6 +229,7 @@ typedef struct mkv_demuxer {
     mkv_index_t *indexes;
     size_t num_indexes;
     bool index_complete;
+    struct mkv_cues *cues;
     int index_mode;
 
     int edition_id;
@@ -210,6 +254,30 @@ typedef struct mkv_demuxer {
     // temporary data, and not normally larger than 0 or 1 elements.
     struct block_info *blocks;
     int num_blocks;
+
+    // Persistent index cache (see index_cache.c). cache_path is NULL if the
+    // cache is disabled or not applicable to this file.
+    char *cache_path;
+    char *cache_type;
+    struct index_cache_elem {
+        uint32_t id;
+        int64_t pos;
+        bstr data;
+    } *cache_elems;
+    int num_cache_elems;
+    int64_t cache_bytes;
+    struct index_cache_state {
+        int64_t segment_start;
+        int64_t cluster_start;
+        double duration;
+        double start_time;
+        int probe_duration;
+    } cache_state;
+    bool cache_hit, cache_dirty;
+    size_t cache_num_indexes;
+    // If set, read_header_data() parses this instead of reading the stream.
+    bstr *cache_parse_src;
+    int64_t cur_elem_pos;
 } mkv_demuxer_t;
 
 #define OPT_BASE_STRUCT struct demux_mkv_opts
@@ -219,6 +287,9 @@ struct demux_mkv_opts {
     double subtitle_preroll_secs_index;
     int probe_duration;
     int probe_start_time;
+    char *index_cache_dir;
+    int64_t index_cache_size;
+    int background_cue_parsing;
 };
 
 const struct m_sub_options demux_mkv_conf = {
@@ -232,6 +303,9 @@ const struct m_sub_options demux_mkv_conf = {
         OPT_CHOICE("probe-video-duration", probe_duration, 0,
                    ({"no", 0}, {"yes", 1}, {"full", 2})),
         OPT_FLAG("probe-start-time", probe_start_time, 0),
+        OPT_STRING("index-cache-dir", index_cache_dir, M_OPT_FILE),
+        OPT_BYTE_SIZE("index-cache-size", index_cache_size, 0, 0, INT_MAX),
+        OPT_FLAG("background-cue-parsing", background_cue_parsing, 0),
         {0}
     },
     .size = sizeof(struct demux_mkv_opts),
@@ -239,6 +313,7 @@ const struct m_sub_options demux_mkv_conf = {
         .subtitle_preroll = 2,
         .subtitle_preroll_secs = 1.0,
         .subtitle_preroll_secs_index = 10.0,
+        .index_cache_size = 64 * 1024 * 1024,
     },
 };
 
@@ -382,10 +457,207 @@ static bstr demux_mkv_decode(struct mp_log *log, mkv_track_t *track,
 }
 
 
+// Pseudo element IDs for index cache records that are not EBML elements.
+// (0 and 1 are not valid EBML IDs.)
+#define INDEX_CACHE_ID_STATE 0  // struct index_cache_state
+#define INDEX_CACHE_ID_INDEX 1  // incrementally built mkv_index_t array
+
+struct index_cache_record {
+    uint32_t id;
+    uint32_t reserved;
+    int64_t pos;
+    uint64_t len;
+};
+
+// Describes the binary layout of the records, so that entries written by a
+// build with different struct layouts or byte order are rejected.
+static char *get_cache_layout(void *ta_parent)
+{
+    union { uint32_t u32; uint8_t u8[4]; } order = {0x01020304};
+    return talloc_asprintf(ta_parent, "mkv rec=%zu state=%zu index=%zu bo=%d",
+                           sizeof(struct index_cache_record),
+                           sizeof(struct index_cache_state),
+                           sizeof(mkv_index_t), order.u8[0]);
+}
+
+static void append_cache_record(void *ta_parent, bstr *dst, uint32_t id,
+                                int64_t pos, bstr data)
+{
+    struct index_cache_record rec = {.id = id, .pos = pos, .len = data.len};
+    bstr_xappend(ta_parent, dst, (bstr){(void *)&rec, sizeof(rec)});
+    bstr_xappend(ta_parent, dst, data);
+}
+
+static void store_index_cache(struct demuxer *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    if (!mkv_d->cache_path || !mkv_d->cache_state.cluster_start)
+        return;
+
+    void *tmp = talloc_new(NULL);
+    bstr data = {0};
+    append_cache_record(tmp, &data, INDEX_CACHE_ID_STATE, 0,
+                        (bstr){(void *)&mkv_d->cache_state,
+                               sizeof(mkv_d->cache_state)});
+    for (int n = 0; n < mkv_d->num_cache_elems; n++) {
+        struct index_cache_elem *e = &mkv_d->cache_elems[n];
+        if (e->id != INDEX_CACHE_ID_INDEX)
+            append_cache_record(tmp, &data, e->id, e->pos, e->data);
+    }
+    if (!mkv_d->index_complete && mkv_d->num_indexes) {
+        append_cache_record(tmp, &data, INDEX_CACHE_ID_INDEX, 0,
+                            (bstr){(void *)mkv_d->indexes,
+                                   mkv_d->num_indexes * sizeof(mkv_index_t)});
+    }
+    demux_index_cache_store(demuxer->global, demuxer->log,
+                            mkv_d->opts->index_cache_dir, mkv_d->cache_type,
+                            get_cache_layout(tmp), mkv_d->cache_path, data,
+                            mkv_d->opts->index_cache_size);
+    talloc_free(tmp);
+
+    mkv_d->cache_dirty = false;
+    mkv_d->cache_num_indexes = mkv_d->num_indexes;
+}
+
+// Load the cache entry into mkv_d->cache_elems. Returns false if there is no
+// usable entry.
+static bool load_index_cache(struct demuxer *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    if (!mkv_d->cache_path)
+        return false;
+
+    bstr data = demux_index_cache_load(mkv_d, demuxer->global, demuxer->log,
+                                       mkv_d->opts->index_cache_dir,
+                                       mkv_d->cache_type,
+                                       get_cache_layout(mkv_d),
+                                       mkv_d->cache_path);
+    if (!data.len)
+        return false;
+
+    bool have_state = false;
+    while (data.len) {
+        struct index_cache_record rec;
+        if (data.len < sizeof(rec))
+            goto invalid;
+        memcpy(&rec, data.start, sizeof(rec));
+        data = bstr_cut(data, sizeof(rec));
+        if (rec.len > data.len)
+            goto invalid;
+        bstr payload = bstr_splice(data, 0, rec.len);
+        data = bstr_cut(data, rec.len);
+
+        if (rec.id == INDEX_CACHE_ID_STATE) {
+            if (payload.len != sizeof(mkv_d->cache_state))
+                goto invalid;
+            memcpy(&mkv_d->cache_state, payload.start, payload.len);
+            have_state = true;
+        } else {
+            struct index_cache_elem e = {rec.id, rec.pos, payload};
+            MP_TARRAY_APPEND(mkv_d, mkv_d->cache_elems, mkv_d->num_cache_elems,
+                             e);
+            if (rec.id != INDEX_CACHE_ID_INDEX)
+                mkv_d->cache_bytes += payload.len;
+        }
+    }
+    struct index_cache_state *st = &mkv_d->cache_state;
+    if (!have_state || st->segment_start != mkv_d->segment_start ||
+        st->cluster_start <= mkv_d->segment_start)
+        goto invalid;
+    return true;
+
+invalid:
+    MP_WARN(demuxer, "Ignoring broken index cache entry.\n");
+    mkv_d->num_cache_elems = 0;
+    mkv_d->cache_bytes = 0;
+    return false;
+}
+
+// Restore the incremental index from the cache. The incremental index is
+// built by reading the file sequentially from the start, so a cached prefix
+// of it is still a valid index.
+static void restore_cached_index(struct demuxer *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    if (mkv_d->index_complete || mkv_d->num_indexes > 1)
+        return;
+
+    for (int n = 0; n < mkv_d->num_cache_elems; n++) {
+        struct index_cache_elem *e = &mkv_d->cache_elems[n];
+        if (e->id != INDEX_CACHE_ID_INDEX)
+            continue;
+        size_t num = e->data.len / sizeof(mkv_index_t);
+        MP_TARRAY_GROW(mkv_d, mkv_d->indexes, num);
+        memcpy(mkv_d->indexes, e->data.start, num * sizeof(mkv_index_t));
+        mkv_d->num_indexes = num;
+        mkv_d->index_has_durations = num > 0;
+        for (int i = 0; i < mkv_d->num_tracks; i++)
+            mkv_d->tracks[i]->last_index_entry = (size_t)-1;
+        for (size_t i = 0; i < num; i++) {
+            for (int t = 0; t < mkv_d->num_tracks; t++) {
+                if (mkv_d->tracks[t]->tnum == mkv_d->indexes[i].tnum)
+                    mkv_d->tracks[t]->last_index_entry = i;
+            }
+        }
+        mkv_d->cache_num_indexes = num;
+        MP_VERBOSE(demuxer, "Restored %zu index entries from cache.\n", num);
+        break;
+    }
+}
+
+// Read and parse the level 1 element with the given ID at the current stream
+// position (or from the index cache, if we're replaying it). If the element
+// could be read completely, remember it for the index cache.
+static int read_header_data(struct demuxer *demuxer, uint32_t id,
+                            struct ebml_parse_ctx *ctx, void *target,
+                            const struct ebml_elem_desc *desc)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+
+    if (mkv_d->cache_parse_src) {
+        ebml_parse_element_data(ctx, target, *mkv_d->cache_parse_src, desc);
+        mkv_d->cache_parse_src = NULL;
+        return 0;
+    }
+
+    if (ebml_read_element(demuxer->stream, ctx, target, desc) < 0)
+        return -1;
+
+    if (mkv_d->cache_path && !ctx->has_errors &&
+        ctx->data.len == talloc_get_size(ctx->talloc_ctx))
+    {
+        mkv_d->cache_bytes += ctx->data.len;
+        if (mkv_d->cache_bytes > mkv_d->opts->index_cache_size) {
+            MP_VERBOSE(demuxer, "Headers too large for the index cache.\n");
+            mkv_d->cache_path = NULL;
+            return 0;
+        }
+        struct index_cache_elem e = {
+            .id = id,
+            .pos = mkv_d->cur_elem_pos,
+            .data = bstrdup(mkv_d, ctx->data),
+        };
+        MP_TARRAY_APPEND(mkv_d, mkv_d->cache_elems, mkv_d->num_cache_elems, e);
+        mkv_d->cache_dirty = true;
+    }
+    return 0;
+}
+
+// Skip the current level 1 element (which read_header_data() would read).
+static void skip_header_data(struct demuxer *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+
+    if (mkv_d->cache_parse_src) {
+        mkv_d->cache_parse_src = NULL;
+    } else {
+        ebml_read_skip(demuxer->log, -1, demuxer->stream);
+    }
+}
+
 static int demux_mkv_read_info(demuxer_t *demuxer)
 {
     mkv_demuxer_t *mkv_d = demuxer->priv;
-    stream_t *s = demuxer->stream;
     int res = 0;
 
     MP_VERBOSE(demuxer, "|+ segment information...\n");
@@ -395,7 +667,8 @@ static int demux_mkv_read_info(demuxer_t *demuxer)
 
     struct ebml_info info = {0};
     struct ebml_parse_ctx parse_ctx = {demuxer->log};
-    if (ebml_read_element(s, &parse_ctx, &info, &ebml_info_desc) < 0)
+    if (read_header_data(demuxer, MATROSKA_ID_INFO, &parse_ctx, &info,
+                         &ebml_info_desc) < 0)
         return -1;
     if (info.muxing_app)
         MP_VERBOSE(demuxer, "| + muxing app: %s\n", info.muxing_app);
@@ -793,13 +1066,13 @@ static void parse_trackentry(struct demuxer *demuxer,
 static int demux_mkv_read_tracks(demuxer_t *demuxer)
 {
     mkv_demuxer_t *mkv_d = (mkv_demuxer_t *) demuxer->priv;
-    stream_t *s = demuxer->stream;
 
     MP_VERBOSE(demuxer, "|+ segment tracks...\n");
 
     struct ebml_tracks tracks = {0};
     struct ebml_parse_ctx parse_ctx = {demuxer->log};
-    if (ebml_read_element(s, &parse_ctx, &tracks, &ebml_tracks_desc) < 0)
+    if (read_header_data(demuxer, MATROSKA_ID_TRACKS, &parse_ctx, &tracks,
+                         &ebml_tracks_desc) < 0)
         return -1;
 
     mkv_d->tracks = talloc_zero_array(mkv_d, struct mkv_track*,
@@ -850,72 +1123,336 @@ static void add_block_position(demuxer_t *demuxer, struct mkv_track *track,
     track->last_index_entry = mkv_d->num_indexes - 1;
 }
 
+// Decode the CuePoints in data (a part of the Cues element payload) and
+// append them to the given index array.
+static void decode_cue_points(struct mp_log *log, bstr data,
+                              int64_t segment_start, void *ta_parent,
+                              mkv_index_t **p_indexes, size_t *p_num_indexes)
+{
+    mkv_index_t *indexes = *p_indexes;
+    size_t num_indexes = *p_num_indexes;
+
+    struct ebml_cues cues = {0};
+    struct ebml_parse_ctx parse_ctx = {log};
+    ebml_parse_element_data(&parse_ctx, &cues, data, &ebml_cues_desc);
+
+    for (int i = 0; i < cues.n_cue_point; i++) {
+        struct ebml_cue_point *cuepoint = &cues.cue_point[i];
+        uint64_t time = cuepoint->cue_time;
+        for (int c = 0; c < cuepoint->n_cue_track_positions; c++) {
+            struct ebml_cue_track_positions *trackpos =
+                &cuepoint->cue_track_positions[c];
+            uint64_t pos = segment_start + trackpos->cue_cluster_position;
+            MP_TARRAY_APPEND(ta_parent, indexes, num_indexes, (mkv_index_t){
+                .tnum = trackpos->cue_track,
+                .filepos = pos,
+                .timecode = time,
+                .duration = trackpos->cue_duration,
+            });
+            mp_msg(log, MSGL_TRACE, "|+ found cue point for track %"PRIu64": "
+                   "timecode %"PRIu64", filepos: %"PRIu64""
+                   "offset %"PRIu64", duration %"PRIu64"\n",
+                   trackpos->cue_track, time, pos,
+                   trackpos->cue_relative_position, trackpos->cue_duration);
+        }
+    }
+
+    talloc_free(parse_ctx.talloc_ctx);
+    *p_indexes = indexes;
+    *p_num_indexes = num_indexes;
+}
+
+static void decode_cue_block(struct demuxer *demuxer, int n)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    struct mkv_cues *cues = mkv_d->cues;
+    struct mkv_cue_block *b = &cues->blocks[n];
+
+    if (b->num_index >= 0)
+        return;
+
+    b->first_index = mkv_d->num_indexes;
+    decode_cue_points(demuxer->log, bstr_splice(cues->data, b->start, b->end),
+                      mkv_d->segment_start, mkv_d, &mkv_d->indexes,
+                      &mkv_d->num_indexes);
+    b->num_index = mkv_d->num_indexes - b->first_index;
+    cues->num_decoded++;
+}
+
+static void cue_job_destroy(void *ptr)
+{
+    struct mkv_cue_job *job = ptr;
+
+    pthread_mutex_lock(&job->lock);
+    job->cancel = true;
+    pthread_mutex_unlock(&job->lock);
+    pthread_join(job->thread, NULL);
+    pthread_mutex_destroy(&job->lock);
+}
+
+static void cues_destroy(void *ptr)
+{
+    struct mkv_cues *cues = ptr;
+
+    // The job must be stopped before the data it uses is freed.
+    talloc_free(cues->job);
+}
+
+static void *cue_job_run(void *ptr)
+{
+    struct mkv_cue_job *job = ptr;
+    mkv_index_t *indexes = NULL;
+    size_t num_indexes = 0;
+
+    for (int n = 0; n < job->num_blocks; n++) {
+        pthread_mutex_lock(&job->lock);
+        bool cancel = job->cancel;
+        pthread_mutex_unlock(&job->lock);
+        if (cancel)
+            break;
+        struct mkv_cue_block *b = &job->blocks[n];
+        decode_cue_points(job->log, bstr_splice(job->data, b->start, b->end),
+                          job->segment_start, job, &indexes, &num_indexes);
+    }
+
+    pthread_mutex_lock(&job->lock);
+    job->indexes = indexes;
+    job->num_indexes = num_indexes;
+    job->done = !job->cancel;
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+}
+
+// Decode all cues on a worker thread. The result is picked up by
+// check_cue_job().
+static void start_cue_job(struct demuxer *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    struct mkv_cues *cues = mkv_d->cues;
+
+    struct mkv_cue_job *job = talloc_zero(cues, struct mkv_cue_job);
+    pthread_mutex_init(&job->lock, NULL);
+    job->log = mp_log_new(job, demuxer->log, NULL);
+    job->data = cues->data;
+    job->blocks = cues->blocks;
+    job->num_blocks = cues->num_blocks;
+    job->segment_start = mkv_d->segment_start;
+    if (pthread_create(&job->thread, NULL, cue_job_run, job)) {
+        pthread_mutex_destroy(&job->lock);
+        talloc_free(job);
+        return;
+    }
+    talloc_set_destructor(job, cue_job_destroy);
+    cues->job = job;
+}
+
+// If the background decoding finished, replace the lazily decoded parts of
+// the index with its result.
+static void check_cue_job(struct demuxer *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    struct mkv_cues *cues = mkv_d->cues;
+    struct mkv_cue_job *job = cues ? cues->job : NULL;
+
+    if (!job)
+        return;
+
+    pthread_mutex_lock(&job->lock);
+    bool done = job->done;
+    pthread_mutex_unlock(&job->lock);
+    if (!done)
+        return;
+
+    if (cues->num_decoded < cues->num_blocks) {
+        mkv_d->num_indexes = cues->num_pre_indexes;
+        MP_TARRAY_GROW(mkv_d, mkv_d->indexes,
+                       mkv_d->num_indexes + job->num_indexes);
+        memcpy(mkv_d->indexes + mkv_d->num_indexes, job->indexes,
+               job->num_indexes * sizeof(mkv_index_t));
+        mkv_d->num_indexes += job->num_indexes;
+        cues->num_decoded = cues->num_blocks;
+        MP_VERBOSE(demuxer, "Cues were decoded in the background.\n");
+    }
+
+    talloc_free(job);
+    cues->job = NULL;
+}
+
+// Whether block n has an index entry for the track (or any track if tnum<0)
+// at or before tc (or, if after==true, at or after tc).
+static bool cue_block_has_entry(struct mkv_demuxer *mkv_d, int n, int tnum,
+                                int64_t tc, bool after)
+{
+    struct mkv_cue_block *b = &mkv_d->cues->blocks[n];
+    for (int i = b->first_index; i < b->first_index + b->num_index; i++) {
+        mkv_index_t *e = &mkv_d->indexes[i];
+        if ((tnum < 0 || e->tnum == tnum) &&
+            (after ? e->timecode >= tc : e->timecode <= tc))
+            return true;
+    }
+    return false;
+}
+
+// Return the last block that starts at or before tc (or 0).
+static int find_cue_block(struct mkv_cues *cues, int64_t tc)
+{
+    int lo = 0, hi = cues->num_blocks - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (cues->blocks[mid].base_time <= tc) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+// Make sure all index entries with timecodes in [min_tc, max_tc] are decoded,
+// as well as the closest entries for the given track outside of the range.
+// This only appends to mkv_d->indexes, so index positions stay valid (unlike
+// check_cue_job(), which the caller must call before looking up entries).
+static void decode_cues_range(struct demuxer *demuxer, int tnum,
+                              int64_t min_tc, int64_t max_tc)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    struct mkv_cues *cues = mkv_d->cues;
+
+    if (!cues)
+        return;
+    if (cues->num_decoded == cues->num_blocks)
+        return;
+
+    int first = find_cue_block(cues, min_tc);
+    int last = find_cue_block(cues, max_tc);
+    for (int n = first; n <= last; n++)
+        decode_cue_block(demuxer, n);
+    while (first > 0 && !cue_block_has_entry(mkv_d, first, tnum, min_tc, false))
+        decode_cue_block(demuxer, --first);
+    while (last < cues->num_blocks - 1 &&
+           !cue_block_has_entry(mkv_d, last, tnum, max_tc, true))
+        decode_cue_block(demuxer, ++last);
+}
+
+// Find the CuePoints in the Cues payload, and check whether the index looks
+// usable. This extracts only the data needed to find the CuePoints relevant
+// for a seek; see decode_cues_range().
+static bool scan_cues(struct demuxer *demuxer, struct mkv_cues *cues)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    bstr data = cues->data;
+    uint64_t prev_time = 0;
+
+    while (data.len) {
+        int start = data.start - cues->data.start;
+        bstr point;
+        uint32_t id = ebml_split_element(&data, &point);
+        if (id == EBML_ID_INVALID) {
+            MP_WARN(demuxer, "Cues element is truncated or broken.\n");
+            break;
+        }
+        if (id != MATROSKA_ID_CUEPOINT)
+            continue;
+
+        uint64_t time = 0;
+        int n_time = 0, n_track_positions = 0;
+        while (point.len) {
+            bstr elem;
+            id = ebml_split_element(&point, &elem);
+            if (id == EBML_ID_INVALID)
+                break;
+            if (id == MATROSKA_ID_CUETIME) {
+                time = ebml_payload_uint(elem);
+                n_time++;
+            } else if (id == MATROSKA_ID_CUETRACKPOSITIONS) {
+                n_track_positions++;
+                // Files either have durations on all entries, or none.
+                while (!cues->has_durations && elem.len) {
+                    bstr sub;
+                    id = ebml_split_element(&elem, &sub);
+                    if (id == EBML_ID_INVALID)
+                        break;
+                    cues->has_durations |= id == MATROSKA_ID_CUEDURATION;
+                }
+            }
+        }
+        if (n_time != 1 || !n_track_positions) {
+            MP_WARN(demuxer, "Malformed CuePoint element\n");
+            return false;
+        }
+        if (time / 1e9 > mkv_d->duration / mkv_d->tc_scale * 10 &&
+            mkv_d->duration != 0)
+            return false;
+
+        if (cues->num_points % CUE_BLOCK_POINTS == 0) {
+            struct mkv_cue_block b = {
+                .base_time = time,
+                .start = start,
+                .num_index = -1,
+            };
+            MP_TARRAY_APPEND(cues, cues->blocks, cues->num_blocks, b);
+        }
+        struct mkv_cue_block *b = &cues->blocks[cues->num_blocks - 1];
+        b->end = data.start - cues->data.start;
+        if (time < prev_time)
+            cues->unsorted = true;
+        cues->num_points++;
+        prev_time = time;
+    }
+
+    // Probably too sparse and will just break seeking.
+    return cues->num_points > 3;
+}
+
 static int demux_mkv_read_cues(demuxer_t *demuxer)
 {
     mkv_demuxer_t *mkv_d = (mkv_demuxer_t *) demuxer->priv;
-    stream_t *s = demuxer->stream;
 
     if (mkv_d->index_mode != 1 || mkv_d->index_complete) {
-        ebml_read_skip(demuxer->log, -1, s);
+        skip_header_data(demuxer);
         return 0;
     }
 
     MP_VERBOSE(demuxer, "Parsing cues...\n");
-    struct ebml_cues cues = {0};
     struct ebml_parse_ctx parse_ctx = {demuxer->log};
-    if (ebml_read_element(s, &parse_ctx, &cues, &ebml_cues_desc) < 0)
+    if (read_header_data(demuxer, MATROSKA_ID_CUES, &parse_ctx, NULL, NULL) < 0)
         return -1;
 
-    for (int i = 0; i < cues.n_cue_point; i++) {
-        struct ebml_cue_point *cuepoint = &cues.cue_point[i];
-        if (cuepoint->n_cue_time != 1 || !cuepoint->n_cue_track_positions) {
-            MP_WARN(demuxer, "Malformed CuePoint element\n");
-            goto done;
-        }
-        if (cuepoint->cue_time / 1e9 > mkv_d->duration / mkv_d->tc_scale * 10 &&
-            mkv_d->duration != 0)
-            goto done;
+    struct mkv_cues *cues = talloc_zero(mkv_d, struct mkv_cues);
+    talloc_set_destructor(cues, cues_destroy);
+    cues->data = parse_ctx.data;
+    talloc_steal(cues, parse_ctx.talloc_ctx);
+    if (!scan_cues(demuxer, cues)) {
+        MP_WARN(demuxer, "Discarding potentially broken or useless index.\n");
+        talloc_free(cues);
+        return 0;
     }
-    if (cues.n_cue_point <= 3) // probably too sparse and will just break seeking
-        goto done;
 
     // Discard incremental index. (Keep the first entry, which must be the
     // start of the file - helps with files that miss the first index entry.)
     mkv_d->num_indexes = MPMIN(1, mkv_d->num_indexes);
-    mkv_d->index_has_durations = false;
-
-    for (int i = 0; i < cues.n_cue_point; i++) {
-        struct ebml_cue_point *cuepoint = &cues.cue_point[i];
-        uint64_t time = cuepoint->cue_time;
-        for (int c = 0; c < cuepoint->n_cue_track_positions; c++) {
-            struct ebml_cue_track_positions *trackpos =
-                &cuepoint->cue_track_positions[c];
-            uint64_t pos = mkv_d->segment_start + trackpos->cue_cluster_position;
-            cue_index_add(demuxer, trackpos->cue_track, pos,
-                          time, trackpos->cue_duration);
-            mkv_d->index_has_durations |= trackpos->n_cue_duration > 0;
-            MP_TRACE(demuxer, "|+ found cue point for track %"PRIu64": "
-                     "timecode %"PRIu64", filepos: %"PRIu64""
-                     "offset %"PRIu64", duration %"PRIu64"\n",
-                     trackpos->cue_track, time, pos,
-                     trackpos->cue_relative_position, trackpos->cue_duration);
-        }
-    }
+    mkv_d->index_has_durations = cues->has_durations;
+    cues->num_pre_indexes = mkv_d->num_indexes;
+    mkv_d->cues = cues;
 
     // Do not attempt to create index on the fly.
     mkv_d->index_complete = true;
 
-done:
-    if (!mkv_d->index_complete)
-        MP_WARN(demuxer, "Discarding potentially broken or useless index.\n");
-    talloc_free(parse_ctx.talloc_ctx);
+    if (cues->unsorted) {
+        // Can't find the relevant parts with a binary search.
+        for (int n = 0; n < cues->num_blocks; n++)
+            decode_cue_block(demuxer, n);
+    } else if (mkv_d->opts->background_cue_parsing) {
+        start_cue_job(demuxer);
+    }
+
+    MP_VERBOSE(demuxer, "Found %d cue points.\n", cues->num_points);
     return 0;
 }
 
 static int demux_mkv_read_chapters(struct demuxer *demuxer)
 {
     mkv_demuxer_t *mkv_d = demuxer->priv;
-    stream_t *s = demuxer->stream;
     int wanted_edition = mkv_d->edition_id;
     uint64_t wanted_edition_uid = demuxer->matroska_data.uid.edition;
 
@@ -927,8 +1464,8 @@ static int demux_mkv_read_chapters(struct demuxer *demuxer)
     MP_VERBOSE(demuxer, "Parsing chapters...\n");
     struct ebml_chapters file_chapters = {0};
     struct ebml_parse_ctx parse_ctx = {demuxer->log};
-    if (ebml_read_element(s, &parse_ctx, &file_chapters,
-                          &ebml_chapters_desc) < 0)
+    if (read_header_data(demuxer, MATROSKA_ID_CHAPTERS, &parse_ctx,
+                         &file_chapters, &ebml_chapters_desc) < 0)
         return -1;
 
     int selected_edition = -1;
@@ -1071,11 +1608,11 @@ static int demux_mkv_read_chapters(struct demuxer *demuxer)
 static int demux_mkv_read_tags(demuxer_t *demuxer)
 {
     struct mkv_demuxer *mkv_d = demuxer->priv;
-    stream_t *s = demuxer->stream;
 
     struct ebml_parse_ctx parse_ctx = {demuxer->log};
     struct ebml_tags           tags = {0};
-    if (ebml_read_element(s, &parse_ctx, &tags, &ebml_tags_desc) < 0)
+    if (read_header_data(demuxer, MATROSKA_ID_TAGS, &parse_ctx, &tags,
+                         &ebml_tags_desc) < 0)
         return -1;
 
     mkv_d->tags = talloc_dup(mkv_d, &tags);
@@ -1143,14 +1680,13 @@ static void process_tags(demuxer_t *demuxer)
 
 static int demux_mkv_read_attachments(demuxer_t *demuxer)
 {
-    stream_t *s = demuxer->stream;
 
     MP_VERBOSE(demuxer, "Parsing attachments...\n");
 
     struct ebml_attachments attachments = {0};
     struct ebml_parse_ctx parse_ctx = {demuxer->log};
-    if (ebml_read_element(s, &parse_ctx, &attachments,
-                          &ebml_attachments_desc) < 0)
+    if (read_header_data(demuxer, MATROSKA_ID_ATTACHMENTS, &parse_ctx,
+                         &attachments, &ebml_attachments_desc) < 0)
         return -1;
 
     for (int i = 0; i < attachments.n_attached_file; i++) {
@@ -1215,13 +1751,14 @@ static bool test_header_element(struct demuxer *demuxer, uint32_t id,
 static int demux_mkv_read_seekhead(demuxer_t *demuxer)
 {
     struct mkv_demuxer *mkv_d = demuxer->priv;
-    struct stream *s = demuxer->stream;
     int res = 0;
     struct ebml_seek_head seekhead = {0};
     struct ebml_parse_ctx parse_ctx = {demuxer->log};
 
     MP_VERBOSE(demuxer, "Parsing seek head...\n");
-    if (ebml_read_element(s, &parse_ctx, &seekhead, &ebml_seek_head_desc) < 0) {
+    if (read_header_data(demuxer, MATROSKA_ID_SEEKHEAD, &parse_ctx, &seekhead,
+                         &ebml_seek_head_desc) < 0)
+    {
         res = -1;
         goto out;
     }
@@ -1244,9 +1781,13 @@ static int demux_mkv_read_seekhead(demuxer_t *demuxer)
 static int read_header_element(struct demuxer *demuxer, uint32_t id,
                                int64_t start_filepos)
 {
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+
     if (id == EBML_ID_INVALID)
         return 0;
 
+    mkv_d->cur_elem_pos = start_filepos;
+
     if (test_header_element(demuxer, id, start_filepos))
         goto skip;
 
@@ -1267,7 +1808,7 @@ static int read_header_element(struct demuxer *demuxer, uint32_t id,
         return demux_mkv_read_attachments(demuxer);
     }
 skip:
-    ebml_read_skip(demuxer->log, -1, demuxer->stream);
+    skip_header_data(demuxer);
     return 0;
 }
 
@@ -1302,12 +1843,17 @@ static void read_deferred_cues(demuxer_t *demuxer)
     if (mkv_d->index_complete || mkv_d->index_mode != 1)
         return;
 
+    int num_cache_elems = mkv_d->num_cache_elems;
     for (int n = 0; n < mkv_d->num_headers; n++) {
         struct header_elem *elem = &mkv_d->headers[n];
 
         if (elem->id == MATROSKA_ID_CUES)
             read_deferred_element(demuxer, elem);
     }
+
+    // Don't require seeking to the cues again next time.
+    if (mkv_d->num_cache_elems != num_cache_elems)
+        store_index_cache(demuxer);
 }
 
 static void add_coverart(struct demuxer *demuxer)
@@ -2041,22 +2587,59 @@ static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
     if (demuxer->params && demuxer->params->matroska_was_valid)
         *demuxer->params->matroska_was_valid = true;
 
-    while (1) {
-        start_pos = stream_tell(s);
-        stream_peek(s, 4); // make sure we can always seek back
-        uint32_t id = ebml_read_id(s);
-        if (s->eof) {
-            MP_WARN(demuxer, "Unexpected end of file (no clusters found)\n");
-            break;
-        }
-        if (id == MATROSKA_ID_CLUSTER) {
-            MP_VERBOSE(demuxer, "|+ found cluster\n");
-            mkv_d->cluster_start = start_pos;
-            break;
+    char *cache_dir = mkv_d->opts->index_cache_dir;
+    if (cache_dir && cache_dir[0] && s->is_local_file && s->path) {
+        int segment = demuxer->params ?
+                      demuxer->params->matroska_wanted_segment : 0;
+        mkv_d->cache_path = talloc_strdup(mkv_d, s->path);
+        mkv_d->cache_type = talloc_asprintf(mkv_d, "mkv-%d", segment);
+        mkv_d->cache_hit = load_index_cache(demuxer);
+        if (!mkv_d->cache_hit) {
+            mkv_d->cache_state = (struct index_cache_state){
+                .segment_start = mkv_d->segment_start,
+            };
+        }
+    }
+
+    if (mkv_d->cache_hit) {
+        // Replay the header elements read last time, and continue at the
+        // first cluster.
+        for (int n = 0; n < mkv_d->num_cache_elems; n++) {
+            struct index_cache_elem *e = &mkv_d->cache_elems[n];
+            if (e->id == INDEX_CACHE_ID_INDEX)
+                continue;
+            mkv_d->cache_parse_src = &e->data;
+            int res = read_header_element(demuxer, e->id, e->pos);
+            mkv_d->cache_parse_src = NULL;
+            if (res < 0)
+                return -1;
         }
-        int res = read_header_element(demuxer, id, start_pos);
-        if (res < 0)
+        start_pos = mkv_d->cache_state.cluster_start;
+        mkv_d->cluster_start = start_pos;
+        if (!stream_seek(s, start_pos)) {
+            MP_ERR(demuxer, "Couldn't seek to first cluster.\n");
             return -1;
+        }
+    } else {
+        while (1) {
+            start_pos = stream_tell(s);
+            stream_peek(s, 4); // make sure we can always seek back
+            uint32_t id = ebml_read_id(s);
+            if (s->eof) {
+                MP_WARN(demuxer, "Unexpected end of file "
+                        "(no clusters found)\n");
+                break;
+            }
+            if (id == MATROSKA_ID_CLUSTER) {
+                MP_VERBOSE(demuxer, "|+ found cluster\n");
+                mkv_d->cluster_start = start_pos;
+                break;
+            }
+            int res = read_header_element(demuxer, id, start_pos);
+            if (res < 0)
+                return -1;
+        }
+        mkv_d->cache_state.cluster_start = mkv_d->cluster_start;
     }
 
     int64_t end = stream_get_size(s);
@@ -2117,19 +2700,38 @@ static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
     display_create_tracks(demuxer);
     add_coverart(demuxer);
     process_tags(demuxer);
+    restore_cached_index(demuxer);
 
     probe_first_timestamp(demuxer);
-    if (mkv_d->opts->probe_duration)
-        probe_last_timestamp(demuxer, start_pos);
+    if (mkv_d->opts->probe_duration) {
+        struct index_cache_state *st = &mkv_d->cache_state;
+        if (mkv_d->cache_hit &&
+            st->probe_duration == mkv_d->opts->probe_duration &&
+            st->start_time == demuxer->start_time)
+        {
+            mkv_d->duration = st->duration;
+            demuxer->duration = mkv_d->duration;
+        } else {
+            probe_last_timestamp(demuxer, start_pos);
+            st->duration = mkv_d->duration;
+            st->start_time = demuxer->start_time;
+            st->probe_duration = mkv_d->opts->probe_duration;
+            mkv_d->cache_dirty = true;
+        }
+    }
     probe_x264_garbage(demuxer);
 
+    if (!mkv_d->cache_hit || mkv_d->cache_dirty)
+        store_index_cache(demuxer);
+
     return 0;
 }
 
 // Read the laced block data at the current stream position (until endpos as
 // indicated by the block length field) into individual buffers.
 static int demux_mkv_read_block_lacing(struct block_info *block, int type,
-                                       struct stream *s, uint64_t endpos)
+                                       struct stream *s, uint64_t endpos,
+                                       struct demux_packet_pool *pool)
 {
     int laces;
     uint32_t lace_size[MAX_NUM_LACES];
@@ -2198,7 +2800,7 @@ static int demux_mkv_read_block_lacing(struct block_info *block, int type,
         if (stream_tell(s) + size > endpos || size > (1 << 30))
             goto error;
         int pad = MPMAX(AV_INPUT_BUFFER_PADDING_SIZE, AV_LZO_INPUT_PADDING);
-        AVBufferRef *buf = av_buffer_alloc(size + pad);
+        AVBufferRef *buf = demux_packet_pool_alloc(pool, size + pad);
         if (!buf)
             goto error;
         buf->size = size;
@@ -2436,7 +3038,8 @@ static void mkv_parse_and_add_packet(demuxer_t *demuxer, mkv_track_t *track,
         int size = dp->len;
         uint8_t *parsed;
         if (libav_parse_wavpack(track, dp->buffer, &parsed, &size) >= 0) {
-            struct demux_packet *new = new_demux_packet_from(parsed, size);
+            struct demux_packet *new =
+                new_demux_packet_from_pool(demuxer->packet_pool, parsed, size);
             if (new) {
                 demux_packet_copy_attribs(new, dp);
                 talloc_free(dp);
@@ -2448,7 +3051,8 @@ static void mkv_parse_and_add_packet(demuxer_t *demuxer, mkv_track_t *track,
 
     if (strcmp(stream->codec->codec, "prores") == 0) {
         size_t newlen = dp->len + 8;
-        struct demux_packet *new = new_demux_packet(newlen);
+        struct demux_packet *new =
+            new_demux_packet_pool(demuxer->packet_pool, newlen);
         if (new) {
             AV_WB32(new->buffer + 0, newlen);
             AV_WB32(new->buffer + 4, MKBETAG('i', 'c', 'p', 'f'));
@@ -2490,7 +3094,8 @@ static void mkv_parse_and_add_packet(demuxer_t *demuxer, mkv_track_t *track,
         dp->len -= len;
         dp->pos += len;
         if (size) {
-            struct demux_packet *new = new_demux_packet_from(data, size);
+            struct demux_packet *new =
+                new_demux_packet_from_pool(demuxer->packet_pool, data, size);
             if (!new)
                 break;
             if (copy_sidedata)
@@ -2567,7 +3172,8 @@ static int read_block(demuxer_t *demuxer, int64_t end, struct block_info *block)
     block->filepos = stream_tell(s);
 
     int lace_type = (header_flags >> 1) & 0x03;
-    if (demux_mkv_read_block_lacing(block, lace_type, s, endpos))
+    if (demux_mkv_read_block_lacing(block, lace_type, s, endpos,
+                                    demuxer->packet_pool))
         goto exit;
 
     if (block->simple)
@@ -2663,7 +3269,8 @@ static int handle_block(demuxer_t *demuxer, struct block_info *block_info)
 
             if (block.start != nblock.start || block.len != nblock.len) {
                 // (avoidable copy of the entire data)
-                dp = new_demux_packet_from(nblock.start, nblock.len);
+                dp = new_demux_packet_from_pool(demuxer->packet_pool,
+                                                nblock.start, nblock.len);
             } else {
                 dp = new_demux_packet_from_buf(data);
             }
@@ -2973,6 +3580,10 @@ static struct mkv_index *seek_with_cues(struct demuxer *demuxer, int seek_id,
     struct mkv_demuxer *mkv_d = demuxer->priv;
     struct mkv_index *index = NULL;
 
+    int64_t target_tc = target_timecode / mkv_d->tc_scale;
+    check_cue_job(demuxer);
+    decode_cues_range(demuxer, seek_id, target_tc, target_tc);
+
     int64_t min_diff = INT64_MIN;
     for (size_t i = 0; i < mkv_d->num_indexes; i++) {
         if (seek_id < 0 || mkv_d->indexes[i].tnum == seek_id) {
@@ -3002,6 +3613,10 @@ static struct mkv_index *seek_with_cues(struct demuxer *demuxer, int seek_id,
                 secs = MPMAX(secs, mkv_d->opts->subtitle_preroll_secs_index);
             int64_t pre = MPMIN(INT64_MAX, secs * 1e9 / mkv_d->tc_scale);
             int64_t min_tc = pre < index->timecode ? index->timecode - pre : 0;
+            // (May reallocate mkv_d->indexes.)
+            size_t index_pos = index - mkv_d->indexes;
+            decode_cues_range(demuxer, seek_id, min_tc, index->timecode);
+            index = &mkv_d->indexes[index_pos];
             uint64_t prev_target = 0;
             int64_t prev_tc = 0;
             for (size_t i = 0; i < mkv_d->num_indexes; i++) {
@@ -3096,6 +3711,8 @@ static void demux_mkv_seek(demuxer_t *demuxer, double seek_pts, int flags)
         stream_t *s = demuxer->stream;
 
         read_deferred_cues(demuxer);
+        check_cue_job(demuxer);
+        decode_cues_range(demuxer, -1, INT64_MIN, INT64_MAX);
 
         int64_t size = stream_get_size(s);
         int64_t target_filepos = size * MPCLAMP(seek_pts, 0, 1);
@@ -3230,6 +3847,9 @@ static void mkv_free(struct demuxer *demuxer)
     if (!mkv_d)
         return;
     mkv_seek_reset(demuxer);
+    // Remember the part of the file that was indexed during playback.
+    if (!mkv_d->index_complete && mkv_d->num_indexes > mkv_d->cache_num_indexes)
+        store_index_cache(demuxer);
     for (int i = 0; i < mkv_d->num_tracks; i++)
         demux_mkv_free_trackentry(mkv_d->tracks[i]);
 }
@@ -19,12 +19,14 @@
 #include <string.h>
 #include <strings.h>
 #include <dirent.h>
+#include <pthread.h>
 
 #include "config.h"
 #include "common/common.h"
 #include "options/options.h"
 #include "common/msg.h"
 #include "common/playlist.h"
+#include "misc/thread_pool.h"
 #include "options/path.h"
 #include "stream/stream.h"
 #include "osdep/io.h"
@@ -32,6 +34,10 @@
 
 #define PROBE_SIZE (8 * 1024)
 
+// With demuxer_params.playlist_incremental, parse only this many entries while
+// opening. This is enough to start playback; the rest is up to the caller.
+#define FIRST_BATCH_ENTRIES 100
+
 static bool check_mimetype(struct stream *s, const char *const *list)
 {
     if (s->mime_type) {
@@ -56,6 +62,8 @@ struct pl_parser {
     enum demux_check check_level;
     struct stream *real_stream;
     char *format;
+    int max_entries;    // stop parsing after this many entries (0: no limit)
+    bool continued;     // not parsing from the start of the file
 };
 
 static char *pl_get_line0(struct pl_parser *p)
@@ -88,6 +96,14 @@ static bool pl_eof(struct pl_parser *p)
     return p->error || p->s->eof;
 }
 
+// Whether the parser should stop, leaving the rest for a playlist_reader.
+// HLS playlists are not playlists for the player, so they're read fully.
+static bool pl_batch_full(struct pl_parser *p)
+{
+    return p->max_entries && !p->format &&
+           p->pl->num_entries >= p->max_entries;
+}
+
 static bool maybe_text(bstr d)
 {
     for (int n = 0; n < d.len; n++) {
@@ -138,6 +154,8 @@ ok:
             e->title = talloc_steal(e, title);
             title = NULL;
             playlist_add(p->pl, e);
+            if (pl_batch_full(p))
+                break;
         }
         line = bstr_strip(pl_get_line(p));
     }
@@ -218,35 +236,102 @@ static int parse_txt(struct pl_parser *p)
         return -1;
     if (p->probing)
         return 0;
-    MP_WARN(p, "Reading plaintext playlist.\n");
+    if (!p->continued)
+        MP_WARN(p, "Reading plaintext playlist.\n");
     while (!pl_eof(p)) {
         bstr line = bstr_strip(pl_get_line(p));
         if (line.len == 0)
             continue;
         pl_add(p, line);
+        if (pl_batch_full(p))
+            break;
     }
     return 0;
 }
 
 #define MAX_DIR_STACK 20
 
+// Maximum number of threads used to scan directories in parallel. Directory
+// scanning is mostly bound by filesystem latency (e.g. on network shares), so
+// this is independent from the number of CPUs.
+#define DIR_SCAN_THREADS 8
+
 static bool same_st(struct stat *st1, struct stat *st2)
 {
     return st1->st_dev == st2->st_dev && st1->st_ino == st2->st_ino;
 }
 
-// Return true if this was a readable directory.
-static bool scan_dir(struct pl_parser *p, char *path,
-                     struct stat *dir_stack, int num_dir_stack,
-                     char ***files, int *num_files)
+struct dir_scan {
+    struct pl_parser *p;
+    struct mp_thread_pool *pool;    // NULL => scan synchronously
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    int pending;                    // number of queued or running dir_jobs
+    char **files;                   // all files found so far
+    int num_files;
+};
+
+// Scans a single directory. Files are collected in the job (and allocated as
+// its talloc children), subdirectories are queued as new jobs.
+struct dir_job {
+    struct dir_scan *scan;
+    char *path;
+    struct stat dir_stack[MAX_DIR_STACK];
+    int num_dir_stack;
+    char **files;
+    int num_files;
+};
+
+static void scan_dir_job(void *ptr);
+
+static void queue_dir(struct dir_scan *scan, char *path,
+                      struct stat *dir_stack, int num_dir_stack)
 {
     if (strlen(path) >= 8192 || num_dir_stack == MAX_DIR_STACK)
-        return false; // things like mount bind loops
+        return; // things like mount bind loops
+
+    struct dir_job *job = talloc_zero(NULL, struct dir_job);
+    job->scan = scan;
+    job->path = talloc_strdup(job, path);
+    if (num_dir_stack)
+        memcpy(job->dir_stack, dir_stack, num_dir_stack * sizeof(dir_stack[0]));
+    job->num_dir_stack = num_dir_stack;
+
+    pthread_mutex_lock(&scan->lock);
+    scan->pending++;
+    pthread_mutex_unlock(&scan->lock);
+
+    if (scan->pool) {
+        mp_thread_pool_queue(scan->pool, scan_dir_job, job);
+    } else {
+        scan_dir_job(job);
+    }
+}
+
+// Whether the directory entry is a subdirectory. Fills *st for directories.
+static bool is_dir_entry(struct dirent *ep, const char *file, struct stat *st)
+{
+#ifdef DT_DIR
+    // Avoid a stat() call for every single file if the filesystem tells us
+    // the type already. Directories still need it for the loop check.
+    if (ep->d_type != DT_UNKNOWN && ep->d_type != DT_LNK &&
+        ep->d_type != DT_DIR)
+        return false;
+#endif
+    return stat(file, st) == 0 && S_ISDIR(st->st_mode);
+}
+
+static void scan_dir_job(void *ptr)
+{
+    struct dir_job *job = ptr;
+    struct dir_scan *scan = job->scan;
+    struct pl_parser *p = scan->p;
 
-    DIR *dp = opendir(path);
+    DIR *dp = opendir(job->path);
     if (!dp) {
         MP_ERR(p, "Could not read directory.\n");
-        return false;
+        goto done;
     }
 
     struct dirent *ep;
@@ -257,28 +342,38 @@ static bool scan_dir(struct pl_parser *p, char *path,
         if (mp_cancel_test(p->s->cancel))
             break;
 
-        char *file = mp_path_join(p, path, ep->d_name);
+        char *file = mp_path_join(job, job->path, ep->d_name);
 
         struct stat st;
-        if (stat(file, &st) == 0 && S_ISDIR(st.st_mode)) {
-            for (int n = 0; n < num_dir_stack; n++) {
-                if (same_st(&dir_stack[n], &st)) {
+        if (is_dir_entry(ep, file, &st)) {
+            for (int n = 0; n < job->num_dir_stack; n++) {
+                if (same_st(&job->dir_stack[n], &st)) {
                     MP_VERBOSE(p, "Skip recursive entry: %s\n", file);
                     goto skip;
                 }
             }
 
-            dir_stack[num_dir_stack] = st;
-            scan_dir(p, file, dir_stack, num_dir_stack + 1, files, num_files);
+            job->dir_stack[job->num_dir_stack] = st;
+            queue_dir(scan, file, job->dir_stack, job->num_dir_stack + 1);
         } else {
-            MP_TARRAY_APPEND(p, *files, *num_files, file);
+            MP_TARRAY_APPEND(job, job->files, job->num_files, file);
         }
 
         skip: ;
     }
 
     closedir(dp);
-    return true;
+
+done:
+    pthread_mutex_lock(&scan->lock);
+    MP_TARRAY_GROW(scan, scan->files, scan->num_files + job->num_files);
+    for (int n = 0; n < job->num_files; n++)
+        scan->files[scan->num_files++] = job->files[n];
+    talloc_steal(scan, job);
+    scan->pending--;
+    if (!scan->pending)
+        pthread_cond_signal(&scan->wakeup);
+    pthread_mutex_unlock(&scan->lock);
 }
 
 static int cmp_filename(const void *a, const void *b)
@@ -297,17 +392,33 @@ static int parse_dir(struct pl_parser *p)
     if (!path)
         return -1;
 
-    char **files = NULL;
-    int num_files = 0;
-    struct stat dir_stack[MAX_DIR_STACK];
+    struct dir_scan *scan = talloc_zero(NULL, struct dir_scan);
+    scan->p = p;
+    pthread_mutex_init(&scan->lock, NULL);
+    pthread_cond_init(&scan->wakeup, NULL);
+    scan->pool = mp_thread_pool_create_dynamic(NULL, 1, DIR_SCAN_THREADS, 1.0);
+
+    queue_dir(scan, path, NULL, 0);
+
+    pthread_mutex_lock(&scan->lock);
+    while (scan->pending)
+        pthread_cond_wait(&scan->wakeup, &scan->lock);
+    pthread_mutex_unlock(&scan->lock);
 
-    scan_dir(p, path, dir_stack, 0, &files, &num_files);
+    talloc_free(scan->pool);
+    pthread_cond_destroy(&scan->wakeup);
+    pthread_mutex_destroy(&scan->lock);
 
-    if (files)
-        qsort(files, num_files, sizeof(files[0]), cmp_filename);
+    // Sorting by full path makes the result independent from the order in
+    // which the directories were scanned.
+    int num_files = scan->num_files;
+    if (num_files)
+        qsort(scan->files, num_files, sizeof(scan->files[0]), cmp_filename);
 
     for (int n = 0; n < num_files; n++)
-        playlist_add_file(p->pl, files[n]);
+        playlist_add_file(p->pl, scan->files[n]);
+
+    talloc_free(scan);
 
     p->add_base = false;
 
@@ -321,17 +432,20 @@ struct pl_format {
     const char *name;
     int (*parse)(struct pl_parser *p);
     const char *const *mime_types;
+    // parse() can stop after max_entries, and continue at the next line
+    bool incremental;
 };
 
 static const struct pl_format formats[] = {
     {"directory", parse_dir},
     {"m3u", parse_m3u,
-     MIME_TYPES("audio/mpegurl", "audio/x-mpegurl", "application/x-mpegurl")},
+     MIME_TYPES("audio/mpegurl", "audio/x-mpegurl", "application/x-mpegurl"),
+     .incremental = true},
     {"ini", parse_ref_init},
     {"pls", parse_pls,
      MIME_TYPES("audio/x-scpls")},
     {"url", parse_url},
-    {"txt", parse_txt},
+    {"txt", parse_txt, .incremental = true},
 };
 
 static const struct pl_format *probe_pl(struct pl_parser *p)
@@ -351,6 +465,59 @@ static const struct pl_format *probe_pl(struct pl_parser *p)
     return NULL;
 }
 
+// Remaining part of a playlist that was opened with playlist_incremental.
+struct playlist_reader {
+    struct pl_parser *p;
+    const struct pl_format *fmt;
+    struct mpv_global *global;
+    char *url;
+    int stream_flags;
+    int64_t pos;        // where parsing continues
+    char *base_path;    // for relative entries, or NULL
+    bool done;
+};
+
+static void destroy_reader(void *ptr)
+{
+    struct playlist_reader *r = ptr;
+    if (r->p->s)
+        free_stream(r->p->s);
+}
+
+// Parse the next (up to) max_entries entries, and append them to pl. The
+// stream is reopened on the first call, and kept open for the following calls,
+// which must pass the same cancel. Returns false if the end of the playlist
+// was reached (pl may still have received entries), or on errors.
+bool playlist_reader_read(struct playlist_reader *r, struct playlist *pl,
+                          int max_entries, struct mp_cancel *cancel)
+{
+    struct pl_parser *p = r->p;
+    if (r->done)
+        return false;
+
+    if (!p->s) {
+        p->s = stream_create(r->url, STREAM_READ | r->stream_flags, cancel,
+                             r->global);
+        if (!p->s || !stream_seek(p->s, r->pos)) {
+            MP_ERR(p, "Could not reopen playlist to read the rest of it.\n");
+            r->done = true;
+            return false;
+        }
+    }
+
+    p->pl = talloc_zero(NULL, struct playlist);
+    p->max_entries = max_entries;
+    r->fmt->parse(p);
+    r->done = !pl_batch_full(p) || pl_eof(p) || mp_cancel_test(cancel);
+    if (p->error)
+        MP_ERR(p, "Error while reading the rest of the playlist.\n");
+    if (r->base_path)
+        playlist_add_base_path(p->pl, bstr0(r->base_path));
+    playlist_append_entries(pl, p->pl);
+    TA_FREEP(&p->pl);
+    return !r->done;
+}
+
 static int open_file(struct demuxer *demuxer, enum demux_check check)
 {
     if (!demuxer->access_references)
@@ -379,16 +546,44 @@ static int open_file(struct demuxer *demuxer, enum demux_check check)
         return -1;
     }
 
+    // The reader reopens the URL, so the stream must support seeking back to
+    // where the first batch ended.
+    struct demuxer_params *params = demuxer->params;
+    bool incremental = params && params->playlist_incremental &&
+                       fmt->incremental && demuxer->stream->seekable;
+
     p->probing = false;
     p->error = false;
     p->s = demuxer->stream;
     p->utf16 = stream_skip_bom(p->s);
+    p->max_entries = incremental ? FIRST_BATCH_ENTRIES : 0;
     bool ok = fmt->parse(p) >= 0 && !p->error;
-    if (p->add_base)
-        playlist_add_base_path(p->pl, mp_dirname(demuxer->filename));
+    bstr base_path = p->add_base ? mp_dirname(demuxer->filename) : (bstr){0};
+    playlist_add_base_path(p->pl, base_path);
     demuxer->playlist = talloc_steal(demuxer, p->pl);
     demuxer->filetype = p->format ? p->format : fmt->name;
     demuxer->fully_read = true;
+    if (ok && pl_batch_full(p) && !pl_eof(p)) {
+        struct playlist_reader *r = talloc_ptrtype(demuxer, r);
+        *r = (struct playlist_reader){
+            .p = talloc_steal(r, p),
+            .fmt = fmt,
+            .global = demuxer->global,
+            .url = talloc_strdup(r, demuxer->stream->url),
+            .stream_flags = params->stream_flags,
+            .pos = stream_tell(p->s),
+            .base_path = base_path.len ? bstrto0(r, base_path) : NULL,
+        };
+        talloc_set_destructor(r, destroy_reader);
+        p->log = mp_log_new(r, demuxer->log, NULL);
+        p->real_stream = NULL;
+        p->s = NULL;
+        p->pl = NULL;
+        p->continued = true;
+        demuxer->playlist_reader = r;
+        MP_VERBOSE(demuxer, "Reading the rest of the playlist later.\n");
+        return 0;
+    }
     talloc_free(p);
     return ok ? 0 : -1;
 }
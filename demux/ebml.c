@@ -590,6 +590,7 @@ static void ebml_parse_element(struct ebml_parse_ctx *ctx, void *target,
 }
 
 // target must be initialized to zero
+// desc can be NULL to only read the element payload into ctx->data.
 int ebml_read_element(struct stream *s, struct ebml_parse_ctx *ctx,
                       void *target, const struct ebml_elem_desc *desc)
 {
@@ -613,8 +614,56 @@ int ebml_read_element(struct stream *s, struct ebml_parse_ctx *ctx,
     int read_len = stream_read(s, ctx->talloc_ctx, length);
     if (read_len < length)
         MP_MSG(ctx, msglevel, "Unexpected end of file - partial or corrupt file?\n");
+    ctx->data = (struct bstr){ctx->talloc_ctx, read_len};
+    if (!desc)
+        return 0;
     ebml_parse_element(ctx, target, ctx->talloc_ctx, read_len, desc, 0);
     if (ctx->has_errors)
         MP_MSG(ctx, msglevel, "Error parsing element %s\n", desc->name);
     return 0;
 }
+
+// Like ebml_read_element(), but parse the element payload from memory (as
+// returned in ctx->data by a previous ebml_read_element() call).
+void ebml_parse_element_data(struct ebml_parse_ctx *ctx, void *target,
+                             struct bstr data,
+                             const struct ebml_elem_desc *desc)
+{
+    ctx->has_errors = false;
+    ctx->talloc_ctx = talloc_memdup(NULL, data.start, data.len);
+    ctx->data = (struct bstr){ctx->talloc_ctx, data.len};
+    if (!desc)
+        return;
+    ebml_parse_element(ctx, target, ctx->talloc_ctx, data.len, desc, 0);
+    if (ctx->has_errors) {
+        int msglevel = ctx->no_error_messages ? MSGL_DEBUG : MSGL_WARN;
+        MP_MSG(ctx, msglevel, "Error parsing element %s\n", desc->name);
+    }
+}
+
+// Split the next element off the start of *data, and return its ID. *payload
+// is set to the element contents. Returns EBML_ID_INVALID (and leaves *data
+// unchanged) if the element is invalid or truncated.
+uint32_t ebml_split_element(struct bstr *data, struct bstr *payload)
+{
+    int id_len, length_len;
+    uint32_t id = ebml_parse_id(data->start, data->len, &id_len);
+    if (id_len < 0 || id_len > data->len)
+        return EBML_ID_INVALID;
+    uint64_t length = ebml_parse_length(data->start + id_len,
+                                        data->len - id_len, &length_len);
+    if (length_len < 0 || length > data->len - id_len - length_len)
+        return EBML_ID_INVALID;
+    *payload = bstr_splice(*data, id_len + length_len,
+                           id_len + length_len + length);
+    *data = bstr_cut(*data, id_len + length_len + length);
+    return id;
+}
+
+// Interpret an element payload as unsigned integer.
+uint64_t ebml_payload_uint(struct bstr payload)
+{
+    if (payload.len > 8)
+        return EBML_UINT_INVALID;
+    return ebml_parse_uint(payload.start, payload.len);
+}
@@ -59,6 +59,7 @@ struct ebml_elem_desc {
 struct ebml_parse_ctx {
     struct mp_log *log;
     void *talloc_ctx;
+    struct bstr data;   // raw element payload (set by ebml_read_element())
     bool has_errors;
     bool no_error_messages;
 };
@@ -89,5 +90,10 @@ int ebml_resync_cluster(struct mp_log *log, stream_t *s);
 
 int ebml_read_element(struct stream *s, struct ebml_parse_ctx *ctx,
                       void *target, const struct ebml_elem_desc *desc);
+void ebml_parse_element_data(struct ebml_parse_ctx *ctx, void *target,
+                             struct bstr data,
+                             const struct ebml_elem_desc *desc);
+uint32_t ebml_split_element(struct bstr *data, struct bstr *payload);
+uint64_t ebml_payload_uint(struct bstr payload);
 
 #endif /* MPLAYER_EBML_H */
@@ -0,0 +1,227 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// On-disk cache for demuxer data that is expensive to recompute (because it
+// requires seeking around in the file), such as indexes and header elements.
+//
+// Entries are keyed by the demuxer type, the absolute file path, the file
+// size, and the modification time (with nanoseconds where available). A
+// changed file thus simply maps to a different entry. The header also
+// contains a layout string provided by the demuxer, which describes the
+// binary layout of the stored data. Entries with a different layout (written
+// by a different build or on a different platform) are ignored. Stale
+// entries are removed by the size limit, which deletes the least recently
+// written entries first.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+#include <libavutil/sha.h>
+#include <libavutil/mem.h>
+
+#include "osdep/io.h"
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "options/path.h"
+#include "stream/stream.h"
+#include "index_cache.h"
+
+#define CACHE_HEADER "mpv index cache v2\n"
+
+static int64_t get_mtime_ns(struct stat *st)
+{
+#if defined(__APPLE__)
+    return st->st_mtimespec.tv_sec * INT64_C(1000000000) +
+           st->st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+    return st->st_mtime * INT64_C(1000000000);
+#else
+    return st->st_mtim.tv_sec * INT64_C(1000000000) + st->st_mtim.tv_nsec;
+#endif
+}
+
+// Return the entry key for the file, or NULL if it's not a local file.
+static char *get_key(void *ta_parent, const char *type, const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) || !S_ISREG(st.st_mode))
+        return NULL;
+    char *cwd = mp_getcwd(ta_parent);
+    if (!cwd)
+        return NULL;
+    return talloc_asprintf(ta_parent, "%s\n%s\n%"PRId64"\n%"PRId64"\n", type,
+                           mp_path_join(ta_parent, cwd, path),
+                           (int64_t)st.st_size, get_mtime_ns(&st));
+}
+
+static char *get_filename(void *ta_parent, struct mpv_global *global,
+                          const char *dir, const char *key)
+{
+    struct AVSHA *sha = av_sha_alloc();
+    if (!sha)
+        abort();
+    av_sha_init(sha, 256);
+    av_sha_update(sha, key, strlen(key));
+
+    uint8_t hash[256 / 8];
+    av_sha_final(sha, hash);
+    av_free(sha);
+
+    char hashstr[256 / 8 * 2 + 1];
+    for (int n = 0; n < 256 / 8; n++)
+        snprintf(hashstr + n * 2, sizeof(hashstr) - n * 2, "%02X", hash[n]);
+
+    char *cache_dir = mp_get_user_path(ta_parent, global, dir);
+    return mp_path_join(ta_parent, cache_dir, hashstr);
+}
+
+// Return the data stored for the given file, or an empty bstr if there is
+// no (valid) entry.
+struct bstr demux_index_cache_load(void *ta_parent, struct mpv_global *global,
+                                   struct mp_log *log, const char *dir,
+                                   const char *type, const char *layout,
+                                   const char *path)
+{
+    struct bstr res = {0};
+    void *tmp = talloc_new(NULL);
+
+    char *key = get_key(tmp, type, path);
+    if (!key)
+        goto done;
+    char *filename = get_filename(tmp, global, dir, key);
+    if (stat(filename, &(struct stat){0}) != 0)
+        goto done;
+
+    struct bstr data = stream_read_file(filename, tmp, global, INT_MAX);
+    if (!bstr_eatstart0(&data, CACHE_HEADER) ||
+        !bstr_eatstart0(&data, layout) || !bstr_eatstart0(&data, "\n") ||
+        !bstr_eatstart0(&data, key))
+    {
+        mp_verbose(log, "Ignoring invalid index cache file %s\n", filename);
+        goto done;
+    }
+
+    mp_verbose(log, "Using index cache file %s\n", filename);
+    res = bstrdup(ta_parent, data);
+
+done:
+    talloc_free(tmp);
+    return res;
+}
+
+struct cache_file {
+    char *filename;
+    int64_t size;
+    time_t mtime;
+};
+
+static int compare_mtime(const void *a, const void *b)
+{
+    const struct cache_file *fa = a, *fb = b;
+    return fa->mtime < fb->mtime ? -1 : (fa->mtime > fb->mtime ? 1 : 0);
+}
+
+// Delete the oldest files in the cache directory until it uses at most
+// max_bytes.
+static void prune_cache(struct mp_log *log, const char *cache_dir,
+                        int64_t max_bytes)
+{
+    void *tmp = talloc_new(NULL);
+    struct cache_file *files = NULL;
+    int num_files = 0;
+    int64_t total = 0;
+
+    DIR *d = opendir(cache_dir);
+    if (!d)
+        goto done;
+    struct dirent *ep;
+    while ((ep = readdir(d))) {
+        char *filename = mp_path_join(tmp, cache_dir, ep->d_name);
+        struct stat st;
+        if (stat(filename, &st) || !S_ISREG(st.st_mode))
+            continue;
+        struct cache_file f = {filename, st.st_size, st.st_mtime};
+        MP_TARRAY_APPEND(tmp, files, num_files, f);
+        total += f.size;
+    }
+    closedir(d);
+
+    qsort(files, num_files, sizeof(files[0]), compare_mtime);
+    for (int n = 0; n < num_files && total > max_bytes; n++) {
+        mp_verbose(log, "Removing index cache file %s\n", files[n].filename);
+        if (unlink(files[n].filename) == 0)
+            total -= files[n].size;
+    }
+
+done:
+    talloc_free(tmp);
+}
+
+// Store data for the given file, replacing any previous entry. Entries that
+// would exceed max_bytes on their own are not stored.
+void demux_index_cache_store(struct mpv_global *global, struct mp_log *log,
+                             const char *dir, const char *type,
+                             const char *layout, const char *path,
+                             struct bstr data,
+                             int64_t max_bytes)
+{
+    void *tmp = talloc_new(NULL);
+
+    char *key = get_key(tmp, type, path);
+    if (!key)
+        goto done;
+    char *header = talloc_asprintf(tmp, "%s%s\n", CACHE_HEADER, layout);
+    if (strlen(header) + strlen(key) + data.len > max_bytes) {
+        mp_verbose(log, "Index too large for the index cache.\n");
+        goto done;
+    }
+
+    char *filename = get_filename(tmp, global, dir, key);
+    char *cache_dir = mp_get_user_path(tmp, global, dir);
+    mp_mkdirp(cache_dir);
+
+    // Write a temporary file first, so that concurrent readers never see
+    // a partially written entry.
+    char *tmpname = talloc_asprintf(tmp, "%s.tmp", filename);
+    FILE *out = fopen(tmpname, "wb");
+    if (!out) {
+        mp_warn(log, "Can't write index cache file %s\n", tmpname);
+        goto done;
+    }
+    bool ok = fwrite(header, strlen(header), 1, out) == 1 &&
+              fwrite(key, strlen(key), 1, out) == 1 &&
+              (!data.len || fwrite(data.start, data.len, 1, out) == 1);
+    ok &= fclose(out) == 0;
+    if (!ok || rename(tmpname, filename) != 0) {
+        mp_warn(log, "Can't write index cache file %s\n", filename);
+        unlink(tmpname);
+        goto done;
+    }
+    mp_verbose(log, "Wrote index cache file %s\n", filename);
+
+    prune_cache(log, cache_dir, max_bytes);
+
+done:
+    talloc_free(tmp);
+}
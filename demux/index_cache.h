@@ -0,0 +1,38 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_DEMUX_INDEX_CACHE_H_
+#define MP_DEMUX_INDEX_CACHE_H_
+
+#include <stdint.h>
+
+#include "misc/bstr.h"
+
+struct mpv_global;
+struct mp_log;
+
+struct bstr demux_index_cache_load(void *ta_parent, struct mpv_global *global,
+                                   struct mp_log *log, const char *dir,
+                                   const char *type, const char *layout,
+                                   const char *path);
+void demux_index_cache_store(struct mpv_global *global, struct mp_log *log,
+                             const char *dir, const char *type,
+                             const char *layout, const char *path,
+                             struct bstr data,
+                             int64_t max_bytes);
+
+#endif
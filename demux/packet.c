@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavcodec/avcodec.h>
 #include <libavutil/intreadwrite.h>
@@ -31,6 +32,46 @@
 
 #include "packet.h"
 
+// demux_packet and its AVPacket are allocated as a single block.
+struct demux_packet_mem {
+    struct demux_packet dp;
+    AVPacket avpkt;
+};
+
+// Payload buffers are recycled through per size class free lists. Each power
+// of 2 size range is split into POOL_STEPS size classes, which bounds the
+// memory wasted by rounding up to a class size to 25%.
+// Freed buffers are put back on the free lists only while the pool holds less
+// than max_bytes, so the memory held by the pool stays bounded.
+#define POOL_MIN_SIZE_LOG2 8    // 256 bytes
+#define POOL_MAX_SIZE_LOG2 24   // 16 MB
+#define POOL_STEPS 4
+#define POOL_NUM_CLASSES ((POOL_MAX_SIZE_LOG2 - POOL_MIN_SIZE_LOG2) * POOL_STEPS)
+
+// Each buffer is preceded by this header (padded to keep data aligned).
+#define POOL_HEADER_SIZE 64
+
+struct pool_header {
+    union {
+        int size_class;             // while in use
+        struct pool_header *next;   // while in a free list
+    };
+};
+
+// Shared between the pool and its buffers, which can outlive the pool.
+struct pool_shared {
+    pthread_mutex_t lock;
+    int refs;                   // the pool itself + allocated buffers
+    bool closed;                // the pool was destroyed
+    int64_t max_bytes;
+    int64_t pooled_bytes;       // sum of class sizes in free[]
+    struct pool_header *free[POOL_NUM_CLASSES];
+};
+
+struct demux_packet_pool {
+    struct pool_shared *s;
+};
+
 static void packet_destroy(void *ptr)
 {
     struct demux_packet *dp = ptr;
@@ -38,6 +79,149 @@ static void packet_destroy(void *ptr)
     mp_packet_tags_unref(dp->metadata);
 }
 
+static size_t get_class_size(int index)
+{
+    size_t base = (size_t)1 << (index / POOL_STEPS + POOL_MIN_SIZE_LOG2);
+    return base + (index % POOL_STEPS + 1) * (base / POOL_STEPS);
+}
+
+// Return the size class for the given size, or -1 if it's too large.
+static int get_size_class(size_t size)
+{
+    if (size > ((size_t)1 << POOL_MAX_SIZE_LOG2))
+        return -1;
+    int e = POOL_MIN_SIZE_LOG2;
+    while (((size_t)1 << (e + 1)) < size)
+        e++;
+    size_t base = (size_t)1 << e;
+    size_t step = base / POOL_STEPS;
+    size_t k = size > base ? (size - base + step - 1) / step : 1;
+    return (e - POOL_MIN_SIZE_LOG2) * POOL_STEPS + (k - 1);
+}
+
+// Free all buffers in the free lists. Called with s->lock held.
+static void pool_clear(struct pool_shared *s)
+{
+    for (int n = 0; n < POOL_NUM_CLASSES; n++) {
+        while (s->free[n]) {
+            struct pool_header *h = s->free[n];
+            s->free[n] = h->next;
+            av_free(h);
+        }
+    }
+    s->pooled_bytes = 0;
+}
+
+static void pool_unref(struct pool_shared *s)
+{
+    pthread_mutex_lock(&s->lock);
+    bool last = --s->refs == 0;
+    pthread_mutex_unlock(&s->lock);
+    if (last) {
+        pthread_mutex_destroy(&s->lock);
+        talloc_free(s);
+    }
+}
+
+static void pool_buffer_free(void *opaque, uint8_t *data)
+{
+    struct pool_shared *s = opaque;
+    struct pool_header *h = (void *)(data - POOL_HEADER_SIZE);
+    int index = h->size_class;
+    size_t class_size = get_class_size(index);
+
+    pthread_mutex_lock(&s->lock);
+    if (!s->closed && s->pooled_bytes + class_size <= s->max_bytes) {
+        h->next = s->free[index];
+        s->free[index] = h;
+        s->pooled_bytes += class_size;
+        h = NULL;
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    av_free(h);
+    pool_unref(s);
+}
+
+static void pool_destroy(void *ptr)
+{
+    struct demux_packet_pool *pool = ptr;
+    struct pool_shared *s = pool->s;
+    pthread_mutex_lock(&s->lock);
+    s->closed = true;
+    pool_clear(s);
+    pthread_mutex_unlock(&s->lock);
+    pool_unref(s);
+}
+
+// Create a pool for packet payload buffers. It can be used from any thread,
+// and packets allocated from it can outlive it. The pool keeps at most
+// max_bytes of unused buffers.
+struct demux_packet_pool *demux_packet_pool_create(void *ta_parent,
+                                                   int64_t max_bytes)
+{
+    struct demux_packet_pool *pool = talloc_zero(ta_parent, struct demux_packet_pool);
+    struct pool_shared *s = talloc_zero(NULL, struct pool_shared);
+    pthread_mutex_init(&s->lock, NULL);
+    s->refs = 1;
+    s->max_bytes = max_bytes;
+    pool->s = s;
+    talloc_set_destructor(pool, pool_destroy);
+    return pool;
+}
+
+// Return the number of bytes in unused buffers held by the pool.
+int64_t demux_packet_pool_get_bytes(struct demux_packet_pool *pool)
+{
+    struct pool_shared *s = pool->s;
+    pthread_mutex_lock(&s->lock);
+    int64_t bytes = s->pooled_bytes;
+    pthread_mutex_unlock(&s->lock);
+    return bytes;
+}
+
+// Allocate a buffer with at least size bytes, with buf->size set to size.
+// The contents are uninitialized. pool can be NULL (then this is equivalent
+// to av_buffer_alloc()).
+struct AVBufferRef *demux_packet_pool_alloc(struct demux_packet_pool *pool,
+                                            size_t size)
+{
+    if (size > INT_MAX)
+        return NULL;
+    int index = pool ? get_size_class(size) : -1;
+    if (index < 0)
+        return av_buffer_alloc(size);
+    size_t class_size = get_class_size(index);
+    struct pool_shared *s = pool->s;
+
+    pthread_mutex_lock(&s->lock);
+    struct pool_header *h = s->free[index];
+    if (h) {
+        s->free[index] = h->next;
+        s->pooled_bytes -= class_size;
+    }
+    s->refs++;
+    pthread_mutex_unlock(&s->lock);
+
+    if (!h)
+        h = av_malloc(POOL_HEADER_SIZE + class_size);
+    if (!h) {
+        pool_unref(s);
+        return NULL;
+    }
+    h->size_class = index;
+
+    AVBufferRef *buf = av_buffer_create((uint8_t *)h + POOL_HEADER_SIZE,
+                                        class_size, pool_buffer_free, s, 0);
+    if (!buf) {
+        av_free(h);
+        pool_unref(s);
+        return NULL;
+    }
+    buf->size = size;
+    return buf;
+}
+
 // This actually preserves only data and side data, not PTS/DTS/pos/etc.
 // It also allows avpkt->data==NULL with avpkt->size!=0 - the libavcodec API
 // does not allow it, but we do it to simplify new_demux_packet().
@@ -45,7 +229,8 @@ struct demux_packet *new_demux_packet_from_avpacket(struct AVPacket *avpkt)
 {
     if (avpkt->size > 1000000000)
         return NULL;
-    struct demux_packet *dp = talloc(NULL, struct demux_packet);
+    struct demux_packet_mem *mem = talloc_zero(NULL, struct demux_packet_mem);
+    struct demux_packet *dp = &mem->dp;
     talloc_set_destructor(dp, packet_destroy);
     *dp = (struct demux_packet) {
         .pts = MP_NOPTS_VALUE,
@@ -55,7 +240,7 @@ struct demux_packet *new_demux_packet_from_avpacket(struct AVPacket *avpkt)
         .start = MP_NOPTS_VALUE,
         .end = MP_NOPTS_VALUE,
         .stream = -1,
-        .avpacket = talloc_zero(dp, AVPacket),
+        .avpacket = &mem->avpkt,
         .kf_seek_pts = MP_NOPTS_VALUE,
     };
     av_init_packet(dp->avpacket);
@@ -107,6 +292,35 @@ struct demux_packet *new_demux_packet(size_t len)
     return new_demux_packet_from_avpacket(&pkt);
 }
 
+// Like new_demux_packet(), but allocate the packet data from the pool.
+// pool can be NULL.
+struct demux_packet *new_demux_packet_pool(struct demux_packet_pool *pool,
+                                           size_t len)
+{
+    if (len > INT_MAX - AV_INPUT_BUFFER_PADDING_SIZE)
+        return NULL;
+    AVBufferRef *buf =
+        demux_packet_pool_alloc(pool, len + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!buf)
+        return NULL;
+    memset(buf->data + len, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    AVPacket pkt = { .data = buf->data, .size = len, .buf = buf };
+    struct demux_packet *dp = new_demux_packet_from_avpacket(&pkt);
+    av_buffer_unref(&buf);
+    return dp;
+}
+
+// Like new_demux_packet_from(), but allocate the packet data from the pool.
+// pool can be NULL.
+struct demux_packet *new_demux_packet_from_pool(struct demux_packet_pool *pool,
+                                                void *data, size_t len)
+{
+    struct demux_packet *dp = new_demux_packet_pool(pool, len);
+    if (dp)
+        memcpy(dp->buffer, data, len);
+    return dp;
+}
+
 void demux_packet_shorten(struct demux_packet *dp, size_t len)
 {
     assert(len <= dp->len);
@@ -161,10 +375,9 @@ struct demux_packet *demux_copy_packet(struct demux_packet *dp)
 // memory wasted due to internal fragmentation.)
 size_t demux_packet_estimate_total_size(struct demux_packet *dp)
 {
-    size_t size = ROUND_ALLOC(sizeof(struct demux_packet));
+    size_t size = ROUND_ALLOC(sizeof(struct demux_packet_mem));
     size += ROUND_ALLOC(dp->len);
     if (dp->avpacket) {
-        size += ROUND_ALLOC(sizeof(AVPacket));
         size += ROUND_ALLOC(sizeof(AVBufferRef));
         size += 64; // upper bound estimate on sizeof(AVBuffer)
         size += ROUND_ALLOC(dp->avpacket->side_data_elems *
@@ -48,8 +48,19 @@ typedef struct demux_packet {
 } demux_packet_t;
 
 struct AVBufferRef;
+struct demux_packet_pool;
+
+struct demux_packet_pool *demux_packet_pool_create(void *ta_parent,
+                                                   int64_t max_bytes);
+int64_t demux_packet_pool_get_bytes(struct demux_packet_pool *pool);
+struct AVBufferRef *demux_packet_pool_alloc(struct demux_packet_pool *pool,
+                                            size_t size);
 
 struct demux_packet *new_demux_packet(size_t len);
+struct demux_packet *new_demux_packet_pool(struct demux_packet_pool *pool,
+                                           size_t len);
+struct demux_packet *new_demux_packet_from_pool(struct demux_packet_pool *pool,
+                                                void *data, size_t len);
 struct demux_packet *new_demux_packet_from_avpacket(struct AVPacket *avpkt);
 struct demux_packet *new_demux_packet_from(void *data, size_t len);
 struct demux_packet *new_demux_packet_from_buf(struct AVBufferRef *buf);
@@ -0,0 +1,327 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Append-only, memory-mapped backing store for packets evicted from the
+// demuxer packet cache.
+//
+// The file is used as a ring: data is always written at the current logical
+// write position, which wraps around to the start of the file once the end
+// is reached. Logical offsets never decrease, so an entry is still intact
+// as long as the write position has not advanced by more than the file size
+// since it was written.
+//
+// Writing to the mapping can page fault, so the data is not copied while the
+// demuxer lock is held. demux_spill_write() only reserves the space, and keeps
+// the packet until the next flush copies it into the file.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libavcodec/avcodec.h>
+
+#include "osdep/io.h"
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "demux.h"
+#include "packet.h"
+#include "spill.h"
+
+struct spill_side_data {
+    uint32_t type;
+    uint32_t size;
+};
+
+// A packet whose data was not copied to the file yet.
+struct spill_write {
+    int64_t offset;
+    struct demux_packet *dp;
+};
+
+struct demux_spill {
+    struct mp_log *log;
+    FILE *file;
+    uint8_t *map;
+    int64_t max_bytes;
+    int64_t write_pos;      // logical write position
+    struct demux_spill_stats stats;
+
+    // Sorted by offset. pending[] is appended by demux_spill_write(), while
+    // flushing[] is owned by the current flush, and is not changed otherwise.
+    struct spill_write *pending;
+    int num_pending;
+    struct spill_write *flushing;
+    int num_flushing;
+};
+
+static void free_writes(struct spill_write *w, int *num)
+{
+    for (int n = 0; n < *num; n++)
+        talloc_free(w[n].dp);
+    *num = 0;
+}
+
+static void spill_destroy(void *ptr)
+{
+    struct demux_spill *sp = ptr;
+    free_writes(sp->pending, &sp->num_pending);
+    free_writes(sp->flushing, &sp->num_flushing);
+    if (sp->map)
+        munmap(sp->map, sp->max_bytes);
+    if (sp->file)
+        fclose(sp->file);
+}
+
+// filename can be "TMP" to use an anonymous temporary file.
+// Returns NULL on failure (the error is logged).
+struct demux_spill *demux_spill_create(void *ta_parent, struct mp_log *log,
+                                       const char *filename, int64_t max_bytes)
+{
+    if (max_bytes < 1 || (uint64_t)max_bytes > SIZE_MAX)
+        return NULL;
+
+    struct demux_spill *sp = talloc_zero(ta_parent, struct demux_spill);
+    talloc_set_destructor(sp, spill_destroy);
+    sp->log = log;
+    sp->max_bytes = max_bytes;
+    sp->stats.max_bytes = max_bytes;
+
+    bool use_anon_file = strcmp(filename, "TMP") == 0;
+    sp->file = use_anon_file ? tmpfile() : fopen(filename, "wb+");
+    if (!sp->file) {
+        mp_err(log, "can't open spill file '%s'\n", filename);
+        goto error;
+    }
+
+    int fd = fileno(sp->file);
+    if (ftruncate(fd, max_bytes)) {
+        mp_err(log, "can't resize spill file to %"PRId64" bytes\n", max_bytes);
+        goto error;
+    }
+
+    void *map = mmap(NULL, max_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        mp_err(log, "can't map spill file\n");
+        goto error;
+    }
+    sp->map = map;
+
+    mp_verbose(log, "using %"PRId64" bytes spill file.\n", max_bytes);
+    return sp;
+
+error:
+    talloc_free(sp);
+    return NULL;
+}
+
+static int64_t packet_spill_size(struct demux_packet *dp)
+{
+    AVPacket *avpkt = dp->avpacket;
+    int64_t size = dp->len;
+    for (int n = 0; avpkt && n < avpkt->side_data_elems; n++)
+        size += sizeof(struct spill_side_data) + avpkt->side_data[n].size;
+    return size;
+}
+
+// Serialize the packet data into the file mapping.
+static void write_packet_data(struct demux_spill *sp, struct spill_write *w)
+{
+    struct demux_packet *dp = w->dp;
+    AVPacket *avpkt = dp->avpacket;
+    int num_side_data = avpkt ? avpkt->side_data_elems : 0;
+
+    uint8_t *dst = sp->map + w->offset % sp->max_bytes;
+    memcpy(dst, dp->buffer, dp->len);
+    dst += dp->len;
+    for (int n = 0; n < num_side_data; n++) {
+        AVPacketSideData *sd = &avpkt->side_data[n];
+        struct spill_side_data hdr = {sd->type, sd->size};
+        memcpy(dst, &hdr, sizeof(hdr));
+        dst += sizeof(hdr);
+        memcpy(dst, sd->data, sd->size);
+        dst += sd->size;
+    }
+}
+
+// Reserve space for the packet in the spill file, and fill *e with the packet
+// attributes. On success, e->metadata holds a new reference, and the spill
+// takes ownership of dp. Its data is written by the next flush.
+bool demux_spill_write(struct demux_spill *sp, struct demux_packet *dp,
+                       struct demux_spill_entry *e)
+{
+    int num_side_data = dp->avpacket ? dp->avpacket->side_data_elems : 0;
+
+    int64_t size = packet_spill_size(dp);
+    if (size > sp->max_bytes)
+        return false;
+
+    // Never split an entry across the end of the file.
+    int64_t pos = sp->write_pos;
+    if (pos % sp->max_bytes + size > sp->max_bytes)
+        pos = (pos / sp->max_bytes + 1) * sp->max_bytes;
+
+    dp->next = NULL;
+    struct spill_write w = {pos, dp};
+    MP_TARRAY_APPEND(sp, sp->pending, sp->num_pending, w);
+
+    *e = (struct demux_spill_entry){
+        .offset = pos,
+        .size = size,
+        .len = dp->len,
+        .num_side_data = num_side_data,
+        .pts = dp->pts,
+        .dts = dp->dts,
+        .duration = dp->duration,
+        .kf_seek_pts = dp->kf_seek_pts,
+        .keyframe = dp->keyframe,
+        .pos = dp->pos,
+        .segmented = dp->segmented,
+        .codec = dp->codec,
+        .start = dp->start,
+        .end = dp->end,
+    };
+    mp_packet_tags_setref(&e->metadata, dp->metadata);
+
+    sp->write_pos = pos + size;
+    sp->stats.live_bytes += size;
+    sp->stats.written_bytes += size;
+    return true;
+}
+
+// Whether the entry's data was not overwritten yet.
+bool demux_spill_entry_valid(struct demux_spill *sp,
+                             struct demux_spill_entry *e)
+{
+    return e->offset >= sp->write_pos - sp->max_bytes;
+}
+
+static struct demux_packet *find_write(struct spill_write *w, int num,
+                                       int64_t offset)
+{
+    int lo = 0, hi = num;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (w[mid].offset < offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < num && w[lo].offset == offset ? w[lo].dp : NULL;
+}
+
+// Recreate the packet from the entry. The entry stays valid, and has to be
+// released separately.
+struct demux_packet *demux_spill_read(struct demux_spill *sp,
+                                      struct demux_spill_entry *e)
+{
+    if (!demux_spill_entry_valid(sp, e))
+        return NULL;
+
+    // Not copied to the file yet. (The flush only reads the packet, so it's
+    // fine to access it concurrently.)
+    struct demux_packet *unwritten =
+        find_write(sp->flushing, sp->num_flushing, e->offset);
+    if (!unwritten)
+        unwritten = find_write(sp->pending, sp->num_pending, e->offset);
+    if (unwritten) {
+        struct demux_packet *dp = demux_copy_packet(unwritten);
+        if (dp)
+            sp->stats.read_bytes += e->size;
+        return dp;
+    }
+
+    uint8_t *src = sp->map + e->offset % sp->max_bytes;
+    struct demux_packet *dp = new_demux_packet_from(src, e->len);
+    if (!dp)
+        return NULL;
+    src += e->len;
+    for (int n = 0; n < e->num_side_data; n++) {
+        struct spill_side_data hdr;
+        memcpy(&hdr, src, sizeof(hdr));
+        src += sizeof(hdr);
+        uint8_t *sd = av_packet_new_side_data(dp->avpacket, hdr.type, hdr.size);
+        if (!sd) {
+            talloc_free(dp);
+            return NULL;
+        }
+        memcpy(sd, src, hdr.size);
+        src += hdr.size;
+    }
+
+    dp->pts = e->pts;
+    dp->dts = e->dts;
+    dp->duration = e->duration;
+    dp->kf_seek_pts = e->kf_seek_pts;
+    dp->keyframe = e->keyframe;
+    dp->pos = e->pos;
+    dp->segmented = e->segmented;
+    dp->codec = e->codec;
+    dp->start = e->start;
+    dp->end = e->end;
+    mp_packet_tags_setref(&dp->metadata, e->metadata);
+
+    sp->stats.read_bytes += e->size;
+    return dp;
+}
+
+// Drop the entry. The file space is reclaimed implicitly by later writes.
+void demux_spill_release(struct demux_spill *sp, struct demux_spill_entry *e)
+{
+    sp->stats.live_bytes -= e->size;
+    mp_packet_tags_unref(e->metadata);
+    e->metadata = NULL;
+}
+
+// Start copying the pending packets to the file. Returns false if there is
+// nothing to do, or if another flush is still running. Otherwise,
+// demux_spill_flush() and demux_spill_end_flush() must be called.
+// Like all other functions, this needs external synchronization, but
+// demux_spill_flush() can run concurrently with the other functions.
+bool demux_spill_begin_flush(struct demux_spill *sp)
+{
+    if (!sp->num_pending || sp->num_flushing)
+        return false;
+    MPSWAP(struct spill_write *, sp->pending, sp->flushing);
+    sp->num_flushing = sp->num_pending;
+    sp->num_pending = 0;
+    return true;
+}
+
+// Copy the packet data. Data written in a later flush may overwrite space
+// used in this one, but never the other way around, because the flushes run
+// strictly one after another, and the write position never decreases. If
+// space is reused while a flush is running, the overwritten entries are
+// invalid anyway.
+void demux_spill_flush(struct demux_spill *sp)
+{
+    for (int n = 0; n < sp->num_flushing; n++)
+        write_packet_data(sp, &sp->flushing[n]);
+}
+
+void demux_spill_end_flush(struct demux_spill *sp)
+{
+    free_writes(sp->flushing, &sp->num_flushing);
+}
+
+void demux_spill_get_stats(struct demux_spill *sp,
+                           struct demux_spill_stats *stats)
+{
+    *stats = sp->stats;
+}
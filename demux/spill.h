@@ -0,0 +1,69 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_DEMUX_SPILL_H_
+#define MP_DEMUX_SPILL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct mp_log;
+struct demux_packet;
+
+// One packet evicted to the spill file. The packet attributes are kept in
+// memory, only the payload and side data live in the file.
+struct demux_spill_entry {
+    int64_t offset;         // logical offset into the spill file
+    int64_t size;           // bytes used in the spill file
+    int len;                // packet payload size
+    int num_side_data;      // number of serialized AVPacket side data elements
+
+    double pts, dts, duration;
+    double kf_seek_pts;
+    bool keyframe;
+    int64_t pos;
+    bool segmented;
+    struct mp_codec_params *codec;
+    double start, end;
+    struct mp_packet_tags *metadata;
+};
+
+struct demux_spill_stats {
+    int64_t max_bytes;      // size of the spill file
+    int64_t live_bytes;     // bytes referenced by live entries
+    int64_t written_bytes;  // total bytes ever written
+    int64_t read_bytes;     // total bytes ever read back
+};
+
+struct demux_spill;
+
+struct demux_spill *demux_spill_create(void *ta_parent, struct mp_log *log,
+                                       const char *filename, int64_t max_bytes);
+bool demux_spill_write(struct demux_spill *sp, struct demux_packet *dp,
+                       struct demux_spill_entry *e);
+struct demux_packet *demux_spill_read(struct demux_spill *sp,
+                                      struct demux_spill_entry *e);
+bool demux_spill_entry_valid(struct demux_spill *sp,
+                             struct demux_spill_entry *e);
+void demux_spill_release(struct demux_spill *sp, struct demux_spill_entry *e);
+bool demux_spill_begin_flush(struct demux_spill *sp);
+void demux_spill_flush(struct demux_spill *sp);
+void demux_spill_end_flush(struct demux_spill *sp);
+void demux_spill_get_stats(struct demux_spill *sp,
+                           struct demux_spill_stats *stats);
+
+#endif
@@ -0,0 +1,405 @@
+#include <pthread.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "osdep/atomic.h"
+#include "osdep/threads.h"
+
+#include "f_async_queue.h"
+#include "filter_internal.h"
+
+struct mp_async_queue {
+    // Ring buffer of frames. The writer owns tail, the reader owns head, and
+    // num_frames is the only state shared between them. A frame slot belongs to
+    // the writer until num_frames is incremented, and to the reader until it
+    // is decremented again.
+    struct mp_frame *frames;
+    int max_frames;
+    int head, tail;
+    atomic_int num_frames;
+
+    // Statistics. Only written by the filter at one end each.
+    atomic_int peak_frames;
+    mp_atomic_int64 total_frames;
+    mp_atomic_int64 underruns;
+    mp_atomic_int64 overruns;
+
+    // Filters accessing the queue, indexed by their pin direction. Set to NULL
+    // when a filter is destroyed. Protected by lock, which is only needed for
+    // wakeups (i.e. when the queue stops being empty or full).
+    pthread_mutex_t lock;
+    struct mp_filter *conn[2];
+};
+
+static void queue_destroy(void *ptr)
+{
+    struct mp_async_queue *q = ptr;
+    mp_async_queue_reset(q);
+    pthread_mutex_destroy(&q->lock);
+}
+
+struct mp_async_queue *mp_async_queue_create(void *ta_parent, int max_frames)
+{
+    struct mp_async_queue *q = talloc_zero(ta_parent, struct mp_async_queue);
+    q->max_frames = MPMAX(max_frames, 1);
+    q->frames = talloc_zero_array(q, struct mp_frame, q->max_frames);
+    atomic_store(&q->num_frames, 0);
+    atomic_store(&q->peak_frames, 0);
+    atomic_store(&q->total_frames, 0);
+    atomic_store(&q->underruns, 0);
+    atomic_store(&q->overruns, 0);
+    pthread_mutex_init(&q->lock, NULL);
+    talloc_set_destructor(q, queue_destroy);
+    return q;
+}
+
+// Wake up the filter at the given end of the queue.
+static void wakeup_conn(struct mp_async_queue *q, enum mp_pin_dir dir)
+{
+    pthread_mutex_lock(&q->lock);
+    struct mp_filter *f = q->conn[dir == MP_PIN_IN ? 0 : 1];
+    if (f)
+        mp_filter_wakeup(f);
+    pthread_mutex_unlock(&q->lock);
+}
+
+void mp_async_queue_reset(struct mp_async_queue *q)
+{
+    int num_frames = atomic_load(&q->num_frames);
+    for (int n = 0; n < num_frames; n++)
+        mp_frame_unref(&q->frames[(q->head + n) % q->max_frames]);
+    q->head = q->tail = 0;
+    atomic_store(&q->num_frames, 0);
+    atomic_store(&q->peak_frames, 0);
+    // The writer may have been blocked on a full queue.
+    wakeup_conn(q, MP_PIN_IN);
+}
+
+void mp_async_queue_get_stats(struct mp_async_queue *q,
+                              struct mp_async_queue_stats *st)
+{
+    *st = (struct mp_async_queue_stats){
+        .num_frames = atomic_load(&q->num_frames),
+        .max_frames = q->max_frames,
+        .peak_frames = atomic_load(&q->peak_frames),
+        .total_frames = atomic_load(&q->total_frames),
+        .underruns = atomic_load(&q->underruns),
+        .overruns = atomic_load(&q->overruns),
+    };
+}
+
+struct priv {
+    struct mp_async_queue *q;
+    enum mp_pin_dir dir;
+    bool blocked; // for statistics
+};
+
+static void queue_filter_process(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+    struct mp_async_queue *q = p->q;
+
+    if (p->dir == MP_PIN_IN) {
+        // If full, the reader wakes us up when it removes a frame. Only this
+        // filter adds frames, so the free space can't shrink after the check.
+        if (atomic_load(&q->num_frames) >= q->max_frames) {
+            if (!p->blocked)
+                atomic_fetch_add(&q->overruns, 1);
+            p->blocked = true;
+            return;
+        }
+        p->blocked = false;
+
+        struct mp_frame frame = mp_pin_out_read(f->ppins[0]);
+        if (!frame.type)
+            return;
+
+        q->frames[q->tail] = frame;
+        q->tail = (q->tail + 1) % q->max_frames;
+        int prev = atomic_fetch_add(&q->num_frames, 1);
+        if (prev + 1 > atomic_load(&q->peak_frames))
+            atomic_store(&q->peak_frames, prev + 1);
+        atomic_fetch_add(&q->total_frames, 1);
+        if (prev == 0)
+            wakeup_conn(q, MP_PIN_OUT);
+
+        // There may be more input.
+        mp_filter_internal_mark_progress(f);
+    } else {
+        if (!mp_pin_in_needs_data(f->ppins[0]))
+            return;
+
+        // If empty, the writer wakes us up when it adds a frame.
+        if (!atomic_load(&q->num_frames)) {
+            if (!p->blocked)
+                atomic_fetch_add(&q->underruns, 1);
+            p->blocked = true;
+            return;
+        }
+        p->blocked = false;
+
+        struct mp_frame frame = q->frames[q->head];
+        q->frames[q->head] = MP_NO_FRAME;
+        q->head = (q->head + 1) % q->max_frames;
+        if (atomic_fetch_add(&q->num_frames, -1) == q->max_frames)
+            wakeup_conn(q, MP_PIN_IN);
+
+        mp_pin_in_write(f->ppins[0], frame);
+    }
+}
+
+static void queue_filter_reset(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+
+    p->blocked = false;
+}
+
+static void queue_filter_destroy(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+
+    pthread_mutex_lock(&p->q->lock);
+    p->q->conn[p->dir == MP_PIN_IN ? 0 : 1] = NULL;
+    pthread_mutex_unlock(&p->q->lock);
+}
+
+static const struct mp_filter_info queue_filter = {
+    .name = "async_queue",
+    .priv_size = sizeof(struct priv),
+    .process = queue_filter_process,
+    .reset = queue_filter_reset,
+    .destroy = queue_filter_destroy,
+};
+
+struct mp_filter *mp_async_queue_create_filter(struct mp_filter *parent,
+                                               enum mp_pin_dir dir,
+                                               struct mp_async_queue *q)
+{
+    struct mp_filter *f = mp_filter_create(parent, &queue_filter);
+    if (!f)
+        return NULL;
+
+    struct priv *p = f->priv;
+    p->q = q;
+    p->dir = dir;
+
+    mp_filter_add_pin(f, dir, dir == MP_PIN_IN ? "in" : "out");
+
+    pthread_mutex_lock(&q->lock);
+    assert(!q->conn[dir == MP_PIN_IN ? 0 : 1]);
+    q->conn[dir == MP_PIN_IN ? 0 : 1] = f;
+    pthread_mutex_unlock(&q->lock);
+
+    return f;
+}
+
+struct threaded_priv {
+    struct mp_async_queue *in_q, *out_q;
+
+    // Filter graph driven by the worker thread.
+    struct mp_filter *root;
+    struct mp_filter *sub;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool thread_valid;
+
+    // Held by the worker while it runs the filters, so commands from the
+    // caller's thread don't race with them.
+    pthread_mutex_t run_lock;
+
+    // Protected by lock.
+    bool need_run;
+    bool need_reset;
+    bool failed;
+    bool terminate;
+};
+
+static void wakeup_thread(void *ptr)
+{
+    struct threaded_priv *p = ptr;
+
+    pthread_mutex_lock(&p->lock);
+    p->need_run = true;
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void *filter_thread(void *ptr)
+{
+    struct mp_filter *f = ptr;
+    struct threaded_priv *p = f->priv;
+
+    mpthread_set_name("filter");
+
+    pthread_mutex_lock(&p->lock);
+    while (!p->terminate) {
+        if (p->need_reset) {
+            pthread_mutex_unlock(&p->lock);
+            // The filters on the other thread were reset already, and the
+            // other thread waits for us, so nothing can touch the queues.
+            pthread_mutex_lock(&p->run_lock);
+            mp_filter_reset(p->root);
+            mp_async_queue_reset(p->in_q);
+            mp_async_queue_reset(p->out_q);
+            pthread_mutex_unlock(&p->run_lock);
+            pthread_mutex_lock(&p->lock);
+            p->need_reset = false;
+            // Restart the data flow from the output end.
+            p->need_run = true;
+            pthread_cond_broadcast(&p->wakeup);
+        } else if (p->need_run) {
+            p->need_run = false;
+            pthread_mutex_unlock(&p->lock);
+            pthread_mutex_lock(&p->run_lock);
+            mp_filter_run(p->root);
+            bool failed = mp_filter_has_failed(p->sub);
+            pthread_mutex_unlock(&p->run_lock);
+            pthread_mutex_lock(&p->lock);
+            if (failed) {
+                p->failed = true;
+                mp_filter_wakeup(f);
+            }
+        } else {
+            pthread_cond_wait(&p->wakeup, &p->lock);
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    return NULL;
+}
+
+static void threaded_process(struct mp_filter *f)
+{
+    struct threaded_priv *p = f->priv;
+
+    pthread_mutex_lock(&p->lock);
+    bool failed = p->failed;
+    p->failed = false;
+    pthread_mutex_unlock(&p->lock);
+
+    if (failed)
+        mp_filter_internal_mark_failed(f);
+}
+
+static void threaded_reset(struct mp_filter *f)
+{
+    struct threaded_priv *p = f->priv;
+
+    // The queue filters on this thread were already reset. Let the worker reset
+    // its filters and drop all queued frames, and wait for it.
+    pthread_mutex_lock(&p->lock);
+    p->need_reset = true;
+    pthread_cond_broadcast(&p->wakeup);
+    while (p->need_reset)
+        pthread_cond_wait(&p->wakeup, &p->lock);
+    p->failed = false;
+    pthread_mutex_unlock(&p->lock);
+}
+
+static bool threaded_command(struct mp_filter *f, struct mp_filter_command *cmd)
+{
+    struct threaded_priv *p = f->priv;
+
+    pthread_mutex_lock(&p->run_lock);
+    bool r = mp_filter_command(p->sub, cmd);
+    pthread_mutex_unlock(&p->run_lock);
+
+    // The command may have changed what the filter outputs.
+    if (r)
+        mp_filter_wakeup(p->sub);
+    return r;
+}
+
+static void threaded_destroy(struct mp_filter *f)
+{
+    struct threaded_priv *p = f->priv;
+
+    if (p->thread_valid) {
+        pthread_mutex_lock(&p->lock);
+        p->terminate = true;
+        pthread_cond_broadcast(&p->wakeup);
+        pthread_mutex_unlock(&p->lock);
+        pthread_join(p->thread, NULL);
+    }
+
+    talloc_free(p->root);
+    // The queue filters on this thread must be gone before the queues.
+    mp_filter_free_children(f);
+    talloc_free(p->in_q);
+    talloc_free(p->out_q);
+
+    pthread_cond_destroy(&p->wakeup);
+    pthread_mutex_destroy(&p->lock);
+    pthread_mutex_destroy(&p->run_lock);
+}
+
+static const struct mp_filter_info threaded_filter = {
+    .name = "threaded",
+    .priv_size = sizeof(struct threaded_priv),
+    .process = threaded_process,
+    .reset = threaded_reset,
+    .command = threaded_command,
+    .destroy = threaded_destroy,
+};
+
+struct mp_filter *mp_threaded_filter_create(struct mp_filter *parent,
+                        int max_frames,
+                        struct mp_filter *(*create)(struct mp_filter *root,
+                                                    void *ctx),
+                        void *ctx)
+{
+    struct mp_filter *f = mp_filter_create(parent, &threaded_filter);
+    if (!f)
+        return NULL;
+
+    struct threaded_priv *p = f->priv;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
+    pthread_mutex_init(&p->run_lock, NULL);
+    p->need_run = true;
+
+    mp_filter_add_pin(f, MP_PIN_IN, "in");
+    mp_filter_add_pin(f, MP_PIN_OUT, "out");
+
+    p->in_q = mp_async_queue_create(NULL, max_frames);
+    p->out_q = mp_async_queue_create(NULL, max_frames);
+
+    // This thread: f.in -> in_q ... out_q -> f.out
+    struct mp_filter *in_w = mp_async_queue_create_filter(f, MP_PIN_IN, p->in_q);
+    struct mp_filter *out_r = mp_async_queue_create_filter(f, MP_PIN_OUT, p->out_q);
+    if (!in_w || !out_r)
+        goto error;
+    mp_pin_connect(in_w->pins[0], f->ppins[0]);
+    mp_pin_connect(f->ppins[1], out_r->pins[0]);
+
+    // Worker thread: in_q -> sub -> out_q
+    p->root = mp_filter_create_root(f->global);
+    p->root->stream_info = mp_filter_find_stream_info(f);
+    mp_filter_root_set_wakeup_cb(p->root, wakeup_thread, p);
+    p->sub = create(p->root, ctx);
+    if (!p->sub)
+        goto error;
+    struct mp_filter *in_r =
+        mp_async_queue_create_filter(p->root, MP_PIN_OUT, p->in_q);
+    struct mp_filter *out_w =
+        mp_async_queue_create_filter(p->root, MP_PIN_IN, p->out_q);
+    if (!in_r || !out_w)
+        goto error;
+    mp_pin_connect(p->sub->pins[0], in_r->pins[0]);
+    mp_pin_connect(out_w->pins[0], p->sub->pins[1]);
+
+    if (pthread_create(&p->thread, NULL, filter_thread, f)) {
+        MP_ERR(f, "could not create filter thread\n");
+        goto error;
+    }
+    p->thread_valid = true;
+
+    return f;
+
+error:
+    talloc_free(f);
+    return NULL;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "filter.h"
+
+// A bounded FIFO of frames, meant for connecting filters which are driven by
+// different threads (i.e. which have different root filters). Frames, including
+// EOF frames, are passed through in order. Passing frames does not take locks;
+// a mutex is used only for waking up the other end when the queue stops being
+// empty or full.
+struct mp_async_queue;
+
+// Create a queue which buffers at most max_frames frames (at least 1).
+// The queue must outlive the filters created with mp_async_queue_create_filter().
+struct mp_async_queue *mp_async_queue_create(void *ta_parent, int max_frames);
+
+// Drop all queued frames. This is not done by mp_filter_reset() on the queue
+// filters, because the two ends of the queue are usually reset in separate
+// threads. The caller has to make sure that neither queue filter is running
+// while this is called (e.g. by resetting from one thread while the other
+// thread is known to be idle), which also guarantees that no frames of the old
+// data flow are written after it.
+void mp_async_queue_reset(struct mp_async_queue *q);
+
+struct mp_async_queue_stats {
+    int num_frames;         // currently queued frames
+    int max_frames;         // maximum number of queued frames
+    int peak_frames;        // highest num_frames since creation or last reset
+    int64_t total_frames;   // number of frames ever added
+    int64_t underruns;      // times the reader wanted data, but found it empty
+    int64_t overruns;       // times the writer found it full
+};
+
+// Explicitly thread-safe. The values are not sampled atomically as a whole.
+void mp_async_queue_get_stats(struct mp_async_queue *q,
+                              struct mp_async_queue_stats *st);
+
+// Create a filter which accesses the queue. With dir==MP_PIN_IN, the filter has
+// a single input pin, and appends all frames from it to the queue. With
+// dir==MP_PIN_OUT, the filter has a single output pin, which returns frames
+// from the queue. There can be at most one filter per direction on a queue.
+// The filters use mp_filter_wakeup() to notify each other's filter graph about
+// queue state changes.
+struct mp_filter *mp_async_queue_create_filter(struct mp_filter *parent,
+                                               enum mp_pin_dir dir,
+                                               struct mp_async_queue *q);
+
+// Run a filter on a separate thread. create() is called with the root filter of
+// a new filter graph, and must return a bidirectional filter (input on pin 0,
+// output on pin 1) created with it as parent, or NULL on failure. It is called
+// on the caller's thread before the worker thread is started, and the filters
+// it created must not be accessed by the caller after that.
+// The returned filter is bidirectional as well, and is connected to the filter
+// on the worker thread with two queues of max_frames frames each, so frames are
+// pipelined across the threads. Resetting it resets the filters on the worker
+// thread too (synchronously). Failures of the wrapped filter are propagated.
+// Commands sent to it are passed to the wrapped filter, serialized with its
+// processing. The worker's graph uses the stream info of the caller's graph.
+// Returns NULL on failure.
+struct mp_filter *mp_threaded_filter_create(struct mp_filter *parent,
+                        int max_frames,
+                        struct mp_filter *(*create)(struct mp_filter *root,
+                                                    void *ctx),
+                        void *ctx);
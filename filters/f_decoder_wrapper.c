@@ -20,6 +20,7 @@
 #include <stdbool.h>
 #include <math.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavutil/buffer.h>
 #include <libavutil/rational.h>
@@ -28,11 +29,14 @@
 #include "options/options.h"
 #include "common/msg.h"
 
+#include "misc/dispatch.h"
+#include "osdep/threads.h"
 #include "osdep/timer.h"
 
 #include "demux/demux.h"
 #include "demux/packet.h"
 
+#include "common/bench.h"
 #include "common/codecs.h"
 #include "common/global.h"
 #include "common/recorder.h"
@@ -43,6 +47,7 @@
 
 #include "demux/stheader.h"
 
+#include "f_async_queue.h"
 #include "f_decoder_wrapper.h"
 #include "f_demux_in.h"
 #include "filter_internal.h"
@@ -53,10 +58,21 @@ struct priv {
     struct MPOpts *opts;
 
     struct sh_stream *header;
+
+    // --- The following fields are accessed by the decoder thread (or by the
+    //     user's thread if there is no decoder thread). Use thread_lock() to
+    //     access them from the user's thread.
+
+    // Filter which drives the decoder. Its parent is dec_root if a decoder
+    // thread is used, f otherwise.
+    struct mp_filter *decf;
+
     struct mp_codec_params *codec;
 
     struct mp_decoder *decoder;
 
+    struct mp_recorder_sink *recorder_sink;
+
     // Demuxer output.
     struct mp_pin *demux;
 
@@ -91,9 +107,50 @@ struct priv {
     struct mp_frame decoded_coverart;
     int coverart_returned; // 0: no, 1: coverart frame itself, 2: EOF returned
 
+    // --- Decoder thread. All of these are unset if it is not used.
+    struct mp_filter *dec_root;     // root filter of the thread's filter graph
+    struct mp_async_queue *queue;   // decoded frames
+    struct mp_dispatch_queue *dec_dispatch;
+    pthread_t dec_thread;
+    bool dec_thread_valid;
+    bool request_terminate_dec_thread; // accessed with thread_lock()
+
+    bool dec_thread_lock; // for debugging
+
+    pthread_mutex_t cache_lock;
+    // --- Protected by cache_lock.
+    char *decoder_desc;
+    bool try_spdif;
+    bool pts_reset;
+    bool dec_failed;        // decf failed on the decoder thread
+    int attempt_framedrops; // try dropping this many frames
+    int dropped_frames;     // total frames _probably_ dropped
+
     struct mp_decoder_wrapper public;
 };
 
+// Get exclusive access to the decoder state, i.e. suspend the decoder thread.
+static void thread_lock(struct priv *p)
+{
+    if (p->dec_dispatch)
+        mp_dispatch_lock(p->dec_dispatch);
+
+    assert(!p->dec_thread_lock);
+    p->dec_thread_lock = true;
+}
+
+static void thread_unlock(struct priv *p)
+{
+    assert(p->dec_thread_lock);
+    p->dec_thread_lock = false;
+
+    if (p->dec_dispatch) {
+        // The caller might have changed state the decoder has to react to.
+        mp_dispatch_interrupt(p->dec_dispatch);
+        mp_dispatch_unlock(p->dec_dispatch);
+    }
+}
+
 static void reset_decoder(struct priv *p)
 {
     p->first_packet_pdts = MP_NOPTS_VALUE;
@@ -103,9 +160,13 @@ static void reset_decoder(struct priv *p)
     p->codec_dts = MP_NOPTS_VALUE;
     p->has_broken_decoded_pts = 0;
     p->last_format = p->fixed_format = (struct mp_image_params){0};
-    p->public.dropped_frames = 0;
-    p->public.attempt_framedrops = 0;
-    p->public.pts_reset = false;
+
+    pthread_mutex_lock(&p->cache_lock);
+    p->dropped_frames = 0;
+    p->attempt_framedrops = 0;
+    p->pts_reset = false;
+    pthread_mutex_unlock(&p->cache_lock);
+
     p->packets_without_output = 0;
     mp_frame_unref(&p->packet);
     talloc_free(p->new_segment);
@@ -117,9 +178,10 @@ static void reset_decoder(struct priv *p)
         mp_filter_reset(p->decoder->f);
 }
 
-static void reset(struct mp_filter *f)
+static void decf_reset(struct mp_filter *f)
 {
     struct priv *p = f->priv;
+    assert(p->decf == f);
 
     reset_decoder(p);
 }
@@ -128,14 +190,19 @@ int mp_decoder_wrapper_control(struct mp_decoder_wrapper *d,
                                enum dec_ctrl cmd, void *arg)
 {
     struct priv *p = d->f->priv;
+    int res = CONTROL_UNKNOWN;
+    thread_lock(p);
     if (p->decoder && p->decoder->control)
-        return p->decoder->control(p->decoder->f, cmd, arg);
-    return CONTROL_UNKNOWN;
+        res = p->decoder->control(p->decoder->f, cmd, arg);
+    thread_unlock(p);
+    return res;
 }
 
-static void destroy(struct mp_filter *f)
+static void decf_destroy(struct mp_filter *f)
 {
     struct priv *p = f->priv;
+    assert(p->decf == f);
+
     if (p->decoder) {
         MP_VERBOSE(f, "Uninit decoder.\n");
         talloc_free(p->decoder->f);
@@ -159,9 +226,8 @@ struct mp_decoder_list *audio_decoder_list(void)
     return list;
 }
 
-bool mp_decoder_wrapper_reinit(struct mp_decoder_wrapper *d)
+static bool reinit_decoder(struct priv *p)
 {
-    struct priv *p = d->f->priv;
     struct MPOpts *opts = p->opts;
 
     if (p->decoder)
@@ -182,7 +248,11 @@ bool mp_decoder_wrapper_reinit(struct mp_decoder_wrapper *d)
         driver = &ad_lavc;
         user_list = opts->audio_decoders;
 
-        if (p->public.try_spdif && p->codec->codec) {
+        pthread_mutex_lock(&p->cache_lock);
+        bool try_spdif = p->try_spdif;
+        pthread_mutex_unlock(&p->cache_lock);
+
+        if (try_spdif && p->codec->codec) {
             struct mp_decoder_list *spdif =
                 select_spdif_codec(p->codec->codec, opts->audio_spdif);
             if (spdif->num_entries) {
@@ -208,11 +278,14 @@ bool mp_decoder_wrapper_reinit(struct mp_decoder_wrapper *d)
         struct mp_decoder_entry *sel = &list->entries[n];
         MP_VERBOSE(p, "Opening decoder %s\n", sel->decoder);
 
-        p->decoder = driver->create(p->f, p->codec, sel->decoder);
+        p->decoder = driver->create(p->decf, p->codec, sel->decoder);
         if (p->decoder) {
-            p->public.decoder_desc =
+            pthread_mutex_lock(&p->cache_lock);
+            talloc_free(p->decoder_desc);
+            p->decoder_desc =
                 talloc_asprintf(p, "%s (%s)", sel->decoder, sel->desc);
-            MP_VERBOSE(p, "Selected codec: %s\n", p->public.decoder_desc);
+            MP_VERBOSE(p, "Selected codec: %s\n", p->decoder_desc);
+            pthread_mutex_unlock(&p->cache_lock);
             break;
         }
 
@@ -228,6 +301,77 @@ bool mp_decoder_wrapper_reinit(struct mp_decoder_wrapper *d)
     return !!p->decoder;
 }
 
+bool mp_decoder_wrapper_reinit(struct mp_decoder_wrapper *d)
+{
+    struct priv *p = d->f->priv;
+    thread_lock(p);
+    bool res = reinit_decoder(p);
+    thread_unlock(p);
+    return res;
+}
+
+void mp_decoder_wrapper_get_desc(struct mp_decoder_wrapper *d,
+                                 char *buf, size_t buf_size)
+{
+    struct priv *p = d->f->priv;
+    pthread_mutex_lock(&p->cache_lock);
+    snprintf(buf, buf_size, "%s", p->decoder_desc ? p->decoder_desc : "");
+    pthread_mutex_unlock(&p->cache_lock);
+}
+
+void mp_decoder_wrapper_set_spdif_flag(struct mp_decoder_wrapper *d, bool spdif)
+{
+    struct priv *p = d->f->priv;
+    pthread_mutex_lock(&p->cache_lock);
+    p->try_spdif = spdif;
+    pthread_mutex_unlock(&p->cache_lock);
+}
+
+void mp_decoder_wrapper_set_frame_drops(struct mp_decoder_wrapper *d, int num)
+{
+    struct priv *p = d->f->priv;
+    pthread_mutex_lock(&p->cache_lock);
+    p->attempt_framedrops = num;
+    pthread_mutex_unlock(&p->cache_lock);
+}
+
+int mp_decoder_wrapper_get_frames_dropped(struct mp_decoder_wrapper *d)
+{
+    struct priv *p = d->f->priv;
+    pthread_mutex_lock(&p->cache_lock);
+    int res = p->dropped_frames;
+    pthread_mutex_unlock(&p->cache_lock);
+    return res;
+}
+
+bool mp_decoder_wrapper_get_pts_reset(struct mp_decoder_wrapper *d)
+{
+    struct priv *p = d->f->priv;
+    pthread_mutex_lock(&p->cache_lock);
+    bool res = p->pts_reset;
+    pthread_mutex_unlock(&p->cache_lock);
+    return res;
+}
+
+void mp_decoder_wrapper_set_recorder_sink(struct mp_decoder_wrapper *d,
+                                          struct mp_recorder_sink *sink)
+{
+    struct priv *p = d->f->priv;
+    thread_lock(p);
+    p->recorder_sink = sink;
+    thread_unlock(p);
+}
+
+bool mp_decoder_wrapper_get_queue_stats(struct mp_decoder_wrapper *d,
+                                        struct mp_async_queue_stats *st)
+{
+    struct priv *p = d->f->priv;
+    if (!p->queue)
+        return false;
+    mp_async_queue_get_stats(p->queue, st);
+    return true;
+}
+
 static bool is_valid_peak(float sig_peak)
 {
     return !sig_peak || (sig_peak >= 1 && sig_peak <= 100);
@@ -386,14 +530,18 @@ static void process_video_frame(struct priv *p, struct mp_image *mpi)
 void mp_decoder_wrapper_reset_params(struct mp_decoder_wrapper *d)
 {
     struct priv *p = d->f->priv;
+    thread_lock(p);
     p->last_format = (struct mp_image_params){0};
+    thread_unlock(p);
 }
 
 void mp_decoder_wrapper_get_video_dec_params(struct mp_decoder_wrapper *d,
                                              struct mp_image_params *m)
 {
     struct priv *p = d->f->priv;
+    thread_lock(p);
     *m = p->dec_format;
+    thread_unlock(p);
 }
 
 static void process_audio_frame(struct priv *p, struct mp_aframe *aframe)
@@ -410,8 +558,11 @@ static void process_audio_frame(struct priv *p, struct mp_aframe *aframe)
         // than enough.
         if (p->pts != MP_NOPTS_VALUE && diff > 0.1) {
             MP_WARN(p, "Invalid audio PTS: %f -> %f\n", p->pts, frame_pts);
-            if (diff >= 5)
-                p->public.pts_reset = true;
+            if (diff >= 5) {
+                pthread_mutex_lock(&p->cache_lock);
+                p->pts_reset = true;
+                pthread_mutex_unlock(&p->cache_lock);
+            }
         }
 
         // Keep the interpolated timestamp if it doesn't deviate more
@@ -434,7 +585,9 @@ static void process_audio_frame(struct priv *p, struct mp_aframe *aframe)
 void mp_decoder_wrapper_set_start_pts(struct mp_decoder_wrapper *d, double pts)
 {
     struct priv *p = d->f->priv;
+    thread_lock(p);
     p->start_pts = pts;
+    thread_unlock(p);
 }
 
 static bool is_new_segment(struct priv *p, struct mp_frame frame)
@@ -458,7 +611,7 @@ static void feed_packet(struct priv *p)
         if (p->packet.type != MP_FRAME_EOF && p->packet.type != MP_FRAME_PACKET) {
             MP_ERR(p, "invalid frame type from demuxer\n");
             mp_frame_unref(&p->packet);
-            mp_filter_internal_mark_failed(p->f);
+            mp_filter_internal_mark_failed(p->decf);
             return;
         }
     }
@@ -482,8 +635,10 @@ static void feed_packet(struct priv *p)
 
         int framedrop_type = 0;
 
-        if (p->public.attempt_framedrops)
+        pthread_mutex_lock(&p->cache_lock);
+        if (p->attempt_framedrops)
             framedrop_type = 1;
+        pthread_mutex_unlock(&p->cache_lock);
 
         if (start_pts != MP_NOPTS_VALUE && packet &&
             packet->pts < start_pts - .005 && !p->has_broken_packet_pts)
@@ -492,8 +647,8 @@ static void feed_packet(struct priv *p)
         p->decoder->control(p->decoder->f, VDCTRL_SET_FRAMEDROP, &framedrop_type);
     }
 
-    if (p->public.recorder_sink)
-        mp_recorder_feed_packet(p->public.recorder_sink, packet);
+    if (p->recorder_sink)
+        mp_recorder_feed_packet(p->recorder_sink, packet);
 
     double pkt_pts = packet ? packet->pts : MP_NOPTS_VALUE;
     double pkt_dts = packet ? packet->dts : MP_NOPTS_VALUE;
@@ -557,7 +712,7 @@ static bool process_decoded_frame(struct priv *p, struct mp_frame *frame)
 
 static void read_frame(struct priv *p)
 {
-    struct mp_pin *pin = p->f->ppins[0];
+    struct mp_pin *pin = p->decf->ppins[0];
 
     if (!p->decoder || !mp_pin_in_needs_data(pin))
         return;
@@ -577,12 +732,13 @@ static void read_frame(struct priv *p)
     if (!frame.type)
         return;
 
-    if (p->public.attempt_framedrops) {
+    pthread_mutex_lock(&p->cache_lock);
+    if (p->attempt_framedrops) {
         int dropped = MPMAX(0, p->packets_without_output - 1);
-        p->public.attempt_framedrops =
-            MPMAX(0, p->public.attempt_framedrops - dropped);
-        p->public.dropped_frames += dropped;
+        p->attempt_framedrops = MPMAX(0, p->attempt_framedrops - dropped);
+        p->dropped_frames += dropped;
     }
+    pthread_mutex_unlock(&p->cache_lock);
     p->packets_without_output = 0;
 
     bool segment_ended = process_decoded_frame(p, &frame);
@@ -596,19 +752,19 @@ static void read_frame(struct priv *p)
 
         if (p->codec != new_segment->codec) {
             p->codec = new_segment->codec;
-            if (!mp_decoder_wrapper_reinit(&p->public))
-                mp_filter_internal_mark_failed(p->f);
+            if (!reinit_decoder(p))
+                mp_filter_internal_mark_failed(p->decf);
         }
 
         p->start = new_segment->start;
         p->end = new_segment->end;
 
         p->packet = MAKE_FRAME(MP_FRAME_PACKET, new_segment);
-        mp_filter_internal_mark_progress(p->f);
+        mp_filter_internal_mark_progress(p->decf);
     }
 
     if (!frame.type) {
-        mp_filter_internal_mark_progress(p->f); // make it retry
+        mp_filter_internal_mark_progress(p->decf); // make it retry
         return;
     }
 
@@ -620,20 +776,114 @@ static void read_frame(struct priv *p)
     mp_pin_in_write(pin, frame);
 }
 
-static void process(struct mp_filter *f)
+static void decf_process(struct mp_filter *f)
 {
     struct priv *p = f->priv;
+    assert(p->decf == f);
 
     feed_packet(p);
     read_frame(p);
 }
 
+static const struct mp_filter_info decf_filter = {
+    .name = "decode_f",
+    .process = decf_process,
+    .reset = decf_reset,
+    .destroy = decf_destroy,
+};
+
+static void *dec_thread(void *ptr)
+{
+    struct priv *p = ptr;
+
+    mpthread_set_name(p->header->type == STREAM_VIDEO ? "vdec" : "adec");
+
+    while (!p->request_terminate_dec_thread) {
+        mp_filter_run(p->dec_root);
+
+        // decf has no parent on this thread which could handle errors.
+        if (mp_filter_has_failed(p->decf)) {
+            pthread_mutex_lock(&p->cache_lock);
+            p->dec_failed = true;
+            pthread_mutex_unlock(&p->cache_lock);
+            mp_filter_wakeup(p->f);
+        }
+
+        mp_dispatch_queue_process(p->dec_dispatch, INFINITY);
+    }
+
+    return NULL;
+}
+
+static void wakeup_dec_thread(void *ptr)
+{
+    struct priv *p = ptr;
+
+    mp_dispatch_interrupt(p->dec_dispatch);
+}
+
+static void public_f_process(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+
+    pthread_mutex_lock(&p->cache_lock);
+    bool failed = p->dec_failed;
+    p->dec_failed = false;
+    pthread_mutex_unlock(&p->cache_lock);
+
+    if (failed)
+        mp_filter_internal_mark_failed(f);
+}
+
+static void public_f_reset(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+    assert(p->public.f == f);
+
+    // Without a decoder thread, decf is a child filter, and was reset already.
+    // Otherwise the queue reader on this thread was reset, and the rest is
+    // done with the decoder thread suspended, so that no frames from before
+    // the reset can end up in the queue.
+    if (p->queue) {
+        thread_lock(p);
+        mp_filter_reset(p->dec_root);
+        mp_async_queue_reset(p->queue);
+        pthread_mutex_lock(&p->cache_lock);
+        p->dec_failed = false;
+        pthread_mutex_unlock(&p->cache_lock);
+        thread_unlock(p);
+    }
+}
+
+static void public_f_destroy(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+    assert(p->public.f == f);
+
+    if (p->dec_thread_valid) {
+        thread_lock(p);
+        p->request_terminate_dec_thread = true;
+        thread_unlock(p);
+        pthread_join(p->dec_thread, NULL);
+        p->dec_thread_valid = false;
+    }
+
+    talloc_free(p->decf);
+    p->decf = NULL;
+    talloc_free(p->dec_root);
+    p->dec_root = NULL;
+    talloc_free(p->dec_dispatch);
+    p->dec_dispatch = NULL;
+
+    pthread_mutex_destroy(&p->cache_lock);
+}
+
 static const struct mp_filter_info decode_wrapper_filter = {
     .name = "decode",
     .priv_size = sizeof(struct priv),
-    .process = process,
-    .reset = reset,
-    .destroy = destroy,
+    .process = public_f_process,
+    .reset = public_f_reset,
+    .destroy = public_f_destroy,
 };
 
 struct mp_decoder_wrapper *mp_decoder_wrapper_create(struct mp_filter *parent,
@@ -645,6 +895,7 @@ struct mp_decoder_wrapper *mp_decoder_wrapper_create(struct mp_filter *parent,
 
     struct priv *p = f->priv;
     struct mp_decoder_wrapper *w = &p->public;
+    pthread_mutex_init(&p->cache_lock, NULL);
     p->opts = f->global->opts;
     p->log = f->log;
     p->f = f;
@@ -654,6 +905,9 @@ struct mp_decoder_wrapper *mp_decoder_wrapper_create(struct mp_filter *parent,
 
     mp_filter_add_pin(f, MP_PIN_OUT, "out");
 
+    bool use_thread = false;
+    int queue_frames = 0;
+
     if (p->header->type == STREAM_VIDEO) {
         p->log = f->log = mp_log_new(f, parent->log, "!vd");
 
@@ -666,15 +920,60 @@ struct mp_decoder_wrapper *mp_decoder_wrapper_create(struct mp_filter *parent,
             MP_INFO(p, "FPS forced to %5.3f.\n", p->public.fps);
             MP_INFO(p, "Use --no-correct-pts to force FPS based timing.\n");
         }
+
+        use_thread = p->opts->vd_queue_enable;
+        queue_frames = p->opts->vd_queue_max_frames;
     } else if (p->header->type == STREAM_AUDIO) {
         p->log = f->log = mp_log_new(f, parent->log, "!ad");
+
+        use_thread = p->opts->ad_queue_enable;
+        queue_frames = p->opts->ad_queue_max_frames;
+    }
+
+    struct mp_filter *decf_parent = f;
+    if (use_thread) {
+        p->dec_dispatch = mp_dispatch_create(NULL);
+        p->dec_root = mp_filter_create_root(f->global);
+        // The decoder needs the hwdec and DR interfaces of the user's graph.
+        p->dec_root->stream_info = mp_filter_find_stream_info(f);
+        mp_filter_root_set_wakeup_cb(p->dec_root, wakeup_dec_thread, p);
+        decf_parent = p->dec_root;
     }
 
-    struct mp_filter *demux = mp_demux_in_create(f, p->header);
+    p->decf = mp_filter_create(decf_parent, &decf_filter);
+    if (!p->decf)
+        goto error;
+    p->decf->priv = p;
+    p->decf->log = p->log;
+    mp_filter_add_pin(p->decf, MP_PIN_OUT, "out");
+
+    struct mp_filter *demux = mp_demux_in_create(p->decf, p->header);
     if (!demux)
         goto error;
     p->demux = demux->pins[0];
 
+    if (use_thread) {
+        p->queue = mp_async_queue_create(f, queue_frames);
+        struct mp_filter *q_in =
+            mp_async_queue_create_filter(p->dec_root, MP_PIN_IN, p->queue);
+        struct mp_filter *q_out =
+            mp_async_queue_create_filter(f, MP_PIN_OUT, p->queue);
+        if (!q_in || !q_out)
+            goto error;
+        mp_pin_connect(q_in->pins[0], p->decf->pins[0]);
+        mp_pin_connect(f->ppins[0], q_out->pins[0]);
+
+        if (pthread_create(&p->dec_thread, NULL, dec_thread, p)) {
+            MP_ERR(p, "Could not create decoder thread.\n");
+            goto error;
+        }
+        p->dec_thread_valid = true;
+        MP_VERBOSE(p, "Using decoder thread with a %d frames queue.\n",
+                   queue_frames);
+    } else {
+        mp_pin_connect(f->ppins[0], p->decf->pins[0]);
+    }
+
     return w;
 error:
     talloc_free(f);
@@ -688,6 +987,8 @@ void lavc_process(struct mp_filter *f, bool *eof_flag,
     if (!mp_pin_in_needs_data(f->ppins[1]))
         return;
 
+    int64_t bench_start = mp_bench_start(f->global);
+
     struct mp_frame frame = {0};
     if (!receive(f, &frame)) {
         if (!*eof_flag)
@@ -695,6 +996,8 @@ void lavc_process(struct mp_filter *f, bool *eof_flag,
         *eof_flag = true;
     } else if (frame.type) {
         *eof_flag = false;
+        mp_bench_add(f->global, frame.type == MP_FRAME_VIDEO ?
+                     MP_BENCH_VIDEO_FRAMES : MP_BENCH_AUDIO_FRAMES, 1);
         mp_pin_in_write(f->ppins[1], frame);
     } else {
         // Need to feed a packet.
@@ -708,16 +1011,19 @@ void lavc_process(struct mp_filter *f, bool *eof_flag,
                 mp_frame_unref(&frame);
                 mp_filter_internal_mark_failed(f);
             }
-            return;
+            goto done;
         }
         if (!send(f, pkt)) {
             // Should never happen, but can happen with broken decoders.
             MP_WARN(f, "could not consume packet\n");
             mp_pin_out_unread(f->ppins[0], frame);
             mp_filter_wakeup(f);
-            return;
+            goto done;
         }
         talloc_free(pkt);
         mp_filter_internal_mark_progress(f);
     }
+
+done:
+    mp_bench_end(f->global, MP_BENCH_DECODE, bench_start);
 }
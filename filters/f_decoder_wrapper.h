@@ -18,6 +18,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #include "filter.h"
 
@@ -26,42 +27,60 @@ struct mp_codec_params;
 struct mp_image_params;
 struct mp_decoder_list;
 struct demux_packet;
+struct mp_recorder_sink;
+struct mp_async_queue_stats;
 
 // (free with talloc_free(mp_decoder_wrapper.f)
 struct mp_decoder_wrapper {
     // Filter with no input and 1 output, which returns the decoded data.
     struct mp_filter *f;
 
-    // For informational purposes.
-    char *decoder_desc;
-
-    // Can be set by user.
-    struct mp_recorder_sink *recorder_sink;
-
     // --- for STREAM_VIDEO
 
     // FPS from demuxer or from user override
     float fps;
-
-    // Framedrop control for playback (not used for hr seek etc.)
-    int attempt_framedrops; // try dropping this many frames
-    int dropped_frames; // total frames _probably_ dropped
-
-    // --- for STREAM_AUDIO
-
-    // Prefer spdif wrapper over real decoders.
-    bool try_spdif;
-
-    // A pts reset was observed (audio only, heuristic).
-    bool pts_reset;
 };
 
 // Create the decoder wrapper for the given stream, plus underlying decoder.
 // The src stream must be selected, and remain valid and selected until the
 // wrapper is destroyed.
+// If enabled with --vd-queue-enable/--ad-queue-enable, the decoder runs on its
+// own thread, and decoded frames are passed through a queue. The functions
+// below can be called from the user's thread in either case.
 struct mp_decoder_wrapper *mp_decoder_wrapper_create(struct mp_filter *parent,
                                                      struct sh_stream *src);
 
+// For informational purposes.
+void mp_decoder_wrapper_get_desc(struct mp_decoder_wrapper *d,
+                                 char *buf, size_t buf_size);
+
+// Set the recorder sink packets are fed to (NULL to stop).
+void mp_decoder_wrapper_set_recorder_sink(struct mp_decoder_wrapper *d,
+                                          struct mp_recorder_sink *sink);
+
+// Queue statistics. Returns false (and leaves *st untouched) if there is no
+// decoder thread.
+bool mp_decoder_wrapper_get_queue_stats(struct mp_decoder_wrapper *d,
+                                        struct mp_async_queue_stats *st);
+
+// --- for STREAM_VIDEO
+
+// Framedrop control for playback (not used for hr seek etc.): try dropping
+// this many frames.
+void mp_decoder_wrapper_set_frame_drops(struct mp_decoder_wrapper *d, int num);
+
+// Total frames _probably_ dropped.
+int mp_decoder_wrapper_get_frames_dropped(struct mp_decoder_wrapper *d);
+
+// --- for STREAM_AUDIO
+
+// Prefer spdif wrapper over real decoders. Takes effect on the next
+// mp_decoder_wrapper_reinit().
+void mp_decoder_wrapper_set_spdif_flag(struct mp_decoder_wrapper *d, bool spdif);
+
+// A pts reset was observed (heuristic).
+bool mp_decoder_wrapper_get_pts_reset(struct mp_decoder_wrapper *d);
+
 struct mp_decoder_list *video_decoder_list(void);
 struct mp_decoder_list *audio_decoder_list(void);
 
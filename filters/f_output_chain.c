@@ -3,10 +3,12 @@
 #include "common/global.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
+#include "options/options.h"
 #include "video/out/vo.h"
 
 #include "filter_internal.h"
 
+#include "f_async_queue.h"
 #include "f_autoconvert.h"
 #include "f_auto_filters.h"
 #include "f_lavfi.h"
@@ -531,11 +533,44 @@ static bool compare_filter(struct m_obj_settings *a, struct m_obj_settings *b)
     return true;
 }
 
+struct user_filter_args {
+    enum mp_output_chain_type type;
+    struct m_obj_settings *entry;
+};
+
+static struct mp_filter *create_user_filter_cb(struct mp_filter *root,
+                                               void *ctx)
+{
+    struct user_filter_args *a = ctx;
+    return mp_create_user_filter(root, a->type, a->entry->name,
+                                 a->entry->attribs);
+}
+
+// Create the user filter, on its own thread if --vf-thread-queue is set.
+static struct mp_filter *create_user_filter(struct chain *p,
+                                            struct mp_user_filter *u,
+                                            struct m_obj_settings *entry,
+                                            int thread_queue)
+{
+    if (!thread_queue || p->type != MP_OUTPUT_CHAIN_VIDEO)
+        return mp_create_user_filter(u->wrapper, p->type, entry->name,
+                                     entry->attribs);
+
+    struct user_filter_args a = {p->type, entry};
+    return mp_threaded_filter_create(u->wrapper, thread_queue,
+                                     create_user_filter_cb, &a);
+}
+
 bool mp_output_chain_update_filters(struct mp_output_chain *c,
                                     struct m_obj_settings *list)
 {
     struct chain *p = c->f->priv;
 
+    struct filter_opts *opts =
+        mp_get_config_group(NULL, p->f->global, &filter_conf);
+    int thread_queue = opts->vf_thread_queue;
+    talloc_free(opts);
+
     struct mp_user_filter **add = NULL;      // new filters
     int num_add = 0;
     struct mp_user_filter **res = NULL;      // new final list
@@ -562,8 +597,7 @@ bool mp_output_chain_update_filters(struct mp_output_chain *c,
             u = create_wrapper_filter(p);
             u->name = talloc_strdup(u, entry->name);
             u->label = talloc_strdup(u, entry->label);
-            u->f = mp_create_user_filter(u->wrapper, p->type, entry->name,
-                                         entry->attribs);
+            u->f = create_user_filter(p, u, entry, thread_queue);
             if (!u->f) {
                 talloc_free(u->wrapper);
                 goto error;
@@ -1,8 +1,10 @@
 #include <pthread.h>
+#include <time.h>
 
 #include "common/common.h"
 #include "common/global.h"
 #include "common/msg.h"
+#include "common/trace.h"
 #include "video/hwdec.h"
 
 #include "filter.h"
@@ -105,8 +107,25 @@ struct mp_filter_internal {
     bool pending;
     bool async_pending;
     bool failed;
+
+    // Accumulated thread CPU time spent in process() (in nanoseconds), and the
+    // number of process() calls. The CPU time is only collected while tracing
+    // or benchmarking, because reading the thread CPU clock is a syscall.
+    int64_t cpu_time;
+    int64_t process_calls;
 };
 
+// CPU time used by the calling thread in nanoseconds, or 0 if unsupported.
+static int64_t get_thread_cpu_time(void)
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        return ts.tv_sec * INT64_C(1000000000) + ts.tv_nsec;
+#endif
+    return 0;
+}
+
 
 // Called when new work needs to be done on a pin belonging to the filter:
 //  - new data was requested
@@ -183,6 +202,9 @@ bool mp_filter_run(struct mp_filter *filter)
 
     r->filtering = true;
 
+    int64_t trace_run = mp_trace_begin(r->global);
+    bool sample_cpu = trace_run || r->global->bench; // see cpu_time
+
     flush_async_notifications(r);
 
     while (r->num_pending) {
@@ -190,10 +212,19 @@ bool mp_filter_run(struct mp_filter *filter)
         r->num_pending -= 1;
         next->in->pending = false;
 
-        if (next->in->info->process)
+        if (next->in->info->process) {
+            int64_t trace_start = mp_trace_begin(r->global);
+            int64_t cpu_start = sample_cpu ? get_thread_cpu_time() : 0;
             next->in->info->process(next);
+            if (sample_cpu)
+                next->in->cpu_time += get_thread_cpu_time() - cpu_start;
+            next->in->process_calls += 1;
+            mp_trace_end(r->global, next->in->info->name, trace_start);
+        }
     }
 
+    mp_trace_end(r->global, "filter-run", trace_run);
+
     r->filtering = false;
 
     bool externals = r->external_pending;
@@ -787,8 +818,9 @@ static void dump_pin_state(struct mp_filter *f, struct mp_pin *pin)
 
 void mp_filter_dump_states(struct mp_filter *f)
 {
-    MP_WARN(f, "%s[%p] (%s[%p])\n", filt_name(f), f,
-            filt_name(f->in->parent), f->in->parent);
+    MP_WARN(f, "%s[%p] (%s[%p]) cpu=%.3fms calls=%"PRId64"\n", filt_name(f), f,
+            filt_name(f->in->parent), f->in->parent,
+            f->in->cpu_time / 1e6, f->in->process_calls);
     for (int n = 0; n < f->num_pins; n++) {
         dump_pin_state(f, f->pins[n]);
         dump_pin_state(f, f->ppins[n]);
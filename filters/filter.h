@@ -428,5 +428,6 @@ struct mp_filter *mp_filter_create_root(struct mpv_global *global);
 void mp_filter_root_set_wakeup_cb(struct mp_filter *root,
                                   void (*wakeup_cb)(void *ctx), void *ctx);
 
-// Debugging internal stuff.
+// Debugging internal stuff. This also logs the thread CPU time each filter has
+// spent in its process() function so far.
 void mp_filter_dump_states(struct mp_filter *f);
@@ -228,4 +228,22 @@ char *mp_json_encode_event(struct mpv_event *event);
 struct mpv_handle;
 char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf);
 
+enum mp_ipc_protocol {
+    MP_IPC_JSON,        // newline-separated JSON or text commands
+    MP_IPC_MSGPACK,     // MessagePack messages, prefixed with 32 bit BE size
+};
+
+// Serialize the event as complete message in the given protocol.
+bstr mp_ipc_encode_event(void *ta_parent, struct mpv_event *event,
+                         enum mp_ipc_protocol protocol);
+
+// Like mp_ipc_consume_next_command(), but for any protocol. Returns 1 if a
+// message was consumed (with *reply set to the reply, possibly empty), 0 if
+// buf contains no complete message, and -1 on unrecoverable framing errors.
+// The "ipc_protocol" command changes *protocol; its reply is still sent in
+// the previous protocol.
+int mp_ipc_consume_next_message(struct mpv_handle *client, void *ctx,
+                                bstr *buf, enum mp_ipc_protocol *protocol,
+                                bstr *reply);
+
 #endif /* MPLAYER_INPUT_H */
@@ -15,8 +15,19 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+// All IPC clients (JSON socket clients and the --input-file client) are served
+// by a single thread. It waits on the listening socket, on every client's
+// socket, and on every client's wakeup pipe (which signals new mpv events),
+// using epoll where available. Client sockets are non-blocking: input is read
+// into a per-client buffer, and output (command replies and events) is queued
+// and written with writev() when the socket is writable. File descriptors the
+// server did not open itself (stdin, fd://) are left blocking, because the flag
+// would also affect other processes sharing them. For those, every read and
+// write is preceded by a poll() with zero timeout.
+
 #include <pthread.h>
 #include <errno.h>
+#include <limits.h>
 #include <unistd.h>
 
 #include <poll.h>
@@ -24,8 +35,16 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#define USE_EPOLL 1
+#else
+#define USE_EPOLL 0
+#endif
+
 #include "config.h"
 
 #include "osdep/io.h"
@@ -40,9 +59,32 @@
 #include "options/path.h"
 #include "player/client.h"
 
-#ifndef MSG_NOSIGNAL
-#define MSG_NOSIGNAL 0
-#endif
+// If more than this many bytes of output are queued for a client, stop
+// reading commands from it until the queue has been written.
+#define OUTPUT_SOFT_LIMIT (1 * 1024 * 1024)
+// If more than this is queued (by events alone), disconnect the client.
+#define OUTPUT_HARD_LIMIT (16 * 1024 * 1024)
+// Maximum number of commands run for a client before serving other clients.
+#define MAX_COMMANDS_PER_ROUND 16
+#define READ_CHUNK 4096
+#define MAX_IOV 64
+#define MAX_READY 64
+
+enum watch_type {
+    WATCH_DEATH,        // death pipe (exit loop)
+    WATCH_LISTEN,       // listening socket (accept clients)
+    WATCH_CLIENT,       // client_fd
+    WATCH_WAKEUP,       // client's mpv wakeup pipe
+};
+
+struct watch {
+    enum watch_type type;
+    struct client *client;
+    int fd;
+    int events;         // POLLIN/POLLOUT currently registered, -1 if none
+    bool always_ready;  // fd can't be polled (regular file)
+    int poll_index;     // index into mp_ipc_ctx.poll_fds (if !USE_EPOLL)
+};
 
 struct mp_ipc_ctx {
     struct mp_log *log;
@@ -51,170 +93,386 @@ struct mp_ipc_ctx {
 
     pthread_t thread;
     int death_pipe[2];
+    int listen_fd;
+    int client_num;
+
+    struct watch death_watch;
+    struct watch listen_watch;
+
+    struct client **clients;
+    int num_clients;
+
+#if USE_EPOLL
+    int epoll_fd;
+#else
+    struct pollfd *poll_fds;
+    struct watch **poll_watches;
+    int num_poll_fds;
+#endif
 };
 
-struct client_arg {
+struct out_buf {
+    char *data;
+    size_t len;
+};
+
+struct client {
     struct mp_log *log;
     struct mpv_handle *client;
 
     char *client_name;
     int client_fd;
     bool close_client_fd;
+    bool nonblocking;   // O_NONBLOCK was set on client_fd
 
     bool writable;
+    bool dead;          // close at the end of the current loop iteration
+    bool eof;           // no more input; close once input and output are done
+    enum mp_ipc_protocol protocol;
+
+    struct watch sock_watch;
+    struct watch wakeup_watch;
+
+    bstr input;         // unprocessed input
+    bool have_commands; // input might contain complete lines
+
+    // Queued output, starting at out[out_first] + out_pos.
+    struct out_buf *out;
+    int num_out;
+    int out_first;
+    size_t out_pos;
+    size_t out_bytes;   // total bytes not written yet
 };
 
-static int ipc_write_str(struct client_arg *client, const char *buf)
+static void watch_init(struct watch *w, enum watch_type type,
+                       struct client *client, int fd)
 {
-    size_t count = strlen(buf);
-    while (count > 0) {
-        ssize_t rc = send(client->client_fd, buf, count, MSG_NOSIGNAL);
-        if (rc <= 0) {
-            if (rc == 0)
-                return -1;
+    *w = (struct watch){
+        .type = type,
+        .client = client,
+        .fd = fd,
+        .events = -1,
+        .poll_index = -1,
+    };
+}
 
-            if (errno == EBADF) {
-                client->writable = false;
-                return 0;
-            }
+static bool poller_init(struct mp_ipc_ctx *ctx)
+{
+#if USE_EPOLL
+    ctx->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    return ctx->epoll_fd >= 0;
+#else
+    return true;
+#endif
+}
 
-            if (errno == EINTR || errno == EAGAIN)
-                continue;
+static void poller_uninit(struct mp_ipc_ctx *ctx)
+{
+#if USE_EPOLL
+    if (ctx->epoll_fd >= 0)
+        close(ctx->epoll_fd);
+#endif
+}
 
-            return rc;
+// Register w with the given events (POLLIN/POLLOUT flags), or change its
+// registered events. Errors (POLLHUP/POLLERR) are always reported.
+static void poller_set(struct mp_ipc_ctx *ctx, struct watch *w, int events)
+{
+    if (w->events == events || w->always_ready)
+        return;
+#if USE_EPOLL
+    struct epoll_event ev = {
+        .events = ((events & POLLIN) ? EPOLLIN : 0) |
+                  ((events & POLLOUT) ? EPOLLOUT : 0),
+        .data.ptr = w,
+    };
+    int op = w->events < 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+    if (epoll_ctl(ctx->epoll_fd, op, w->fd, &ev) < 0) {
+        // epoll does not support regular files. They are always readable.
+        if (errno == EPERM) {
+            w->always_ready = true;
+        } else {
+            MP_ERR(ctx, "epoll_ctl failed (%s)\n", mp_strerror(errno));
         }
-
-        count -= rc;
-        buf   += rc;
+        return;
     }
-
-    return 0;
+#else
+    if (w->poll_index < 0) {
+        w->poll_index = ctx->num_poll_fds;
+        MP_TARRAY_APPEND(ctx, ctx->poll_watches, ctx->num_poll_fds, w);
+        MP_TARRAY_GROW(ctx, ctx->poll_fds, w->poll_index);
+    }
+    ctx->poll_fds[w->poll_index] = (struct pollfd){
+        .fd = w->fd,
+        .events = events,
+    };
+#endif
+    w->events = events;
 }
 
-static void *client_thread(void *p)
+static void poller_remove(struct mp_ipc_ctx *ctx, struct watch *w)
 {
-    pthread_detach(pthread_self());
-
-    // We don't use MSG_NOSIGNAL because the moldy fruit OS doesn't support it.
-    struct sigaction sa = { .sa_handler = SIG_IGN, .sa_flags = SA_RESTART };
-    sigfillset(&sa.sa_mask);
-    sigaction(SIGPIPE, &sa, NULL);
-
-    int rc;
-
-    struct client_arg *arg = p;
-    bstr client_msg = { talloc_strdup(NULL, ""), 0 };
-
-    mpthread_set_name(arg->client_name);
+    if (w->events < 0)
+        return;
+#if USE_EPOLL
+    epoll_ctl(ctx->epoll_fd, EPOLL_CTL_DEL, w->fd, NULL);
+#else
+    int last = ctx->num_poll_fds - 1;
+    ctx->poll_fds[w->poll_index] = ctx->poll_fds[last];
+    ctx->poll_watches[w->poll_index] = ctx->poll_watches[last];
+    ctx->poll_watches[w->poll_index]->poll_index = w->poll_index;
+    ctx->num_poll_fds--;
+    w->poll_index = -1;
+#endif
+    w->events = -1;
+}
 
-    int pipe_fd = mpv_get_wakeup_pipe(arg->client);
-    if (pipe_fd < 0) {
-        MP_ERR(arg, "Could not get wakeup pipe\n");
-        goto done;
+// Wait until a registered fd becomes ready. Returns the number of entries
+// written to ready[] and ready_events[] (POLL* flags).
+static int poller_wait(struct mp_ipc_ctx *ctx, struct watch **ready,
+                       int *ready_events, int timeout)
+{
+#if USE_EPOLL
+    struct epoll_event evs[MAX_READY];
+    int num = epoll_wait(ctx->epoll_fd, evs, MAX_READY, timeout);
+    for (int n = 0; n < num; n++) {
+        ready[n] = evs[n].data.ptr;
+        ready_events[n] = ((evs[n].events & EPOLLIN) ? POLLIN : 0) |
+                          ((evs[n].events & EPOLLOUT) ? POLLOUT : 0) |
+                          ((evs[n].events & EPOLLHUP) ? POLLHUP : 0) |
+                          ((evs[n].events & EPOLLERR) ? POLLERR : 0);
     }
+    return num;
+#else
+    int rc = poll(ctx->poll_fds, ctx->num_poll_fds, timeout);
+    int num = 0;
+    for (int n = 0; rc > 0 && n < ctx->num_poll_fds && num < MAX_READY; n++) {
+        if (ctx->poll_fds[n].revents) {
+            ready[num] = ctx->poll_watches[n];
+            ready_events[num] = ctx->poll_fds[n].revents;
+            num++;
+        }
+    }
+    return rc < 0 ? rc : num;
+#endif
+}
 
-    MP_VERBOSE(arg, "Client connected\n");
+// msg.start must be a talloc allocation, which is taken over.
+static void queue_output(struct client *client, bstr msg)
+{
+    if (!client->writable || !msg.len) {
+        talloc_free(msg.start);
+        return;
+    }
+    struct out_buf buf = {talloc_steal(client, msg.start), msg.len};
+    MP_TARRAY_APPEND(client, client->out, client->num_out, buf);
+    client->out_bytes += msg.len;
+    if (client->out_bytes > OUTPUT_HARD_LIMIT) {
+        MP_ERR(client, "Client is not reading its output, disconnecting.\n");
+        client->dead = true;
+    }
+}
 
-    struct pollfd fds[2] = {
-        {.events = POLLIN, .fd = pipe_fd},
-        {.events = POLLIN, .fd = arg->client_fd},
-    };
+static void drop_output(struct client *client)
+{
+    for (int n = client->out_first; n < client->num_out; n++)
+        talloc_free(client->out[n].data);
+    client->num_out = client->out_first = 0;
+    client->out_pos = client->out_bytes = 0;
+}
 
-    fcntl(arg->client_fd, F_SETFL, fcntl(arg->client_fd, F_GETFL, 0) | O_NONBLOCK);
+// Whether a read or write (as given by events) on a blocking fd won't block.
+static bool fd_ready(int fd, short events)
+{
+    struct pollfd pfd = {.fd = fd, .events = events};
+    return poll(&pfd, 1, 0) > 0;
+}
 
-    while (1) {
-        rc = poll(fds, 2, 0);
-        if (rc == 0)
-            rc = poll(fds, 2, -1);
-        if (rc < 0) {
-            MP_ERR(arg, "Poll error\n");
-            continue;
+// Write as much queued output as possible without blocking.
+static void flush_output(struct client *client)
+{
+    while (client->out_first < client->num_out && !client->dead) {
+        // A blocking fd that polls writable has room for at least PIPE_BUF
+        // bytes, so writing at most that much doesn't block.
+        size_t budget = SIZE_MAX;
+        if (!client->nonblocking) {
+            if (!fd_ready(client->client_fd, POLLOUT))
+                break;
+            budget = PIPE_BUF;
         }
 
-        if (fds[0].revents & POLLIN) {
-            mp_flush_wakeup_pipe(pipe_fd);
+        struct iovec iov[MAX_IOV];
+        int num_iov = 0;
+        for (int n = client->out_first; n < client->num_out; n++) {
+            if (num_iov == MAX_IOV || !budget)
+                break;
+            size_t skip = n == client->out_first ? client->out_pos : 0;
+            size_t len = MPMIN(client->out[n].len - skip, budget);
+            budget -= len;
+            iov[num_iov++] = (struct iovec){
+                .iov_base = client->out[n].data + skip,
+                .iov_len = len,
+            };
+        }
 
-            while (1) {
-                mpv_event *event = mpv_wait_event(arg->client, 0);
+        ssize_t rc = writev(client->client_fd, iov, num_iov);
+        if (rc < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if (errno == EBADF) {
+                client->writable = false;
+                drop_output(client);
+                break;
+            }
+            if (client->eof && (errno == EPIPE || errno == ECONNRESET)) {
+                MP_VERBOSE(client, "Client closed before reading replies\n");
+            } else {
+                MP_ERR(client, "Write error (%s)\n", mp_strerror(errno));
+            }
+            client->dead = true;
+            break;
+        }
 
-                if (event->event_id == MPV_EVENT_NONE)
-                    break;
+        client->out_bytes -= rc;
+        size_t done = client->out_pos + rc;
+        while (client->out_first < client->num_out &&
+               done >= client->out[client->out_first].len)
+        {
+            done -= client->out[client->out_first].len;
+            talloc_free(client->out[client->out_first].data);
+            client->out_first++;
+        }
+        client->out_pos = done;
+    }
 
-                if (event->event_id == MPV_EVENT_SHUTDOWN)
-                    goto done;
+    // Compact the queue once the written part dominates.
+    if (client->out_first == client->num_out) {
+        client->num_out = client->out_first = 0;
+    } else if (client->out_first > client->num_out / 2) {
+        int num = client->num_out - client->out_first;
+        memmove(client->out, client->out + client->out_first,
+                num * sizeof(client->out[0]));
+        client->num_out = num;
+        client->out_first = 0;
+    }
+}
 
-                if (!arg->writable)
-                    continue;
+static void read_events(struct client *client)
+{
+    while (!client->dead) {
+        mpv_event *event = mpv_wait_event(client->client, 0);
 
-                char *event_msg = mp_json_encode_event(event);
-                if (!event_msg) {
-                    MP_ERR(arg, "Encoding error\n");
-                    goto done;
-                }
+        if (event->event_id == MPV_EVENT_NONE)
+            break;
 
-                rc = ipc_write_str(arg, event_msg);
-                talloc_free(event_msg);
-                if (rc < 0) {
-                    MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
-                    goto done;
-                }
-            }
+        if (event->event_id == MPV_EVENT_SHUTDOWN) {
+            client->dead = true;
+            break;
         }
 
-        if (fds[1].revents & (POLLIN | POLLHUP)) {
-            while (1) {
-                char buf[128];
-                bstr append = { buf, 0 };
-
-                ssize_t bytes = read(arg->client_fd, buf, sizeof(buf));
-                if (bytes < 0) {
-                    if (errno == EAGAIN)
-                        break;
+        if (!client->writable)
+            continue;
 
-                    MP_ERR(arg, "Read error (%s)\n", mp_strerror(errno));
-                    goto done;
-                }
+        bstr event_msg = mp_ipc_encode_event(NULL, event, client->protocol);
+        if (!event_msg.len) {
+            MP_ERR(client, "Encoding error\n");
+            client->dead = true;
+            break;
+        }
+        queue_output(client, event_msg);
+    }
+}
 
-                if (bytes == 0) {
-                    MP_VERBOSE(arg, "Client disconnected\n");
-                    goto done;
-                }
+static void run_commands(struct client *client)
+{
+    for (int n = 0; n < MAX_COMMANDS_PER_ROUND; n++) {
+        // Resume once the output queue was drained.
+        if (client->dead || client->out_bytes > OUTPUT_SOFT_LIMIT)
+            return;
+        bstr reply_msg;
+        int r = mp_ipc_consume_next_message(client->client, NULL,
+                                            &client->input, &client->protocol,
+                                            &reply_msg);
+        if (r < 0)
+            client->dead = true;
+        if (r <= 0) {
+            client->have_commands = false;
+            return;
+        }
+        queue_output(client, reply_msg);
+    }
+    // Continue after serving other clients.
+    client->have_commands = true;
+}
 
-                append.len = bytes;
+static void read_input(struct client *client)
+{
+    // Read at most a few chunks per round to be fair to other clients.
+    for (int n = 0; n < 16 && !client->dead && !client->eof; n++) {
+        if (!client->nonblocking && !fd_ready(client->client_fd, POLLIN))
+            break;
+        char buf[READ_CHUNK];
+        ssize_t bytes = read(client->client_fd, buf, sizeof(buf));
+        if (bytes < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            MP_ERR(client, "Read error (%s)\n", mp_strerror(errno));
+            client->dead = true;
+            break;
+        }
 
-                bstr_xappend(NULL, &client_msg, append);
+        if (bytes == 0) {
+            MP_VERBOSE(client, "Client disconnected\n");
+            client->eof = true;
+            break;
+        }
 
-                while (bstrchr(client_msg, '\n') != -1) {
-                    char *reply_msg = mp_ipc_consume_next_command(arg->client,
-                        NULL, &client_msg);
+        bstr_xappend(NULL, &client->input, (bstr){buf, bytes});
+        client->have_commands = true;
+        if (bytes < sizeof(buf))
+            break;
+    }
+    run_commands(client);
+}
 
-                    if (reply_msg && arg->writable) {
-                        rc = ipc_write_str(arg, reply_msg);
-                        if (rc < 0) {
-                            MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
-                            talloc_free(reply_msg);
-                            goto done;
-                        }
-                    }
+// Whether the client can be closed: either it failed, or it closed its side
+// and all of its commands were run and the replies written.
+static bool client_finished(struct client *client)
+{
+    return client->dead ||
+           (client->eof && !client->have_commands &&
+            client->out_first == client->num_out);
+}
 
-                    talloc_free(reply_msg);
-                }
-            }
-        }
-    }
+static void update_client_watch(struct mp_ipc_ctx *ctx, struct client *client)
+{
+    int events = 0;
+    if (!client->eof && client->out_bytes <= OUTPUT_SOFT_LIMIT)
+        events |= POLLIN;
+    if (client->out_first < client->num_out)
+        events |= POLLOUT;
+    poller_set(ctx, &client->sock_watch, events);
+}
 
-done:
-    if (client_msg.len > 0)
-        MP_WARN(arg, "Ignoring unterminated command on disconnect.\n");
-    talloc_free(client_msg.start);
-    if (arg->close_client_fd)
-        close(arg->client_fd);
-    mpv_destroy(arg->client);
-    talloc_free(arg);
-    return NULL;
+static void destroy_client(struct mp_ipc_ctx *ctx, struct client *client)
+{
+    poller_remove(ctx, &client->sock_watch);
+    poller_remove(ctx, &client->wakeup_watch);
+    if (client->input.len > 0)
+        MP_WARN(client, "Ignoring unterminated command on disconnect.\n");
+    talloc_free(client->input.start);
+    drop_output(client);
+    if (client->close_client_fd)
+        close(client->client_fd);
+    mpv_destroy(client->client);
+    talloc_free(client);
 }
 
-static void ipc_start_client(struct mp_ipc_ctx *ctx, struct client_arg *client)
+static void ipc_start_client(struct mp_ipc_ctx *ctx, struct client *client)
 {
     client->client = mp_new_client(ctx->client_api, client->client_name);
     if (!client->client)
@@ -222,10 +480,31 @@ static void ipc_start_client(struct mp_ipc_ctx *ctx, struct client_arg *client)
 
     client->log = mp_client_get_log(client->client);
 
-    pthread_t client_thr;
-    if (pthread_create(&client_thr, NULL, client_thread, client))
+    // mp_flush_wakeup_pipe() reads enough to reset an eventfd too.
+    int pipe_fd = mpv_get_wakeup_eventfd(client->client);
+    if (pipe_fd < 0)
+        pipe_fd = mpv_get_wakeup_pipe(client->client);
+    if (pipe_fd < 0) {
+        MP_ERR(client, "Could not get wakeup pipe\n");
         goto err;
+    }
 
+    MP_VERBOSE(client, "Client connected\n");
+
+    // O_NONBLOCK is shared by all processes using the same open file, so set
+    // it only on files and sockets the server opened itself.
+    if (client->close_client_fd) {
+        fcntl(client->client_fd, F_SETFL,
+              fcntl(client->client_fd, F_GETFL, 0) | O_NONBLOCK);
+        client->nonblocking = true;
+    }
+
+    watch_init(&client->sock_watch, WATCH_CLIENT, client, client->client_fd);
+    watch_init(&client->wakeup_watch, WATCH_WAKEUP, client, pipe_fd);
+    poller_set(ctx, &client->sock_watch, POLLIN);
+    poller_set(ctx, &client->wakeup_watch, POLLIN);
+
+    MP_TARRAY_APPEND(ctx, ctx->clients, ctx->num_clients, client);
     return;
 
 err:
@@ -240,8 +519,8 @@ err:
 
 static void ipc_start_client_json(struct mp_ipc_ctx *ctx, int id, int fd)
 {
-    struct client_arg *client = talloc_ptrtype(NULL, client);
-    *client = (struct client_arg){
+    struct client *client = talloc_ptrtype(NULL, client);
+    *client = (struct client){
         .client_name = talloc_asprintf(client, "ipc-%d", id),
         .client_fd   = fd,
         .close_client_fd = true,
@@ -283,8 +562,8 @@ static void ipc_start_client_text(struct mp_ipc_ctx *ctx, const char *path)
         return;
     }
 
-    struct client_arg *client = talloc_ptrtype(NULL, client);
-    *client = (struct client_arg){
+    struct client *client = talloc_ptrtype(NULL, client);
+    *client = (struct client){
         .client_name = "input-file",
         .client_fd   = client_fd,
         .close_client_fd = close_client_fd,
@@ -294,23 +573,19 @@ static void ipc_start_client_text(struct mp_ipc_ctx *ctx, const char *path)
     ipc_start_client(ctx, client);
 }
 
-static void *ipc_thread(void *p)
+static bool ipc_listen(struct mp_ipc_ctx *arg)
 {
     int rc;
 
     int ipc_fd;
     struct sockaddr_un ipc_un = {0};
 
-    struct mp_ipc_ctx *arg = p;
-
-    mpthread_set_name("ipc socket listener");
-
     MP_VERBOSE(arg, "Starting IPC master\n");
 
     ipc_fd = socket(AF_UNIX, SOCK_STREAM, 0);
     if (ipc_fd < 0) {
         MP_ERR(arg, "Could not create IPC socket\n");
-        goto done;
+        goto error;
     }
 
 #if HAVE_FCHMOD
@@ -320,7 +595,7 @@ static void *ipc_thread(void *p)
     size_t path_len = strlen(arg->path);
     if (path_len >= sizeof(ipc_un.sun_path) - 1) {
         MP_ERR(arg, "Could not create IPC socket\n");
-        goto done;
+        goto error;
     }
 
     ipc_un.sun_family = AF_UNIX,
@@ -337,48 +612,132 @@ static void *ipc_thread(void *p)
     rc = bind(ipc_fd, (struct sockaddr *) &ipc_un, addr_len);
     if (rc < 0) {
         MP_ERR(arg, "Could not bind IPC socket\n");
-        goto done;
+        goto error;
     }
 
-    rc = listen(ipc_fd, 10);
+    rc = listen(ipc_fd, 128);
     if (rc < 0) {
         MP_ERR(arg, "Could not listen on IPC socket\n");
-        goto done;
+        goto error;
     }
 
+    fcntl(ipc_fd, F_SETFL, fcntl(ipc_fd, F_GETFL, 0) | O_NONBLOCK);
+
     MP_VERBOSE(arg, "Listening to IPC socket.\n");
 
-    int client_num = 0;
+    arg->listen_fd = ipc_fd;
+    watch_init(&arg->listen_watch, WATCH_LISTEN, NULL, ipc_fd);
+    poller_set(arg, &arg->listen_watch, POLLIN);
+    return true;
 
-    struct pollfd fds[2] = {
-        {.events = POLLIN, .fd = arg->death_pipe[0]},
-        {.events = POLLIN, .fd = ipc_fd},
-    };
+error:
+    if (ipc_fd >= 0)
+        close(ipc_fd);
+    return false;
+}
 
+static void accept_clients(struct mp_ipc_ctx *arg)
+{
     while (1) {
-        rc = poll(fds, 2, -1);
-        if (rc < 0) {
-            MP_ERR(arg, "Poll error\n");
+        int client_fd = accept(arg->listen_fd, NULL, NULL);
+        if (client_fd < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                MP_ERR(arg, "Could not accept IPC client\n");
+            break;
+        }
+
+        ipc_start_client_json(arg, arg->client_num++, client_fd);
+    }
+}
+
+static void *ipc_thread(void *p)
+{
+    struct mp_ipc_ctx *arg = p;
+
+    mpthread_set_name("ipc");
+
+    // We don't use MSG_NOSIGNAL because the moldy fruit OS doesn't support it.
+    struct sigaction sa = { .sa_handler = SIG_IGN, .sa_flags = SA_RESTART };
+    sigfillset(&sa.sa_mask);
+    sigaction(SIGPIPE, &sa, NULL);
+
+    if (arg->path && !ipc_listen(arg))
+        arg->path = NULL;
+
+    // Events that were queued before the thread started.
+    for (int n = 0; n < arg->num_clients; n++)
+        read_events(arg->clients[n]);
+
+    while (1) {
+        // Clients with unprocessed input must not wait for new input.
+        int timeout = -1;
+        for (int n = 0; n < arg->num_clients; n++) {
+            struct client *client = arg->clients[n];
+            if ((client->have_commands &&
+                 client->out_bytes <= OUTPUT_SOFT_LIMIT) ||
+                (client->sock_watch.always_ready && !client->eof))
+                timeout = 0;
+        }
+
+        struct watch *ready[MAX_READY];
+        int ready_events[MAX_READY];
+        int num_ready = poller_wait(arg, ready, ready_events, timeout);
+        if (num_ready < 0) {
+            if (errno != EINTR)
+                MP_ERR(arg, "Poll error\n");
             continue;
         }
 
-        if (fds[0].revents & POLLIN)
-            goto done;
+        for (int n = 0; n < num_ready; n++) {
+            struct watch *w = ready[n];
+            struct client *client = w->client;
+            int events = ready_events[n];
 
-        if (fds[1].revents & POLLIN) {
-            int client_fd = accept(ipc_fd, NULL, NULL);
-            if (client_fd < 0) {
-                MP_ERR(arg, "Could not accept IPC client\n");
+            switch (w->type) {
+            case WATCH_DEATH:
                 goto done;
+            case WATCH_LISTEN:
+                accept_clients(arg);
+                break;
+            case WATCH_WAKEUP:
+                mp_flush_wakeup_pipe(w->fd);
+                read_events(client);
+                break;
+            case WATCH_CLIENT:
+                if (events & POLLOUT)
+                    flush_output(client);
+                if (events & (POLLIN | POLLHUP | POLLERR))
+                    read_input(client);
+                break;
             }
+        }
 
-            ipc_start_client_json(arg, client_num++, client_fd);
+        for (int n = arg->num_clients - 1; n >= 0; n--) {
+            struct client *client = arg->clients[n];
+            if (client->sock_watch.always_ready && !client->eof) {
+                read_input(client);
+            } else if (client->have_commands) {
+                run_commands(client);
+            }
+            flush_output(client);
+            if (client_finished(client)) {
+                destroy_client(arg, client);
+                MP_TARRAY_REMOVE_AT(arg->clients, arg->num_clients, n);
+                continue;
+            }
+            update_client_watch(arg, client);
         }
     }
 
 done:
-    if (ipc_fd >= 0)
-        close(ipc_fd);
+    for (int n = 0; n < arg->num_clients; n++)
+        destroy_client(arg, arg->clients[n]);
+    arg->num_clients = 0;
+
+    if (arg->listen_fd >= 0)
+        close(arg->listen_fd);
 
     return NULL;
 }
@@ -394,17 +753,29 @@ struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
         .client_api = client_api,
         .path       = mp_get_user_path(arg, global, opts->ipc_path),
         .death_pipe = {-1, -1},
+        .listen_fd  = -1,
+#if USE_EPOLL
+        .epoll_fd   = -1,
+#endif
     };
     char *input_file = mp_get_user_path(arg, global, opts->input_file);
 
-    if (input_file && *input_file)
-        ipc_start_client_text(arg, input_file);
+    if (!arg->path || !arg->path[0])
+        arg->path = NULL;
 
-    if (!opts->ipc_path || !*opts->ipc_path)
+    if (!poller_init(arg))
         goto out;
 
     if (mp_make_wakeup_pipe(arg->death_pipe) < 0)
         goto out;
+    watch_init(&arg->death_watch, WATCH_DEATH, NULL, arg->death_pipe[0]);
+    poller_set(arg, &arg->death_watch, POLLIN);
+
+    if (input_file && *input_file)
+        ipc_start_client_text(arg, input_file);
+
+    if (!arg->path && !arg->num_clients)
+        goto out;
 
     if (pthread_create(&arg->thread, NULL, ipc_thread, arg))
         goto out;
@@ -412,10 +783,13 @@ struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
     return arg;
 
 out:
+    for (int n = 0; n < arg->num_clients; n++)
+        destroy_client(arg, arg->clients[n]);
     if (arg->death_pipe[0] >= 0) {
         close(arg->death_pipe[0]);
         close(arg->death_pipe[1]);
     }
+    poller_uninit(arg);
     talloc_free(arg);
     return NULL;
 }
@@ -430,5 +804,6 @@ void mp_uninit_ipc(struct mp_ipc_ctx *arg)
 
     close(arg->death_pipe[0]);
     close(arg->death_pipe[1]);
+    poller_uninit(arg);
     talloc_free(arg);
 }
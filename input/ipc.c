@@ -20,6 +20,7 @@
 #include "common/msg.h"
 #include "input/input.h"
 #include "misc/json.h"
+#include "misc/msgpack.h"
 #include "options/m_option.h"
 #include "options/options.h"
 #include "options/path.h"
@@ -193,33 +194,61 @@ char *mp_json_encode_event(mpv_event *event)
     return output;
 }
 
-// Function is allowed to modify src[n].
-static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
-                                  char *src)
+// Messages in the MessagePack protocol are prefixed with their size as 32 bit
+// big endian integer. Larger messages are rejected.
+#define MSGPACK_MAX_MESSAGE (16 * 1024 * 1024)
+
+// Encode the node as length-prefixed MessagePack message. Returns an empty
+// bstr if the node can't be encoded.
+static bstr msgpack_encode_message(void *ta_parent, mpv_node *node)
+{
+    bstr res = {0};
+    bstr_xappend(NULL, &res, (bstr){(char[4]){0}, 4});
+    if (msgpack_write(&res, node) < 0 || res.len - 4 > MSGPACK_MAX_MESSAGE) {
+        talloc_free(res.start);
+        return (bstr){0};
+    }
+    size_t size = res.len - 4;
+    for (int n = 0; n < 4; n++)
+        res.start[n] = size >> ((3 - n) * 8);
+    talloc_steal(ta_parent, res.start);
+    return res;
+}
+
+bstr mp_ipc_encode_event(void *ta_parent, mpv_event *event,
+                         enum mp_ipc_protocol protocol)
+{
+    if (protocol == MP_IPC_JSON) {
+        char *output = mp_json_encode_event(event);
+        return bstr0(talloc_steal(ta_parent, output));
+    }
+
+    void *tmp = talloc_new(NULL);
+    mpv_node event_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+    mpv_event_to_node(tmp, event, &event_node);
+    bstr res = msgpack_encode_message(ta_parent, &event_node);
+    talloc_free(tmp);
+    return res;
+}
+
+// Execute the command in msg_node, and add the results to reply_node.
+// If protocol is not NULL, the client is allowed to switch the protocol.
+static void execute_command_node(struct mpv_handle *client, void *ta_parent,
+                                 mpv_node *msg_node, mpv_node *reply_node,
+                                 enum mp_ipc_protocol *protocol)
 {
     int rc;
     const char *cmd = NULL;
-    struct mp_log *log = mp_client_get_log(client);
-
-    mpv_node msg_node;
-    mpv_node reply_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
     mpv_node *reqid_node = NULL;
 
-    rc = json_parse(ta_parent, &msg_node, &src, 50);
-    if (rc < 0) {
-        mp_err(log, "malformed JSON received: '%s'\n", src);
-        rc = MPV_ERROR_INVALID_PARAMETER;
-        goto error;
-    }
-
-    if (msg_node.format != MPV_FORMAT_NODE_MAP) {
+    if (msg_node->format != MPV_FORMAT_NODE_MAP) {
         rc = MPV_ERROR_INVALID_PARAMETER;
         goto error;
     }
 
-    reqid_node = mpv_node_map_get(&msg_node, "request_id");
+    reqid_node = mpv_node_map_get(msg_node, "request_id");
 
-    mpv_node *cmd_node = mpv_node_map_get(&msg_node, "command");
+    mpv_node *cmd_node = mpv_node_map_get(msg_node, "command");
     if (!cmd_node ||
         (cmd_node->format != MPV_FORMAT_NODE_ARRAY) ||
         !cmd_node->u.list->num)
@@ -238,15 +267,38 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
 
     if (!strcmp("client_name", cmd)) {
         const char *client_name = mpv_client_name(client);
-        mpv_node_map_add_string(ta_parent, &reply_node, "data", client_name);
+        mpv_node_map_add_string(ta_parent, reply_node, "data", client_name);
         rc = MPV_ERROR_SUCCESS;
+    } else if (!strcmp("ipc_protocol", cmd)) {
+        if (cmd_node->u.list->num != 2) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        if (cmd_node->u.list->values[1].format != MPV_FORMAT_STRING) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        char *name = cmd_node->u.list->values[1].u.string;
+        if (!protocol) {
+            rc = MPV_ERROR_NOT_IMPLEMENTED;
+        } else if (!strcmp(name, "json")) {
+            *protocol = MP_IPC_JSON;
+            rc = MPV_ERROR_SUCCESS;
+        } else if (!strcmp(name, "msgpack")) {
+            *protocol = MP_IPC_MSGPACK;
+            rc = MPV_ERROR_SUCCESS;
+        } else {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+        }
     } else if (!strcmp("get_time_us", cmd)) {
         int64_t time_us = mpv_get_time_us(client);
-        mpv_node_map_add_int64(ta_parent, &reply_node, "data", time_us);
+        mpv_node_map_add_int64(ta_parent, reply_node, "data", time_us);
         rc = MPV_ERROR_SUCCESS;
     } else if (!strcmp("get_version", cmd)) {
         int64_t ver = mpv_client_api_version();
-        mpv_node_map_add_int64(ta_parent, &reply_node, "data", ver);
+        mpv_node_map_add_int64(ta_parent, reply_node, "data", ver);
         rc = MPV_ERROR_SUCCESS;
     } else if (!strcmp("get_property", cmd)) {
         mpv_node result_node;
@@ -264,9 +316,64 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         rc = mpv_get_property(client, cmd_node->u.list->values[1].u.string,
                               MPV_FORMAT_NODE, &result_node);
         if (rc >= 0) {
-            mpv_node_map_add(ta_parent, &reply_node, "data", &result_node);
+            mpv_node_map_add(ta_parent, reply_node, "data", &result_node);
             mpv_free_node_contents(&result_node);
         }
+    } else if (!strcmp("get_properties", cmd)) {
+        int num = cmd_node->u.list->num - 1;
+        mpv_node *names = cmd_node->u.list->values + 1;
+        for (int n = 0; n < num; n++) {
+            if (names[n].format != MPV_FORMAT_STRING) {
+                rc = MPV_ERROR_INVALID_PARAMETER;
+                goto error;
+            }
+        }
+
+        // Each name is read once, so it's a unique key in the reply maps.
+        const char **prop_names = talloc_array(ta_parent, const char *, num);
+        int num_props = 0;
+        for (int n = 0; n < num; n++) {
+            bool dup = false;
+            for (int i = 0; i < num_props; i++)
+                dup |= !strcmp(prop_names[i], names[n].u.string);
+            if (!dup)
+                prop_names[num_props++] = names[n].u.string;
+        }
+        num = num_props;
+
+        mpv_format *formats = talloc_array(ta_parent, mpv_format, num);
+        mpv_node *results = talloc_zero_array(ta_parent, mpv_node, num);
+        void **data = talloc_array(ta_parent, void *, num);
+        int *errors = talloc_array(ta_parent, int, num);
+        for (int n = 0; n < num; n++) {
+            formats[n] = MPV_FORMAT_NODE;
+            data[n] = &results[n];
+            errors[n] = MPV_ERROR_GENERIC;
+        }
+
+        // The request itself succeeds even if some properties can't be read.
+        // Those are not in "data", but in "errors", which maps each of them
+        // to its error string. "errors" is present only if something failed.
+        mpv_get_properties(client, num, prop_names, formats, data, errors);
+        rc = MPV_ERROR_SUCCESS;
+        mpv_node data_node = {
+            .format = MPV_FORMAT_NODE_MAP,
+            .u.list = talloc_zero(ta_parent, mpv_node_list),
+        };
+        mpv_node errors_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+        for (int n = 0; n < num; n++) {
+            if (errors[n] >= 0) {
+                mpv_node_map_add(ta_parent, &data_node, prop_names[n],
+                                 &results[n]);
+                mpv_free_node_contents(&results[n]);
+            } else {
+                mpv_node_map_add_string(ta_parent, &errors_node, prop_names[n],
+                                        mpv_error_string(errors[n]));
+            }
+        }
+        mpv_node_map_add(ta_parent, reply_node, "data", &data_node);
+        if (errors_node.u.list)
+            mpv_node_map_add(ta_parent, reply_node, "errors", &errors_node);
     } else if (!strcmp("get_property_string", cmd)) {
         if (cmd_node->u.list->num != 2) {
             rc = MPV_ERROR_INVALID_PARAMETER;
@@ -281,10 +388,10 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         char *result = mpv_get_property_string(client,
                                         cmd_node->u.list->values[1].u.string);
         if (result) {
-            mpv_node_map_add_string(ta_parent, &reply_node, "data", result);
+            mpv_node_map_add_string(ta_parent, reply_node, "data", result);
             mpv_free(result);
         } else {
-            mpv_node_map_add_null(ta_parent, &reply_node, "data");
+            mpv_node_map_add_null(ta_parent, reply_node, "data");
         }
     } else if (!strcmp("set_property", cmd) ||
         !strcmp("set_property_string", cmd))
@@ -405,7 +512,7 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
 
         rc = mpv_command_node(client, cmd_node, &result_node);
         if (rc >= 0)
-            mpv_node_map_add(ta_parent, &reply_node, "data", &result_node);
+            mpv_node_map_add(ta_parent, reply_node, "data", &result_node);
     }
 
 error:
@@ -414,10 +521,29 @@ error:
      * the original requests.
      */
     if (reqid_node) {
-        mpv_node_map_add(ta_parent, &reply_node, "request_id", reqid_node);
+        mpv_node_map_add(ta_parent, reply_node, "request_id", reqid_node);
     }
 
-    mpv_node_map_add_string(ta_parent, &reply_node, "error", mpv_error_string(rc));
+    mpv_node_map_add_string(ta_parent, reply_node, "error", mpv_error_string(rc));
+}
+
+// Function is allowed to modify src[n].
+static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
+                                  char *src, enum mp_ipc_protocol *protocol)
+{
+    struct mp_log *log = mp_client_get_log(client);
+
+    mpv_node msg_node;
+    mpv_node reply_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+
+    if (json_parse(ta_parent, &msg_node, &src, 50) < 0) {
+        mp_err(log, "malformed JSON received: '%s'\n", src);
+        mpv_node_map_add_string(ta_parent, &reply_node, "error",
+                    mpv_error_string(MPV_ERROR_INVALID_PARAMETER));
+    } else {
+        execute_command_node(client, ta_parent, &msg_node, &reply_node,
+                             protocol);
+    }
 
     char *output = talloc_strdup(ta_parent, "");
     json_write(&output, &reply_node);
@@ -433,7 +559,8 @@ static char *text_execute_command(struct mpv_handle *client, void *tmp, char *sr
     return NULL;
 }
 
-char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf)
+static char *consume_next_line(struct mpv_handle *client, void *ctx, bstr *buf,
+                               enum mp_ipc_protocol *protocol)
 {
     void *tmp = talloc_new(NULL);
 
@@ -449,7 +576,7 @@ char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *bu
     if (line0[0] == '\0' || line0[0] == '#') {
         // skip
     } else if (line0[0] == '{') {
-        reply_msg = json_execute_command(client, tmp, line0);
+        reply_msg = json_execute_command(client, tmp, line0, protocol);
     } else {
         reply_msg = text_execute_command(client, tmp, line0);
     }
@@ -458,3 +585,74 @@ char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *bu
     talloc_free(tmp);
     return reply_msg;
 }
+
+char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf)
+{
+    return consume_next_line(client, ctx, buf, NULL);
+}
+
+static int consume_next_msgpack(struct mpv_handle *client, void *ctx,
+                                bstr *buf, enum mp_ipc_protocol *protocol,
+                                bstr *reply)
+{
+    struct mp_log *log = mp_client_get_log(client);
+
+    if (buf->len < 4)
+        return 0;
+    uint32_t size = 0;
+    for (int n = 0; n < 4; n++)
+        size = (size << 8) | (unsigned char)buf->start[n];
+    if (size > MSGPACK_MAX_MESSAGE) {
+        mp_err(log, "MessagePack message too large (%"PRIu32" bytes).\n", size);
+        return -1;
+    }
+    if (buf->len - 4 < size)
+        return 0;
+
+    void *tmp = talloc_new(NULL);
+
+    bstr msg = bstr_splice(*buf, 4, 4 + size);
+    talloc_steal(tmp, buf->start);
+    *buf = bstrdup(NULL, bstr_cut(*buf, 4 + size));
+
+    mpv_node msg_node;
+    mpv_node reply_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+
+    if (msgpack_parse(tmp, &msg_node, &msg, 50) < 0 || msg.len) {
+        mp_err(log, "malformed MessagePack message received\n");
+        mpv_node_map_add_string(tmp, &reply_node, "error",
+                    mpv_error_string(MPV_ERROR_INVALID_PARAMETER));
+    } else {
+        execute_command_node(client, tmp, &msg_node, &reply_node, protocol);
+    }
+
+    *reply = msgpack_encode_message(ctx, &reply_node);
+    if (!reply->len) {
+        mp_err(log, "could not encode MessagePack reply\n");
+        mpv_node error_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+        mpv_node *reqid_node = mpv_node_map_get(&reply_node, "request_id");
+        if (reqid_node)
+            mpv_node_map_add(tmp, &error_node, "request_id", reqid_node);
+        mpv_node_map_add_string(tmp, &error_node, "error",
+                    mpv_error_string(MPV_ERROR_GENERIC));
+        *reply = msgpack_encode_message(ctx, &error_node);
+    }
+    talloc_free(tmp);
+    return 1;
+}
+
+int mp_ipc_consume_next_message(struct mpv_handle *client, void *ctx,
+                                bstr *buf, enum mp_ipc_protocol *protocol,
+                                bstr *reply)
+{
+    *reply = (bstr){0};
+
+    // Note that the reply to a protocol switch still uses the old protocol.
+    if (*protocol == MP_IPC_MSGPACK)
+        return consume_next_msgpack(client, ctx, buf, protocol, reply);
+
+    if (bstrchr(*buf, '\n') < 0)
+        return 0;
+    *reply = bstr0(consume_next_line(client, ctx, buf, protocol));
+    return 1;
+}
@@ -236,7 +236,7 @@ extern "C" {
  * relational operators (<, >, <=, >=).
  */
 #define MPV_MAKE_VERSION(major, minor) (((major) << 16) | (minor) | 0UL)
-#define MPV_CLIENT_API_VERSION MPV_MAKE_VERSION(1, 101)
+#define MPV_CLIENT_API_VERSION MPV_MAKE_VERSION(1, 103)
 
 /**
  * The API user is allowed to "#define MPV_ENABLE_DEPRECATED 0" before
@@ -1131,6 +1131,28 @@ char *mpv_get_property_string(mpv_handle *ctx, const char *name);
  */
 char *mpv_get_property_osd_string(mpv_handle *ctx, const char *name);
 
+/**
+ * Read the values of multiple properties at once. This behaves like calling
+ * mpv_get_property() for each entry, except that the player is locked only
+ * once for all of them. The values thus form a consistent snapshot: they are
+ * all read without the playback core running in between (for example,
+ * "time-pos" and "estimated-frame-number" are from the same frame).
+ *
+ * Safe to be called from mpv render API threads.
+ *
+ * @param num Number of entries in names, formats, data and errors.
+ * @param names The property names.
+ * @param formats The format of each property (see enum mpv_format).
+ * @param[out] data Pointers to the variables holding the values, see
+ *                  mpv_get_property(). Entries for which reading the property
+ *                  failed are not written to.
+ * @param[out] errors If not NULL, set to the error code of each property.
+ * @return MPV_ERROR_SUCCESS if all properties were read, otherwise the error
+ *         code of the first property that failed
+ */
+int mpv_get_properties(mpv_handle *ctx, int num, const char **names,
+                       const mpv_format *formats, void **data, int *errors);
+
 /**
  * Get a property asynchronously. You will receive the result of the operation
  * as well as the property data with the MPV_EVENT_GET_PROPERTY_REPLY event.
@@ -1913,6 +1935,9 @@ int mpv_hook_continue(mpv_handle *ctx, uint64_t id);
  * of events queued. Also, it's possible that mpv does not write to the pipe
  * once it's guaranteed that the client was already signaled. See the example
  * below how to do it correctly.
+ *
+ * See mpv_get_wakeup_eventfd() for a variant that needs only one FD, and
+ * can't fill up.
  * 实际上，这是使用与mpv_set_wakeup_callback（）相同的底层代码实现的（尽管它们并不冲突），
  * 就像每次回调调用向管道写入一个0字节一样。当管道变得可读时，
  * 管道上调用poll（）（或select（））的代码应该读取管道的所有内容，然后调用mpv_wait_event（c，0），直到没有返回新的事件。
@@ -1959,6 +1984,27 @@ int mpv_hook_continue(mpv_handle *ctx, uint64_t id);
  */
 int mpv_get_wakeup_pipe(mpv_handle *ctx);
 
+/**
+ * Like mpv_get_wakeup_pipe(), but return a Linux eventfd instead of the read
+ * end of a pipe. It is signaled in the same situations, uses only one FD,
+ * and its counter can't fill up the way a pipe buffer can. The FD is separate
+ * from the one returned by mpv_get_wakeup_pipe(); a client can use both.
+ *
+ * An eventfd must be read with a buffer of at least 8 bytes. Smaller reads
+ * fail with EINVAL and don't reset it, so the FD stays readable. One read of
+ * 8 bytes resets it:
+ *
+ *  uint64_t unused;
+ *  read(fd, &unused, sizeof(unused));
+ *
+ * The FD is non-blocking and close-on-exec. It is owned by the mpv_handle
+ * and closed when it is destroyed. Available since API version 1.103.
+ *
+ * @return An eventfd, or -1 on error or if eventfds are not supported (they
+ *         are only available on Linux).
+ */
+int mpv_get_wakeup_eventfd(mpv_handle *ctx);
+
 /**
  * @deprecated use render.h
  */
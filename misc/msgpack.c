@@ -0,0 +1,306 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* MessagePack reader and writer for mpv_node.
+ *
+ * Maps to mpv_node as follows: nil, bool, integers, floats, strings, arrays
+ * and maps map to the obvious node types. Binary data is read as string (if
+ * it contains no 0 bytes) and written from MPV_FORMAT_BYTE_ARRAY. Map keys
+ * must be strings. Extension types and unsigned integers that don't fit into
+ * int64_t are rejected.
+ *
+ * Also see: https://github.com/msgpack/msgpack/blob/master/spec.md
+ */
+
+#include <string.h>
+#include <inttypes.h>
+
+#include "common/common.h"
+
+#include "msgpack.h"
+
+static bool read_uint(bstr *src, int size, uint64_t *out)
+{
+    if (src->len < size)
+        return false;
+    uint64_t v = 0;
+    for (int n = 0; n < size; n++)
+        v = (v << 8) | src->start[n];
+    *src = bstr_cut(*src, size);
+    *out = v;
+    return true;
+}
+
+static int read_str(void *ta_parent, struct mpv_node *dst, bstr *src,
+                    uint64_t len)
+{
+    if (src->len < len)
+        return -1;
+    bstr s = bstr_splice(*src, 0, len);
+    if (bstrchr(s, '\0') >= 0)
+        return -1; // can't be represented as C string
+    dst->format = MPV_FORMAT_STRING;
+    dst->u.string = bstrto0(ta_parent, s);
+    *src = bstr_cut(*src, len);
+    return 0;
+}
+
+static int read_list(void *ta_parent, struct mpv_node *dst, bstr *src,
+                     uint64_t num, bool is_obj, int max_depth)
+{
+    // Every element needs at least 1 byte; reject bogus sizes early.
+    if (num > src->len)
+        return -1;
+    struct mpv_node_list *list = talloc_zero(ta_parent, struct mpv_node_list);
+    list->values = talloc_array(list, struct mpv_node, num);
+    if (is_obj)
+        list->keys = talloc_array(list, char *, num);
+    for (uint64_t n = 0; n < num; n++) {
+        if (is_obj) {
+            struct mpv_node keynode;
+            if (msgpack_parse(list, &keynode, src, max_depth) < 0 ||
+                keynode.format != MPV_FORMAT_STRING)
+                return -1; // key is not a string
+            list->keys[n] = keynode.u.string;
+        }
+        if (msgpack_parse(ta_parent, &list->values[n], src, max_depth) < 0)
+            return -1;
+        list->num++;
+    }
+    dst->format = is_obj ? MPV_FORMAT_NODE_MAP : MPV_FORMAT_NODE_ARRAY;
+    dst->u.list = list;
+    return 0;
+}
+
+/* Parse one MessagePack value from the start of *src, and write the result
+ * into *dst. max_depth limits the array/map nesting.
+ * Returns:
+ *   0: success, *dst is valid, *src is advanced past the value
+ *  -1: failure (malformed or truncated data), *dst is invalid, there may be
+ *      dead allocs under ta_parent
+ * Unlike json_parse(), the input is never mutated, and strings are copied.
+ */
+int msgpack_parse(void *ta_parent, struct mpv_node *dst, bstr *src,
+                  int max_depth)
+{
+    if (max_depth <= 0 || !src->len)
+        return -1;
+    max_depth -= 1;
+
+    uint8_t c = src->start[0];
+    *src = bstr_cut(*src, 1);
+    uint64_t v;
+
+    if (c <= 0x7f) {
+        dst->format = MPV_FORMAT_INT64;
+        dst->u.int64 = c;
+        return 0;
+    }
+    if (c >= 0xe0) {
+        dst->format = MPV_FORMAT_INT64;
+        dst->u.int64 = (int8_t)c;
+        return 0;
+    }
+    if (c >= 0xa0 && c <= 0xbf)
+        return read_str(ta_parent, dst, src, c & 0x1f);
+    if (c >= 0x90 && c <= 0x9f)
+        return read_list(ta_parent, dst, src, c & 0xf, false, max_depth);
+    if (c >= 0x80 && c <= 0x8f)
+        return read_list(ta_parent, dst, src, c & 0xf, true, max_depth);
+
+    switch (c) {
+    case 0xc0:
+        dst->format = MPV_FORMAT_NONE;
+        return 0;
+    case 0xc2:
+    case 0xc3:
+        dst->format = MPV_FORMAT_FLAG;
+        dst->u.flag = c == 0xc3;
+        return 0;
+    case 0xcc: case 0xcd: case 0xce: case 0xcf:
+        if (!read_uint(src, 1 << (c - 0xcc), &v) || v > INT64_MAX)
+            return -1;
+        dst->format = MPV_FORMAT_INT64;
+        dst->u.int64 = v;
+        return 0;
+    case 0xd0: case 0xd1: case 0xd2: case 0xd3: {
+        int size = 1 << (c - 0xd0);
+        if (!read_uint(src, size, &v))
+            return -1;
+        // Sign-extend.
+        int shift = 64 - size * 8;
+        dst->format = MPV_FORMAT_INT64;
+        dst->u.int64 = shift ? (int64_t)(v << shift) >> shift : (int64_t)v;
+        return 0;
+    }
+    case 0xca: {
+        if (!read_uint(src, 4, &v))
+            return -1;
+        uint32_t bits = v;
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        dst->format = MPV_FORMAT_DOUBLE;
+        dst->u.double_ = f;
+        return 0;
+    }
+    case 0xcb:
+        if (!read_uint(src, 8, &v))
+            return -1;
+        dst->format = MPV_FORMAT_DOUBLE;
+        memcpy(&dst->u.double_, &v, sizeof(double));
+        return 0;
+    case 0xd9: case 0xda: case 0xdb:
+        if (!read_uint(src, 1 << (c - 0xd9), &v))
+            return -1;
+        return read_str(ta_parent, dst, src, v);
+    case 0xc4: case 0xc5: case 0xc6:
+        if (!read_uint(src, 1 << (c - 0xc4), &v))
+            return -1;
+        return read_str(ta_parent, dst, src, v);
+    case 0xdc: case 0xdd:
+        if (!read_uint(src, 2 << (c - 0xdc), &v))
+            return -1;
+        return read_list(ta_parent, dst, src, v, false, max_depth);
+    case 0xde: case 0xdf:
+        if (!read_uint(src, 2 << (c - 0xde), &v))
+            return -1;
+        return read_list(ta_parent, dst, src, v, true, max_depth);
+    }
+
+    return -1; // reserved or extension type
+}
+
+static void append_byte(bstr *b, uint8_t c)
+{
+    bstr_xappend(NULL, b, (bstr){&c, 1});
+}
+
+// Append a type byte followed by v as size-byte big endian integer.
+static void append_uint(bstr *b, uint8_t type, uint64_t v, int size)
+{
+    uint8_t buf[9] = {type};
+    for (int n = 0; n < size; n++)
+        buf[1 + n] = v >> ((size - 1 - n) * 8);
+    bstr_xappend(NULL, b, (bstr){buf, 1 + size});
+}
+
+static void append_int(bstr *b, int64_t v)
+{
+    if (v >= 0) {
+        if (v <= 0x7f) {
+            append_byte(b, v);
+        } else if (v <= UINT8_MAX) {
+            append_uint(b, 0xcc, v, 1);
+        } else if (v <= UINT16_MAX) {
+            append_uint(b, 0xcd, v, 2);
+        } else if (v <= UINT32_MAX) {
+            append_uint(b, 0xce, v, 4);
+        } else {
+            append_uint(b, 0xcf, v, 8);
+        }
+    } else {
+        if (v >= -32) {
+            append_byte(b, (uint8_t)v);
+        } else if (v >= INT8_MIN) {
+            append_uint(b, 0xd0, (uint64_t)v, 1);
+        } else if (v >= INT16_MIN) {
+            append_uint(b, 0xd1, (uint64_t)v, 2);
+        } else if (v >= INT32_MIN) {
+            append_uint(b, 0xd2, (uint64_t)v, 4);
+        } else {
+            append_uint(b, 0xd3, (uint64_t)v, 8);
+        }
+    }
+}
+
+// Append the header of a str/bin/array/map value. types[] contains the fix
+// type (or 0 if none), and the types with 8, 16 and 32 bit sizes (or 0).
+static void append_header(bstr *b, uint64_t len, int fix_max,
+                          const uint8_t types[4])
+{
+    if (types[0] && len <= fix_max) {
+        append_byte(b, types[0] | len);
+    } else if (types[1] && len <= UINT8_MAX) {
+        append_uint(b, types[1], len, 1);
+    } else if (len <= UINT16_MAX) {
+        append_uint(b, types[2], len, 2);
+    } else {
+        append_uint(b, types[3], len, 4);
+    }
+}
+
+static void append_str(bstr *b, bstr s)
+{
+    append_header(b, s.len, 31, (const uint8_t[]){0xa0, 0xd9, 0xda, 0xdb});
+    bstr_xappend(NULL, b, s);
+}
+
+static int msgpack_append(bstr *b, const struct mpv_node *src)
+{
+    switch (src->format) {
+    case MPV_FORMAT_NONE:
+        append_byte(b, 0xc0);
+        return 0;
+    case MPV_FORMAT_FLAG:
+        append_byte(b, src->u.flag ? 0xc3 : 0xc2);
+        return 0;
+    case MPV_FORMAT_INT64:
+        append_int(b, src->u.int64);
+        return 0;
+    case MPV_FORMAT_DOUBLE: {
+        uint64_t bits;
+        memcpy(&bits, &src->u.double_, sizeof(bits));
+        append_uint(b, 0xcb, bits, 8);
+        return 0;
+    }
+    case MPV_FORMAT_STRING:
+        append_str(b, bstr0(src->u.string));
+        return 0;
+    case MPV_FORMAT_BYTE_ARRAY: {
+        struct mpv_byte_array *ba = src->u.ba;
+        append_header(b, ba->size, 0, (const uint8_t[]){0, 0xc4, 0xc5, 0xc6});
+        bstr_xappend(NULL, b, (bstr){ba->data, ba->size});
+        return 0;
+    }
+    case MPV_FORMAT_NODE_ARRAY:
+    case MPV_FORMAT_NODE_MAP: {
+        struct mpv_node_list *list = src->u.list;
+        bool is_obj = src->format == MPV_FORMAT_NODE_MAP;
+        int num = list ? list->num : 0;
+        append_header(b, num, 15, is_obj ? (const uint8_t[]){0x80, 0, 0xde, 0xdf}
+                                         : (const uint8_t[]){0x90, 0, 0xdc, 0xdd});
+        for (int n = 0; n < num; n++) {
+            if (is_obj)
+                append_str(b, bstr0(list->keys[n]));
+            if (msgpack_append(b, &list->values[n]) < 0)
+                return -1;
+        }
+        return 0;
+    }
+    default:
+        return -1; // unknown format
+    }
+}
+
+/* Append the contents of *src as MessagePack to *dst. *dst is extended with
+ * bstr_xappend() (i.e. dst->start must be NULL or a talloc allocation).
+ * Returns: 0 on success, <0 on failure.
+ */
+int msgpack_write(bstr *dst, struct mpv_node *src)
+{
+    return msgpack_append(dst, src);
+}
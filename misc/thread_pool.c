@@ -15,56 +15,226 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+// Work-stealing thread pool.
+//
+// Every worker has its own job queues (one per priority), each protected by a
+// separate lock. A worker takes the oldest job from its own queues, so jobs
+// queued to the same worker run in order. If its own queues are empty, it
+// steals the newest job from other workers' queues. New jobs are distributed
+// over all workers in a round-robin fashion.
+// The pool-wide lock is only needed to wake up sleeping workers and to start
+// or stop worker threads, which is avoided when all workers are busy.
+
+#include <errno.h>
 #include <pthread.h>
 
 #include "common/common.h"
+#include "osdep/atomic.h"
+#include "osdep/timer.h"
 
 #include "thread_pool.h"
 
-struct work {
+struct mp_thread_pool_job {
+    struct mp_thread_pool *pool;
     void (*fn)(void *ctx);
     void *fn_ctx;
+    bool detached;      // no job handle; free the job after running it
+    bool done;          // protected by pool->lock
+};
+
+// Ring buffer of jobs, used as double-ended queue.
+struct job_queue {
+    struct mp_thread_pool_job **jobs;
+    unsigned int size;  // allocated size of jobs[], power of 2
+    unsigned int start, count;
+};
+
+struct worker {
+    struct mp_thread_pool *pool;
+    pthread_t thread;
+
+    pthread_mutex_t lock;
+    // --- the following fields are protected by lock
+    struct job_queue queues[MP_THREAD_POOL_PRIO_COUNT];
+
+    // --- the following fields are protected by pool->lock
+    bool running;       // thread was started and did not exit yet
+    bool exited;        // thread exited, but was not joined yet
 };
 
 struct mp_thread_pool {
-    pthread_t *threads;
-    int num_threads;
+    struct worker *workers;
+    int max_threads;
+    int min_threads;
+    double idle_timeout;
+
+    atomic_uint next_worker;    // for distributing new jobs
+    atomic_int pending;         // number of queued jobs
+    atomic_int num_idle;        // number of workers waiting for wakeup
+    atomic_int num_threads;     // number of running workers
 
     pthread_mutex_t lock;
     pthread_cond_t wakeup;
+    pthread_cond_t job_done;
 
     // --- the following fields are protected by lock
     bool terminate;
-    struct work *work;
-    int num_work;
 };
 
-static void *worker_thread(void *arg)
+static void queue_push(struct job_queue *q, struct mp_thread_pool_job *job)
+{
+    if (q->count == q->size) {
+        unsigned int new_size = MPMAX(q->size * 2, 16);
+        struct mp_thread_pool_job **jobs =
+            talloc_array(NULL, struct mp_thread_pool_job *, new_size);
+        for (unsigned int n = 0; n < q->count; n++)
+            jobs[n] = q->jobs[(q->start + n) & (q->size - 1)];
+        talloc_free(q->jobs);
+        q->jobs = jobs;
+        q->size = new_size;
+        q->start = 0;
+    }
+    q->jobs[(q->start + q->count) & (q->size - 1)] = job;
+    q->count++;
+}
+
+static struct mp_thread_pool_job *queue_pop_back(struct job_queue *q)
+{
+    if (!q->count)
+        return NULL;
+    q->count--;
+    return q->jobs[(q->start + q->count) & (q->size - 1)];
+}
+
+static struct mp_thread_pool_job *queue_pop_front(struct job_queue *q)
+{
+    if (!q->count)
+        return NULL;
+    struct mp_thread_pool_job *job = q->jobs[q->start];
+    q->start = (q->start + 1) & (q->size - 1);
+    q->count--;
+    return job;
+}
+
+// Take the next job from the worker's own queues, or steal one from another
+// worker. Higher priorities are preferred over the own queues.
+static struct mp_thread_pool_job *take_job(struct worker *w)
+{
+    struct mp_thread_pool *pool = w->pool;
+    struct mp_thread_pool_job *job = NULL;
+
+    if (!atomic_load(&pool->pending))
+        return NULL;
+
+    int index = w - pool->workers;
+    for (int prio = MP_THREAD_POOL_PRIO_COUNT - 1; prio >= 0; prio--) {
+        pthread_mutex_lock(&w->lock);
+        job = queue_pop_front(&w->queues[prio]);
+        pthread_mutex_unlock(&w->lock);
+        if (job)
+            goto done;
+
+        for (int n = 1; n < pool->max_threads; n++) {
+            int victim_index = (index + n) % pool->max_threads;
+            struct worker *victim = &pool->workers[victim_index];
+            pthread_mutex_lock(&victim->lock);
+            job = queue_pop_back(&victim->queues[prio]);
+            pthread_mutex_unlock(&victim->lock);
+            if (job)
+                goto done;
+        }
+    }
+    return NULL;
+
+done:
+    atomic_fetch_add(&pool->pending, -1);
+    return job;
+}
+
+static void run_job(struct mp_thread_pool_job *job)
 {
-    struct mp_thread_pool *pool = arg;
+    struct mp_thread_pool *pool = job->pool;
+
+    job->fn(job->fn_ctx);
+
+    if (job->detached) {
+        talloc_free(job);
+        return;
+    }
 
     pthread_mutex_lock(&pool->lock);
-    while (1) {
-        while (!pool->num_work && !pool->terminate)
-            pthread_cond_wait(&pool->wakeup, &pool->lock);
+    job->done = true;
+    pthread_cond_broadcast(&pool->job_done);
+    pthread_mutex_unlock(&pool->lock);
+}
 
-        if (!pool->num_work && pool->terminate)
-            break;
+static void *worker_thread(void *arg)
+{
+    struct worker *w = arg;
+    struct mp_thread_pool *pool = w->pool;
 
-        assert(pool->num_work > 0);
-        struct work work = pool->work[pool->num_work - 1];
-        pool->num_work -= 1;
+    while (1) {
+        struct mp_thread_pool_job *job = take_job(w);
+        if (job) {
+            run_job(job);
+            continue;
+        }
 
-        pthread_mutex_unlock(&pool->lock);
-        work.fn(work.fn_ctx);
         pthread_mutex_lock(&pool->lock);
+        atomic_fetch_add(&pool->num_idle, 1);
+        bool timeout = false;
+        while (!atomic_load(&pool->pending) && !pool->terminate && !timeout) {
+            if (atomic_load(&pool->num_threads) > pool->min_threads) {
+                struct timespec ts =
+                    mp_rel_time_to_timespec(pool->idle_timeout);
+                timeout = pthread_cond_timedwait(&pool->wakeup, &pool->lock,
+                                                 &ts) == ETIMEDOUT;
+            } else {
+                pthread_cond_wait(&pool->wakeup, &pool->lock);
+            }
+        }
+        atomic_fetch_add(&pool->num_idle, -1);
+        if (pool->terminate ||
+            (timeout && atomic_load(&pool->num_threads) > pool->min_threads))
+        {
+            // Exit only if no jobs are left. num_threads is decremented before
+            // checking, so that add_job() either queues a job we see here, or
+            // sees the lower thread count and starts a new worker.
+            atomic_fetch_add(&pool->num_threads, -1);
+            if (!atomic_load(&pool->pending)) {
+                w->running = false;
+                w->exited = true;
+                pthread_mutex_unlock(&pool->lock);
+                break;
+            }
+            atomic_fetch_add(&pool->num_threads, 1);
+        }
+        pthread_mutex_unlock(&pool->lock);
     }
-    assert(pool->num_work == 0);
-    pthread_mutex_unlock(&pool->lock);
 
     return NULL;
 }
 
+// Start a new worker thread. Must be called with pool->lock held.
+static bool add_worker(struct mp_thread_pool *pool)
+{
+    for (int n = 0; n < pool->max_threads; n++) {
+        struct worker *w = &pool->workers[n];
+        if (w->running)
+            continue;
+        if (w->exited) {
+            pthread_join(w->thread, NULL);
+            w->exited = false;
+        }
+        if (pthread_create(&w->thread, NULL, worker_thread, w))
+            return false;
+        w->running = true;
+        atomic_fetch_add(&pool->num_threads, 1);
+        return true;
+    }
+    return false;
+}
+
 static void thread_pool_dtor(void *ctx)
 {
     struct mp_thread_pool *pool = ctx;
@@ -74,52 +244,171 @@ static void thread_pool_dtor(void *ctx)
     pthread_cond_broadcast(&pool->wakeup);
     pthread_mutex_unlock(&pool->lock);
 
-    for (int n = 0; n < pool->num_threads; n++)
-        pthread_join(pool->threads[n], NULL);
+    // No new threads can be started at this point, so this is race-free.
+    for (int n = 0; n < pool->max_threads; n++) {
+        struct worker *w = &pool->workers[n];
+        pthread_mutex_lock(&pool->lock);
+        bool join = w->running || w->exited;
+        pthread_mutex_unlock(&pool->lock);
+        if (join)
+            pthread_join(w->thread, NULL);
+    }
 
-    assert(pool->num_work == 0);
+    assert(atomic_load(&pool->pending) == 0);
+    for (int n = 0; n < pool->max_threads; n++) {
+        struct worker *w = &pool->workers[n];
+        for (int prio = 0; prio < MP_THREAD_POOL_PRIO_COUNT; prio++)
+            talloc_free(w->queues[prio].jobs);
+        pthread_mutex_destroy(&w->lock);
+    }
+    pthread_cond_destroy(&pool->job_done);
     pthread_cond_destroy(&pool->wakeup);
     pthread_mutex_destroy(&pool->lock);
 }
 
-// Create a thread pool with the given number of worker threads. This can return
-// NULL if the worker threads could not be created. The thread pool can be
-// destroyed with talloc_free(pool), or indirectly with talloc_free(ta_parent).
-// If there are still work items on freeing, it will block until all work items
-// are done, and the threads terminate.
-struct mp_thread_pool *mp_thread_pool_create(void *ta_parent, int threads)
+// Create a thread pool that starts with min_threads worker threads, and adds
+// threads up to max_threads if all threads are busy when new work is queued.
+// Threads above min_threads exit after being idle for idle_timeout seconds.
+// min_threads can be 0, in which case all threads exit when idle, and are
+// started again on demand. If not even one thread can be started then, jobs
+// are run on the thread that queues them. This can return NULL if the initial
+// worker threads could not be created. The thread pool can be destroyed with
+// talloc_free(pool), or indirectly with talloc_free(ta_parent). If there are
+// still work items on freeing, it will block until all work items are done,
+// and the threads terminate.
+struct mp_thread_pool *mp_thread_pool_create_dynamic(void *ta_parent,
+                                                     int min_threads,
+                                                     int max_threads,
+                                                     double idle_timeout)
 {
-    assert(threads > 0);
+    assert(min_threads >= 0);
+    assert(max_threads >= MPMAX(min_threads, 1));
 
     struct mp_thread_pool *pool = talloc_zero(ta_parent, struct mp_thread_pool);
-    talloc_set_destructor(pool, thread_pool_dtor);
+    pool->min_threads = min_threads;
+    pool->max_threads = max_threads;
+    pool->idle_timeout = idle_timeout;
+    pool->workers = talloc_zero_array(pool, struct worker, max_threads);
+    atomic_store(&pool->next_worker, 0);
+    atomic_store(&pool->pending, 0);
+    atomic_store(&pool->num_idle, 0);
+    atomic_store(&pool->num_threads, 0);
 
     pthread_mutex_init(&pool->lock, NULL);
     pthread_cond_init(&pool->wakeup, NULL);
+    pthread_cond_init(&pool->job_done, NULL);
+    for (int n = 0; n < max_threads; n++) {
+        pool->workers[n].pool = pool;
+        pthread_mutex_init(&pool->workers[n].lock, NULL);
+    }
+    talloc_set_destructor(pool, thread_pool_dtor);
 
-    for (int n = 0; n < threads; n++) {
-        pthread_t thread;
-        if (pthread_create(&thread, NULL, worker_thread, pool)) {
-            talloc_free(pool);
-            return NULL;
-        }
-        MP_TARRAY_APPEND(pool, pool->threads, pool->num_threads, thread);
+    pthread_mutex_lock(&pool->lock);
+    bool ok = true;
+    for (int n = 0; n < min_threads; n++)
+        ok &= add_worker(pool);
+    pthread_mutex_unlock(&pool->lock);
+
+    if (!ok) {
+        talloc_free(pool);
+        return NULL;
     }
 
     return pool;
 }
 
+// Create a thread pool with the given fixed number of worker threads.
+// See mp_thread_pool_create_dynamic().
+struct mp_thread_pool *mp_thread_pool_create(void *ta_parent, int threads)
+{
+    return mp_thread_pool_create_dynamic(ta_parent, threads, threads, 0);
+}
+
+static struct mp_thread_pool_job *add_job(struct mp_thread_pool *pool,
+                                          enum mp_thread_pool_prio prio,
+                                          void (*fn)(void *ctx), void *fn_ctx,
+                                          bool detached)
+{
+    assert(prio >= 0 && prio < MP_THREAD_POOL_PRIO_COUNT);
+
+    struct mp_thread_pool_job *job = talloc_ptrtype(NULL, job);
+    *job = (struct mp_thread_pool_job){
+        .pool = pool,
+        .fn = fn,
+        .fn_ctx = fn_ctx,
+        .detached = detached,
+    };
+
+    unsigned int index = atomic_fetch_add(&pool->next_worker, 1);
+    struct worker *w = &pool->workers[index % pool->max_threads];
+    pthread_mutex_lock(&w->lock);
+    queue_push(&w->queues[prio], job);
+    pthread_mutex_unlock(&w->lock);
+    atomic_fetch_add(&pool->pending, 1);
+
+    // If all workers are busy and no more can be added, one of them will
+    // pick up the job when it's done with its current job.
+    if (atomic_load(&pool->num_idle) ||
+        atomic_load(&pool->num_threads) < pool->max_threads)
+    {
+        pthread_mutex_lock(&pool->lock);
+        if (atomic_load(&pool->num_idle)) {
+            pthread_cond_signal(&pool->wakeup);
+        } else if (!pool->terminate) {
+            add_worker(pool);
+        }
+        bool no_threads = !atomic_load(&pool->num_threads);
+        pthread_mutex_unlock(&pool->lock);
+
+        // Only possible with min_threads==0: nobody else would run the job.
+        if (no_threads) {
+            struct mp_thread_pool_job *queued;
+            while ((queued = take_job(w)))
+                run_job(queued);
+        }
+    }
+
+    return job;
+}
+
 // Queue a function to be run on a worker thread: fn(fn_ctx)
-// If no worker thread is currently available, it's appended to a list in memory
-// with unbounded size. This function always returns immediately.
-// Concurrent queue calls are allowed, as long as it does not overlap with
-// pool destruction.
+// This function always returns immediately. Concurrent queue calls are
+// allowed, as long as it does not overlap with pool destruction.
 void mp_thread_pool_queue(struct mp_thread_pool *pool, void (*fn)(void *ctx),
                           void *fn_ctx)
 {
+    add_job(pool, MP_THREAD_POOL_PRIO_NORMAL, fn, fn_ctx, true);
+}
+
+// Like mp_thread_pool_queue(), but with the given priority. Jobs with higher
+// priority are run first. Returns a job handle, which must be released with
+// mp_thread_pool_job_wait().
+struct mp_thread_pool_job *mp_thread_pool_submit(struct mp_thread_pool *pool,
+                                                 enum mp_thread_pool_prio prio,
+                                                 void (*fn)(void *ctx),
+                                                 void *fn_ctx)
+{
+    return add_job(pool, prio, fn, fn_ctx, false);
+}
+
+// Whether the job's function has returned.
+bool mp_thread_pool_job_done(struct mp_thread_pool_job *job)
+{
+    pthread_mutex_lock(&job->pool->lock);
+    bool done = job->done;
+    pthread_mutex_unlock(&job->pool->lock);
+    return done;
+}
+
+// Wait until the job's function has returned, and free the job handle.
+void mp_thread_pool_job_wait(struct mp_thread_pool_job *job)
+{
+    struct mp_thread_pool *pool = job->pool;
+
     pthread_mutex_lock(&pool->lock);
-    struct work work = {fn, fn_ctx};
-    MP_TARRAY_INSERT_AT(pool, pool->work, pool->num_work, 0, work);
-    pthread_cond_signal(&pool->wakeup);
+    while (!job->done)
+        pthread_cond_wait(&pool->job_done, &pool->lock);
     pthread_mutex_unlock(&pool->lock);
+
+    talloc_free(job);
 }
@@ -1,10 +1,30 @@
 #ifndef MPV_MP_THREAD_POOL_H
 #define MPV_MP_THREAD_POOL_H
 
+#include <stdbool.h>
+
 struct mp_thread_pool;
+struct mp_thread_pool_job;
+
+enum mp_thread_pool_prio {
+    MP_THREAD_POOL_PRIO_LOW,
+    MP_THREAD_POOL_PRIO_NORMAL,
+    MP_THREAD_POOL_PRIO_HIGH,
+    MP_THREAD_POOL_PRIO_COUNT
+};
 
 struct mp_thread_pool *mp_thread_pool_create(void *ta_parent, int threads);
+struct mp_thread_pool *mp_thread_pool_create_dynamic(void *ta_parent,
+                                                     int min_threads,
+                                                     int max_threads,
+                                                     double idle_timeout);
 void mp_thread_pool_queue(struct mp_thread_pool *pool, void (*fn)(void *ctx),
                           void *fn_ctx);
+struct mp_thread_pool_job *mp_thread_pool_submit(struct mp_thread_pool *pool,
+                                                 enum mp_thread_pool_prio prio,
+                                                 void (*fn)(void *ctx),
+                                                 void *fn_ctx);
+bool mp_thread_pool_job_done(struct mp_thread_pool_job *job);
+void mp_thread_pool_job_wait(struct mp_thread_pool_job *job);
 
 #endif
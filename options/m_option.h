@@ -418,7 +418,8 @@ char *format_file_size(int64_t size);
 #define UPDATE_VOL              (1 << 17) // softvol related options
 #define UPDATE_LAVFI_COMPLEX    (1 << 18) // --lavfi-complex
 #define UPDATE_VO_RESIZE        (1 << 19) // --android-surface-size
-#define UPDATE_OPT_LAST         (1 << 19)
+#define UPDATE_TRACE            (1 << 20) // --trace-file
+#define UPDATE_OPT_LAST         (1 << 20)
 
 // All bits between _FIRST and _LAST (inclusive)
 #define UPDATE_OPTS_MASK \
@@ -36,8 +36,62 @@
 #include "common/msg.h"
 #include "common/common.h"
 
+struct index_entry {
+    bstr name;
+    struct m_property *prop;
+};
+
+struct m_property_index {
+    struct m_property *list;
+    struct index_entry *entries;    // sorted by name
+    int num_entries;
+};
+
+static int compare_entry(const void *a, const void *b)
+{
+    const struct index_entry *ea = a, *eb = b;
+    return bstrcmp(ea->name, eb->name);
+}
+
+// Create a lookup table for the given property list (terminated by a {0}
+// entry). The list must not be changed while the index is used. If the list
+// contains duplicate names, which of them is found is undefined.
+struct m_property_index *m_property_index_create(void *ta_parent,
+                                                 const struct m_property *list)
+{
+    struct m_property_index *index = talloc_zero(ta_parent,
+                                                 struct m_property_index);
+    index->list = (struct m_property *)list;
+    for (int n = 0; list[n].name; n++) {
+        struct index_entry e = {bstr0(list[n].name), &index->list[n]};
+        MP_TARRAY_APPEND(index, index->entries, index->num_entries, e);
+    }
+    qsort(index->entries, index->num_entries, sizeof(index->entries[0]),
+          compare_entry);
+    return index;
+}
+
+// Like m_property_list_find(), but with a binary search.
+struct m_property *m_property_index_find(struct m_property_index *index,
+                                         bstr name)
+{
+    int lo = 0, hi = index->num_entries;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        int cmp = bstrcmp(index->entries[mid].name, name);
+        if (cmp == 0)
+            return index->entries[mid].prop;
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
 static int m_property_multiply(struct mp_log *log,
-                               const struct m_property *prop_list,
+                               struct m_property_index *prop_list,
                                const char *property, double f, void *ctx)
 {
     union m_option_value val = {0};
@@ -72,16 +126,15 @@ struct m_property *m_property_list_find(const struct m_property *list,
     return NULL;
 }
 
-static int do_action(const struct m_property *prop_list, const char *name,
+static int do_action(struct m_property_index *prop_list, const char *name,
                      int action, void *arg, void *ctx)
 {
     struct m_property *prop;
     struct m_property_action_arg ka;
     const char *sep = strchr(name, '/');
     if (sep && sep[1]) {
-        char base[128];
-        snprintf(base, sizeof(base), "%.*s", (int)(sep - name), name);
-        prop = m_property_list_find(prop_list, base);
+        bstr base = {(unsigned char *)name, sep - name};
+        prop = m_property_index_find(prop_list, base);
         ka = (struct m_property_action_arg) {
             .key = sep + 1,
             .action = action,
@@ -90,14 +143,14 @@ static int do_action(const struct m_property *prop_list, const char *name,
         action = M_PROPERTY_KEY_ACTION;
         arg = &ka;
     } else
-        prop = m_property_list_find(prop_list, name);
+        prop = m_property_index_find(prop_list, bstr0(name));
     if (!prop)
         return M_PROPERTY_UNKNOWN;
     return prop->call(ctx, prop, action, arg);
 }
 
 // (as a hack, log can be NULL on read-only paths)
-int m_property_do(struct mp_log *log, const struct m_property *prop_list,
+int m_property_do(struct mp_log *log, struct m_property_index *prop_list,
                   const char *name, int action, void *arg, void *ctx)
 {
     union m_option_value val = {0};
@@ -235,7 +288,7 @@ static void m_property_unkey(int *action, void **arg)
     }
 }
 
-static int m_property_do_bstr(const struct m_property *prop_list, bstr name,
+static int m_property_do_bstr(struct m_property_index *prop_list, bstr name,
                               int action, void *arg, void *ctx)
 {
     char name0[64];
@@ -253,7 +306,7 @@ static void append_str(char **s, int *len, bstr append)
     *len = *len + append.len;
 }
 
-static int expand_property(const struct m_property *prop_list, char **ret,
+static int expand_property(struct m_property_index *prop_list, char **ret,
                            int *ret_len, bstr prop, bool silent_error, void *ctx)
 {
     bool cond_yes = bstr_eatstart0(&prop, "?");
@@ -284,7 +337,7 @@ static int expand_property(const struct m_property *prop_list, char **ret,
     return skip;
 }
 
-char *m_properties_expand_string(const struct m_property *prop_list,
+char *m_properties_expand_string(struct m_property_index *prop_list,
                                  const char *str0, void *ctx)
 {
     char *ret = NULL;
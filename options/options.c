@@ -306,6 +306,7 @@ const struct m_sub_options dvd_conf = {
 const struct m_sub_options filter_conf = {
     .opts = (const struct m_option[]){
         OPT_FLAG("deinterlace", deinterlace, 0),
+        OPT_INTRANGE("vf-thread-queue", vf_thread_queue, 0, 0, 100),
         {0}
     },
     .size = sizeof(OPT_BASE_STRUCT),
@@ -357,6 +358,7 @@ const m_option_t mp_opts[] = {
     OPT_GENERAL(char**, "msg-level", msg_levels, CONF_PRE_PARSE | UPDATE_TERM,
                 .type = &m_option_type_msglevels),
     OPT_STRING("dump-stats", dump_stats, UPDATE_TERM | CONF_PRE_PARSE),
+    OPT_STRING("trace-file", trace_file, M_OPT_FILE | UPDATE_TRACE),
     OPT_FLAG("msg-color", msg_color, CONF_PRE_PARSE | UPDATE_TERM),
     OPT_STRING("log-file", log_file, CONF_PRE_PARSE | M_OPT_FILE | UPDATE_TERM),
     OPT_FLAG("msg-module", msg_module, UPDATE_TERM),
@@ -393,6 +395,9 @@ const m_option_t mp_opts[] = {
 // ------------------------- stream options --------------------
 
     OPT_SUBSTRUCT("", stream_cache, stream_cache_conf, 0),
+    OPT_FLAG("stream-mmap", stream_mmap, 0),
+    OPT_BYTE_SIZE("stream-buffer-size", stream_buffer_size, 0,
+                  4 * 1024, 256 * 1024 * 1024),
 
 #if HAVE_DVDREAD || HAVE_DVDNAV
     OPT_SUBSTRUCT("", dvd_opts, dvd_conf, 0),
@@ -513,6 +518,11 @@ const m_option_t mp_opts[] = {
     OPT_STRING("ad", audio_decoders, 0),
     OPT_STRING("vd", video_decoders, 0),
 
+    OPT_FLAG("vd-queue-enable", vd_queue_enable, 0),
+    OPT_INTRANGE("vd-queue-max-frames", vd_queue_max_frames, 0, 1, 1000),
+    OPT_FLAG("ad-queue-enable", ad_queue_enable, 0),
+    OPT_INTRANGE("ad-queue-max-frames", ad_queue_max_frames, 0, 1, 1000),
+
     OPT_STRING("audio-spdif", audio_spdif, 0),
 
     OPT_STRING_VALIDATE("hwdec", hwdec_api, M_OPT_OPTIONAL_PARAM,
@@ -618,6 +628,7 @@ const m_option_t mp_opts[] = {
     OPT_FLAG("video-latency-hacks", video_latency_hacks, 0),
 
     OPT_FLAG("untimed", untimed, 0),
+    OPT_STRING("benchmark", benchmark, M_OPT_FILE),
 
     OPT_STRING("stream-dump", stream_dump, M_OPT_FILE),
 
@@ -702,6 +713,10 @@ const m_option_t mp_opts[] = {
 
     OPT_STRING("input-file", input_file, M_OPT_FILE | UPDATE_INPUT),
     OPT_STRING("input-ipc-server", ipc_path, M_OPT_FILE | UPDATE_INPUT),
+    OPT_INTRANGE("client-event-queue-size", client_event_queue_size, 0,
+                 16, 1000000),
+    OPT_CHOICE("client-event-overflow", client_event_overflow, 0,
+               ({"choke", 0}, {"drop", 1}, {"coalesce", 2}, {"block", 3})),
 
     OPT_SUBSTRUCT("screenshot", screenshot_image_opts, screenshot_conf, 0),
     OPT_STRING("screenshot-template", screenshot_template, 0),
@@ -772,7 +787,6 @@ const m_option_t mp_opts[] = {
     OPT_REMOVED("ass-bottom-margin", "use --vf=sub=bottom:top"),
     OPT_REPLACED("ass", "sub-ass"),
     OPT_REPLACED("audiofile", "audio-file"),
-    OPT_REMOVED("benchmark", "use --untimed (no stats)"),
     OPT_REMOVED("capture", NULL),
     OPT_REMOVED("stream-capture", NULL),
     OPT_REMOVED("channels", "use --audio-channels (changed semantics)"),
@@ -887,6 +901,8 @@ const struct MPOpts mp_default_opts = {
     .audio_driver_list = NULL,
     .audio_decoders = NULL,
     .video_decoders = NULL,
+    .vd_queue_max_frames = 3,
+    .ad_queue_max_frames = 16,
     .softvol_max = 130,
     .softvol_volume = 100,
     .softvol_mute = 0,
@@ -922,6 +938,7 @@ const struct MPOpts mp_default_opts = {
     .autoload_files = 1,
     .demuxer_thread = 1,
     .hls_bitrate = INT_MAX,
+    .stream_buffer_size = 128 * 1024,
     .cache_pause = 1,
     .cache_pause_wait = 1.0,
     .chapterrange = {-1, -1},
@@ -968,6 +985,8 @@ const struct MPOpts mp_default_opts = {
 
     .index_mode = 1,
 
+    .client_event_queue_size = 1000,
+
     .mf_fps = 1.0,
 
     .display_tags = (char **)(const char*[]){
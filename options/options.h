@@ -67,6 +67,7 @@ struct mp_cache_opts {
     int back_buffer;
     char *file;
     int file_max;
+    int prefetch_requests;
 };
 
 // Subtitle options needed by the subtitle decoders/renderers.
@@ -123,6 +124,7 @@ typedef struct MPOpts {
     int property_print_help;
     int use_terminal;
     char *dump_stats;
+    char *trace_file;
     int verbose;
     int msg_really_quiet;
     char **msg_levels;
@@ -178,6 +180,10 @@ typedef struct MPOpts {
     char *audio_decoders;
     char *video_decoders;
     char *audio_spdif;
+    int vd_queue_enable;
+    int vd_queue_max_frames;
+    int ad_queue_enable;
+    int ad_queue_max_frames;
 
     struct mp_subtitle_opts *subs_rend;
     struct mp_osd_render_opts *osd_rend;
@@ -189,6 +195,7 @@ typedef struct MPOpts {
     int video_osd;
 
     int untimed;
+    char *benchmark;
     char *stream_dump;
     char *record_file;
     int stop_playback_on_init_failure;
@@ -208,6 +215,8 @@ typedef struct MPOpts {
     int use_filedir_conf;
     int hls_bitrate;
     struct mp_cache_opts *stream_cache;
+    int stream_mmap;
+    int64_t stream_buffer_size;
     int chapterrange[2];
     int edition_id;
     int correct_pts;
@@ -330,6 +339,8 @@ typedef struct MPOpts {
 
     char *ipc_path;
     char *input_file;
+    int client_event_queue_size;
+    int client_event_overflow;
 
     int wingl_dwm_flush;
 
@@ -359,6 +370,7 @@ struct dvd_opts {
 
 struct filter_opts {
     int deinterlace;
+    int vf_thread_queue;
 };
 
 extern const m_option_t mp_opts[];
@@ -49,3 +49,16 @@ void mpthread_set_name(const char *name)
     pthread_setname_np(tname);
 #endif
 }
+
+// Get the name of the calling thread. Returns an empty string if the name is
+// unknown or if the platform doesn't support it.
+void mpthread_get_name(char *buf, size_t size)
+{
+    if (!size)
+        return;
+    buf[0] = '\0';
+#if HAVE_GLIBC_THREAD_NAME || HAVE_OSX_THREAD_NAME
+    if (pthread_getname_np(pthread_self(), buf, size))
+        buf[0] = '\0';
+#endif
+}
@@ -3,11 +3,13 @@
 
 #include <pthread.h>
 #include <inttypes.h>
+#include <stddef.h>
 
 // Helper to reduce boiler plate.
 int mpthread_mutex_init_recursive(pthread_mutex_t *mutex);
 
 // Set thread name (for debuggers).
 void mpthread_set_name(const char *name);
+void mpthread_get_name(char *buf, size_t size);
 
 #endif
@@ -22,6 +22,10 @@
 #include <math.h>
 #include <assert.h>
 
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
 #include "common/common.h"
 #include "common/global.h"
 #include "common/msg.h"
@@ -32,11 +36,14 @@
 #include "misc/ctype.h"
 #include "misc/dispatch.h"
 #include "misc/rendezvous.h"
+#include "misc/node.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
 #include "options/m_property.h"
+#include "options/options.h"
 #include "options/path.h"
 #include "options/parse_configfile.h"
+#include "osdep/atomic.h"
 #include "osdep/threads.h"
 #include "osdep/timer.h"
 #include "osdep/io.h"
@@ -86,6 +93,25 @@ struct mp_client_api {
 
     struct mpv_render_context *render_context;
     struct mpv_opengl_cb_context *gl_cb_ctx;
+
+    // Last values of observed properties, shared by all observers.
+    struct prop_cache **prop_caches;
+    int num_prop_caches;
+};
+
+// The value of a property/format pair, as last retrieved by any observer.
+// Observers compare the generation numbers instead of the values to find out
+// whether the property changed. Protected by mp_client_api.lock.
+struct prop_cache {
+    char *name;
+    int id;                 // ==mp_get_property_id(name)
+    mpv_format format;
+    int refcount;           // number of observe_property referencing this
+    uint64_t notify_gen;    // incremented on each change notification
+    uint64_t fetched_gen;   // notify_gen at the time value was retrieved
+    uint64_t value_gen;     // incremented if value actually changed
+    bool value_valid;
+    union m_option_value value;
 };
 
 struct observe_property {
@@ -100,6 +126,8 @@ struct observe_property {
     bool dead;              // property unobserved while retrieving value
     bool new_value_valid, user_value_valid;
     union m_option_value new_value, user_value;
+    uint64_t new_value_gen, user_value_gen; // prop_cache.value_gen of values
+    struct prop_cache *cache; // NULL if format==MPV_FORMAT_NONE
     struct mpv_handle *client;
 };
 
@@ -124,6 +152,21 @@ struct mpv_handle {
     void (*wakeup_cb)(void *d);
     void *wakeup_cb_ctx;
     int wakeup_pipe[2];
+    int wakeup_eventfd;
+
+    // -- event queue
+    // This is a SPSC ringbuffer. Writers are serialized by holding lock, and
+    // the mpv_wait_event() thread is the only reader. Reading an event does
+    // not need the lock, so the core never waits for a client that is
+    // draining its queue.
+    mpv_event *events;      // ringbuffer of max_events entries
+    int max_events;         // allocated number of entries in events
+    atomic_ullong event_rpos; // events[event_rpos % max_events] is next read
+    atomic_ullong event_wpos; // number of events ever written
+    atomic_ullong coalesce_pending; // mask of coalescible events in the queue
+    atomic_int event_space_waiters; // writers waiting on event_space
+    pthread_cond_t event_space;     // signaled (with lock) after reading
+    int overflow_policy;    // EVENT_OVERFLOW_*
 
     // -- protected by lock
 
@@ -131,12 +174,12 @@ struct mpv_handle {
     bool queued_wakeup;
     int suspend_count;
 
-    mpv_event *events;      // ringbuffer of max_events entries
-    int max_events;         // allocated number of entries in events
-    int first_event;        // events[first_event] is the first readable event
-    int num_events;         // number of readable events
     int reserved_events;    // number of entries reserved for replies
+    int blocked_senders;    // send_event_wait() calls in progress
+    bool destroying;        // make blocked senders give up
     bool choked;            // recovering from queue overflow
+    int64_t events_dropped; // events lost due to queue overflow
+    int64_t events_coalesced; // events merged with an already queued one
 
     struct observe_property **properties;
     int num_properties;
@@ -149,6 +192,20 @@ struct mpv_handle {
     struct mp_log_buffer *messages;
 };
 
+enum {
+    EVENT_OVERFLOW_CHOKE,       // drop new events until the queue is empty
+    EVENT_OVERFLOW_DROP,        // drop only the events that don't fit
+    EVENT_OVERFLOW_COALESCE,    // merge events without data, otherwise choke
+    EVENT_OVERFLOW_BLOCK,       // wait for the client, then choke
+};
+
+// Maximum time a sender blocks with EVENT_OVERFLOW_BLOCK.
+#define EVENT_BLOCK_TIMEOUT 0.1
+
+static bool read_event(struct mpv_handle *ctx, struct mpv_event *event,
+                       bool locked);
+static void prop_cache_unref(struct mp_client_api *clients,
+                             struct observe_property *prop);
 static bool gen_log_message_event(struct mpv_handle *ctx);
 static bool gen_property_change_event(struct mpv_handle *ctx);
 static void notify_property_events(struct mpv_handle *ctx, uint64_t event_mask);
@@ -248,7 +305,12 @@ struct mpv_handle *mp_new_client(struct mp_client_api *clients, const char *name
         return NULL;
     }
 
-    int num_events = 1000;
+    struct mpv_global *global = clients->mpctx->global;
+    int num_events, overflow_policy;
+    mp_read_option_raw(global, "client-event-queue-size", &m_option_type_int,
+                       &num_events);
+    mp_read_option_raw(global, "client-event-overflow", &m_option_type_choice,
+                       &overflow_policy);
 
     struct mpv_handle *client = talloc_ptrtype(NULL, client);
     *client = (struct mpv_handle){
@@ -258,12 +320,15 @@ struct mpv_handle *mp_new_client(struct mp_client_api *clients, const char *name
         .cur_event = talloc_zero(client, struct mpv_event),
         .events = talloc_array(client, mpv_event, num_events),
         .max_events = num_events,
+        .overflow_policy = overflow_policy,
         .event_mask = (1ULL << INTERNAL_EVENT_BASE) - 1, // exclude internal events
         .wakeup_pipe = {-1, -1},
+        .wakeup_eventfd = -1,
     };
     pthread_mutex_init(&client->lock, NULL);
     pthread_mutex_init(&client->wakeup_lock, NULL);
     pthread_cond_init(&client->wakeup, NULL);
+    pthread_cond_init(&client->event_space, NULL);
 
     snprintf(client->name, sizeof(client->name), "%s", nname);
 
@@ -312,6 +377,16 @@ struct MPContext *mp_client_api_get_core(struct mp_client_api *api)
     return api->mpctx;
 }
 
+// Make the fds returned by mpv_get_wakeup_pipe()/mpv_get_wakeup_eventfd()
+// readable.
+static void signal_wakeup_fd(struct mpv_handle *ctx)
+{
+    if (ctx->wakeup_pipe[1] != -1)
+        (void)write(ctx->wakeup_pipe[1], &(char){0}, 1);
+    if (ctx->wakeup_eventfd != -1)
+        (void)write(ctx->wakeup_eventfd, &(uint64_t){1}, sizeof(uint64_t));
+}
+
 static void wakeup_client(struct mpv_handle *ctx)
 {
     pthread_mutex_lock(&ctx->wakeup_lock);
@@ -320,8 +395,7 @@ static void wakeup_client(struct mpv_handle *ctx)
         pthread_cond_broadcast(&ctx->wakeup);
         if (ctx->wakeup_cb)
             ctx->wakeup_cb(ctx->wakeup_cb_ctx);
-        if (ctx->wakeup_pipe[0] != -1)
-            (void)write(ctx->wakeup_pipe[1], &(char){0}, 1);
+        signal_wakeup_fd(ctx);
     }
     pthread_mutex_unlock(&ctx->wakeup_lock);
 }
@@ -412,12 +486,26 @@ static void mp_destroy_client(mpv_handle *ctx, bool terminate)
     for (int n = 0; n < clients->num_clients; n++) {
         if (clients->clients[n] == ctx) {
             MP_TARRAY_REMOVE_AT(clients->clients, clients->num_clients, n);
-            while (ctx->num_events) {
-                talloc_free(ctx->events[ctx->first_event].data);
-                ctx->first_event = (ctx->first_event + 1) % ctx->max_events;
-                ctx->num_events--;
+            for (int i = 0; i < ctx->num_properties; i++)
+                prop_cache_unref(clients, ctx->properties[i]);
+            // Senders blocked on a full queue don't hold clients->lock.
+            // Make them give up, and wait until they are done with ctx.
+            pthread_mutex_lock(&ctx->lock);
+            ctx->destroying = true;
+            pthread_cond_broadcast(&ctx->event_space);
+            while (ctx->blocked_senders)
+                wait_wakeup(ctx, INT64_MAX);
+            pthread_mutex_unlock(&ctx->lock);
+            struct mpv_event event;
+            while (read_event(ctx, &event, false))
+                talloc_free(event.data);
+            if (ctx->events_dropped || ctx->events_coalesced) {
+                MP_VERBOSE(ctx, "Events dropped: %"PRId64", coalesced: "
+                           "%"PRId64"\n", ctx->events_dropped,
+                           ctx->events_coalesced);
             }
             mp_msg_log_buffer_destroy(ctx->messages);
+            pthread_cond_destroy(&ctx->event_space);
             pthread_cond_destroy(&ctx->wakeup);
             pthread_mutex_destroy(&ctx->wakeup_lock);
             pthread_mutex_destroy(&ctx->lock);
@@ -425,6 +513,8 @@ static void mp_destroy_client(mpv_handle *ctx, bool terminate)
                 close(ctx->wakeup_pipe[0]);
                 close(ctx->wakeup_pipe[1]);
             }
+            if (ctx->wakeup_eventfd != -1)
+                close(ctx->wakeup_eventfd);
             talloc_free(ctx);
             ctx = NULL;
             break;
@@ -623,6 +713,59 @@ static void dup_event_data(struct mpv_event *ev)
     }
 }
 
+// Events without data and reply ID can be merged with an already queued event
+// of the same type (with EVENT_OVERFLOW_COALESCE).
+static bool event_is_coalescible(struct mpv_event *event)
+{
+    return !event->data && !event->reply_userdata && !event->error &&
+           event->event_id != MPV_EVENT_SHUTDOWN;
+}
+
+// Number of events in the ringbuffer.
+static int queued_events(struct mpv_handle *ctx)
+{
+    return atomic_load(&ctx->event_wpos) - atomic_load(&ctx->event_rpos);
+}
+
+// Remove the oldest event from the ringbuffer. Can be called without holding
+// ctx->lock (locked says whether it is held), but only by a single thread at
+// a time (the mpv_wait_event() caller, or the thread destroying the handle).
+static bool read_event(struct mpv_handle *ctx, struct mpv_event *event,
+                       bool locked)
+{
+    uint64_t rpos = atomic_load(&ctx->event_rpos);
+    if (rpos == atomic_load(&ctx->event_wpos))
+        return false;
+    *event = ctx->events[rpos % ctx->max_events];
+    // Clear this before making the entry available for writing, so that a new
+    // event of the same type is never merged into one that was already read.
+    if (event_is_coalescible(event))
+        atomic_fetch_and(&ctx->coalesce_pending, ~(1ULL << event->event_id));
+    atomic_store(&ctx->event_rpos, rpos + 1);
+    if (atomic_load(&ctx->event_space_waiters)) {
+        if (!locked)
+            pthread_mutex_lock(&ctx->lock);
+        pthread_cond_broadcast(&ctx->event_space);
+        if (!locked)
+            pthread_mutex_unlock(&ctx->lock);
+    }
+    return true;
+}
+
+// Wait until the reader makes space in the ringbuffer, or the deadline is
+// reached. Must be called with ctx->lock held.
+static void wait_event_space(struct mpv_handle *ctx, struct timespec *deadline)
+{
+    atomic_fetch_add(&ctx->event_space_waiters, 1);
+    while (queued_events(ctx) + ctx->reserved_events >= ctx->max_events &&
+           !ctx->destroying)
+    {
+        if (pthread_cond_timedwait(&ctx->event_space, &ctx->lock, deadline))
+            break;
+    }
+    atomic_fetch_add(&ctx->event_space_waiters, -1);
+}
+
 // Reserve an entry in the ring buffer. This can be used to guarantee that the
 // reply can be made, even if the buffer becomes congested _after_ sending
 // the request.
@@ -631,7 +774,8 @@ static int reserve_reply(struct mpv_handle *ctx)
 {
     int res = MPV_ERROR_EVENT_QUEUE_FULL;
     pthread_mutex_lock(&ctx->lock);
-    if (ctx->reserved_events + ctx->num_events < ctx->max_events && !ctx->choked)
+    if (ctx->reserved_events + queued_events(ctx) < ctx->max_events &&
+        !ctx->choked)
     {
         ctx->reserved_events++;
         res = 0;
@@ -640,20 +784,41 @@ static int reserve_reply(struct mpv_handle *ctx)
     return res;
 }
 
+// Must be called with ctx->lock held.
 static int append_event(struct mpv_handle *ctx, struct mpv_event event, bool copy)
 {
-    if (ctx->num_events + ctx->reserved_events >= ctx->max_events)
+    if (queued_events(ctx) + ctx->reserved_events >= ctx->max_events)
         return -1;
     if (copy)
         dup_event_data(&event);
-    ctx->events[(ctx->first_event + ctx->num_events) % ctx->max_events] = event;
-    ctx->num_events++;
+    uint64_t wpos = atomic_load(&ctx->event_wpos);
+    ctx->events[wpos % ctx->max_events] = event;
+    if (ctx->overflow_policy == EVENT_OVERFLOW_COALESCE &&
+        event_is_coalescible(&event))
+        atomic_fetch_or(&ctx->coalesce_pending, 1ULL << event.event_id);
+    // Publishes the entry to the reader.
+    atomic_store(&ctx->event_wpos, wpos + 1);
     wakeup_client(ctx);
     if (event.event_id == MPV_EVENT_SHUTDOWN)
         ctx->event_mask &= ctx->event_mask & ~(1ULL << MPV_EVENT_SHUTDOWN);
     return 0;
 }
 
+// Must be called with ctx->lock held.
+static void event_overflow(struct mpv_handle *ctx)
+{
+    ctx->events_dropped++;
+    if (ctx->overflow_policy != EVENT_OVERFLOW_DROP) {
+        MP_ERR(ctx, "Too many events queued.\n");
+        ctx->choked = true;
+    }
+}
+
+// Queue the event. Returns 0 if it was queued (or not wanted by the client),
+// and -1 if it was dropped. If the queue is full and the client uses
+// EVENT_OVERFLOW_BLOCK, the event is not queued and 1 is returned. Then the
+// caller must call send_event_wait() with the same arguments, after releasing
+// clients->lock. (Waiting while holding it would stall all other clients.)
 static int send_event(struct mpv_handle *ctx, struct mpv_event *event, bool copy)
 {
     pthread_mutex_lock(&ctx->lock);
@@ -663,19 +828,52 @@ static int send_event(struct mpv_handle *ctx, struct mpv_event *event, bool copy
     int r;
     if (!(ctx->event_mask & mask)) {
         r = 0;
+    } else if (ctx->overflow_policy == EVENT_OVERFLOW_COALESCE &&
+               event_is_coalescible(event) &&
+               (atomic_load(&ctx->coalesce_pending) & mask))
+    {
+        // An identical event is still queued and not read yet.
+        ctx->events_coalesced++;
+        r = 0;
     } else if (ctx->choked) {
+        ctx->events_dropped++;
         r = -1;
     } else {
         r = append_event(ctx, *event, copy);
-        if (r < 0) {
-            MP_ERR(ctx, "Too many events queued.\n");
-            ctx->choked = true;
+        if (r < 0 && ctx->overflow_policy == EVENT_OVERFLOW_BLOCK) {
+            ctx->blocked_senders++;
+            r = 1;
+        } else if (r < 0) {
+            event_overflow(ctx);
         }
     }
     pthread_mutex_unlock(&ctx->lock);
     return r;
 }
 
+// Finish a send_event() call that returned 1: wait for queue space until the
+// deadline, then queue the event or drop it. Must be called without holding
+// clients->lock. The blocked_senders count keeps ctx alive until then.
+static int send_event_wait(struct mpv_handle *ctx, struct mpv_event *event,
+                           bool copy, struct timespec *deadline)
+{
+    pthread_mutex_lock(&ctx->lock);
+    wait_event_space(ctx, deadline);
+    int r = -1;
+    if (ctx->choked) {
+        ctx->events_dropped++;
+    } else {
+        r = append_event(ctx, *event, copy);
+        if (r < 0)
+            event_overflow(ctx);
+    }
+    ctx->blocked_senders--;
+    if (!ctx->blocked_senders)
+        wakeup_client(ctx); // for mp_destroy_client()
+    pthread_mutex_unlock(&ctx->lock);
+    return r;
+}
+
 // Send a reply; the reply must have been previously reserved with
 // reserve_reply (otherwise, use send_event()).
 //该回复必须事先用reserve_reply保留（否则，请使用send_event（））
@@ -725,9 +923,35 @@ bool mp_client_event_is_registered(struct MPContext *mpctx, int event)
     return r;
 }
 
+// Write the event queue state of all clients as node array to dst.
+void mp_client_get_event_stats(struct MPContext *mpctx, struct mpv_node *dst)
+{
+    struct mp_client_api *clients = mpctx->clients;
+
+    node_init(dst, MPV_FORMAT_NODE_ARRAY, NULL);
+
+    pthread_mutex_lock(&clients->lock);
+
+    for (int n = 0; n < clients->num_clients; n++) {
+        struct mpv_handle *ctx = clients->clients[n];
+        struct mpv_node *entry = node_array_add(dst, MPV_FORMAT_NODE_MAP);
+        pthread_mutex_lock(&ctx->lock);
+        node_map_add_string(entry, "name", ctx->name);
+        node_map_add_int64(entry, "queued", queued_events(ctx));
+        node_map_add_int64(entry, "capacity", ctx->max_events);
+        node_map_add_int64(entry, "dropped", ctx->events_dropped);
+        node_map_add_int64(entry, "coalesced", ctx->events_coalesced);
+        pthread_mutex_unlock(&ctx->lock);
+    }
+
+    pthread_mutex_unlock(&clients->lock);
+}
+
 void mp_client_broadcast_event(struct MPContext *mpctx, int event, void *data)
 {
     struct mp_client_api *clients = mpctx->clients;
+    struct mpv_handle **blocked = NULL;
+    int num_blocked = 0;
 
     pthread_mutex_lock(&clients->lock);
 
@@ -736,10 +960,22 @@ void mp_client_broadcast_event(struct MPContext *mpctx, int event, void *data)
             .event_id = event,
             .data = data,
         };
-        send_event(clients->clients[n], &event_data, true);
+        if (send_event(clients->clients[n], &event_data, true) > 0)
+            MP_TARRAY_APPEND(NULL, blocked, num_blocked, clients->clients[n]);
     }
 
     pthread_mutex_unlock(&clients->lock);
+
+    // All blocked clients share a single timeout.
+    struct timespec deadline = mp_rel_time_to_timespec(EVENT_BLOCK_TIMEOUT);
+    for (int n = 0; n < num_blocked; n++) {
+        struct mpv_event event_data = {
+            .event_id = event,
+            .data = data,
+        };
+        send_event_wait(blocked[n], &event_data, true, &deadline);
+    }
+    talloc_free(blocked);
 }
 
 // If client_name == NULL, then broadcast and free the event.
@@ -773,6 +1009,11 @@ int mp_client_send_event(struct MPContext *mpctx, const char *client_name,
 
     pthread_mutex_unlock(&clients->lock);
 
+    if (r > 0) {
+        struct timespec deadline = mp_rel_time_to_timespec(EVENT_BLOCK_TIMEOUT);
+        r = send_event_wait(ctx, &event_data, false, &deadline);
+    }
+
     return r;
 }
 
@@ -812,12 +1053,6 @@ mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout)
 {
     mpv_event *event = ctx->cur_event;
 
-    pthread_mutex_lock(&ctx->lock);
-
-    if (!ctx->fuzzy_initialized)
-        mp_wakeup_core(ctx->clients->mpctx);
-    ctx->fuzzy_initialized = true;
-
     if (timeout < 0)
         timeout = 1e20;
 
@@ -826,11 +1061,24 @@ mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout)
     *event = (mpv_event){0};
     talloc_free_children(event);
 
+    // Fast path: return queued events without contending with the core for
+    // ctx->lock.
+    if (ctx->fuzzy_initialized && read_event(ctx, event, false)) {
+        talloc_steal(event, event->data);
+        return event;
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+
+    if (!ctx->fuzzy_initialized)
+        mp_wakeup_core(ctx->clients->mpctx);
+    ctx->fuzzy_initialized = true;
+
     while (1) {
         if (ctx->queued_wakeup)
             deadline = 0;
         // Recover from overflow.
-        if (ctx->choked && !ctx->num_events) {
+        if (ctx->choked && !queued_events(ctx)) {
             ctx->choked = false;
             event->event_id = MPV_EVENT_QUEUE_OVERFLOW;
             break;
@@ -840,10 +1088,7 @@ mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout)
             MP_ERR(ctx, "attempting to wait while core is suspended");
             break;
         }
-        if (ctx->num_events) {
-            *event = ctx->events[ctx->first_event];
-            ctx->first_event = (ctx->first_event + 1) % ctx->max_events;
-            ctx->num_events--;
+        if (read_event(ctx, event, true)) {
             talloc_steal(event, event->data);
             break;
         }
@@ -1353,6 +1598,57 @@ int mpv_get_property(mpv_handle *ctx, const char *name, mpv_format format,
     return req.status;
 }
 
+struct getproperties_request {
+    struct getproperty_request *reqs;
+    int num;
+};
+
+static void getproperties_fn(void *arg)
+{
+    struct getproperties_request *req = arg;
+    for (int n = 0; n < req->num; n++)
+        getproperty_fn(&req->reqs[n]);
+}
+
+int mpv_get_properties(mpv_handle *ctx, int num, const char **names,
+                       const mpv_format *formats, void **data, int *errors)
+{
+    if (!ctx->mpctx->initialized)
+        return MPV_ERROR_UNINITIALIZED;
+    if (num < 0 || (num && (!names || !formats || !data)))
+        return MPV_ERROR_INVALID_PARAMETER;
+    for (int n = 0; n < num; n++) {
+        if (!names[n] || !data[n])
+            return MPV_ERROR_INVALID_PARAMETER;
+        if (!get_mp_type_get(formats[n]))
+            return MPV_ERROR_PROPERTY_FORMAT;
+    }
+
+    struct getproperties_request req = {
+        .reqs = talloc_zero_array(NULL, struct getproperty_request, num),
+        .num = num,
+    };
+    for (int n = 0; n < num; n++) {
+        req.reqs[n] = (struct getproperty_request){
+            .mpctx = ctx->mpctx,
+            .name = names[n],
+            .format = formats[n],
+            .data = data[n],
+        };
+    }
+    run_locked(ctx, getproperties_fn, &req);
+
+    int res = MPV_ERROR_SUCCESS;
+    for (int n = 0; n < num; n++) {
+        if (errors)
+            errors[n] = req.reqs[n].status;
+        if (res >= 0 && req.reqs[n].status < 0)
+            res = req.reqs[n].status;
+    }
+    talloc_free(req.reqs);
+    return res;
+}
+
 char *mpv_get_property_string(mpv_handle *ctx, const char *name)
 {
     char *str = NULL;
@@ -1386,6 +1682,12 @@ int mpv_get_property_async(mpv_handle *ctx, uint64_t ud, const char *name,
     return run_async(ctx, getproperty_fn, req);
 }
 
+static void prop_cache_free(void *p)
+{
+    struct prop_cache *c = p;
+    m_option_free(get_mp_type_get(c->format), &c->value);
+}
+
 static void property_free(void *p)
 {
     struct observe_property *prop = p;
@@ -1396,6 +1698,79 @@ static void property_free(void *p)
     }
 }
 
+// Return the cache entry for the property, creating it if needed.
+// Called with clients->lock held.
+static struct prop_cache *prop_cache_ref(struct mp_client_api *clients,
+                                         const char *name, int id,
+                                         mpv_format format)
+{
+    struct prop_cache *c = NULL;
+    for (int n = 0; n < clients->num_prop_caches; n++) {
+        struct prop_cache *cur = clients->prop_caches[n];
+        if (cur->id == id && cur->format == format && !strcmp(cur->name, name))
+        {
+            c = cur;
+            break;
+        }
+    }
+    if (!c) {
+        c = talloc_ptrtype(clients, c);
+        talloc_set_destructor(c, prop_cache_free);
+        *c = (struct prop_cache){
+            .name = talloc_strdup(c, name),
+            .id = id,
+            .format = format,
+        };
+        MP_TARRAY_APPEND(clients, clients->prop_caches, clients->num_prop_caches,
+                         c);
+    }
+    c->refcount++;
+    // The cached value may be stale for properties which are changed without
+    // notification, so make sure the new observer gets a fresh value.
+    c->notify_gen++;
+    return c;
+}
+
+// Called with clients->lock held.
+static void prop_cache_unref(struct mp_client_api *clients,
+                             struct observe_property *prop)
+{
+    struct prop_cache *c = prop->cache;
+    if (!c)
+        return;
+    prop->cache = NULL;
+    if (--c->refcount > 0)
+        return;
+    for (int n = 0; n < clients->num_prop_caches; n++) {
+        if (clients->prop_caches[n] == c) {
+            MP_TARRAY_REMOVE_AT(clients->prop_caches, clients->num_prop_caches,
+                                n);
+            break;
+        }
+    }
+    talloc_free(c);
+}
+
+// Set a newly retrieved value (taking over val). notify_gen is the generation
+// the value was retrieved for. Called with clients->lock held.
+static void prop_cache_update(struct prop_cache *c, uint64_t notify_gen,
+                              bool valid, union m_option_value *val)
+{
+    const struct m_option *type = get_mp_type_get(c->format);
+    bool changed = valid != c->value_valid ||
+                   (valid && !compare_value(&c->value, val, c->format));
+    if (changed) {
+        m_option_free(type, &c->value);
+        c->value_valid = valid;
+        if (valid)
+            memcpy(&c->value, val, type->type->size);
+        c->value_gen++;
+    } else if (valid) {
+        m_option_free(type, val);
+    }
+    c->fetched_gen = MPMAX(c->fetched_gen, notify_gen);
+}
+
 int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
                          const char *name, mpv_format format)
 {
@@ -1405,29 +1780,37 @@ int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
     if (format == MPV_FORMAT_OSD_STRING)
         return MPV_ERROR_PROPERTY_FORMAT;
 
+    struct mp_client_api *clients = ctx->clients;
+    int id = mp_get_property_id(ctx->mpctx, name);
+
+    pthread_mutex_lock(&clients->lock);
     pthread_mutex_lock(&ctx->lock);
     struct observe_property *prop = talloc_ptrtype(ctx, prop);
     talloc_set_destructor(prop, property_free);
     *prop = (struct observe_property){
         .client = ctx,
         .name = talloc_strdup(prop, name),
-        .id = mp_get_property_id(ctx->mpctx, name),
+        .id = id,
         .event_mask = mp_get_property_event_mask(name),
         .reply_id = userdata,
         .format = format,
         .changed = true,
         .need_new_value = true,
     };
+    if (format)
+        prop->cache = prop_cache_ref(clients, name, id, format);
     MP_TARRAY_APPEND(ctx, ctx->properties, ctx->num_properties, prop);
     ctx->property_event_masks |= prop->event_mask;
     ctx->lowest_changed = 0;
     pthread_mutex_unlock(&ctx->lock);
+    pthread_mutex_unlock(&clients->lock);
     invalidate_global_event_mask(ctx);
     return 0;
 }
 
 int mpv_unobserve_property(mpv_handle *ctx, uint64_t userdata)
 {
+    pthread_mutex_lock(&ctx->clients->lock);
     pthread_mutex_lock(&ctx->lock);
     ctx->property_event_masks = 0;
     int count = 0;
@@ -1442,6 +1825,7 @@ int mpv_unobserve_property(mpv_handle *ctx, uint64_t userdata)
                 // make sure it's not freed while in use. The same can happen
                 // with the value update mechanism.
                 talloc_steal(ctx->cur_event, prop);
+                prop_cache_unref(ctx->clients, prop);
             }
             MP_TARRAY_REMOVE_AT(ctx->properties, ctx->num_properties, n);
             count++;
@@ -1451,16 +1835,20 @@ int mpv_unobserve_property(mpv_handle *ctx, uint64_t userdata)
     }
     ctx->lowest_changed = 0;
     pthread_mutex_unlock(&ctx->lock);
+    pthread_mutex_unlock(&ctx->clients->lock);
     invalidate_global_event_mask(ctx);
     return count;
 }
 
+// Called with clients->lock and client->lock held.
 static void mark_property_changed(struct mpv_handle *client, int index)
 {
     struct observe_property *prop = client->properties[index];
     prop->changed = true;
     prop->need_new_value = prop->format != 0;
     client->lowest_changed = MPMIN(client->lowest_changed, index);
+    if (prop->cache)
+        prop->cache->notify_gen++;
 }
 
 // Broadcast that a property has changed.
@@ -1471,6 +1859,11 @@ void mp_client_property_change(struct MPContext *mpctx, const char *name)
 
     pthread_mutex_lock(&clients->lock);
 
+    for (int n = 0; n < clients->num_prop_caches; n++) {
+        if (clients->prop_caches[n]->id == id)
+            clients->prop_caches[n]->notify_gen++;
+    }
+
     for (int n = 0; n < clients->num_clients; n++) {
         struct mpv_handle *client = clients->clients[n];
         pthread_mutex_lock(&client->lock);
@@ -1487,7 +1880,7 @@ void mp_client_property_change(struct MPContext *mpctx, const char *name)
 }
 
 // Mark properties as changed in reaction to specific events.
-// Called with ctx->lock held.
+// Called with ctx->lock and clients->lock held.
 static void notify_property_events(struct mpv_handle *ctx, uint64_t event_mask)
 {
     for (int i = 0; i < ctx->num_properties; i++) {
@@ -1498,40 +1891,56 @@ static void notify_property_events(struct mpv_handle *ctx, uint64_t event_mask)
         wakeup_client(ctx);
 }
 
+// Runs on the playback thread. If other observers already retrieved the
+// value since the last change notification, the cached value is used.
 static void update_prop(void *p)
 {
     struct observe_property *prop = p;
     struct mpv_handle *ctx = prop->client;
+    struct mp_client_api *clients = ctx->clients;
+    struct prop_cache *c = prop->cache;
 
     const struct m_option *type = get_mp_type_get(prop->format);
-    union m_option_value val = {0};
 
+    pthread_mutex_lock(&clients->lock);
+    uint64_t notify_gen = c->notify_gen;
+    bool fetch = c->fetched_gen != notify_gen;
+    pthread_mutex_unlock(&clients->lock);
+
+    union m_option_value val = {0};
     struct getproperty_request req = {
         .mpctx = ctx->mpctx,
         .name = prop->name,
         .format = prop->format,
         .data = &val,
     };
+    // Not locked: property getters might notify property changes.
+    if (fetch)
+        getproperty_fn(&req);
 
-    getproperty_fn(&req);
+    pthread_mutex_lock(&clients->lock);
+    if (fetch)
+        prop_cache_update(c, notify_gen, req.status >= 0, &val);
 
     pthread_mutex_lock(&ctx->lock);
     ctx->properties_updating--;
     prop->updating = false;
-    m_option_free(type, &prop->new_value);
-    prop->new_value_valid = req.status >= 0;
-    if (prop->new_value_valid)
-        memcpy(&prop->new_value, &val, type->type->size);
-    if (prop->user_value_valid != prop->new_value_valid) {
-        prop->changed = true;
-    } else if (prop->user_value_valid && prop->new_value_valid) {
-        if (!compare_value(&prop->user_value, &prop->new_value, prop->format))
-            prop->changed = true;
+    if (prop->new_value_gen != c->value_gen) {
+        m_option_free(type, &prop->new_value);
+        prop->new_value_valid = c->value_valid;
+        if (c->value_valid)
+            m_option_copy(type, &prop->new_value, &c->value);
+        prop->new_value_gen = c->value_gen;
     }
-    if (prop->dead)
+    if (prop->user_value_gen != prop->new_value_gen)
+        prop->changed = true;
+    if (prop->dead) {
         talloc_steal(ctx->cur_event, prop);
+        prop_cache_unref(clients, prop);
+    }
     wakeup_client(ctx);
     pthread_mutex_unlock(&ctx->lock);
+    pthread_mutex_unlock(&clients->lock);
 }
 
 // Set ctx->cur_event to a generated property change event, if there is any
@@ -1558,6 +1967,7 @@ static bool gen_property_change_event(struct mpv_handle *ctx)
             } else {
                 const struct m_option *type = get_mp_type_get(prop->format);
                 prop->user_value_valid = prop->new_value_valid;
+                prop->user_value_gen = prop->new_value_gen;
                 if (prop->new_value_valid)
                     m_option_copy(type, &prop->user_value, &prop->new_value);
                 ctx->cur_property_event = (struct mpv_event_property){
@@ -1679,6 +2089,21 @@ int mpv_get_wakeup_pipe(mpv_handle *ctx)
     return fd;
 }
 
+int mpv_get_wakeup_eventfd(mpv_handle *ctx)
+{
+    pthread_mutex_lock(&ctx->wakeup_lock);
+#ifdef __linux__
+    if (ctx->wakeup_eventfd == -1) {
+        ctx->wakeup_eventfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (ctx->wakeup_eventfd != -1)
+            (void)write(ctx->wakeup_eventfd, &(uint64_t){1}, sizeof(uint64_t));
+    }
+#endif
+    int fd = ctx->wakeup_eventfd;
+    pthread_mutex_unlock(&ctx->wakeup_lock);
+    return fd;
+}
+
 unsigned long mpv_client_api_version(void)
 {
     return MPV_CLIENT_API_VERSION;
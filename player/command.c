@@ -32,10 +32,14 @@
 #include "build/config.h"
 #include "mpv_talloc.h"
 #include "client.h"
+#include "common/bench.h"
+#include "common/global.h"
+#include "common/trace.h"
 #include "common/av_common.h"
 #include "common/codecs.h"
 #include "common/msg.h"
 #include "common/msg_control.h"
+#include "filters/f_async_queue.h"
 #include "filters/f_decoder_wrapper.h"
 #include "command.h"
 #include "osdep/timer.h"
@@ -74,6 +78,8 @@
 struct command_ctx {
     // All properties, terminated with a {0} item.
     struct m_property *properties;
+    // Lookup table for properties.
+    struct m_property_index *prop_index;
 
     bool is_idle;
 
@@ -387,7 +393,8 @@ int mp_on_set_option(void *ctx, struct m_config_option *co, void *data, int flag
     // the bridge would drop).
     //跳过mp_property_generic_选项（通常情况下），因为属性实现很简单，如果涉及非平凡标志（网桥会删除这些标志），
     //则会破坏一些模糊的功能，例如--profile和--include）。
-    struct m_property *prop = m_property_list_find(cmd->properties, name);
+    struct m_property *prop = m_property_index_find(cmd->prop_index,
+                                                    bstr0(name));
     if (prop && prop->is_option)
         goto direct_option;
 
@@ -730,7 +737,38 @@ static int mp_property_frame_drop_dec(void *ctx, struct m_property *prop,
     if (!dec)
         return M_PROPERTY_UNAVAILABLE;
 
-    return m_property_int_ro(action, arg, dec->dropped_frames);
+    return m_property_int_ro(action, arg,
+                             mp_decoder_wrapper_get_frames_dropped(dec));
+}
+
+// Statistics of the queue between a decoder thread and the playback thread.
+static int mp_property_decoder_queue(void *ctx, struct m_property *prop,
+                                     int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    int type = (uintptr_t)prop->priv;
+    struct track *track = mpctx->current_track[0][type];
+
+    struct mp_async_queue_stats st;
+    if (!track || !track->dec || !mp_decoder_wrapper_get_queue_stats(track->dec, &st))
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_MAP, NULL);
+    node_map_add_int64(r, "frames", st.num_frames);
+    node_map_add_int64(r, "max-frames", st.max_frames);
+    node_map_add_int64(r, "peak-frames", st.peak_frames);
+    node_map_add_int64(r, "total-frames", st.total_frames);
+    node_map_add_int64(r, "underruns", st.underruns);
+    node_map_add_int64(r, "overruns", st.overruns);
+    return M_PROPERTY_OK;
 }
 
 static int mp_property_mistimed_frame_count(void *ctx, struct m_property *prop,
@@ -1782,6 +1820,21 @@ static int mp_property_demuxer_cache_state(void *ctx, struct m_property *prop,
     node_map_add_flag(r, "idle", s.idle);
     node_map_add_int64(r, "total-bytes", s.total_bytes);
     node_map_add_int64(r, "fw-bytes", s.fw_bytes);
+    node_map_add_int64(r, "pool-bytes", s.pool_bytes);
+    if (s.spill_max_bytes > 0) {
+        node_map_add_int64(r, "spill-max-bytes", s.spill_max_bytes);
+        node_map_add_int64(r, "spill-bytes", s.spill_bytes);
+        node_map_add_int64(r, "spill-written-bytes", s.spill_written_bytes);
+        node_map_add_int64(r, "spill-read-bytes", s.spill_read_bytes);
+    }
+
+    struct stream_cache_info info = {0};
+    if (demux_stream_control(mpctx->demuxer, STREAM_CTRL_GET_CACHE_INFO,
+                             &info) == STREAM_OK)
+    {
+        node_map_add_int64(r, "stream-read-calls", info.read_calls);
+        node_map_add_int64(r, "stream-read-bytes", info.read_bytes);
+    }
     if (s.seeking != MP_NOPTS_VALUE)
         node_map_add_double(r, "debug-seeking", s.seeking);
     node_map_add_int64(r, "debug-low-level-seeks", s.low_level_seeks);
@@ -2080,8 +2133,10 @@ static int mp_property_audio_codec(void *ctx, struct m_property *prop,
 {
     MPContext *mpctx = ctx;
     struct track *track = mpctx->current_track[0][STREAM_AUDIO];
-    const char *c = track && track->dec ? track->dec->decoder_desc : NULL;
-    return m_property_strdup_ro(action, arg, c);
+    char desc[256] = "";
+    if (track && track->dec)
+        mp_decoder_wrapper_get_desc(track->dec, desc, sizeof(desc));
+    return m_property_strdup_ro(action, arg, desc[0] ? desc : NULL);
 }
 
 static int property_audiofmt(struct mp_aframe *fmt, int action, void *arg)
@@ -2235,9 +2290,9 @@ static int get_track_entry(int item, int action, void *arg, void *ctx)
     struct mp_codec_params p =
         track->stream ? *track->stream->codec : (struct mp_codec_params){0};
 
-    const char *decoder_desc = NULL;
+    char decoder_desc[256] = "";
     if (track->dec)
-        decoder_desc = track->dec->decoder_desc;
+        mp_decoder_wrapper_get_desc(track->dec, decoder_desc, sizeof(decoder_desc));
 
     bool has_rg = track->stream && track->stream->codec->replaygain_data;
     struct replaygain_data rg = has_rg ? *track->stream->codec->replaygain_data
@@ -2265,7 +2320,7 @@ static int get_track_entry(int item, int action, void *arg, void *ctx)
                         .unavailable = !track->external_filename},
         {"ff-index",    SUB_PROP_INT(track->ff_index)},
         {"decoder-desc", SUB_PROP_STR(decoder_desc),
-                        .unavailable = !decoder_desc},
+                        .unavailable = !decoder_desc[0]},
         {"codec",       SUB_PROP_STR(p.codec),
                         .unavailable = !p.codec},
         {"demux-w",     SUB_PROP_INT(p.disp_w), .unavailable = !p.disp_w},
@@ -2600,8 +2655,10 @@ static int mp_property_video_codec(void *ctx, struct m_property *prop,
 {
     MPContext *mpctx = ctx;
     struct track *track = mpctx->current_track[0][STREAM_VIDEO];
-    const char *c = track && track->dec ? track->dec->decoder_desc : NULL;
-    return m_property_strdup_ro(action, arg, c);
+    char desc[256] = "";
+    if (track && track->dec)
+        mp_decoder_wrapper_get_desc(track->dec, desc, sizeof(desc));
+    return m_property_strdup_ro(action, arg, desc[0] ? desc : NULL);
 }
 
 static int property_imgparams(struct mp_image_params p, int action, void *arg)
@@ -3329,30 +3386,11 @@ static int mp_property_playlist_pos_1(void *ctx, struct m_property *prop,
     return mp_property_playlist_pos_x(ctx, prop, action, arg, 1);
 }
 
-struct get_playlist_ctx {
-    struct MPContext *mpctx;
-    int last_index;
-    struct playlist_entry *last_entry;
-};
-
 static int get_playlist_entry(int item, int action, void *arg, void *ctx)
 {
-    struct get_playlist_ctx *p = ctx;
-    struct MPContext *mpctx = p->mpctx;
-
-    struct playlist_entry *e;
-    // This is an optimization that prevents O(n^2) behaviour when the entire
-    // playlist is requested. If a request is made for the last requested entry
-    // or the entry immediately following it, it can be found without a full
-    // traversal of the linked list.
-    if (p->last_entry && item == p->last_index)
-        e = p->last_entry;
-    else if (p->last_entry && item == p->last_index + 1)
-        e = p->last_entry->next;
-    else
-        e = playlist_entry_from_index(mpctx->playlist, item);
-    p->last_index = item;
-    p->last_entry = e;
+    struct MPContext *mpctx = ctx;
+
+    struct playlist_entry *e = playlist_entry_from_index(mpctx->playlist, item);
     if (!e)
         return M_PROPERTY_ERROR;
 
@@ -3394,9 +3432,8 @@ static int mp_property_playlist(void *ctx, struct m_property *prop,
         return M_PROPERTY_OK;
     }
 
-    struct get_playlist_ctx p = {.mpctx = mpctx};
     return m_property_read_list(action, arg, playlist_entry_count(mpctx->playlist),
-                                get_playlist_entry, &p);
+                                get_playlist_entry, mpctx);
 }
 
 static char *print_obj_osd_list(struct m_obj_settings *list)
@@ -3795,6 +3832,41 @@ static int mp_property_option_info(void *ctx, struct m_property *prop,
     return M_PROPERTY_NOT_IMPLEMENTED;
 }
 
+static int mp_property_client_event_stats(void *ctx, struct m_property *prop,
+                                          int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    mp_client_get_event_stats(mpctx, arg);
+    return M_PROPERTY_OK;
+}
+
+static int mp_property_benchmark_results(void *ctx, struct m_property *prop,
+                                         int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct mp_bench *bench = mpctx->global->bench;
+    if (!bench)
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    mp_bench_get_node(bench, arg);
+    return M_PROPERTY_OK;
+}
+
 static int mp_property_list(void *ctx, struct m_property *prop,
                             int action, void *arg)
 {
@@ -3866,6 +3938,10 @@ static const struct m_property mp_properties_base[] = {
     {"mistimed-frame-count", mp_property_mistimed_frame_count},
     {"vsync-ratio", mp_property_vsync_ratio},
     {"decoder-frame-drop-count", mp_property_frame_drop_dec},
+    {"video-decoder-queue", mp_property_decoder_queue,
+     (void *)(uintptr_t)STREAM_VIDEO},
+    {"audio-decoder-queue", mp_property_decoder_queue,
+     (void *)(uintptr_t)STREAM_AUDIO},
     {"frame-drop-count", mp_property_frame_drop_vo},
     {"vo-delayed-frame-count", mp_property_vo_delayed_frame_count},
     {"percent-pos", mp_property_percent_pos},
@@ -4039,6 +4115,8 @@ static const struct m_property mp_properties_base[] = {
     {"option-info", mp_property_option_info},
     {"property-list", mp_property_list},
     {"profile-list", mp_profile_list},
+    {"client-event-stats", mp_property_client_event_stats},
+    {"benchmark-results", mp_property_benchmark_results},
 
     M_PROPERTY_ALIAS("video", "vid"),
     M_PROPERTY_ALIAS("audio", "aid"),
@@ -4144,11 +4222,14 @@ uint64_t mp_get_property_event_mask(const char *name)
 int mp_get_property_id(struct MPContext *mpctx, const char *name)
 {
     struct command_ctx *ctx = mpctx->command_ctx;
-    for (int n = 0; ctx->properties[n].name; n++) {
-        if (match_property(ctx->properties[n].name, name))
-            return n;
-    }
-    return -1;
+    // Same as finding the first property for which match_property() is true.
+    bstr base = bstr0(name);
+    bstr_eatstart0(&base, "options/");
+    int sep = bstrchr(base, '/');
+    if (sep >= 0)
+        base = bstr_splice(base, 0, sep);
+    struct m_property *prop = m_property_index_find(ctx->prop_index, base);
+    return prop ? prop - ctx->properties : -1;
 }
 
 static bool is_property_set(int action, void *val)
@@ -4173,7 +4254,7 @@ static int mp_property_do_silent(const char *name, int action, void *val,
 {
     struct command_ctx *cmd = ctx->command_ctx;
     cmd->silence_option_deprecations += 1;
-    int r = m_property_do(ctx->log, cmd->properties, name, action, val, ctx);
+    int r = m_property_do(ctx->log, cmd->prop_index, name, action, val, ctx);
     cmd->silence_option_deprecations -= 1;
     if (r == M_PROPERTY_OK && is_property_set(action, val))
         mp_notify_property(ctx, (char *)name);
@@ -4207,7 +4288,7 @@ int mp_property_do(const char *name, int action, void *val,
 char *mp_property_expand_string(struct MPContext *mpctx, const char *str)
 {
     struct command_ctx *ctx = mpctx->command_ctx;
-    return m_properties_expand_string(ctx->properties, str, mpctx);
+    return m_properties_expand_string(ctx->prop_index, str, mpctx);
 }
 
 // Before expanding properties, parse C-style escapes like "\n"
@@ -5277,15 +5358,7 @@ static void cmd_playlist_clear(void *p)
     // Supposed to clear the playlist, except the currently played item.
     if (mpctx->playlist->current_was_replaced)
         mpctx->playlist->current = NULL;
-    while (mpctx->playlist->first) {
-        struct playlist_entry *e = mpctx->playlist->first;
-        if (e == mpctx->playlist->current) {
-            e = e->next;
-            if (!e)
-                break;
-        }
-        playlist_remove(mpctx->playlist, e);
-    }
+    playlist_clear_except(mpctx->playlist, mpctx->playlist->current);
     mp_notify(mpctx, MP_EVENT_CHANGE_PLAYLIST, NULL);
     mp_wakeup_core(mpctx);
 }
@@ -5733,6 +5806,14 @@ static void cmd_write_watch_later_config(void *p)
     mp_write_watch_later_conf(mpctx);
 }
 
+static void cmd_trace_dump(void *p)
+{
+    struct mp_cmd_ctx *cmd = p;
+    struct MPContext *mpctx = cmd->mpctx;
+
+    cmd->success = mp_write_trace(mpctx, cmd->args[0].v.s);
+}
+
 static void cmd_hook_add(void *p)
 {
     struct mp_cmd_ctx *cmd = p;
@@ -6028,6 +6109,8 @@ const struct mp_cmd_def mp_cmds[] = {
 
     { "write-watch-later-config", cmd_write_watch_later_config },
 
+    { "trace-dump", cmd_trace_dump, { ARG_STRING } },
+
     { "hook-add", cmd_hook_add, { ARG_STRING, ARG_INT, ARG_INT } },
     { "hook-ack", cmd_hook_ack, { ARG_INT } },
 
@@ -6090,6 +6173,10 @@ void command_init(struct MPContext *mpctx)
         talloc_zero_array(ctx, struct m_property, num_base + num_opts + 1);
     memcpy(ctx->properties, mp_properties_base, sizeof(mp_properties_base));
 
+    // For the duplicate check below (option names are unique).
+    struct m_property_index *base_index =
+        m_property_index_create(NULL, ctx->properties);
+
     int count = num_base;
     for (int n = 0; n < num_opts; n++) {
         struct m_config_option *co = m_config_get_co_index(mpctx->mconfig, n);
@@ -6111,11 +6198,14 @@ void command_init(struct MPContext *mpctx)
         }
 
         // The option might be covered by a manual property already.
-        if (m_property_list_find(ctx->properties, prop.name))
+        if (m_property_index_find(base_index, bstr0(prop.name)))
             continue;
 
         ctx->properties[count++] = prop;
     }
+
+    talloc_free(base_index);
+    ctx->prop_index = m_property_index_create(ctx, ctx->properties);
 }
 
 static void command_event(struct MPContext *mpctx, int event, void *arg)
@@ -6233,6 +6323,14 @@ void mp_option_change_callback(void *ctx, struct m_config_option *co, int flags)
         if (mpctx->video_out)
             vo_control(mpctx->video_out, VOCTRL_EXTERNAL_RESIZE, NULL);
     }
+
+    if (flags & UPDATE_TRACE) {
+        struct MPOpts *opts = mpctx->opts;
+        if (mpctx->global->trace) {
+            mp_trace_set_enabled(mpctx->global->trace,
+                                 opts->trace_file && opts->trace_file[0]);
+        }
+    }
 }
 
 void mp_notify_property(struct MPContext *mpctx, const char *property)
@@ -475,10 +475,15 @@ typedef struct MPContext {
     char *open_url;
     char *open_format;
     int open_url_flags;
+    bool open_playlist_incremental;
     // --- All fields below are owned by open_thread, unless open_done was set
     //     to true.
     struct demuxer *open_res_demuxer;
     int open_res_error;
+
+    // Playlists whose remaining entries are read in the background.
+    struct playlist_loader **playlist_loaders;
+    int num_playlist_loaders;
 } MPContext;
 
 // audio.c
@@ -531,6 +536,7 @@ void update_demuxer_properties(struct MPContext *mpctx);
 void print_track_list(struct MPContext *mpctx, const char *msg);
 void reselect_demux_stream(struct MPContext *mpctx, struct track *track);
 void prepare_playlist(struct MPContext *mpctx, struct playlist *pl);
+void handle_playlist_loaders(struct MPContext *mpctx);
 void autoload_external_files(struct MPContext *mpctx);
 struct track *select_default_track(struct MPContext *mpctx, int order,
                                    enum stream_type type);
@@ -561,6 +567,7 @@ void update_window_title(struct MPContext *mpctx, bool force);
 void error_on_track(struct MPContext *mpctx, struct track *track);
 int stream_dump(struct MPContext *mpctx, const char *source_filename);
 double get_track_seek_offset(struct MPContext *mpctx, struct track *track);
+bool mp_write_trace(struct MPContext *mpctx, const char *filename);
 
 // osd.c
 void set_osd_bar(struct MPContext *mpctx, int type,
@@ -758,6 +758,148 @@ static void transfer_playlist(struct MPContext *mpctx, struct playlist *pl)
     }
 }
 
+// Number of entries the playlist loader thread reads at a time.
+#define PLAYLIST_BATCH_ENTRIES 1000
+
+// Reads the rest of a playlist that was opened incrementally (see
+// demuxer.playlist_reader), and adds the entries after the ones that were
+// added already, in batches.
+struct playlist_loader {
+    struct MPContext *mpctx;
+    struct playlist_reader *reader;
+    struct mp_cancel *cancel;
+    pthread_t thread;
+    // Owned by the core thread.
+    struct playlist_entry *last;    // last added entry (reserved)
+    struct playlist *batch;
+    int stream_flags;               // added to each entry
+    char *redirect;                 // added to each entry, or NULL
+
+    pthread_mutex_t lock;
+    // --- Protected by lock.
+    struct playlist *pending;       // read, but not added yet
+    bool done;                      // no more entries will be read
+};
+
+static void *playlist_loader_thread(void *p)
+{
+    struct playlist_loader *l = p;
+
+    mpthread_set_name("playlist");
+
+    struct playlist *pl = talloc_zero(NULL, struct playlist);
+    bool more = true;
+    while (more) {
+        more = playlist_reader_read(l->reader, pl, PLAYLIST_BATCH_ENTRIES,
+                                    l->cancel);
+        pthread_mutex_lock(&l->lock);
+        playlist_append_entries(l->pending, pl);
+        l->done = !more;
+        pthread_mutex_unlock(&l->lock);
+        mp_wakeup_core(l->mpctx);
+    }
+    talloc_free(pl);
+    return NULL;
+}
+
+static void set_loader_last(struct playlist_loader *l,
+                            struct playlist_entry *e)
+{
+    e->reserved++;
+    if (l->last)
+        playlist_entry_unref(l->last);
+    l->last = e;
+}
+
+// Take over demuxer.playlist_reader. last is the last entry that was added to
+// the player's playlist from the demuxer's playlist.
+static void start_playlist_loader(struct MPContext *mpctx,
+                                  struct demuxer *demuxer,
+                                  struct playlist_entry *last,
+                                  int stream_flags, char *redirect)
+{
+    struct playlist_loader *l = talloc_ptrtype(NULL, l);
+    *l = (struct playlist_loader){
+        .mpctx = mpctx,
+        .reader = talloc_steal(l, demuxer->playlist_reader),
+        .cancel = mp_cancel_new(l),
+        .batch = talloc_zero(l, struct playlist),
+        .pending = talloc_zero(l, struct playlist),
+        .stream_flags = stream_flags,
+        .redirect = talloc_strdup(l, redirect),
+    };
+    demuxer->playlist_reader = NULL;
+    set_loader_last(l, last);
+    pthread_mutex_init(&l->lock, NULL);
+
+    if (pthread_create(&l->thread, NULL, playlist_loader_thread, l)) {
+        MP_ERR(mpctx, "Could not read the rest of the playlist.\n");
+        pthread_mutex_destroy(&l->lock);
+        playlist_entry_unref(l->last);
+        talloc_free(l);
+        return;
+    }
+
+    MP_TARRAY_APPEND(mpctx, mpctx->playlist_loaders,
+                     mpctx->num_playlist_loaders, l);
+}
+
+static void free_playlist_loader(struct playlist_loader *l)
+{
+    mp_cancel_trigger(l->cancel);
+    pthread_join(l->thread, NULL);
+    pthread_mutex_destroy(&l->lock);
+    playlist_clear(l->pending);
+    playlist_entry_unref(l->last);
+    talloc_free(l);
+}
+
+static void stop_playlist_loaders(struct MPContext *mpctx)
+{
+    for (int n = 0; n < mpctx->num_playlist_loaders; n++)
+        free_playlist_loader(mpctx->playlist_loaders[n]);
+    mpctx->num_playlist_loaders = 0;
+}
+
+// Add the entries the playlist loaders have read so far. If the last entry a
+// loader added was removed from the playlist (e.g. the playlist was cleared),
+// the rest of that playlist is dropped.
+void handle_playlist_loaders(struct MPContext *mpctx)
+{
+    for (int n = mpctx->num_playlist_loaders - 1; n >= 0; n--) {
+        struct playlist_loader *l = mpctx->playlist_loaders[n];
+
+        pthread_mutex_lock(&l->lock);
+        playlist_append_entries(l->batch, l->pending);
+        bool done = l->done;
+        pthread_mutex_unlock(&l->lock);
+
+        bool stop = done;
+        if (l->last->pl != mpctx->playlist) {
+            MP_VERBOSE(mpctx, "Not adding the rest of a modified playlist.\n");
+            playlist_clear(l->batch);
+            stop = true;
+        } else if (l->batch->first) {
+            struct playlist *pl = l->batch;
+            for (struct playlist_entry *e = pl->first; e; e = e->next)
+                e->stream_flags |= l->stream_flags;
+            if (l->redirect)
+                playlist_add_redirect(pl, l->redirect);
+            struct playlist_entry *last = pl->last;
+            playlist_transfer_entries_to(mpctx->playlist,
+                                         l->last->pl_index + 1, pl);
+            set_loader_last(l, last);
+            mp_notify_property(mpctx, "playlist");
+        }
+
+        if (stop) {
+            free_playlist_loader(l);
+            MP_TARRAY_REMOVE_AT(mpctx->playlist_loaders,
+                                mpctx->num_playlist_loaders, n);
+        }
+    }
+}
+
 static void process_hooks(struct MPContext *mpctx, char *name)
 {
     mp_hook_start(mpctx, name);
@@ -814,6 +956,7 @@ static void *open_demux_thread(void *ctx)
         .force_format = mpctx->open_format,
         .stream_flags = mpctx->open_url_flags,
         .initial_readahead = true,
+        .playlist_incremental = mpctx->open_playlist_incremental,
     };
     mpctx->open_res_demuxer =
         demux_open_url(mpctx->open_url, &p, mpctx->open_cancel, mpctx->global);
@@ -872,6 +1015,10 @@ static void start_open(struct MPContext *mpctx, char *url, int url_flags)
     mpctx->open_url_flags = url_flags;
     if (mpctx->opts->load_unsafe_playlists)
         mpctx->open_url_flags = 0;
+    // prepare_playlist() needs all entries for these.
+    mpctx->open_playlist_incremental = !mpctx->opts->shuffle &&
+                                       !mpctx->opts->merge_files &&
+                                       mpctx->opts->playlist_pos < 0;
 
     //解封装线程
     if (pthread_create(&mpctx->open_thread, NULL, open_demux_thread, mpctx)) {
@@ -1256,7 +1403,15 @@ static void play_current_file(struct MPContext *mpctx)
         }
         for (struct playlist_entry *e = pl->first; e; e = e->next)
             e->stream_flags |= entry_stream_flags;
+        struct playlist_entry *last = pl->last;
+        char *redirect = mpctx->playlist->current
+            ? talloc_strdup(NULL, mpctx->playlist->current->filename) : NULL;
         transfer_playlist(mpctx, pl);
+        if (mpctx->demuxer->playlist_reader && last) {
+            start_playlist_loader(mpctx, mpctx->demuxer, last,
+                                  entry_stream_flags, redirect);
+        }
+        talloc_free(redirect);
         mp_notify_property(mpctx, "playlist");
         mpctx->error_playing = 2;
         goto terminate_playback;
@@ -1556,7 +1711,20 @@ void mp_play_files(struct MPContext *mpctx)
             mpctx->stop_play == AT_END_OF_FILE || !mpctx->stop_play)
         {
             new_entry = mp_next_file(mpctx, +1, false, true);
+            // The rest of the playlist might still be read.
+            while (!new_entry && mpctx->num_playlist_loaders &&
+                   mpctx->stop_play != PT_QUIT &&
+                   mpctx->stop_play != PT_STOP &&
+                   mpctx->stop_play != PT_CURRENT_ENTRY)
+            {
+                mp_idle(mpctx);
+                new_entry = mp_next_file(mpctx, +1, false, true);
+            }
+            if (mpctx->stop_play == PT_CURRENT_ENTRY)
+                new_entry = mpctx->playlist->current;
         }
+        if (mpctx->stop_play == PT_QUIT)
+            break;
 
         mpctx->playlist->current = new_entry;
         mpctx->playlist->current_was_replaced = false;
@@ -1567,6 +1735,7 @@ void mp_play_files(struct MPContext *mpctx)
     }
 
     cancel_open(mpctx);
+    stop_playlist_loaders(mpctx);
 
     if (mpctx->encode_lavc_ctx) {
         // Make sure all streams get finished.
@@ -1598,7 +1767,7 @@ static void set_track_recorder_sink(struct track *track,
     if (track->d_sub)
         sub_set_recorder_sink(track->d_sub, sink);
     if (track->dec)
-        track->dec->recorder_sink = sink;
+        mp_decoder_wrapper_set_recorder_sink(track->dec, sink);
     track->remux_sink = sink;
 }
 
@@ -28,12 +28,15 @@
 #include "mpv_talloc.h"
 
 #include "misc/dispatch.h"
+#include "misc/json.h"
 #include "osdep/io.h"
 #include "osdep/terminal.h"
 #include "osdep/timer.h"
 #include "osdep/main-fn.h"
 
 #include "common/av_log.h"
+#include "common/bench.h"
+#include "common/trace.h"
 #include "common/codecs.h"
 #include "common/encode.h"
 #include "options/m_config.h"
@@ -154,6 +157,31 @@ void mp_print_version(struct mp_log *log, int always)
     }
 }
 
+static void write_benchmark_results(struct MPContext *mpctx)
+{
+    struct mp_bench *bench = mpctx->global->bench;
+    if (!bench)
+        return;
+
+    struct mpv_node node;
+    mp_bench_get_node(bench, &node);
+    char *res = talloc_strdup(NULL, "");
+    json_write_pretty(&res, &node);
+    talloc_free(node.u.list);
+
+    const char *file = mpctx->opts->benchmark;
+    char *path = mp_get_user_path(res, mpctx->global, file);
+    FILE *f = strcmp(file, "-") == 0 ? stdout : fopen(path, "wb");
+    if (f) {
+        fprintf(f, "%s\n", res);
+        if (f != stdout)
+            fclose(f);
+    } else {
+        MP_ERR(mpctx, "Can't write benchmark results to %s\n", path);
+    }
+    talloc_free(res);
+}
+
 void mp_destroy(struct MPContext *mpctx)
 {
     mp_shutdown_clients(mpctx);
@@ -164,6 +192,11 @@ void mp_destroy(struct MPContext *mpctx)
     uninit_audio_out(mpctx);
     uninit_video_out(mpctx);
 
+    write_benchmark_results(mpctx);
+
+    if (mpctx->opts->trace_file && mpctx->opts->trace_file[0])
+        mp_write_trace(mpctx, mpctx->opts->trace_file);
+
     // If it's still set here, it's an error.
     encode_lavc_free(mpctx->encode_lavc_ctx);
     mpctx->encode_lavc_ctx = NULL;
@@ -284,6 +317,7 @@ struct MPContext *mp_create(void)
     pthread_mutex_init(&mpctx->lock, NULL);
 
     mpctx->global = talloc_zero(mpctx, struct mpv_global);
+    mpctx->global->trace = mp_trace_create(mpctx->global);
 
     // Nothing must call mp_msg*() and related before this
     mp_msg_init(mpctx->global);
@@ -405,6 +439,11 @@ int mp_initialize(struct MPContext *mpctx, char **options)
         mp_input_enable_section(mpctx->input, "encode", MP_INPUT_EXCLUSIVE);
     }
 
+    if (opts->benchmark && opts->benchmark[0]) {
+        mpctx->global->bench = mp_bench_create(mpctx);
+        m_config_set_profile(mpctx->mconfig, "benchmark", M_SETOPT_NO_OVERWRITE);
+    }
+
 #if !HAVE_LIBASS
     MP_WARN(mpctx, "Compiled without libass.\n");
     MP_WARN(mpctx, "There will be no OSD and no text subtitles.\n");
@@ -31,10 +31,12 @@
 #include "options/options.h"
 #include "options/m_property.h"
 #include "options/m_config.h"
+#include "options/path.h"
 #include "common/common.h"
 #include "common/global.h"
 #include "common/encode.h"
 #include "common/playlist.h"
+#include "common/trace.h"
 #include "input/input.h"
 
 #include "audio/out/ao.h"
@@ -356,3 +358,20 @@ void merge_playlist_files(struct playlist *pl)
     playlist_add_file(pl, edl);
     talloc_free(edl);
 }
+
+// Write the recorded trace events to the given file (--trace-file).
+bool mp_write_trace(struct MPContext *mpctx, const char *filename)
+{
+    struct mp_trace *trace = mpctx->global->trace;
+    if (!trace)
+        return false;
+    char *path = mp_get_user_path(NULL, mpctx->global, filename);
+    bool ok = mp_trace_write(trace, path);
+    if (ok) {
+        MP_INFO(mpctx, "Trace written to %s\n", path);
+    } else {
+        MP_ERR(mpctx, "Can't write trace to %s\n", path);
+    }
+    talloc_free(path);
+    return ok;
+}
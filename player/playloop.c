@@ -24,6 +24,7 @@
 #include "build/config.h"
 #include "mpv_talloc.h"
 
+#include "common/bench.h"
 #include "common/msg.h"
 #include "options/options.h"
 #include "common/common.h"
@@ -1115,6 +1116,7 @@ void run_playloop(struct MPContext *mpctx)
     handle_cursor_autohide(mpctx);
     handle_vo_events(mpctx);
     handle_command_updates(mpctx);
+    handle_playlist_loaders(mpctx);
 
     if (mpctx->lavfi && mp_filter_has_failed(mpctx->lavfi))
         mpctx->stop_play = AT_END_OF_FILE;
@@ -1150,8 +1152,10 @@ void run_playloop(struct MPContext *mpctx)
     //视频显示
     handle_osd_redraw(mpctx);
 
+    int64_t bench_start = mp_bench_start(mpctx->global);
     if (mp_filter_run(mpctx->filter_root))
         mp_wakeup_core(mpctx);
+    mp_bench_end(mpctx->global, MP_BENCH_FILTER, bench_start);
     mp_wait_events(mpctx);
 
     //暂停处理
@@ -1173,6 +1177,7 @@ void mp_idle(struct MPContext *mpctx)
     mp_wait_events(mpctx);
     mp_process_input(mpctx);
     handle_command_updates(mpctx);
+    handle_playlist_loaders(mpctx);
     handle_cursor_autohide(mpctx);
     handle_vo_events(mpctx);
     update_osd_msg(mpctx);
@@ -61,6 +61,12 @@
 
 #define OPT_BASE_STRUCT struct mp_cache_opts
 
+// Upper bound for --cache-prefetch-requests.
+#define MAX_PREFETCH_REQUESTS 64
+
+// Size and alignment of prefetch reads.
+#define PREFETCH_CHUNK (256 * 1024)
+
 const struct m_sub_options stream_cache_conf = {
     .opts = (const struct m_option[]){
         OPT_CHOICE_OR_INT("cache", size, 0, 32, 0x7fffffff,
@@ -74,6 +80,8 @@ const struct m_sub_options stream_cache_conf = {
         OPT_INTRANGE("cache-backbuffer", back_buffer, 0, 0, 0x7fffffff),
         OPT_STRING("cache-file", file, M_OPT_FILE),
         OPT_INTRANGE("cache-file-size", file_max, 0, 0, 0x7fffffff),
+        OPT_INTRANGE("cache-prefetch-requests", prefetch_requests, 0, 0,
+                     MAX_PREFETCH_REQUESTS),
         {0}
     },
     .size = sizeof(struct mp_cache_opts),
@@ -87,6 +95,22 @@ const struct m_sub_options stream_cache_conf = {
     },
 };
 
+enum prefetch_state {
+    REQ_PENDING,            // waiting for a prefetch thread
+    REQ_BUSY,               // being read by a prefetch thread
+    REQ_DONE,               // finished (or cancelled before it was started)
+};
+
+// A positional read into the ringbuffer, issued by the cache thread and
+// performed by a prefetch thread.
+struct prefetch_req {
+    enum prefetch_state state;
+    int64_t filepos;
+    int64_t bpos;           // target offset into buffer
+    int len;
+    int result;             // return value of read_at()
+};
+
 // Note: (struct priv*)(cache->priv)->cache == cache
 struct priv {
     pthread_t cache_thread;
@@ -127,6 +151,8 @@ struct priv {
     int64_t speed_start;    // start time (us) for calculating download speed
     int64_t speed_amount;   // bytes read since speed_start
     double speed;
+    uint64_t read_calls;    // copies of the stream's read counters
+    uint64_t read_bytes;
 
     bool enable_readahead;  // actively read beyond read() position
     int64_t read_filepos;   // client read position (mirrors cache->pos)
@@ -135,6 +161,19 @@ struct priv {
 
     int64_t eof_pos;
 
+    // Prefetching (only if the stream supports read_at). Requests are in a
+    // FIFO in file order, and cover [max_filepos, prefetch_pos) without gaps.
+    // Completed requests are published (added to max_filepos) in order.
+    pthread_t *prefetch_threads;
+    int num_prefetch_threads;
+    pthread_cond_t prefetch_wakeup; // signals prefetch threads
+    bool prefetch_quit;
+    bool prefetch_wait;     // cache thread waits for running requests
+    struct prefetch_req *reqs;
+    int num_reqs;           // allocated size of the FIFO
+    int req_first, req_count;
+    int64_t prefetch_pos;   // end of the range covered by requests
+
     bool read_seek_failed;  // let a read fail because an async seek failed
 
     int control;            // requested STREAM_CTRL_... or CACHE_CTRL_...
@@ -182,10 +221,37 @@ static bool cache_wakeup_and_wait(struct priv *s, double *retry_time)
     return !mp_cancel_test(s->cache->cancel);
 }
 
+static struct prefetch_req *prefetch_get(struct priv *s, int n)
+{
+    return &s->reqs[(s->req_first + n) % s->num_reqs];
+}
+
+// Drop all requests. Waits until running reads are done, as they write into
+// the buffer. Runs in the cache thread (or before the threads are started).
+static void prefetch_cancel(struct priv *s)
+{
+    while (1) {
+        bool busy = false;
+        for (int n = 0; n < s->req_count; n++) {
+            struct prefetch_req *req = prefetch_get(s, n);
+            if (req->state == REQ_PENDING)
+                req->state = REQ_DONE;
+            busy |= req->state == REQ_BUSY;
+        }
+        if (!busy)
+            break;
+        pthread_cond_wait(&s->wakeup, &s->mutex);
+    }
+    s->req_first = s->req_count = 0;
+    s->prefetch_pos = s->max_filepos;
+}
+
 // Runs in the cache thread
 static void cache_drop_contents(struct priv *s)
 {
-    s->offset = s->min_filepos = s->max_filepos = s->read_filepos;
+    prefetch_cancel(s);
+    s->offset = s->min_filepos = s->prefetch_pos = s->max_filepos =
+        s->read_filepos;
     s->eof = false;
     s->start_pts = MP_NOPTS_VALUE;
 }
@@ -257,6 +323,10 @@ static bool cache_update_stream_position(struct priv *s)
         cache_drop_contents(s);
     }
 
+    // Prefetch reads are positional; the stream position is unused.
+    if (s->num_prefetch_threads)
+        return true;
+
     if (stream_tell(s->stream) != s->max_filepos && s->seekable) {
         MP_VERBOSE(s, "Seeking underlying stream: %"PRId64" -> %"PRId64"\n",
                    stream_tell(s->stream), s->max_filepos);
@@ -326,6 +396,9 @@ static void cache_fill(struct priv *s)
     len = stream_read_partial(s->stream, &s->buffer[pos], space);
     pthread_mutex_lock(&s->mutex);
 
+    s->read_calls = s->stream->total_read_calls;
+    s->read_bytes = s->stream->total_read_bytes;
+
     // Do this after reading a block, because at least libdvdnav updates the
     // stream position only after actually reading something after a seek.
     if (s->start_pts == MP_NOPTS_VALUE) {
@@ -358,6 +431,138 @@ done: ;
     pthread_cond_signal(&s->wakeup);
 }
 
+// Runs in the cache thread. Like cache_fill(), but keeps multiple reads in
+// flight using the prefetch threads. Reads can complete in any order, but
+// only contiguous data starting at max_filepos is made visible to the reader.
+static void cache_prefetch(struct priv *s)
+{
+    int64_t read = s->read_filepos;
+    bool progress = false;
+    bool read_attempted = false;
+    int len = 0;
+
+    cache_update_stream_position(s);
+
+    // Publish finished requests.
+    while (s->req_count && prefetch_get(s, 0)->state == REQ_DONE) {
+        struct prefetch_req *req = prefetch_get(s, 0);
+        s->req_first = (s->req_first + 1) % s->num_reqs;
+        s->req_count--;
+        assert(req->filepos == s->max_filepos);
+        len = MPMAX(req->result, 0);
+        s->max_filepos += len;
+        if (req->bpos + len == s->buffer_size)
+            s->offset += s->buffer_size; // wrap...
+        s->speed_amount += len;
+        s->read_calls++;
+        s->read_bytes += len;
+        progress = read_attempted = true;
+        if (len < req->len) {
+            // EOF or error; the following requests are useless.
+            prefetch_cancel(s);
+            break;
+        }
+    }
+
+    if (read_attempted && len > 0)
+        s->eof = false;
+    bool eof = s->eof || (read_attempted && len <= 0);
+
+    if (!s->enable_readahead && s->read_min <= s->prefetch_pos)
+        goto done;
+
+    if (mp_cancel_test(s->cache->cancel))
+        goto done;
+
+    // Issue new requests. This uses the same buffer accounting as
+    // cache_fill(), except that the range of running requests counts as
+    // used space.
+    while (s->req_count < s->num_reqs) {
+        int64_t back = MPCLAMP(read - s->min_filepos, 0, s->back_size);
+        if (s->stream_size > s->buffer_size)
+            back = MPMAX(back, s->back_size);
+
+        int64_t newb = FFMAX(s->prefetch_pos - read, 0);
+        int64_t space = s->buffer_size - (newb + back);
+        if (space < FILL_LIMIT)
+            break;
+
+        int64_t bpos = (s->prefetch_pos - s->offset) % s->buffer_size;
+        if (bpos < 0)
+            bpos += s->buffer_size;
+
+        // Don't wrap, and end requests on PREFETCH_CHUNK boundaries.
+        space = MPMIN(space, s->buffer_size - bpos);
+        space = MPMIN(space, PREFETCH_CHUNK - s->prefetch_pos % PREFETCH_CHUNK);
+
+        int64_t back2 = s->buffer_size - (space + newb); // max back size
+        if (s->min_filepos < (read - back2))
+            s->min_filepos = read - back2;
+
+        struct prefetch_req *req = prefetch_get(s, s->req_count++);
+        *req = (struct prefetch_req){
+            .state = REQ_PENDING,
+            .filepos = s->prefetch_pos,
+            .bpos = bpos,
+            .len = space,
+        };
+        s->prefetch_pos += space;
+        progress = true;
+        pthread_cond_signal(&s->prefetch_wakeup);
+    }
+
+done: ;
+
+    bool prev_eof = s->eof;
+    s->eof = eof;
+    if (!prev_eof && s->eof) {
+        s->eof_pos = s->max_filepos;
+        MP_VERBOSE(s, "EOF reached.\n");
+    }
+    s->idle = s->eof || !s->req_count;
+    s->prefetch_wait = !progress && s->req_count;
+    s->reads++;
+
+    update_speed(s);
+
+    pthread_cond_signal(&s->wakeup);
+}
+
+static void *prefetch_thread(void *arg)
+{
+    struct priv *s = arg;
+    mpthread_set_name("cache-prefetch");
+    pthread_mutex_lock(&s->mutex);
+    while (!s->prefetch_quit) {
+        struct prefetch_req *req = NULL;
+        for (int n = 0; n < s->req_count; n++) {
+            if (prefetch_get(s, n)->state == REQ_PENDING) {
+                req = prefetch_get(s, n);
+                break;
+            }
+        }
+        if (!req) {
+            pthread_cond_wait(&s->prefetch_wakeup, &s->mutex);
+            continue;
+        }
+        req->state = REQ_BUSY;
+        char *dst = (char *)&s->buffer[req->bpos];
+        int64_t filepos = req->filepos;
+        int len = req->len;
+
+        pthread_mutex_unlock(&s->mutex);
+        int r = s->stream->read_at(s->stream, dst, len, filepos);
+        pthread_mutex_lock(&s->mutex);
+
+        // req is still valid: BUSY requests are never published or reused.
+        req->result = r;
+        req->state = REQ_DONE;
+        pthread_cond_broadcast(&s->wakeup);
+    }
+    pthread_mutex_unlock(&s->mutex);
+    return NULL;
+}
+
 // This is called both during init and at runtime.
 // The size argument is the readahead half only; s->back_size is the backbuffer.
 static int resize_cache(struct priv *s, int64_t size)
@@ -381,6 +586,8 @@ static int resize_cache(struct priv *s, int64_t size)
     if (!buffer)
         return STREAM_ERROR;
 
+    prefetch_cancel(s);
+
     if (s->buffer) {
         // Copy & free the old ringbuffer data.
         // If the buffer is too small, prefer to copy these regions:
@@ -401,7 +608,7 @@ static int resize_cache(struct priv *s, int64_t size)
         // Set it up such that read_1 is at buffer pos 0, and read_2 wraps
         // around below it, so that it is located at the end of the buffer.
         s->min_filepos = s->read_filepos - read_2;
-        s->max_filepos = s->read_filepos + read_1;
+        s->max_filepos = s->prefetch_pos = s->read_filepos + read_1;
         s->offset = s->max_filepos - read_1;
     } else {
         cache_drop_contents(s);
@@ -458,6 +665,8 @@ static int cache_get_cached_control(stream_t *cache, int cmd, void *arg)
             .fill = s->max_filepos - s->read_filepos,
             .idle = s->idle,
             .speed = llrint(s->speed),
+            .read_calls = s->read_calls,
+            .read_bytes = s->read_bytes,
         };
         return STREAM_OK;
     case STREAM_CTRL_SET_READAHEAD:
@@ -562,6 +771,8 @@ static void *cache_thread(void *arg)
             s->control_res = cache_update_stream_position(s);
             s->control = CACHE_CTRL_NONE;
             pthread_cond_signal(&s->wakeup);
+        } else if (s->num_prefetch_threads) {
+            cache_prefetch(s);
         } else {
             cache_fill(s);
         }
@@ -569,7 +780,7 @@ static void *cache_thread(void *arg)
             pthread_cond_signal(&s->wakeup);
             s->control = CACHE_CTRL_NONE;
         }
-        if (s->idle && s->control == CACHE_CTRL_NONE) {
+        if ((s->idle || s->prefetch_wait) && s->control == CACHE_CTRL_NONE) {
             struct timespec ts = mp_rel_time_to_timespec(CACHE_IDLE_SLEEP_TIME);
             pthread_cond_timedwait(&s->wakeup, &s->mutex, &ts);
         }
@@ -723,12 +934,33 @@ static void cache_uninit(stream_t *cache)
         pthread_mutex_unlock(&s->mutex);
         pthread_join(s->cache_thread, NULL);
     }
+    if (s->num_prefetch_threads) {
+        pthread_mutex_lock(&s->mutex);
+        prefetch_cancel(s);
+        s->prefetch_quit = true;
+        pthread_cond_broadcast(&s->prefetch_wakeup);
+        pthread_mutex_unlock(&s->mutex);
+        for (int n = 0; n < s->num_prefetch_threads; n++)
+            pthread_join(s->prefetch_threads[n], NULL);
+    }
+    pthread_cond_destroy(&s->prefetch_wakeup);
     pthread_mutex_destroy(&s->mutex);
     pthread_cond_destroy(&s->wakeup);
     free(s->buffer);
     talloc_free(s);
 }
 
+// Undo stream_cache_init() after the stream callbacks were set. This stops and
+// joins all threads that were started, so the caller only has to free the
+// stream as usual.
+static int cache_init_failed(stream_t *cache)
+{
+    cache_uninit(cache);
+    cache->close = NULL;
+    cache->priv = NULL;
+    return -1;
+}
+
 // return 1 on success, 0 if the cache is disabled/not needed, and -1 on error
 // or if the cache is disabled
 int stream_cache_init(stream_t *cache, stream_t *stream,
@@ -759,6 +991,7 @@ int stream_cache_init(stream_t *cache, stream_t *stream,
 
     pthread_mutex_init(&s->mutex, NULL);
     pthread_cond_init(&s->wakeup, NULL);
+    pthread_cond_init(&s->prefetch_wakeup, NULL);
 
     cache->priv = s;
     s->cache = cache;
@@ -775,9 +1008,30 @@ int stream_cache_init(stream_t *cache, stream_t *stream,
 
     s->seekable = stream->seekable;
 
+    if (opts->prefetch_requests > 0 && stream->read_at) {
+        s->num_reqs = opts->prefetch_requests;
+        s->reqs = talloc_array(s, struct prefetch_req, s->num_reqs);
+        s->prefetch_threads = talloc_array(s, pthread_t, s->num_reqs);
+        for (int n = 0; n < s->num_reqs; n++) {
+            if (pthread_create(&s->prefetch_threads[n], NULL,
+                               prefetch_thread, s) != 0)
+                break;
+            s->num_prefetch_threads++;
+        }
+        if (!s->num_prefetch_threads) {
+            MP_ERR(s, "Starting prefetch threads failed.\n");
+            return cache_init_failed(cache);
+        }
+        if (s->num_prefetch_threads < s->num_reqs) {
+            MP_WARN(s, "Started only %d of %d prefetch threads.\n",
+                    s->num_prefetch_threads, s->num_reqs);
+        }
+        MP_VERBOSE(s, "Using %d prefetch requests.\n", s->num_reqs);
+    }
+
     if (pthread_create(&s->cache_thread, NULL, cache_thread, s) != 0) {
         MP_ERR(s, "Starting cache thread failed.\n");
-        return -1;
+        return cache_init_failed(cache);
     }
     s->cache_thread_running = true;
 
@@ -786,7 +1040,7 @@ int stream_cache_init(stream_t *cache, stream_t *stream,
         return 1;
     for (;;) {
         if (mp_cancel_test(cache->cancel))
-            return -1;
+            return cache_init_failed(cache);
         struct stream_cache_info info;
         if (stream_control(s->cache, STREAM_CTRL_GET_CACHE_INFO, &info) < 0)
             break;
@@ -51,8 +51,9 @@
 #include <poll.h>
 #endif
 
-// Includes additional padding in case sizes get rounded up by sector size.
-#define TOTAL_BUFFER_SIZE (STREAM_MAX_BUFFER_SIZE + STREAM_MAX_SECTOR_SIZE)
+// Initial size of the ring buffer. Must be a power of 2, and large enough to
+// hold 2 sectors.
+#define STREAM_MIN_RING_SIZE (2 * STREAM_MAX_SECTOR_SIZE)
 
 extern const stream_info_t stream_info_cdda;
 extern const stream_info_t stream_info_dvb;
@@ -197,7 +198,12 @@ char *mp_url_escape(void *talloc_ctx, const char *url, const char *ok)
 
 static stream_t *new_stream(void)
 {
-    return talloc_zero_size(NULL, sizeof(stream_t) + TOTAL_BUFFER_SIZE);
+    stream_t *s = talloc_zero(NULL, stream_t);
+    s->buffer = talloc_size(s, STREAM_MIN_RING_SIZE);
+    s->buffer_mask = STREAM_MIN_RING_SIZE - 1;
+    s->read_size = STREAM_BUFFER_SIZE;
+    s->max_read_size = STREAM_BUFFER_SIZE;
+    return s;
 }
 
 static const char *match_proto(const char *url, const char *proto)
@@ -246,6 +252,10 @@ static int open_internal(const stream_info_t *sinfo, const char *url, int flags,
         int opt;
         mp_read_option_raw(global, "access-references", &m_option_type_flag, &opt);
         s->access_references = opt;
+        int64_t max_read;
+        mp_read_option_raw(global, "stream-buffer-size", &m_option_type_byte_size,
+                           &max_read);
+        s->max_read_size = max_read;
     }
 
     MP_VERBOSE(s, "Opening %s\n", url);
@@ -337,17 +347,47 @@ stream_t *open_output_stream(const char *filename, struct mpv_global *global)
     return stream_create(filename, STREAM_WRITE, NULL, global);
 }
 
-// Read function bypassing the local stream buffer. This will not write into
-// s->buffer, but into buf[0..len] instead.
-// Returns 0 on error or EOF, and length of bytes read on success.
-// Partial reads are possible, even if EOF is not reached.
-static int stream_read_unbuffered(stream_t *s, void *buf, int len)
+static unsigned int ring_size(stream_t *s)
+{
+    return s->buffer_mask + 1;
+}
+
+// Copy len bytes starting at the (unwrapped) buffer index pos to dst.
+static void ring_copy(stream_t *s, void *dst, unsigned int pos, int len)
+{
+    unsigned int wpos = pos & s->buffer_mask;
+    int n = MPMIN(len, (int)(ring_size(s) - wpos));
+    memcpy(dst, &s->buffer[wpos], n);
+    memcpy((char *)dst + n, s->buffer, len - n);
+}
+
+// Reallocate the ring buffer to hold at least size bytes, and move all valid
+// data to the start of it. This is also used to make the data contiguous.
+static void stream_resize_buffer(stream_t *s, unsigned int size)
+{
+    unsigned int alloc = ring_size(s);
+    while (alloc < size)
+        alloc *= 2;
+    unsigned char *buffer = talloc_size(s, alloc);
+    ring_copy(s, buffer, s->buf_start, s->buf_len - s->buf_start);
+    talloc_free(s->buffer);
+    s->buffer = buffer;
+    s->buffer_mask = alloc - 1;
+    s->buf_pos -= s->buf_start;
+    s->buf_len -= s->buf_start;
+    s->buf_start = 0;
+}
+
+// Call the stream implementation's read function. This does not touch the
+// buffer state.
+static int stream_read_low(stream_t *s, void *buf, int len)
 {
     int res = 0;
-    s->buf_pos = s->buf_len = 0;
     // we will retry even if we already reached EOF previously.
-    if (s->fill_buffer && !mp_cancel_test(s->cancel))
+    if (s->fill_buffer && !mp_cancel_test(s->cancel)) {
         res = s->fill_buffer(s, buf, len);
+        s->total_read_calls++;
+    }
     if (res <= 0) {
         s->eof = 1;
         return 0;
@@ -355,24 +395,88 @@ static int stream_read_unbuffered(stream_t *s, void *buf, int len)
     // When reading succeeded we are obviously not at eof.
     s->eof = 0;
     s->pos += res;
+    s->total_read_bytes += res;
     return res;
 }
 
-static int stream_fill_buffer_by(stream_t *s, int64_t len)
+// Account data handed out by get_view() like data returned by fill_buffer.
+// Data already counted by an earlier peek is not counted again.
+static void count_view(stream_t *s, int64_t pos, int len)
 {
-    len = MPMIN(len, s->read_chunk);
-    len = MPMAX(len, STREAM_BUFFER_SIZE);
-    if (s->sector_size)
-        len = s->sector_size;
-    len = stream_read_unbuffered(s, s->buffer, len);
-    s->buf_pos = 0;
-    s->buf_len = len;
-    return s->buf_len;
+    int64_t end = pos + len;
+    if (end > s->view_counted_end) {
+        s->total_read_calls++;
+        s->total_read_bytes += end - MPMAX(pos, s->view_counted_end);
+        s->view_counted_end = end;
+    }
+}
+
+// Read function bypassing the local stream buffer. This will not write into
+// s->buffer, but into buf[0..len] instead.
+// Returns 0 on error or EOF, and length of bytes read on success.
+// Partial reads are possible, even if EOF is not reached.
+static int stream_read_unbuffered(stream_t *s, void *buf, int len)
+{
+    s->buf_start = s->buf_pos = s->buf_len = 0;
+    return stream_read_low(s, buf, len);
 }
 
+// Read into the ring buffer until at least forward bytes are available after
+// the current read position, or EOF/error is reached. Old data before the
+// read position is overwritten as needed. Returns the available bytes.
+static int stream_fill_ring(stream_t *s, int forward)
+{
+    int avail = s->buf_len - s->buf_pos;
+    while (avail < forward) {
+        // Keep the indexes from overflowing.
+        if (s->buf_start > s->buffer_mask) {
+            unsigned int offset = s->buf_start & ~s->buffer_mask;
+            s->buf_start -= offset;
+            s->buf_pos -= offset;
+            s->buf_len -= offset;
+        }
+        int chunk = s->sector_size ? s->sector_size
+                    : MPMAX(s->read_size, MPMIN(forward - avail, s->read_chunk));
+        if (avail + chunk > ring_size(s))
+            stream_resize_buffer(s, avail + chunk);
+        unsigned int size = ring_size(s);
+        unsigned int space = size - (s->buf_len - s->buf_start);
+        if (space < chunk)
+            s->buf_start += chunk - space; // drop old data
+        unsigned int wpos = s->buf_len & s->buffer_mask;
+        int read;
+        if (s->sector_size && wpos + chunk > size) {
+            // Sectors can't be split across the buffer end.
+            unsigned char tmp[STREAM_MAX_SECTOR_SIZE];
+            read = stream_read_low(s, tmp, chunk);
+            int n = MPMIN(read, (int)(size - wpos));
+            memcpy(&s->buffer[wpos], tmp, n);
+            memcpy(s->buffer, tmp + n, read - n);
+        } else {
+            // Use a single read call, even if it stops at the buffer end.
+            read = stream_read_low(s, &s->buffer[wpos],
+                                   MPMIN(chunk, (int)(size - wpos)));
+        }
+        if (read <= 0)
+            break; // EOF
+        s->buf_len += read;
+        avail += read;
+    }
+    return avail;
+}
+
+// Read more data into the buffer, which is expected to be fully consumed.
+// Returns the number of bytes available (0 on EOF or error).
 int stream_fill_buffer(stream_t *s)
 {
-    return stream_fill_buffer_by(s, STREAM_BUFFER_SIZE);
+    // Data was consumed sequentially since the last seek, so read larger
+    // chunks to reduce the number of read calls. read_chunk is set by streams
+    // for which large reads would add too much latency.
+    if (s->buf_len && !s->sector_size) {
+        int max = MPMIN(s->max_read_size, s->read_chunk);
+        s->read_size = MPMIN(s->read_size * 2, MPMAX(max, STREAM_BUFFER_SIZE));
+    }
+    return stream_fill_ring(s, 1);
 }
 
 // Read between 1..buf_size bytes of data, return how much data has been read.
@@ -382,16 +486,27 @@ int stream_read_partial(stream_t *s, char *buf, int buf_size)
     assert(s->buf_pos <= s->buf_len);
     assert(buf_size >= 0);
     if (s->buf_pos == s->buf_len && buf_size > 0) {
-        s->buf_pos = s->buf_len = 0;
+        // Copy straight from the stream's own memory if possible.
+        if (s->get_view && !mp_cancel_test(s->cancel)) {
+            struct bstr view = s->get_view(s, s->pos, buf_size);
+            if (view.len) {
+                count_view(s, s->pos, view.len);
+                s->buf_start = s->buf_pos = s->buf_len = 0;
+                memcpy(buf, view.start, view.len);
+                s->pos += view.len;
+                s->eof = 0;
+                return view.len;
+            }
+        }
         // Do a direct read, but only if there's no sector alignment requirement
         // Also, small reads will be more efficient with buffering & copying
-        if (!s->sector_size && buf_size >= STREAM_BUFFER_SIZE)
+        if (!s->sector_size && buf_size >= s->read_size)
             return stream_read_unbuffered(s, buf, buf_size);
         if (!stream_fill_buffer(s))
             return 0;
     }
-    int len = FFMIN(buf_size, s->buf_len - s->buf_pos);
-    memcpy(buf, &s->buffer[s->buf_pos], len);
+    int len = MPMIN(buf_size, s->buf_len - s->buf_pos);
+    ring_copy(s, buf, s->buf_pos, len);
     s->buf_pos += len;
     if (len > 0)
         s->eof = 0;
@@ -425,28 +540,29 @@ struct bstr stream_peek(stream_t *s, int len)
 {
     assert(len >= 0);
     assert(len <= STREAM_MAX_BUFFER_SIZE);
-    if (s->buf_len - s->buf_pos < len) {
-        // Move to front to guarantee we really can read up to max size.
-        int buf_valid = s->buf_len - s->buf_pos;
-        memmove(s->buffer, &s->buffer[s->buf_pos], buf_valid);
-        // Fill rest of the buffer.
-        while (buf_valid < len) {
-            int chunk = MPMAX(len - buf_valid, STREAM_BUFFER_SIZE);
-            if (s->sector_size)
-                chunk = s->sector_size;
-            assert(buf_valid + chunk <= TOTAL_BUFFER_SIZE);
-            int read = stream_read_unbuffered(s, &s->buffer[buf_valid], chunk);
-            if (read == 0)
-                break; // EOF
-            buf_valid += read;
+    if (s->get_view && s->buf_pos == s->buf_len) {
+        // Hand out the stream's memory directly. If it can't provide all
+        // data (e.g. the file was appended to), use the normal buffering.
+        struct bstr view = s->get_view(s, s->pos, len);
+        if (view.len == len) {
+            count_view(s, s->pos, len);
+            if (len)
+                s->eof = 0;
+            return view;
         }
-        s->buf_pos = 0;
-        s->buf_len = buf_valid;
-        if (s->buf_len)
+    }
+    if (s->buf_len - s->buf_pos < len) {
+        stream_fill_ring(s, len);
+        if (s->buf_len != s->buf_pos)
             s->eof = 0;
     }
-    return (bstr){.start = &s->buffer[s->buf_pos],
-                  .len = FFMIN(len, s->buf_len - s->buf_pos)};
+    len = MPMIN(len, s->buf_len - s->buf_pos);
+    // The data may wrap around the buffer end; this is rare enough to simply
+    // move all data to the buffer start.
+    if ((s->buf_pos & s->buffer_mask) + len > ring_size(s))
+        stream_resize_buffer(s, ring_size(s));
+    return (bstr){.start = &s->buffer[s->buf_pos & s->buffer_mask],
+                  .len = len};
 }
 
 int stream_write_buffer(stream_t *s, unsigned char *buf, int len)
@@ -470,7 +586,7 @@ static bool stream_skip_read(struct stream *s, int64_t len)
     while (len > 0) {
         unsigned int left = s->buf_len - s->buf_pos;
         if (!left) {
-            if (!stream_fill_buffer_by(s, left))
+            if (!stream_fill_buffer(s))
                 return false;
             continue;
         }
@@ -487,7 +603,9 @@ static bool stream_skip_read(struct stream *s, int64_t len)
 void stream_drop_buffers(stream_t *s)
 {
     s->pos = stream_tell(s);
-    s->buf_pos = s->buf_len = 0;
+    s->buf_start = s->buf_pos = s->buf_len = 0;
+    s->read_size = STREAM_BUFFER_SIZE;
+    s->view_counted_end = 0;
     s->eof = 0;
 }
 
@@ -527,9 +645,9 @@ bool stream_seek(stream_t *s, int64_t pos)
         pos = 0;
     }
     if (pos < s->pos) {
-        int64_t x = pos - (s->pos - (int)s->buf_len);
+        int64_t x = pos - (s->pos - (int)(s->buf_len - s->buf_start));
         if (x >= 0) {
-            s->buf_pos = x;
+            s->buf_pos = s->buf_start + x;
             assert(s->buf_pos <= s->buf_len);
             return true;
         }
@@ -574,7 +692,16 @@ bool stream_skip(stream_t *s, int64_t len)
 
 int stream_control(stream_t *s, int cmd, void *arg)
 {
-    return s->control ? s->control(s, cmd, arg) : STREAM_UNSUPPORTED;
+    int r = s->control ? s->control(s, cmd, arg) : STREAM_UNSUPPORTED;
+    if (cmd == STREAM_CTRL_GET_CACHE_INFO && r == STREAM_UNSUPPORTED) {
+        *(struct stream_cache_info *)arg = (struct stream_cache_info){
+            .idle = true,
+            .read_calls = s->total_read_calls,
+            .read_bytes = s->total_read_bytes,
+        };
+        r = STREAM_OK;
+    }
+    return r;
 }
 
 // Return the current size of the stream, or a negative value if unknown.
@@ -732,8 +859,10 @@ static int read_characters(stream_t *s, uint8_t *dst, int dstsize, int utf16)
     } else {
         if (s->buf_pos >= s->buf_len)
             stream_fill_buffer(s);
-        uint8_t *src = s->buffer + s->buf_pos;
-        int src_len = s->buf_len - s->buf_pos;
+        // Only the part up to the end of the ring buffer; the caller loops.
+        unsigned int wpos = s->buf_pos & s->buffer_mask;
+        uint8_t *src = s->buffer + wpos;
+        int src_len = MPMIN(s->buf_len - s->buf_pos, ring_size(s) - wpos);
         uint8_t *end = memchr(src, '\n', src_len);
         int len = end ? end - src + 1 : src_len;
         if (len > dstsize)
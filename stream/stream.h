@@ -105,11 +105,14 @@ enum stream_ctrl {
 };
 
 // for STREAM_CTRL_GET_CACHE_INFO
+// Streams without cache report size==0, idle==true, and the read counters.
 struct stream_cache_info {
     int64_t size;
     int64_t fill;
     bool idle;
     int64_t speed;
+    uint64_t read_calls; // low level read calls on the stream
+    uint64_t read_bytes; // bytes returned by them
 };
 
 struct stream_lang_req {
@@ -152,6 +155,10 @@ typedef struct stream {
 
     // Read
     int (*fill_buffer)(struct stream *s, char *buffer, int max_len);
+    // Optional: read up to len bytes at pos, without using or changing the
+    // stream position. Must be safe to call concurrently from any thread.
+    // Returns the number of bytes read, 0 on EOF, or <0 on error.
+    int (*read_at)(struct stream *s, char *buffer, int len, int64_t pos);
     // Write
     int (*write_buffer)(struct stream *s, char *buffer, int len);
     // Seek
@@ -162,10 +169,25 @@ typedef struct stream {
     int (*control)(struct stream *s, int cmd, void *arg);
     // Close
     void (*close)(struct stream *s);
+    // Optional: return a pointer to up to len bytes of the stream data at pos,
+    // without copying. Returns a shorter (or empty) bstr if not all data is
+    // directly accessible. The memory must stay valid until the stream is
+    // closed. Used for zero-copy access to memory mapped files.
+    struct bstr (*get_view)(struct stream *s, int64_t pos, int len);
 
     int sector_size; // sector size (seek will be aligned on this size if non 0)
     int read_chunk; // maximum amount of data to read at once to limit latency
-    unsigned int buf_pos, buf_len;
+    // Ring buffer. The valid data is in [buf_start, buf_len), and buf_pos is
+    // the read position within it. These indexes are not wrapped; the byte at
+    // index i is buffer[i & buffer_mask]. The buffer size is a power of 2.
+    unsigned int buf_start, buf_pos, buf_len;
+    unsigned int buffer_mask;
+    unsigned char *buffer;
+    int read_size; // current buffered read size, grows on sequential reading
+    int max_read_size; // --stream-buffer-size
+    uint64_t total_read_calls; // number of fill_buffer calls
+    uint64_t total_read_bytes; // sum of bytes returned by fill_buffer
+    int64_t view_counted_end; // get_view data up to here was counted
     int64_t pos;
     int eof;
     int mode; //STREAM_READ or STREAM_WRITE
@@ -190,9 +212,6 @@ typedef struct stream {
     struct mp_cancel *cancel;   // cancellation notification
 
     struct stream *underlying;  // e.g. cache wrapper
-
-    // Includes additional padding in case sizes get rounded up by sector size.
-    unsigned char buffer[];
 } stream_t;
 
 int stream_fill_buffer(stream_t *s);
@@ -211,8 +230,8 @@ int stream_write_buffer(stream_t *s, unsigned char *buf, int len);
 
 inline static int stream_read_char(stream_t *s)
 {
-    return (s->buf_pos < s->buf_len) ? s->buffer[s->buf_pos++] :
-           (stream_fill_buffer(s) ? s->buffer[s->buf_pos++] : -256);
+    return (s->buf_pos < s->buf_len) ? s->buffer[s->buf_pos++ & s->buffer_mask] :
+           (stream_fill_buffer(s) ? s->buffer[s->buf_pos++ & s->buffer_mask] : -256);
 }
 
 unsigned char *stream_read_line(stream_t *s, unsigned char *mem, int max,
@@ -33,9 +33,11 @@
 #include "osdep/io.h"
 
 #include "common/common.h"
+#include "common/global.h"
 #include "common/msg.h"
 #include "stream.h"
 #include "options/m_option.h"
+#include "options/m_config.h"
 #include "options/path.h"
 
 #if HAVE_BSD_FSTATFS
@@ -64,8 +66,19 @@ struct priv {
     bool regular_file;
     bool appending;
     int64_t orig_size;
+
+    // Set if the file is memory mapped (--stream-mmap).
+    uint8_t *map;
+    int64_t map_size;
+    int64_t advised_start, advised_end; // range last passed to WILLNEED
 };
 
+// Amount of data ahead of the read position the kernel is asked to prefetch
+// when reading from a mapping. Also the alignment of the advised range, which
+// makes it a multiple of any common page size.
+#define MMAP_READAHEAD (4 * 1024 * 1024)
+#define MMAP_ADVISE_ALIGN (64 * 1024)
+
 // Total timeout = RETRY_TIMEOUT * MAX_RETRIES
 #define RETRY_TIMEOUT 0.2
 #define MAX_RETRIES 10
@@ -78,10 +91,49 @@ static int64_t get_size(stream_t *s)
     return size == (off_t)-1 ? -1 : size;
 }
 
+// Tell the kernel that the mapped data following pos will be accessed soon.
+// Only re-advise once the read position leaves the previously advised range,
+// so sequential reading causes a syscall every MMAP_READAHEAD/2 bytes.
+static void mmap_readahead(struct priv *p, int64_t pos)
+{
+#ifdef POSIX_MADV_WILLNEED
+    if (pos >= p->advised_start && pos + MMAP_READAHEAD / 2 <= p->advised_end)
+        return;
+    int64_t start = pos & ~(int64_t)(MMAP_ADVISE_ALIGN - 1);
+    int64_t end = MPMIN(start + MMAP_READAHEAD, p->map_size);
+    if (start >= end)
+        return;
+    posix_madvise(p->map + start, end - start, POSIX_MADV_WILLNEED);
+    p->advised_start = start;
+    p->advised_end = end;
+#endif
+}
+
+static struct bstr get_view(stream_t *s, int64_t pos, int len)
+{
+    struct priv *p = s->priv;
+    if (pos < 0 || pos >= p->map_size)
+        return (struct bstr){0};
+    mmap_readahead(p, pos);
+    return (struct bstr){p->map + pos, MPMIN(len, p->map_size - pos)};
+}
+
 static int fill_buffer(stream_t *s, char *buffer, int max_len)
 {
     struct priv *p = s->priv;
 
+    if (p->map) {
+        struct bstr view = get_view(s, s->pos, max_len);
+        if (view.len) {
+            memcpy(buffer, view.start, view.len);
+            return view.len;
+        }
+        // Past the mapped area, which happens only if the file has grown.
+        // The file position is not maintained while reading from the map.
+        if (lseek(p->fd, s->pos, SEEK_SET) == (off_t)-1)
+            return 0;
+    }
+
 #ifndef __MINGW32__
     if (p->use_poll) {
         int c = s->cancel ? mp_cancel_get_fd(s->cancel) : -1;
@@ -118,6 +170,23 @@ static int fill_buffer(stream_t *s, char *buffer, int max_len)
     return 0;
 }
 
+#ifndef __MINGW32__
+static int read_at(stream_t *s, char *buffer, int len, int64_t pos)
+{
+    struct priv *p = s->priv;
+    if (pos < p->map_size) {
+        int copy = MPMIN(len, p->map_size - pos);
+        memcpy(buffer, p->map + pos, copy);
+        return copy;
+    }
+    ssize_t r;
+    do {
+        r = pread(p->fd, buffer, len, pos);
+    } while (r < 0 && errno == EINTR);
+    return r;
+}
+#endif
+
 static int write_buffer(stream_t *s, char *buffer, int len)
 {
     struct priv *p = s->priv;
@@ -136,6 +205,11 @@ static int write_buffer(stream_t *s, char *buffer, int len)
 static int seek(stream_t *s, int64_t newpos)
 {
     struct priv *p = s->priv;
+    if (p->map) {
+        // fill_buffer() syncs the file position when leaving the mapping.
+        mmap_readahead(p, newpos);
+        return newpos >= 0;
+    }
     return lseek(p->fd, newpos, SEEK_SET) != (off_t)-1;
 }
 
@@ -157,6 +231,8 @@ static int control(stream_t *s, int cmd, void *arg)
 static void s_close(stream_t *s)
 {
     struct priv *p = s->priv;
+    if (p->map)
+        munmap(p->map, p->map_size);
     if (p->close)
         close(p->fd);
 }
@@ -263,6 +339,36 @@ static bool check_stream_network(int fd)
 }
 #endif
 
+// Map the whole file read-only. The stream falls back to read() if this
+// fails. Note that truncating a mapped file while it is played causes SIGBUS,
+// which is why this is opt-in.
+static void try_mmap(stream_t *stream)
+{
+    struct priv *p = stream->priv;
+
+    int opt = 0;
+    if (stream->global->config)
+        mp_read_option_raw(stream->global, "stream-mmap", &m_option_type_flag, &opt);
+    if (!opt || stream->mode != STREAM_READ || !p->regular_file ||
+        p->appending || p->orig_size <= 0 || (uint64_t)p->orig_size > SIZE_MAX)
+        return;
+
+    void *map = mmap(NULL, p->orig_size, PROT_READ, MAP_SHARED, p->fd, 0);
+    if (map == MAP_FAILED) {
+        MP_VERBOSE(stream, "Could not map file, using read().\n");
+        return;
+    }
+    p->map = map;
+    p->map_size = p->orig_size;
+#ifdef POSIX_MADV_SEQUENTIAL
+    posix_madvise(p->map, p->map_size, POSIX_MADV_SEQUENTIAL);
+#endif
+    mmap_readahead(p, 0);
+
+    stream->get_view = get_view;
+    MP_VERBOSE(stream, "Using memory mapped file.\n");
+}
+
 static int open_f(stream_t *stream)
 {
     struct priv *p = talloc_ptrtype(stream, p);
@@ -360,6 +466,13 @@ static int open_f(stream_t *stream)
 
     p->orig_size = get_size(stream);
 
+    try_mmap(stream);
+
+#ifndef __MINGW32__
+    if (p->regular_file && !write)
+        stream->read_at = read_at;
+#endif
+
     return STREAM_OK;
 }
 
@@ -0,0 +1,785 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include <libavutil/cpu.h>
+
+#include "config.h"
+#include "common/common.h"
+#include "blend.h"
+
+#if HAVE_ASM && defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define HAVE_BLEND_X86 1
+#include <immintrin.h>
+#else
+#define HAVE_BLEND_X86 0
+#endif
+
+#if HAVE_ASM && defined(__ARM_NEON)
+#define HAVE_BLEND_NEON 1
+#include <arm_neon.h>
+#else
+#define HAVE_BLEND_NEON 0
+#endif
+
+// The scalar versions are the reference. The SIMD versions compute exactly the
+// same integer expressions, using:
+//  - x / 255 == (x + 1 + (x >> 8)) >> 8          for 0 <= x < 65535
+//  - x / 255 == (x * 0x80808081) >> 39           for any uint32_t x
+//  - x / 65025 == (x * 0x81018203) >> 47         for any uint32_t x
+// Pixels with alpha 0 are left unchanged by all formulas, so skipping them (as
+// the scalar code does) is only an optimization.
+
+#define CONDITIONAL 1
+
+#define BLEND_CONST_ALPHA(TYPE)                                                 \
+    TYPE *dst_r = dst_rp;                                                       \
+    for (int x = x0; x < w; x++) {                                              \
+        uint32_t srcap = srca_r[x];                                             \
+        if (CONDITIONAL && !srcap) continue;                                    \
+        srcap *= srcamul; /* now 0..65025 */                                    \
+        dst_r[x] = (srcp * srcap + dst_r[x] * (65025 - srcap) + 32512) / 65025; \
+    }
+
+static void const_alpha_c(void *dst_rp, int srcp, const uint8_t *srca_r,
+                          uint32_t srcamul, int x0, int w, int bytes)
+{
+    if (bytes == 2) {
+        BLEND_CONST_ALPHA(uint16_t)
+    } else if (bytes == 1) {
+        BLEND_CONST_ALPHA(uint8_t)
+    }
+}
+
+#define BLEND_SRC_ALPHA(TYPE)                                                   \
+    TYPE *dst_r = dst_rp;                                                       \
+    const TYPE *src_r = src_rp;                                                 \
+    for (int x = x0; x < w; x++) {                                              \
+        uint32_t srcap = srca_r[x];                                             \
+        if (CONDITIONAL && !srcap) continue;                                    \
+        dst_r[x] = (src_r[x] * srcap + dst_r[x] * (255 - srcap) + 127) / 255;   \
+    }
+
+static void src_alpha_c(void *dst_rp, const void *src_rp, const uint8_t *srca_r,
+                        int x0, int w, int bytes)
+{
+    if (bytes == 2) {
+        BLEND_SRC_ALPHA(uint16_t)
+    } else if (bytes == 1) {
+        BLEND_SRC_ALPHA(uint8_t)
+    }
+}
+
+#define BLEND_SRC_DST_MUL(TYPE, MAX)                                            \
+    TYPE *dst_r = dst_rp;                                                       \
+    for (int x = x0; x < w; x++) {                                              \
+        uint32_t srcp = (uint16_t)(src_r[x] * srcmul); /* now 0..65025 */       \
+        dst_r[x] = (srcp * (MAX) + dst_r[x] * (65025 - srcp) + 32512) / 65025;  \
+    }
+
+static void src_dst_mul_c(void *dst_rp, const uint8_t *src_r, uint32_t srcmul,
+                          int x0, int w, int bytes)
+{
+    if (bytes == 2) {
+        BLEND_SRC_DST_MUL(uint16_t, 65025)
+    } else if (bytes == 1) {
+        BLEND_SRC_DST_MUL(uint8_t, 255)
+    }
+}
+
+// Each function blends a single row.
+struct blend_fns {
+    void (*const_alpha)(void *dst, int srcp, const uint8_t *srca,
+                        uint32_t srcamul, int w, int bytes);
+    void (*src_alpha)(void *dst, const void *src, const uint8_t *srca,
+                      int w, int bytes);
+    void (*src_dst_mul)(void *dst, const uint8_t *src, uint32_t srcmul,
+                        int w, int bytes);
+};
+
+static void const_alpha_row_c(void *dst, int srcp, const uint8_t *srca,
+                              uint32_t srcamul, int w, int bytes)
+{
+    const_alpha_c(dst, srcp, srca, srcamul, 0, w, bytes);
+}
+
+static void src_alpha_row_c(void *dst, const void *src, const uint8_t *srca,
+                            int w, int bytes)
+{
+    src_alpha_c(dst, src, srca, 0, w, bytes);
+}
+
+static void src_dst_mul_row_c(void *dst, const uint8_t *src, uint32_t srcmul,
+                              int w, int bytes)
+{
+    src_dst_mul_c(dst, src, srcmul, 0, w, bytes);
+}
+
+static const struct blend_fns blend_fns_c = {
+    .const_alpha = const_alpha_row_c,
+    .src_alpha = src_alpha_row_c,
+    .src_dst_mul = src_dst_mul_row_c,
+};
+
+// The SIMD row functions are instantiated with a constant bytes value, so the
+// load/store helpers collapse to the right instructions.
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+#if HAVE_BLEND_X86
+
+#define SSE2_FN __attribute__((target("sse2")))
+#define AVX2_FN __attribute__((target("avx2")))
+
+// 8 pixels, widened to 16 bit.
+static ALWAYS_INLINE SSE2_FN __m128i sse2_load_px(const void *p, int bytes)
+{
+    if (bytes == 2)
+        return _mm_loadu_si128(p);
+    return _mm_unpacklo_epi8(_mm_loadl_epi64(p), _mm_setzero_si128());
+}
+
+static ALWAYS_INLINE SSE2_FN void sse2_store_px(void *p, __m128i v, int bytes)
+{
+    if (bytes == 2) {
+        _mm_storeu_si128(p, v);
+    } else {
+        _mm_storel_epi64(p, _mm_packus_epi16(v, v));
+    }
+}
+
+// a * b + c * d on unsigned 16 bit lanes, with 32 bit results (lo: lanes 0-3,
+// hi: lanes 4-7).
+static ALWAYS_INLINE SSE2_FN void sse2_madd_u16(__m128i a, __m128i b,
+                                                __m128i c, __m128i d,
+                                                __m128i *lo, __m128i *hi)
+{
+    __m128i ab_l = _mm_mullo_epi16(a, b), ab_h = _mm_mulhi_epu16(a, b);
+    __m128i cd_l = _mm_mullo_epi16(c, d), cd_h = _mm_mulhi_epu16(c, d);
+    *lo = _mm_add_epi32(_mm_unpacklo_epi16(ab_l, ab_h),
+                        _mm_unpacklo_epi16(cd_l, cd_h));
+    *hi = _mm_add_epi32(_mm_unpackhi_epi16(ab_l, ab_h),
+                        _mm_unpackhi_epi16(cd_l, cd_h));
+}
+
+// (x * m) >> shift for each 32 bit lane, with shift >= 32.
+static ALWAYS_INLINE SSE2_FN __m128i sse2_mulshr_u32(__m128i x, uint32_t m,
+                                                     int shift)
+{
+    const __m128i vm = _mm_set1_epi32((int)m);
+    __m128i even = _mm_srli_epi64(_mm_mul_epu32(x, vm), shift);
+    __m128i odd = _mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(x, 32), vm),
+                                 shift - 32);
+    return _mm_or_si128(even, _mm_and_si128(odd, _mm_set_epi32(-1, 0, -1, 0)));
+}
+
+static ALWAYS_INLINE SSE2_FN __m128i sse2_div255_u32(__m128i x)
+{
+    return sse2_mulshr_u32(x, 0x80808081u, 39);
+}
+
+static ALWAYS_INLINE SSE2_FN __m128i sse2_div65025_u32(__m128i x)
+{
+    return sse2_mulshr_u32(x, 0x81018203u, 47);
+}
+
+// Pack 32 bit lanes with values in 0..65535 to 16 bit lanes.
+static ALWAYS_INLINE SSE2_FN __m128i sse2_pack_u32(__m128i lo, __m128i hi)
+{
+    const __m128i bias = _mm_set1_epi32(0x8000);
+    __m128i r = _mm_packs_epi32(_mm_sub_epi32(lo, bias), _mm_sub_epi32(hi, bias));
+    return _mm_xor_si128(r, _mm_set1_epi16(-0x8000));
+}
+
+static ALWAYS_INLINE SSE2_FN bool sse2_all_zero(__m128i a8)
+{
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(a8, _mm_setzero_si128())) == 0xFFFF;
+}
+
+static ALWAYS_INLINE SSE2_FN void
+const_alpha_sse2_tmpl(void *dst, int srcp, const uint8_t *srca,
+                      uint32_t srcamul, int w, int bytes)
+{
+    const __m128i vsrcp = _mm_set1_epi16(srcp);
+    const __m128i vmul = _mm_set1_epi16(srcamul);
+    const __m128i vmax = _mm_set1_epi16(65025 - 65536);
+    const __m128i round = _mm_set1_epi32(32512);
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        __m128i a8 = _mm_loadl_epi64((const void *)(srca + x));
+        if (sse2_all_zero(a8))
+            continue;
+        __m128i srcap = _mm_mullo_epi16(_mm_unpacklo_epi8(a8, _mm_setzero_si128()),
+                                        vmul);
+        void *d = (uint8_t *)dst + x * bytes;
+        __m128i lo, hi;
+        sse2_madd_u16(vsrcp, srcap, sse2_load_px(d, bytes),
+                      _mm_sub_epi16(vmax, srcap), &lo, &hi);
+        lo = sse2_div65025_u32(_mm_add_epi32(lo, round));
+        hi = sse2_div65025_u32(_mm_add_epi32(hi, round));
+        sse2_store_px(d, sse2_pack_u32(lo, hi), bytes);
+    }
+    const_alpha_c(dst, srcp, srca, srcamul, x, w, bytes);
+}
+
+static ALWAYS_INLINE SSE2_FN void
+src_alpha_sse2_tmpl(void *dst, const void *src, const uint8_t *srca,
+                    int w, int bytes)
+{
+    const __m128i v255 = _mm_set1_epi16(255);
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        __m128i a8 = _mm_loadl_epi64((const void *)(srca + x));
+        if (sse2_all_zero(a8))
+            continue;
+        __m128i a = _mm_unpacklo_epi8(a8, _mm_setzero_si128());
+        __m128i ia = _mm_sub_epi16(v255, a);
+        void *d = (uint8_t *)dst + x * bytes;
+        __m128i vs = sse2_load_px((const uint8_t *)src + x * bytes, bytes);
+        __m128i vd = sse2_load_px(d, bytes);
+        __m128i res;
+        if (bytes == 1) {
+            // Everything fits into 16 bit: n <= 255 * 255 + 127.
+            __m128i n = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(vs, a),
+                                                    _mm_mullo_epi16(vd, ia)),
+                                      _mm_set1_epi16(127));
+            n = _mm_add_epi16(n, _mm_add_epi16(_mm_srli_epi16(n, 8),
+                                               _mm_set1_epi16(1)));
+            res = _mm_srli_epi16(n, 8);
+        } else {
+            const __m128i round = _mm_set1_epi32(127);
+            __m128i lo, hi;
+            sse2_madd_u16(vs, a, vd, ia, &lo, &hi);
+            lo = sse2_div255_u32(_mm_add_epi32(lo, round));
+            hi = sse2_div255_u32(_mm_add_epi32(hi, round));
+            res = sse2_pack_u32(lo, hi);
+        }
+        sse2_store_px(d, res, bytes);
+    }
+    src_alpha_c(dst, src, srca, x, w, bytes);
+}
+
+static ALWAYS_INLINE SSE2_FN void
+src_dst_mul_sse2_tmpl(void *dst, const uint8_t *src, uint32_t srcmul,
+                      int w, int bytes)
+{
+    const __m128i vmul = _mm_set1_epi16(srcmul);
+    const __m128i vmax = _mm_set1_epi16(65025 - 65536);
+    const __m128i vdmax = bytes == 2 ? vmax : _mm_set1_epi16(255);
+    const __m128i round = _mm_set1_epi32(32512);
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        __m128i a8 = _mm_loadl_epi64((const void *)(src + x));
+        if (sse2_all_zero(a8))
+            continue;
+        __m128i srcp = _mm_mullo_epi16(_mm_unpacklo_epi8(a8, _mm_setzero_si128()),
+                                       vmul);
+        void *d = (uint8_t *)dst + x * bytes;
+        __m128i lo, hi;
+        sse2_madd_u16(srcp, vdmax, sse2_load_px(d, bytes),
+                      _mm_sub_epi16(vmax, srcp), &lo, &hi);
+        lo = sse2_div65025_u32(_mm_add_epi32(lo, round));
+        hi = sse2_div65025_u32(_mm_add_epi32(hi, round));
+        sse2_store_px(d, sse2_pack_u32(lo, hi), bytes);
+    }
+    src_dst_mul_c(dst, src, srcmul, x, w, bytes);
+}
+
+static SSE2_FN void const_alpha_row_sse2(void *dst, int srcp,
+                                         const uint8_t *srca, uint32_t srcamul,
+                                         int w, int bytes)
+{
+    if (bytes == 2) {
+        const_alpha_sse2_tmpl(dst, srcp, srca, srcamul, w, 2);
+    } else {
+        const_alpha_sse2_tmpl(dst, srcp, srca, srcamul, w, 1);
+    }
+}
+
+static SSE2_FN void src_alpha_row_sse2(void *dst, const void *src,
+                                       const uint8_t *srca, int w, int bytes)
+{
+    if (bytes == 2) {
+        src_alpha_sse2_tmpl(dst, src, srca, w, 2);
+    } else {
+        src_alpha_sse2_tmpl(dst, src, srca, w, 1);
+    }
+}
+
+static SSE2_FN void src_dst_mul_row_sse2(void *dst, const uint8_t *src,
+                                         uint32_t srcmul, int w, int bytes)
+{
+    if (bytes == 2) {
+        src_dst_mul_sse2_tmpl(dst, src, srcmul, w, 2);
+    } else {
+        src_dst_mul_sse2_tmpl(dst, src, srcmul, w, 1);
+    }
+}
+
+static const struct blend_fns blend_fns_sse2 = {
+    .const_alpha = const_alpha_row_sse2,
+    .src_alpha = src_alpha_row_sse2,
+    .src_dst_mul = src_dst_mul_row_sse2,
+};
+
+// 16 pixels, widened to 16 bit.
+static ALWAYS_INLINE AVX2_FN __m256i avx2_load_px(const void *p, int bytes)
+{
+    if (bytes == 2)
+        return _mm256_loadu_si256(p);
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128(p));
+}
+
+static ALWAYS_INLINE AVX2_FN void avx2_store_px(void *p, __m256i v, int bytes)
+{
+    if (bytes == 2) {
+        _mm256_storeu_si256(p, v);
+    } else {
+        __m256i r = _mm256_permute4x64_epi64(_mm256_packus_epi16(v, v), 0x08);
+        _mm_storeu_si128(p, _mm256_castsi256_si128(r));
+    }
+}
+
+// Like sse2_madd_u16(). lo and hi contain the lanes interleaved per 128 bit
+// half, which avx2_pack_u32() undoes.
+static ALWAYS_INLINE AVX2_FN void avx2_madd_u16(__m256i a, __m256i b,
+                                                __m256i c, __m256i d,
+                                                __m256i *lo, __m256i *hi)
+{
+    __m256i ab_l = _mm256_mullo_epi16(a, b), ab_h = _mm256_mulhi_epu16(a, b);
+    __m256i cd_l = _mm256_mullo_epi16(c, d), cd_h = _mm256_mulhi_epu16(c, d);
+    *lo = _mm256_add_epi32(_mm256_unpacklo_epi16(ab_l, ab_h),
+                           _mm256_unpacklo_epi16(cd_l, cd_h));
+    *hi = _mm256_add_epi32(_mm256_unpackhi_epi16(ab_l, ab_h),
+                           _mm256_unpackhi_epi16(cd_l, cd_h));
+}
+
+static ALWAYS_INLINE AVX2_FN __m256i avx2_mulshr_u32(__m256i x, uint32_t m,
+                                                     int shift)
+{
+    const __m256i vm = _mm256_set1_epi32((int)m);
+    __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(x, vm), shift);
+    __m256i odd = _mm256_srli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(x, 32), vm),
+                                    shift - 32);
+    return _mm256_blend_epi32(even, odd, 0xAA);
+}
+
+static ALWAYS_INLINE AVX2_FN __m256i avx2_div255_u32(__m256i x)
+{
+    return avx2_mulshr_u32(x, 0x80808081u, 39);
+}
+
+static ALWAYS_INLINE AVX2_FN __m256i avx2_div65025_u32(__m256i x)
+{
+    return avx2_mulshr_u32(x, 0x81018203u, 47);
+}
+
+static ALWAYS_INLINE AVX2_FN __m256i avx2_pack_u32(__m256i lo, __m256i hi)
+{
+    return _mm256_packus_epi32(lo, hi);
+}
+
+static ALWAYS_INLINE AVX2_FN bool avx2_all_zero(__m128i a8)
+{
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(a8, _mm_setzero_si128())) == 0xFFFF;
+}
+
+static ALWAYS_INLINE AVX2_FN void
+const_alpha_avx2_tmpl(void *dst, int srcp, const uint8_t *srca,
+                      uint32_t srcamul, int w, int bytes)
+{
+    const __m256i vsrcp = _mm256_set1_epi16(srcp);
+    const __m256i vmul = _mm256_set1_epi16(srcamul);
+    const __m256i vmax = _mm256_set1_epi16(65025 - 65536);
+    const __m256i round = _mm256_set1_epi32(32512);
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m128i a8 = _mm_loadu_si128((const void *)(srca + x));
+        if (avx2_all_zero(a8))
+            continue;
+        __m256i srcap = _mm256_mullo_epi16(_mm256_cvtepu8_epi16(a8), vmul);
+        void *d = (uint8_t *)dst + x * bytes;
+        __m256i lo, hi;
+        avx2_madd_u16(vsrcp, srcap, avx2_load_px(d, bytes),
+                      _mm256_sub_epi16(vmax, srcap), &lo, &hi);
+        lo = avx2_div65025_u32(_mm256_add_epi32(lo, round));
+        hi = avx2_div65025_u32(_mm256_add_epi32(hi, round));
+        avx2_store_px(d, avx2_pack_u32(lo, hi), bytes);
+    }
+    const_alpha_c(dst, srcp, srca, srcamul, x, w, bytes);
+}
+
+static ALWAYS_INLINE AVX2_FN void
+src_alpha_avx2_tmpl(void *dst, const void *src, const uint8_t *srca,
+                    int w, int bytes)
+{
+    const __m256i v255 = _mm256_set1_epi16(255);
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m128i a8 = _mm_loadu_si128((const void *)(srca + x));
+        if (avx2_all_zero(a8))
+            continue;
+        __m256i a = _mm256_cvtepu8_epi16(a8);
+        __m256i ia = _mm256_sub_epi16(v255, a);
+        void *d = (uint8_t *)dst + x * bytes;
+        __m256i vs = avx2_load_px((const uint8_t *)src + x * bytes, bytes);
+        __m256i vd = avx2_load_px(d, bytes);
+        __m256i res;
+        if (bytes == 1) {
+            __m256i n = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(vs, a),
+                                                          _mm256_mullo_epi16(vd, ia)),
+                                         _mm256_set1_epi16(127));
+            n = _mm256_add_epi16(n, _mm256_add_epi16(_mm256_srli_epi16(n, 8),
+                                                     _mm256_set1_epi16(1)));
+            res = _mm256_srli_epi16(n, 8);
+        } else {
+            const __m256i round = _mm256_set1_epi32(127);
+            __m256i lo, hi;
+            avx2_madd_u16(vs, a, vd, ia, &lo, &hi);
+            lo = avx2_div255_u32(_mm256_add_epi32(lo, round));
+            hi = avx2_div255_u32(_mm256_add_epi32(hi, round));
+            res = avx2_pack_u32(lo, hi);
+        }
+        avx2_store_px(d, res, bytes);
+    }
+    src_alpha_c(dst, src, srca, x, w, bytes);
+}
+
+static ALWAYS_INLINE AVX2_FN void
+src_dst_mul_avx2_tmpl(void *dst, const uint8_t *src, uint32_t srcmul,
+                      int w, int bytes)
+{
+    const __m256i vmul = _mm256_set1_epi16(srcmul);
+    const __m256i vmax = _mm256_set1_epi16(65025 - 65536);
+    const __m256i vdmax = bytes == 2 ? vmax : _mm256_set1_epi16(255);
+    const __m256i round = _mm256_set1_epi32(32512);
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m128i a8 = _mm_loadu_si128((const void *)(src + x));
+        if (avx2_all_zero(a8))
+            continue;
+        __m256i srcp = _mm256_mullo_epi16(_mm256_cvtepu8_epi16(a8), vmul);
+        void *d = (uint8_t *)dst + x * bytes;
+        __m256i lo, hi;
+        avx2_madd_u16(srcp, vdmax, avx2_load_px(d, bytes),
+                      _mm256_sub_epi16(vmax, srcp), &lo, &hi);
+        lo = avx2_div65025_u32(_mm256_add_epi32(lo, round));
+        hi = avx2_div65025_u32(_mm256_add_epi32(hi, round));
+        avx2_store_px(d, avx2_pack_u32(lo, hi), bytes);
+    }
+    src_dst_mul_c(dst, src, srcmul, x, w, bytes);
+}
+
+static AVX2_FN void const_alpha_row_avx2(void *dst, int srcp,
+                                         const uint8_t *srca, uint32_t srcamul,
+                                         int w, int bytes)
+{
+    if (bytes == 2) {
+        const_alpha_avx2_tmpl(dst, srcp, srca, srcamul, w, 2);
+    } else {
+        const_alpha_avx2_tmpl(dst, srcp, srca, srcamul, w, 1);
+    }
+}
+
+static AVX2_FN void src_alpha_row_avx2(void *dst, const void *src,
+                                       const uint8_t *srca, int w, int bytes)
+{
+    if (bytes == 2) {
+        src_alpha_avx2_tmpl(dst, src, srca, w, 2);
+    } else {
+        src_alpha_avx2_tmpl(dst, src, srca, w, 1);
+    }
+}
+
+static AVX2_FN void src_dst_mul_row_avx2(void *dst, const uint8_t *src,
+                                         uint32_t srcmul, int w, int bytes)
+{
+    if (bytes == 2) {
+        src_dst_mul_avx2_tmpl(dst, src, srcmul, w, 2);
+    } else {
+        src_dst_mul_avx2_tmpl(dst, src, srcmul, w, 1);
+    }
+}
+
+static const struct blend_fns blend_fns_avx2 = {
+    .const_alpha = const_alpha_row_avx2,
+    .src_alpha = src_alpha_row_avx2,
+    .src_dst_mul = src_dst_mul_row_avx2,
+};
+
+#endif /* HAVE_BLEND_X86 */
+
+#if HAVE_BLEND_NEON
+
+// 8 pixels, widened to 16 bit.
+static ALWAYS_INLINE uint16x8_t neon_load_px(const void *p, int bytes)
+{
+    if (bytes == 2)
+        return vld1q_u16(p);
+    return vmovl_u8(vld1_u8(p));
+}
+
+static ALWAYS_INLINE void neon_store_px(void *p, uint16x8_t v, int bytes)
+{
+    if (bytes == 2) {
+        vst1q_u16(p, v);
+    } else {
+        vst1_u8(p, vmovn_u16(v));
+    }
+}
+
+// a * b + c * d + r, with 32 bit results (lo: lanes 0-3, hi: lanes 4-7).
+static ALWAYS_INLINE void neon_madd_u16(uint16x8_t a, uint16x8_t b,
+                                        uint16x8_t c, uint16x8_t d, uint32_t r,
+                                        uint32x4_t *lo, uint32x4_t *hi)
+{
+    uint32x4_t vr = vdupq_n_u32(r);
+    *lo = vmlal_u16(vmlal_u16(vr, vget_low_u16(a), vget_low_u16(b)),
+                    vget_low_u16(c), vget_low_u16(d));
+    *hi = vmlal_u16(vmlal_u16(vr, vget_high_u16(a), vget_high_u16(b)),
+                    vget_high_u16(c), vget_high_u16(d));
+}
+
+// (x * m) >> 32 for each 32 bit lane.
+static ALWAYS_INLINE uint32x4_t neon_mulhi_u32(uint32x4_t x, uint32_t m)
+{
+    const uint32x2_t vm = vdup_n_u32(m);
+    uint32x2_t lo = vshrn_n_u64(vmull_u32(vget_low_u32(x), vm), 32);
+    uint32x2_t hi = vshrn_n_u64(vmull_u32(vget_high_u32(x), vm), 32);
+    return vcombine_u32(lo, hi);
+}
+
+static ALWAYS_INLINE uint32x4_t neon_div255_u32(uint32x4_t x)
+{
+    return vshrq_n_u32(neon_mulhi_u32(x, 0x80808081u), 7);
+}
+
+static ALWAYS_INLINE uint32x4_t neon_div65025_u32(uint32x4_t x)
+{
+    return vshrq_n_u32(neon_mulhi_u32(x, 0x81018203u), 15);
+}
+
+static ALWAYS_INLINE uint16x8_t neon_pack_u32(uint32x4_t lo, uint32x4_t hi)
+{
+    return vcombine_u16(vmovn_u32(lo), vmovn_u32(hi));
+}
+
+static ALWAYS_INLINE bool neon_all_zero(uint8x8_t a8)
+{
+    return !vget_lane_u64(vreinterpret_u64_u8(a8), 0);
+}
+
+static ALWAYS_INLINE void
+const_alpha_neon_tmpl(void *dst, int srcp, const uint8_t *srca,
+                      uint32_t srcamul, int w, int bytes)
+{
+    const uint16x8_t vsrcp = vdupq_n_u16(srcp);
+    const uint16x8_t vmax = vdupq_n_u16(65025);
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        uint8x8_t a8 = vld1_u8(srca + x);
+        if (neon_all_zero(a8))
+            continue;
+        uint16x8_t srcap = vmulq_n_u16(vmovl_u8(a8), srcamul);
+        void *d = (uint8_t *)dst + x * bytes;
+        uint32x4_t lo, hi;
+        neon_madd_u16(vsrcp, srcap, neon_load_px(d, bytes),
+                      vsubq_u16(vmax, srcap), 32512, &lo, &hi);
+        neon_store_px(d, neon_pack_u32(neon_div65025_u32(lo),
+                                       neon_div65025_u32(hi)), bytes);
+    }
+    const_alpha_c(dst, srcp, srca, srcamul, x, w, bytes);
+}
+
+static ALWAYS_INLINE void
+src_alpha_neon_tmpl(void *dst, const void *src, const uint8_t *srca,
+                    int w, int bytes)
+{
+    const uint16x8_t v255 = vdupq_n_u16(255);
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        uint8x8_t a8 = vld1_u8(srca + x);
+        if (neon_all_zero(a8))
+            continue;
+        uint16x8_t a = vmovl_u8(a8);
+        uint16x8_t ia = vsubq_u16(v255, a);
+        void *d = (uint8_t *)dst + x * bytes;
+        uint16x8_t vs = neon_load_px((const uint8_t *)src + x * bytes, bytes);
+        uint16x8_t vd = neon_load_px(d, bytes);
+        uint16x8_t res;
+        if (bytes == 1) {
+            uint16x8_t n = vmlaq_u16(vmulq_u16(vs, a), vd, ia);
+            n = vaddq_u16(n, vdupq_n_u16(127));
+            n = vaddq_u16(n, vaddq_u16(vshrq_n_u16(n, 8), vdupq_n_u16(1)));
+            res = vshrq_n_u16(n, 8);
+        } else {
+            uint32x4_t lo, hi;
+            neon_madd_u16(vs, a, vd, ia, 127, &lo, &hi);
+            res = neon_pack_u32(neon_div255_u32(lo), neon_div255_u32(hi));
+        }
+        neon_store_px(d, res, bytes);
+    }
+    src_alpha_c(dst, src, srca, x, w, bytes);
+}
+
+static ALWAYS_INLINE void
+src_dst_mul_neon_tmpl(void *dst, const uint8_t *src, uint32_t srcmul,
+                      int w, int bytes)
+{
+    const uint16x8_t vmax = vdupq_n_u16(65025);
+    const uint16x8_t vdmax = vdupq_n_u16(bytes == 2 ? 65025 : 255);
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        uint8x8_t a8 = vld1_u8(src + x);
+        if (neon_all_zero(a8))
+            continue;
+        uint16x8_t srcp = vmulq_n_u16(vmovl_u8(a8), srcmul);
+        void *d = (uint8_t *)dst + x * bytes;
+        uint32x4_t lo, hi;
+        neon_madd_u16(srcp, vdmax, neon_load_px(d, bytes),
+                      vsubq_u16(vmax, srcp), 32512, &lo, &hi);
+        neon_store_px(d, neon_pack_u32(neon_div65025_u32(lo),
+                                       neon_div65025_u32(hi)), bytes);
+    }
+    src_dst_mul_c(dst, src, srcmul, x, w, bytes);
+}
+
+static void const_alpha_row_neon(void *dst, int srcp, const uint8_t *srca,
+                                 uint32_t srcamul, int w, int bytes)
+{
+    if (bytes == 2) {
+        const_alpha_neon_tmpl(dst, srcp, srca, srcamul, w, 2);
+    } else {
+        const_alpha_neon_tmpl(dst, srcp, srca, srcamul, w, 1);
+    }
+}
+
+static void src_alpha_row_neon(void *dst, const void *src, const uint8_t *srca,
+                               int w, int bytes)
+{
+    if (bytes == 2) {
+        src_alpha_neon_tmpl(dst, src, srca, w, 2);
+    } else {
+        src_alpha_neon_tmpl(dst, src, srca, w, 1);
+    }
+}
+
+static void src_dst_mul_row_neon(void *dst, const uint8_t *src,
+                                 uint32_t srcmul, int w, int bytes)
+{
+    if (bytes == 2) {
+        src_dst_mul_neon_tmpl(dst, src, srcmul, w, 2);
+    } else {
+        src_dst_mul_neon_tmpl(dst, src, srcmul, w, 1);
+    }
+}
+
+static const struct blend_fns blend_fns_neon = {
+    .const_alpha = const_alpha_row_neon,
+    .src_alpha = src_alpha_row_neon,
+    .src_dst_mul = src_dst_mul_row_neon,
+};
+
+#endif /* HAVE_BLEND_NEON */
+
+static const struct blend_impl {
+    const char *name;
+    const struct blend_fns *fns;
+    int cpu_flag;
+} blend_impls[] = {
+    {"c", &blend_fns_c, 0},
+#if HAVE_BLEND_X86
+    {"sse2", &blend_fns_sse2, AV_CPU_FLAG_SSE2},
+    {"avx2", &blend_fns_avx2, AV_CPU_FLAG_AVX2},
+#endif
+#if HAVE_BLEND_NEON
+    {"neon", &blend_fns_neon, AV_CPU_FLAG_NEON},
+#endif
+};
+
+static pthread_once_t blend_init_once = PTHREAD_ONCE_INIT;
+static const struct blend_fns *blend_fns = &blend_fns_c;
+
+// Use the last (best) implementation the CPU supports.
+static void blend_init(void)
+{
+    int flags = av_get_cpu_flags();
+    for (int n = 0; n < MP_ARRAY_SIZE(blend_impls); n++) {
+        if ((flags & blend_impls[n].cpu_flag) == blend_impls[n].cpu_flag)
+            blend_fns = blend_impls[n].fns;
+    }
+}
+
+static const struct blend_fns *get_blend_fns(void)
+{
+    pthread_once(&blend_init_once, blend_init);
+    return blend_fns;
+}
+
+const char *mp_blend_select_impl(int index)
+{
+    pthread_once(&blend_init_once, blend_init);
+    if (index < 0 || index >= MP_ARRAY_SIZE(blend_impls))
+        return NULL;
+    const struct blend_impl *impl = &blend_impls[index];
+    if ((av_get_cpu_flags() & impl->cpu_flag) != impl->cpu_flag)
+        return NULL;
+    blend_fns = impl->fns;
+    return impl->name;
+}
+
+void mp_blend_const_alpha(void *dst, int dst_stride, int srcp,
+                          uint8_t *srca, int srca_stride, uint8_t srcamul,
+                          int w, int h, int bytes)
+{
+    if (!srcamul || (bytes != 1 && bytes != 2))
+        return;
+    const struct blend_fns *fns = get_blend_fns();
+    for (int y = 0; y < h; y++) {
+        fns->const_alpha((uint8_t *)dst + dst_stride * y, srcp,
+                         srca + srca_stride * y, srcamul, w, bytes);
+    }
+}
+
+void mp_blend_src_alpha(void *dst, int dst_stride, void *src,
+                        int src_stride, uint8_t *srca, int srca_stride,
+                        int w, int h, int bytes)
+{
+    if (bytes != 1 && bytes != 2)
+        return;
+    const struct blend_fns *fns = get_blend_fns();
+    for (int y = 0; y < h; y++) {
+        fns->src_alpha((uint8_t *)dst + dst_stride * y,
+                       (uint8_t *)src + src_stride * y,
+                       srca + srca_stride * y, w, bytes);
+    }
+}
+
+void mp_blend_src_dst_mul(void *dst, int dst_stride,
+                          uint8_t *src, int src_stride, uint8_t srcmul,
+                          int w, int h, int dst_bytes)
+{
+    if (dst_bytes != 1 && dst_bytes != 2)
+        return;
+    const struct blend_fns *fns = get_blend_fns();
+    for (int y = 0; y < h; y++) {
+        fns->src_dst_mul((uint8_t *)dst + dst_stride * y,
+                         src + src_stride * y, srcmul, w, dst_bytes);
+    }
+}
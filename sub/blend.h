@@ -0,0 +1,50 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_SUB_BLEND_H_
+#define MP_SUB_BLEND_H_
+
+#include <stdint.h>
+
+// Blending kernels used by draw_bmp.c. They work on a w*h rectangle of a single
+// plane. bytes is the size of a dst (and src) component, either 1 or 2. The
+// alpha planes are always 8 bit.
+// All implementations produce bit-identical results. SIMD versions are selected
+// at runtime according to av_get_cpu_flags().
+
+// dst = srcp * (srca * srcamul) + dst * (1 - (srca * srcamul))
+void mp_blend_const_alpha(void *dst, int dst_stride, int srcp,
+                          uint8_t *srca, int srca_stride, uint8_t srcamul,
+                          int w, int h, int bytes);
+
+// dst = src * srca + dst * (1 - srca)
+void mp_blend_src_alpha(void *dst, int dst_stride, void *src,
+                        int src_stride, uint8_t *srca, int srca_stride,
+                        int w, int h, int bytes);
+
+// dst = src * srcmul + dst * (1 - src * srcmul)
+void mp_blend_src_dst_mul(void *dst, int dst_stride,
+                          uint8_t *src, int src_stride, uint8_t srcmul,
+                          int w, int h, int dst_bytes);
+
+// For tests and benchmarks: make all functions above use the implementation
+// with the given index (0 is the scalar reference). Returns its name, or NULL
+// if there is no such implementation or the CPU doesn't support it. Not
+// thread-safe against concurrent blending.
+const char *mp_blend_select_impl(int index);
+
+#endif
@@ -25,6 +25,7 @@
 #include <libavutil/common.h>
 
 #include "common/common.h"
+#include "blend.h"
 #include "draw_bmp.h"
 #include "img_convert.h"
 #include "video/mp_image.h"
@@ -64,83 +65,6 @@ static bool get_sub_area(struct mp_rect bb, struct mp_image *temp,
                          struct sub_bitmap *sb, struct mp_image *out_area,
                          int *out_src_x, int *out_src_y);
 
-#define CONDITIONAL 1
-
-#define BLEND_CONST_ALPHA(TYPE)                                                 \
-    TYPE *dst_r = dst_rp;                                                       \
-    for (int x = 0; x < w; x++) {                                               \
-        uint32_t srcap = srca_r[x];                                             \
-        if (CONDITIONAL && !srcap) continue;                                    \
-        srcap *= srcamul; /* now 0..65025 */                                    \
-        dst_r[x] = (srcp * srcap + dst_r[x] * (65025 - srcap) + 32512) / 65025; \
-    }
-
-// dst = srcp * (srca * srcamul) + dst * (1 - (srca * srcamul))
-static void blend_const_alpha(void *dst, int dst_stride, int srcp,
-                              uint8_t *srca, int srca_stride, uint8_t srcamul,
-                              int w, int h, int bytes)
-{
-    if (!srcamul)
-        return;
-    for (int y = 0; y < h; y++) {
-        void *dst_rp = (uint8_t *)dst + dst_stride * y;
-        uint8_t *srca_r = srca + srca_stride * y;
-        if (bytes == 2) {
-            BLEND_CONST_ALPHA(uint16_t)
-        } else if (bytes == 1) {
-            BLEND_CONST_ALPHA(uint8_t)
-        }
-    }
-}
-
-#define BLEND_SRC_ALPHA(TYPE)                                                   \
-    TYPE *dst_r = dst_rp, *src_r = src_rp;                                      \
-    for (int x = 0; x < w; x++) {                                               \
-        uint32_t srcap = srca_r[x];                                             \
-        if (CONDITIONAL && !srcap) continue;                                    \
-        dst_r[x] = (src_r[x] * srcap + dst_r[x] * (255 - srcap) + 127) / 255;   \
-    }
-
-// dst = src * srca + dst * (1 - srca)
-static void blend_src_alpha(void *dst, int dst_stride, void *src,
-                            int src_stride, uint8_t *srca, int srca_stride,
-                            int w, int h, int bytes)
-{
-    for (int y = 0; y < h; y++) {
-        void *dst_rp = (uint8_t *)dst + dst_stride * y;
-        void *src_rp = (uint8_t *)src + src_stride * y;
-        uint8_t *srca_r = srca + srca_stride * y;
-        if (bytes == 2) {
-            BLEND_SRC_ALPHA(uint16_t)
-        } else if (bytes == 1) {
-            BLEND_SRC_ALPHA(uint8_t)
-        }
-    }
-}
-
-#define BLEND_SRC_DST_MUL(TYPE, MAX)                                            \
-    TYPE *dst_r = dst_rp;                                                       \
-    for (int x = 0; x < w; x++) {                                               \
-        uint16_t srcp = src_r[x] * srcmul; /* now 0..65025 */                   \
-        dst_r[x] = (srcp * (MAX) + dst_r[x] * (65025 - srcp) + 32512) / 65025;  \
-    }
-
-// dst = src * srcmul + dst * (1 - src * srcmul)
-static void blend_src_dst_mul(void *dst, int dst_stride,
-                              uint8_t *src, int src_stride, uint8_t srcmul,
-                              int w, int h, int dst_bytes)
-{
-    for (int y = 0; y < h; y++) {
-        void *dst_rp = (uint8_t *)dst + dst_stride * y;
-        uint8_t *src_r = (uint8_t *)src + src_stride * y;
-        if (dst_bytes == 2) {
-            BLEND_SRC_DST_MUL(uint16_t, 65025)
-        } else if (dst_bytes == 1) {
-            BLEND_SRC_DST_MUL(uint8_t, 255)
-        }
-    }
-}
-
 static void unpremultiply_and_split_BGR32(struct mp_image *img,
                                           struct mp_image *alpha)
 {
@@ -190,11 +114,11 @@ static void scale_sb_rgba(struct sub_bitmap *sb, struct mp_image *dst_format,
         return;
     }
 
-    mp_image_swscale(sbisrc2, &sbisrc, SWS_BILINEAR);
+    mp_image_swscale(sbisrc2, &sbisrc, SWS_BILINEAR, 1);
     unpremultiply_and_split_BGR32(sbisrc2, sba);
 
     sbi->params.color = dst_format->params.color;
-    mp_image_swscale(sbi, sbisrc2, SWS_BILINEAR);
+    mp_image_swscale(sbi, sbisrc2, SWS_BILINEAR, 1);
 
     talloc_free(sbisrc2);
 
@@ -233,12 +157,13 @@ static void draw_rgba(struct mp_draw_sub_cache *cache, struct mp_rect bb,
         uint8_t *alpha_p = sba->planes[0] + src_y * sba->stride[0] + src_x;
         for (int p = 0; p < (temp->num_planes > 2 ? 3 : 1); p++) {
             void *src = sbi->planes[p] + src_y * sbi->stride[p] + src_x * bytes;
-            blend_src_alpha(dst.planes[p], dst.stride[p], src, sbi->stride[p],
-                            alpha_p, sba->stride[0], dst.w, dst.h, bytes);
+            mp_blend_src_alpha(dst.planes[p], dst.stride[p], src,
+                               sbi->stride[p], alpha_p, sba->stride[0],
+                               dst.w, dst.h, bytes);
         }
         if (temp->num_planes >= 4) {
-            blend_src_dst_mul(dst.planes[3], dst.stride[3], alpha_p,
-                              sba->stride[0], 255, dst.w, dst.h, bytes);
+            mp_blend_src_dst_mul(dst.planes[3], dst.stride[3], alpha_p,
+                                 sba->stride[0], 255, dst.w, dst.h, bytes);
         }
 
         part->imgs[i].i = talloc_steal(part, sbi);
@@ -287,12 +212,12 @@ static void draw_ass(struct mp_draw_sub_cache *cache, struct mp_rect bb,
         int bytes = (bits + 7) / 8;
         uint8_t *alpha_p = (uint8_t *)sb->bitmap + src_y * sb->stride + src_x;
         for (int p = 0; p < (temp->num_planes > 2 ? 3 : 1); p++) {
-            blend_const_alpha(dst.planes[p], dst.stride[p], color_yuv[p],
-                              alpha_p, sb->stride, a, dst.w, dst.h, bytes);
+            mp_blend_const_alpha(dst.planes[p], dst.stride[p], color_yuv[p],
+                                 alpha_p, sb->stride, a, dst.w, dst.h, bytes);
         }
         if (temp->num_planes >= 4) {
-            blend_src_dst_mul(dst.planes[3], dst.stride[3], alpha_p,
-                              sb->stride, a, dst.w, dst.h, bytes);
+            mp_blend_src_dst_mul(dst.planes[3], dst.stride[3], alpha_p,
+                                 sb->stride, a, dst.w, dst.h, bytes);
         }
     }
 }
@@ -452,12 +377,12 @@ static struct mp_image *chroma_up(struct mp_draw_sub_cache *cache, int imgfmt,
             t_dst.stride[0] = temp->stride[1 + c];
             t_src.planes[0] = src->planes[1 + c];
             t_src.stride[0] = src->stride[1 + c];
-            mp_image_swscale(&t_dst, &t_src, SWS_POINT);
+            mp_image_swscale(&t_dst, &t_src, SWS_POINT, 1);
         }
         temp->planes[0] = src->planes[0];
         temp->stride[0] = src->stride[0];
     } else {
-        mp_image_swscale(temp, src, SWS_POINT);
+        mp_image_swscale(temp, src, SWS_POINT, 1);
     }
 
     return temp;
@@ -482,10 +407,10 @@ static void chroma_down(struct mp_image *old_src, struct mp_image *temp)
                 t_dst.stride[0] = old_src->stride[1 + c];
                 t_src.planes[0] = temp->planes[1 + c];
                 t_src.stride[0] = temp->stride[1 + c];
-                mp_image_swscale(&t_dst, &t_src, SWS_AREA);
+                mp_image_swscale(&t_dst, &t_src, SWS_AREA, 1);
             }
         } else {
-            mp_image_swscale(old_src, temp, SWS_AREA); // chroma down
+            mp_image_swscale(old_src, temp, SWS_AREA, 1); // chroma down
         }
     }
 }
@@ -20,6 +20,7 @@
 
 #define TA_NO_WRAPPERS
 #include "ta.h"
+#include "osdep/atomic.h"
 
 // Note: the actual minimum alignment is dictated by malloc(). It doesn't
 //       make sense to set this value higher than malloc's alignment.
@@ -69,6 +70,9 @@ struct ta_ext_header {
 // ta_ext_header.children.size is set to this
 #define CHILDREN_SENTINEL ((size_t)-1)
 
+static atomic_bool enable_alloc_count; // set once, read by every allocation
+static mp_atomic_int64 alloc_count;
+
 static void ta_dbg_add(struct ta_header *h);
 static void ta_dbg_check_header(struct ta_header *h);
 static void ta_dbg_remove(struct ta_header *h);
@@ -149,6 +153,8 @@ void *ta_alloc_size(void *ta_parent, size_t size)
     struct ta_header *h = malloc(sizeof(union aligned_header) + size);
     if (!h)
         return NULL;
+    if (atomic_load_explicit(&enable_alloc_count, memory_order_relaxed))
+        atomic_fetch_add(&alloc_count, 1);
     *h = (struct ta_header) {.size = size};
     ta_dbg_add(h);
     void *ptr = PTR_FROM_HEADER(h);
@@ -169,6 +175,8 @@ void *ta_zalloc_size(void *ta_parent, size_t size)
     struct ta_header *h = calloc(1, sizeof(union aligned_header) + size);
     if (!h)
         return NULL;
+    if (atomic_load_explicit(&enable_alloc_count, memory_order_relaxed))
+        atomic_fetch_add(&alloc_count, 1);
     *h = (struct ta_header) {.size = size};
     ta_dbg_add(h);
     void *ptr = PTR_FROM_HEADER(h);
@@ -307,6 +315,22 @@ void *ta_find_parent(void *ptr)
     return NULL;
 }
 
+/* Start counting allocations made with ta_alloc_size() and ta_zalloc_size()
+ * (and everything built on them). This is not enabled by default, because
+ * the shared counter adds contention between threads.
+ */
+void ta_enable_alloc_count(void)
+{
+    atomic_store(&enable_alloc_count, true);
+}
+
+/* Return the number of allocations made since ta_enable_alloc_count().
+ */
+uint64_t ta_get_alloc_count(void)
+{
+    return atomic_load(&alloc_count);
+}
+
 #ifdef TA_MEMORY_DEBUGGING
 
 #include <pthread.h>
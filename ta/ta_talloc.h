@@ -40,6 +40,8 @@
 #define talloc_set_destructor           ta_xset_destructor
 #define talloc_parent                   ta_find_parent
 #define talloc_enable_leak_report       ta_enable_leak_report
+#define talloc_enable_alloc_count       ta_enable_alloc_count
+#define talloc_get_alloc_count          ta_get_alloc_count
 #define talloc_size                     ta_xalloc_size
 #define talloc_zero_size                ta_xzalloc_size
 #define talloc_get_size                 ta_get_size
@@ -0,0 +1,84 @@
+// Random cached seeks over a fully cached file.
+//
+// Usage: bench_demux_seek [url [num_seeks]]
+//
+// The whole file is read into the demuxer packet cache first. Then num_seeks
+// (default 10000) seeks to random timestamps are done, each followed by
+// reading one packet. All seeks must be served by the cache, which is checked
+// with the number of low level seeks.
+
+#include <stdlib.h>
+
+#include "mpv_talloc.h"
+#include "common/common.h"
+#include "demux/demux.h"
+#include "stream/stream.h"
+#include "test_utils.h"
+
+#define DEFAULT_URL "av://lavfi:testsrc2=size=64x48:rate=25:duration=600"
+
+int main(int argc, char **argv)
+{
+    const char *url = argc > 1 ? argv[1] : DEFAULT_URL;
+    int num_seeks = argc > 2 ? atoi(argv[2]) : 10000;
+
+    mpv_handle *h = test_create_player((const char *[]){
+        "demuxer-seekable-cache", "yes",
+        "demuxer-max-bytes", "2000MiB",
+        "demuxer-max-back-bytes", "2000MiB",
+        NULL});
+    struct mpv_global *global = test_get_global(h);
+
+    struct mp_cancel *cancel = mp_cancel_new(NULL);
+    struct demuxer_params params = {0};
+    struct demuxer *d = demux_open_url(url, &params, cancel, global);
+    TEST_CHECK(d);
+    for (int n = 0; n < demux_get_num_stream(d); n++)
+        demuxer_select_track(d, demux_get_stream(d, n), MP_NOPTS_VALUE, true);
+
+    double t0 = test_time();
+    int64_t packets = 0;
+    struct demux_packet *pkt;
+    while ((pkt = demux_read_any_packet(d))) {
+        talloc_free(pkt);
+        packets++;
+    }
+    double t_read = test_time() - t0;
+
+    // (The reader state is only available with the demuxer thread.)
+    demux_start_thread(d);
+    struct sh_stream *sh = demux_get_stream(d, 0);
+
+    struct demux_ctrl_reader_state st;
+    TEST_CHECK(demux_control(d, DEMUXER_CTRL_GET_READER_STATE, &st) > 0);
+    TEST_CHECK(st.num_seek_ranges > 0);
+    double start = st.seek_ranges[0].start, end = st.seek_ranges[0].end;
+    int low_level_seeks = st.low_level_seeks;
+
+    printf("%s: %"PRId64" packets, %"PRId64" bytes cached, range %f-%f\n",
+           url, packets, st.total_bytes, start, end);
+    test_report("read", t_read, "s");
+
+    srand(1);
+    t0 = test_time();
+    for (int n = 0; n < num_seeks; n++) {
+        double pts = start + (end - start) * (rand() / (double)RAND_MAX);
+        TEST_CHECK(demux_seek(d, pts, SEEK_CACHED));
+        pkt = demux_read_packet(sh);
+        TEST_CHECK(pkt);
+        talloc_free(pkt);
+    }
+    double t_seek = test_time() - t0;
+
+    TEST_CHECK(demux_control(d, DEMUXER_CTRL_GET_READER_STATE, &st) > 0);
+    TEST_CHECK(st.low_level_seeks == low_level_seeks);
+
+    test_report("seek+read", t_seek, "s");
+    test_report("per seek", t_seek / num_seeks * 1e6, "us");
+
+    demux_stop_thread(d);
+    free_demuxer_and_stream(d);
+    talloc_free(cancel);
+    mpv_terminate_destroy(h);
+    return 0;
+}
@@ -0,0 +1,126 @@
+// Download time of hardware surfaces with mp_image_hw_download(), against
+// libavutil's own av_hwframe_transfer_data().
+//
+// Usage: bench_hw_download [min_seconds]
+//
+// Runs for each surface type in hw_types whose device can be created on this
+// system (others are skipped), at 1080p and 4K, with an NV12 surface.
+// mp_image_hw_download() maps the surface for the types listed in
+// hw_download_map_types (video/mp_image_pool.c). For other types it uses the
+// libavutil transfer too, so both rows should be about equal. The reported
+// time is the average per frame, over as many frames as fit into min_seconds
+// (default 0.2).
+
+#include <stdlib.h>
+
+#include <libavutil/frame.h>
+#include <libavutil/hwcontext.h>
+
+#include "mpv_talloc.h"
+#include "common/common.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+#include "video/mp_image_pool.h"
+#include "test_utils.h"
+
+static const struct { const char *name; int w, h; } sizes[] = {
+    {"1080p", 1920, 1080},
+    {"4K", 3840, 2160},
+};
+
+static const struct {
+    const char *name;
+    enum AVHWDeviceType type;
+    int imgfmt;
+} hw_types[] = {
+    {"vaapi", AV_HWDEVICE_TYPE_VAAPI, IMGFMT_VAAPI},
+    {"videotoolbox", AV_HWDEVICE_TYPE_VIDEOTOOLBOX, IMGFMT_VIDEOTOOLBOX},
+};
+
+static double min_time;
+
+static void download_transfer(struct mp_image *hw, struct mp_image_pool *pool)
+{
+    AVFrame *srcav = mp_image_to_av_frame(hw);
+    AVFrame *dstav = av_frame_alloc();
+    TEST_CHECK(srcav && dstav);
+    TEST_CHECK(av_hwframe_transfer_data(dstav, srcav, 0) >= 0);
+    av_frame_free(&srcav);
+    av_frame_free(&dstav);
+}
+
+static void download_mp(struct mp_image *hw, struct mp_image_pool *pool)
+{
+    struct mp_image *sw = mp_image_hw_download(hw, pool);
+    TEST_CHECK(sw);
+    talloc_free(sw);
+}
+
+static void run(const char *name, struct mp_image *hw,
+                struct mp_image_pool *pool,
+                void (*fn)(struct mp_image *hw, struct mp_image_pool *pool))
+{
+    fn(hw, pool); // warm up
+    int frames = 0;
+    double t0 = test_time(), t;
+    do {
+        fn(hw, pool);
+        frames++;
+        t = test_time() - t0;
+    } while (t < min_time);
+    test_report(name, t / frames * 1e3, "ms");
+}
+
+int main(int argc, char **argv)
+{
+    min_time = argc > 1 ? atof(argv[1]) : 0.2;
+
+    for (int n = 0; n < MP_ARRAY_SIZE(hw_types); n++) {
+        AVBufferRef *device = NULL;
+        if (av_hwdevice_ctx_create(&device, hw_types[n].type,
+                                   NULL, NULL, 0) < 0)
+        {
+            printf("%s: no device, skipped\n", hw_types[n].name);
+            continue;
+        }
+
+        for (int s = 0; s < MP_ARRAY_SIZE(sizes); s++) {
+            int w = sizes[s].w, h = sizes[s].h;
+            struct mp_image *sw = mp_image_alloc(IMGFMT_NV12, w, h);
+            TEST_CHECK(sw);
+            for (int p = 0; p < sw->num_planes; p++) {
+                for (int y = 0; y < mp_image_plane_h(sw, p); y++) {
+                    uint8_t *line = sw->planes[p] + sw->stride[p] * y;
+                    for (int x = 0; x < sw->stride[p]; x++)
+                        line[x] = rand();
+                }
+            }
+
+            AVBufferRef *frames = NULL;
+            struct mp_image *hw = NULL;
+            if (mp_update_av_hw_frames_pool(&frames, device, hw_types[n].imgfmt,
+                                            IMGFMT_NV12, w, h))
+                hw = mp_av_pool_image_hw_upload(frames, sw);
+            if (!hw) {
+                printf("%s %s: can't upload, skipped\n", hw_types[n].name,
+                       sizes[s].name);
+            } else {
+                struct mp_image_pool *pool = mp_image_pool_new(NULL);
+                char name[80];
+                snprintf(name, sizeof(name), "%s %s av_hwframe_transfer_data",
+                         hw_types[n].name, sizes[s].name);
+                run(name, hw, pool, download_transfer);
+                snprintf(name, sizeof(name), "%s %s mp_image_hw_download",
+                         hw_types[n].name, sizes[s].name);
+                run(name, hw, pool, download_mp);
+                talloc_free(pool);
+            }
+
+            talloc_free(hw);
+            av_buffer_unref(&frames);
+            talloc_free(sw);
+        }
+        av_buffer_unref(&device);
+    }
+    return 0;
+}
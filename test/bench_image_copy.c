@@ -0,0 +1,111 @@
+// Image copy throughput of mp_image_copy() (sliced over multiple threads for
+// large images) against a single-threaded memcpy_pic() of every plane.
+//
+// Usage: bench_image_copy [min_seconds]
+//
+// "stream" is mp_image_copy_flags() with MP_IMAGE_COPY_STREAM (non-temporal
+// stores where available). "uncached_src" uses MP_IMAGE_COPY_UNCACHED_SRC
+// (streaming loads). src is normal memory here, so this only shows their
+// overhead; see bench_hw_download for mapped GPU surfaces. "new_copy" is
+// mp_image_new_copy(), which includes allocating and freeing the destination,
+// so it also pays for faulting in fresh pages. The reported time is the
+// average per frame, over as many frames as fit into min_seconds (default 0.2).
+
+#include <stdlib.h>
+
+#include "mpv_talloc.h"
+#include "common/common.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+#include "test_utils.h"
+
+static const struct { const char *name; int w, h; } sizes[] = {
+    {"1080p", 1920, 1080},
+    {"4K", 3840, 2160},
+};
+
+static const struct { const char *name; int fmt; } formats[] = {
+    {"yuv420p", IMGFMT_420P},
+    {"bgr0", IMGFMT_BGR0},
+    {"p010", IMGFMT_P010},
+};
+
+enum { COPY_MEMCPY_PIC, COPY_IMAGE, COPY_STREAM, COPY_UNCACHED, COPY_NEW,
+       COPY_COUNT };
+
+static const char *const copy_names[] = {
+    [COPY_MEMCPY_PIC] = "memcpy_pic",
+    [COPY_IMAGE] = "mp_image_copy",
+    [COPY_STREAM] = "stream",
+    [COPY_UNCACHED] = "uncached_src",
+    [COPY_NEW] = "new_copy",
+};
+
+static void run_copy(struct mp_image *dst, struct mp_image *src, int type)
+{
+    switch (type) {
+    case COPY_MEMCPY_PIC:
+        for (int p = 0; p < dst->num_planes; p++) {
+            memcpy_pic(dst->planes[p], src->planes[p],
+                       (mp_image_plane_w(dst, p) * dst->fmt.bpp[p] + 7) / 8,
+                       mp_image_plane_h(dst, p), dst->stride[p], src->stride[p]);
+        }
+        break;
+    case COPY_IMAGE:
+        mp_image_copy(dst, src);
+        break;
+    case COPY_STREAM:
+        mp_image_copy_flags(dst, src, MP_IMAGE_COPY_STREAM);
+        break;
+    case COPY_UNCACHED:
+        mp_image_copy_flags(dst, src, MP_IMAGE_COPY_UNCACHED_SRC);
+        break;
+    case COPY_NEW: {
+        struct mp_image *new = mp_image_new_copy(src);
+        TEST_CHECK(new);
+        talloc_free(new);
+        break;
+    }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    double min_time = argc > 1 ? atof(argv[1]) : 0.2;
+
+    for (int s = 0; s < MP_ARRAY_SIZE(sizes); s++) {
+        for (int f = 0; f < MP_ARRAY_SIZE(formats); f++) {
+            int w = sizes[s].w, h = sizes[s].h;
+            struct mp_image *src = mp_image_alloc(formats[f].fmt, w, h);
+            struct mp_image *dst = mp_image_alloc(formats[f].fmt, w, h);
+            TEST_CHECK(src && dst);
+            for (int p = 0; p < src->num_planes; p++) {
+                for (int y = 0; y < mp_image_plane_h(src, p); y++) {
+                    uint8_t *line = src->planes[p] + src->stride[p] * y;
+                    for (int x = 0; x < src->stride[p]; x++)
+                        line[x] = rand();
+                }
+            }
+
+            for (int type = 0; type < COPY_COUNT; type++) {
+                run_copy(dst, src, type); // warm up
+                int frames = 0;
+                double t0 = test_time(), t;
+                do {
+                    run_copy(dst, src, type);
+                    frames++;
+                    t = test_time() - t0;
+                } while (t < min_time);
+
+                char name[80];
+                snprintf(name, sizeof(name), "%s %s %s", sizes[s].name,
+                         formats[f].name, copy_names[type]);
+                test_report(name, t / frames * 1e3, "ms");
+            }
+
+            talloc_free(src);
+            talloc_free(dst);
+        }
+    }
+    return 0;
+}
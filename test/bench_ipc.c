@@ -0,0 +1,146 @@
+// Load test for the IPC server: concurrent JSON clients against a player
+// with null outputs, reporting request latency percentiles.
+//
+// Usage: bench_ipc [clients [requests_per_client]]
+//
+// Every client connects to the --input-ipc-server socket, and sends
+// requests one at a time, each waiting for its reply. This is repeated for
+// increasing numbers of clients up to the given maximum (default 256).
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "mpv_talloc.h"
+#include "common/common.h"
+#include "test_utils.h"
+
+struct client {
+    pthread_t thread;
+    const char *path;
+    int num_requests;
+    double *latencies;
+};
+
+static int connect_socket(const char *path)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    TEST_CHECK(fd >= 0);
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    // The IPC thread might not be listening yet.
+    for (int n = 0; connect(fd, (struct sockaddr *)&addr, sizeof(addr)); n++) {
+        TEST_CHECK(n < 500);
+        usleep(10000);
+    }
+    return fd;
+}
+
+static void *client_thread(void *p)
+{
+    struct client *c = p;
+    int fd = connect_socket(c->path);
+    char buf[4096];
+    size_t buf_len = 0;
+
+    for (int n = 0; n < c->num_requests; n++) {
+        char req[128], id[40];
+        int len = snprintf(req, sizeof(req), "{\"command\": [\"get_property\", "
+                           "\"volume\"], \"request_id\": %d}\n", n);
+        snprintf(id, sizeof(id), "\"request_id\":%d", n);
+
+        double t0 = test_time();
+        TEST_CHECK(write(fd, req, len) == len);
+        // Skip events and other lines until the reply arrives.
+        bool found = false;
+        while (!found) {
+            char *nl;
+            while (!found && (nl = memchr(buf, '\n', buf_len))) {
+                *nl = '\0';
+                found = strstr(buf, id);
+                size_t line = nl + 1 - buf;
+                memmove(buf, nl + 1, buf_len - line);
+                buf_len -= line;
+            }
+            if (found)
+                break;
+            TEST_CHECK(buf_len < sizeof(buf));
+            ssize_t r = read(fd, buf + buf_len, sizeof(buf) - buf_len);
+            TEST_CHECK(r > 0);
+            buf_len += r;
+        }
+        c->latencies[n] = test_time() - t0;
+    }
+
+    close(fd);
+    return NULL;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double da = *(const double *)a, db = *(const double *)b;
+    return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+static void run(const char *path, int num_clients, int num_requests)
+{
+    void *tmp = talloc_new(NULL);
+    struct client *clients = talloc_zero_array(tmp, struct client, num_clients);
+    int total = num_clients * num_requests;
+    double *all = talloc_array(tmp, double, total);
+
+    double t0 = test_time();
+    for (int n = 0; n < num_clients; n++) {
+        clients[n] = (struct client){
+            .path = path,
+            .num_requests = num_requests,
+            .latencies = all + n * num_requests,
+        };
+        TEST_CHECK(!pthread_create(&clients[n].thread, NULL, client_thread,
+                                   &clients[n]));
+    }
+    for (int n = 0; n < num_clients; n++)
+        pthread_join(clients[n].thread, NULL);
+    double t = test_time() - t0;
+
+    qsort(all, total, sizeof(all[0]), compare_double);
+    static const double percentiles[] = {50, 90, 99, 99.9};
+    char name[80];
+    for (int n = 0; n < MP_ARRAY_SIZE(percentiles); n++) {
+        snprintf(name, sizeof(name), "clients=%d p%g", num_clients,
+                 percentiles[n]);
+        int i = MPMIN(total * percentiles[n] / 100, total - 1);
+        test_report(name, all[i] * 1e6, "us");
+    }
+    snprintf(name, sizeof(name), "clients=%d max", num_clients);
+    test_report(name, all[total - 1] * 1e6, "us");
+    snprintf(name, sizeof(name), "clients=%d throughput", num_clients);
+    test_report(name, total / t, "requests/s");
+
+    talloc_free(tmp);
+}
+
+int main(int argc, char **argv)
+{
+    int max_clients = argc > 1 ? atoi(argv[1]) : 256;
+    int num_requests = argc > 2 ? atoi(argv[2]) : 1000;
+
+    char path[] = "/tmp/bench_ipc.XXXXXX";
+    int fd = mkstemp(path);
+    TEST_CHECK(fd >= 0);
+    close(fd);
+
+    mpv_handle *h = test_create_player((const char *[]){
+        "input-ipc-server", path,
+        NULL});
+
+    for (int n = 1; n <= max_clients; n *= 4)
+        run(path, n, num_requests);
+
+    mpv_terminate_destroy(h);
+    unlink(path);
+    return 0;
+}
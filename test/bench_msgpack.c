@@ -0,0 +1,151 @@
+// Encode and decode speed of the IPC MessagePack protocol compared to JSON.
+//
+// Usage: bench_msgpack [iterations]
+//
+// The message is a reply like that of get_property track-list for a file
+// with many tracks: an array of maps with strings, integers, doubles and
+// flags. Both formats encode the same mpv_node, and the decoded result is
+// checked against the original.
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mpv_talloc.h"
+#include "common/common.h"
+#include "misc/json.h"
+#include "misc/msgpack.h"
+#include "misc/node.h"
+#include "test_utils.h"
+
+static void create_message(void *ta_parent, struct mpv_node *dst)
+{
+    node_init(dst, MPV_FORMAT_NODE_MAP, NULL);
+    talloc_steal(ta_parent, dst->u.list);
+    struct mpv_node *list = node_map_add(dst, "data", MPV_FORMAT_NODE_ARRAY);
+    for (int n = 0; n < 200; n++) {
+        struct mpv_node *t = node_array_add(list, MPV_FORMAT_NODE_MAP);
+        node_map_add_int64(t, "id", n + 1);
+        node_map_add_string(t, "type", n % 3 ? "audio" : "sub");
+        node_map_add_string(t, "title", "Commentary track with a long title");
+        node_map_add_string(t, "lang", "eng");
+        node_map_add_flag(t, "default", n == 0);
+        node_map_add_flag(t, "selected", false);
+        node_map_add_string(t, "codec", "aac");
+        node_map_add_double(t, "demux-samplerate", 48000);
+        node_map_add_double(t, "demux-fps", 24000 / 1001.0);
+        node_map_add_int64(t, "ff-index", n);
+    }
+    node_map_add_int64(dst, "request_id", 12345);
+    node_map_add_string(dst, "error", "success");
+}
+
+static double get_number(struct mpv_node *node)
+{
+    return node->format == MPV_FORMAT_INT64 ? node->u.int64 : node->u.double_;
+}
+
+static bool is_number(struct mpv_node *node)
+{
+    return node->format == MPV_FORMAT_INT64 ||
+           node->format == MPV_FORMAT_DOUBLE;
+}
+
+// If json is set, numbers are compared as doubles with some tolerance, as the
+// JSON parser returns all numbers as doubles, and the writer rounds them.
+static bool equal_nodes(struct mpv_node *a, struct mpv_node *b, bool json)
+{
+    if (json && is_number(a) && is_number(b))
+        return fabs(get_number(a) - get_number(b)) < 1e-5;
+    if (a->format != b->format)
+        return false;
+    switch (a->format) {
+    case MPV_FORMAT_STRING:
+        return strcmp(a->u.string, b->u.string) == 0;
+    case MPV_FORMAT_FLAG:
+        return a->u.flag == b->u.flag;
+    case MPV_FORMAT_INT64:
+        return a->u.int64 == b->u.int64;
+    case MPV_FORMAT_DOUBLE:
+        return a->u.double_ == b->u.double_;
+    case MPV_FORMAT_NODE_ARRAY:
+    case MPV_FORMAT_NODE_MAP:
+        if (a->u.list->num != b->u.list->num)
+            return false;
+        for (int n = 0; n < a->u.list->num; n++) {
+            if (a->format == MPV_FORMAT_NODE_MAP &&
+                strcmp(a->u.list->keys[n], b->u.list->keys[n]) != 0)
+                return false;
+            if (!equal_nodes(&a->u.list->values[n], &b->u.list->values[n],
+                             json))
+                return false;
+        }
+        return true;
+    }
+    return true;
+}
+
+static void report(const char *name, double t, int iterations, size_t size)
+{
+    char buf[80];
+    snprintf(buf, sizeof(buf), "%s (%zu bytes)", name, size);
+    test_report(buf, t / iterations * 1e6, "us/message");
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+    void *tmp = talloc_new(NULL);
+
+    struct mpv_node msg;
+    create_message(tmp, &msg);
+
+    // JSON
+    char *json = NULL;
+    double t0 = test_time();
+    for (int n = 0; n < iterations; n++) {
+        talloc_free(json);
+        json = talloc_strdup(NULL, "");
+        TEST_CHECK(json_write(&json, &msg) >= 0);
+    }
+    report("json encode", test_time() - t0, iterations, strlen(json));
+
+    t0 = test_time();
+    for (int n = 0; n < iterations; n++) {
+        void *ctx = talloc_new(NULL);
+        char *src = talloc_strdup(ctx, json); // json_parse modifies the input
+        struct mpv_node res;
+        TEST_CHECK(json_parse(ctx, &res, &src, 50) >= 0);
+        if (n == 0)
+            TEST_CHECK(equal_nodes(&msg, &res, true));
+        talloc_free(ctx);
+    }
+    report("json decode", test_time() - t0, iterations, strlen(json));
+
+    // MessagePack
+    bstr mp = {0};
+    t0 = test_time();
+    for (int n = 0; n < iterations; n++) {
+        talloc_free(mp.start);
+        mp = (bstr){0};
+        TEST_CHECK(msgpack_write(&mp, &msg) >= 0);
+    }
+    report("msgpack encode", test_time() - t0, iterations, mp.len);
+
+    t0 = test_time();
+    for (int n = 0; n < iterations; n++) {
+        void *ctx = talloc_new(NULL);
+        bstr src = mp;
+        struct mpv_node res;
+        TEST_CHECK(msgpack_parse(ctx, &res, &src, 50) >= 0 && !src.len);
+        if (n == 0)
+            TEST_CHECK(equal_nodes(&msg, &res, false));
+        talloc_free(ctx);
+    }
+    report("msgpack decode", test_time() - t0, iterations, mp.len);
+
+    talloc_free(json);
+    talloc_free(mp.start);
+    talloc_free(tmp);
+    return 0;
+}
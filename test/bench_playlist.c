@@ -0,0 +1,129 @@
+// Playlist operations on a large list.
+//
+// Usage: bench_playlist [num_entries]
+//
+// The list (default 1M entries) is built and modified directly with the
+// playlist API, and then loaded and shuffled through the player with the
+// loadlist and playlist-shuffle commands, from a generated playlist file, and
+// played with loadfile.
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "mpv_talloc.h"
+#include "common/common.h"
+#include "common/playlist.h"
+#include "test_utils.h"
+
+static void bench_api(int num)
+{
+    struct playlist *pl = talloc_zero(NULL, struct playlist);
+    struct playlist *tmp = talloc_zero(NULL, struct playlist);
+    char name[40];
+
+    double t0 = test_time();
+    for (int n = 0; n < num; n++) {
+        snprintf(name, sizeof(name), "file%d.mkv", n);
+        playlist_add_file(tmp, name);
+    }
+    test_report("add", test_time() - t0, "s");
+
+    t0 = test_time();
+    playlist_append_entries(pl, tmp);
+    test_report("append to list", test_time() - t0, "s");
+    TEST_CHECK(playlist_entry_count(pl) == num);
+    pl->current = playlist_entry_from_index(pl, num / 2);
+
+    srand(1);
+    t0 = test_time();
+    for (int n = 0; n < num; n++) {
+        int index = rand() % num;
+        struct playlist_entry *e = playlist_entry_from_index(pl, index);
+        TEST_CHECK(playlist_entry_to_index(pl, e) == index);
+    }
+    test_report("index lookups", test_time() - t0, "s");
+
+    t0 = test_time();
+    for (int n = 0; n < 1000; n++) {
+        struct playlist_entry *e = playlist_entry_from_index(pl, rand() % num);
+        playlist_move(pl, e, playlist_entry_from_index(pl, rand() % num));
+    }
+    test_report("1000 moves", test_time() - t0, "s");
+
+    t0 = test_time();
+    playlist_shuffle(pl);
+    test_report("shuffle", test_time() - t0, "s");
+    TEST_CHECK(playlist_entry_count(pl) == num);
+
+    t0 = test_time();
+    playlist_clear_except(pl, pl->current);
+    test_report("clear", test_time() - t0, "s");
+    TEST_CHECK(playlist_entry_count(pl) == 1);
+
+    playlist_clear(pl);
+    talloc_free(tmp);
+    talloc_free(pl);
+}
+
+static void bench_player(int num)
+{
+    char path[] = "/tmp/bench_playlist.XXXXXX";
+    int fd = mkstemp(path);
+    TEST_CHECK(fd >= 0);
+    FILE *f = fdopen(fd, "w");
+    TEST_CHECK(f);
+    fprintf(f, "#EXTM3U\n");
+    for (int n = 0; n < num; n++)
+        fprintf(f, "/nonexistent/file%d.mkv\n", n);
+    TEST_CHECK(fclose(f) == 0);
+
+    mpv_handle *h = test_create_player(NULL);
+
+    double t0 = test_time();
+    // (Appending to the empty list in idle mode does not start playback.)
+    TEST_CHECK(mpv_command(h, (const char *[]){"loadlist", path, "append",
+                                               NULL}) >= 0);
+    int64_t count = 0;
+    TEST_CHECK(mpv_get_property(h, "playlist-count", MPV_FORMAT_INT64,
+                                &count) >= 0);
+    test_report("loadlist", test_time() - t0, "s");
+    TEST_CHECK(count == num);
+
+    t0 = test_time();
+    TEST_CHECK(mpv_command(h, (const char *[]){"playlist-shuffle", NULL}) >= 0);
+    test_report("playlist-shuffle", test_time() - t0, "s");
+
+    t0 = test_time();
+    TEST_CHECK(mpv_command(h, (const char *[]){"playlist-clear", NULL}) >= 0);
+    test_report("playlist-clear", test_time() - t0, "s");
+
+    // Playback starts after the first entries; the rest is added as it's read.
+    t0 = test_time();
+    TEST_CHECK(mpv_command(h, (const char *[]){"loadfile", path, NULL}) >= 0);
+    bool first = false;
+    for (;;) {
+        TEST_CHECK(mpv_get_property(h, "playlist-count", MPV_FORMAT_INT64,
+                                    &count) >= 0);
+        if (count > 1 && !first) {
+            test_report("loadfile (first entries)", test_time() - t0, "s");
+            first = true;
+        }
+        if (count == num)
+            break;
+        mpv_wait_event(h, 0.01);
+    }
+    test_report("loadfile (all entries)", test_time() - t0, "s");
+
+    mpv_terminate_destroy(h);
+    unlink(path);
+}
+
+int main(int argc, char **argv)
+{
+    int num = argc > 1 ? atoi(argv[1]) : 1000000;
+    TEST_CHECK(num > 1);
+
+    bench_api(num);
+    bench_player(num);
+    return 0;
+}
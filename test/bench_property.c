@@ -0,0 +1,87 @@
+// Property lookup cost, with the sorted property index and with the linear
+// list search it replaced.
+//
+// Usage: bench_property [iterations]
+//
+// First, all names from "property-list" are looked up in a list built from
+// the same names, with m_property_list_find() and m_property_index_find().
+// Then a few properties are read with mpv_get_property() in a tight loop,
+// which includes the client API and property implementation overhead.
+
+#include <stdlib.h>
+
+#include "mpv_talloc.h"
+#include "common/common.h"
+#include "options/m_property.h"
+#include "test_utils.h"
+
+static int dummy_call(void *ctx, struct m_property *prop, int action,
+                      void *arg)
+{
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+
+    mpv_handle *h = test_create_player(NULL);
+
+    mpv_node names;
+    TEST_CHECK(mpv_get_property(h, "property-list", MPV_FORMAT_NODE,
+                                &names) >= 0);
+    TEST_CHECK(names.format == MPV_FORMAT_NODE_ARRAY);
+    int num = names.u.list->num;
+
+    struct m_property *list = talloc_zero_array(NULL, struct m_property,
+                                                num + 1);
+    for (int n = 0; n < num; n++) {
+        TEST_CHECK(names.u.list->values[n].format == MPV_FORMAT_STRING);
+        list[n] = (struct m_property){names.u.list->values[n].u.string,
+                                      dummy_call};
+    }
+    struct m_property_index *index = m_property_index_create(list, list);
+
+    int lookups = MPMAX(iterations / num, 1) * num;
+    printf("%d properties, %d lookups per method\n", num, lookups);
+
+    double t0 = test_time();
+    for (int i = 0; i < lookups / num; i++) {
+        for (int n = 0; n < num; n++)
+            TEST_CHECK(m_property_list_find(list, list[n].name) == &list[n]);
+    }
+    double t = test_time() - t0;
+    test_report("m_property_list_find", t / lookups * 1e9, "ns/lookup");
+
+    t0 = test_time();
+    for (int i = 0; i < lookups / num; i++) {
+        for (int n = 0; n < num; n++) {
+            struct m_property *p =
+                m_property_index_find(index, bstr0(list[n].name));
+            TEST_CHECK(p && strcmp(p->name, list[n].name) == 0);
+        }
+    }
+    t = test_time() - t0;
+    test_report("m_property_index_find", t / lookups * 1e9, "ns/lookup");
+
+    static const char *const props[] = {
+        "pause", "volume", "time-pos", "options/vo", "track-list/count",
+    };
+    for (int p = 0; p < MP_ARRAY_SIZE(props); p++) {
+        t0 = test_time();
+        for (int i = 0; i < iterations; i++) {
+            char *s = NULL;
+            mpv_get_property(h, props[p], MPV_FORMAT_STRING, &s);
+            mpv_free(s);
+        }
+        t = test_time() - t0;
+        char name[80];
+        snprintf(name, sizeof(name), "mpv_get_property(%s)", props[p]);
+        test_report(name, t / iterations * 1e9, "ns/call");
+    }
+
+    talloc_free(list);
+    mpv_free_node_contents(&names);
+    mpv_terminate_destroy(h);
+    return 0;
+}
@@ -0,0 +1,78 @@
+// Time of one scaletempo overlap search (one per output stride), per channel
+// count, sample format and search implementation.
+//
+// Usage: bench_scaletempo [min_seconds]
+//
+// 48 kHz with the default stride and overlap. Float is run with the default
+// search window (14ms, direct search), and with search=30, where the filter
+// switches to the FFT path. The reported time is the average per search, over
+// as many searches as fit into min_seconds (default 0.2).
+
+#include "scaletempo_utils.h"
+
+static const int channel_counts[] = {1, 2, 4, 6, 8};
+
+static double min_time;
+
+static void run(struct priv *s, const char *impl, int (*fn)(struct priv *s))
+{
+    fn(s); // warm up
+    int runs = 0;
+    double t0 = test_time(), t;
+    do {
+        fn(s);
+        runs++;
+        t = test_time() - t0;
+    } while (t < min_time);
+
+    char name[80];
+    snprintf(name, sizeof(name), "%s %dch search=%d %s",
+             s->bytes_per_frame / s->num_channels == 2 ? "s16" : "float",
+             s->num_channels, s->frames_search * 1000 / 48000, impl);
+    test_report(name, t / runs * 1e6, "us");
+}
+
+static void bench(struct mp_filter *root, int format, int nch, float ms_search)
+{
+    struct priv *s = st_create(root, format, nch, ms_search);
+    st_fill(s, -1);
+
+    if (format == AF_FORMAT_FLOAT) {
+        run(s, "c", best_overlap_offset_float);
+        for (const struct dot_kernel *k = dot_kernels; k->name; k++) {
+            if (!dot_kernel_supported(k))
+                continue;
+            s->dot_float = k->dot_float;
+            run(s, k->name, best_overlap_offset_float_dot);
+        }
+        if (s->fft_bits)
+            run(s, "fft", best_overlap_offset_float_fft);
+    } else {
+        run(s, "c", best_overlap_offset_s16);
+        for (const struct dot_kernel *k = dot_kernels; k->name; k++) {
+            if (!dot_kernel_supported(k))
+                continue;
+            s->dot_s16 = k->dot_s16;
+            run(s, k->name, best_overlap_offset_s16_dot);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    min_time = argc > 1 ? atof(argv[1]) : 0.2;
+
+    mpv_handle *h = test_create_player(NULL);
+    struct mp_filter *root = mp_filter_create_root(test_get_global(h));
+
+    for (int n = 0; n < MP_ARRAY_SIZE(channel_counts); n++) {
+        int nch = channel_counts[n];
+        bench(root, AF_FORMAT_FLOAT, nch, 14);
+        bench(root, AF_FORMAT_FLOAT, nch, 30);
+        bench(root, AF_FORMAT_S16, nch, 14);
+    }
+
+    talloc_free(root);
+    mpv_terminate_destroy(h);
+    return 0;
+}
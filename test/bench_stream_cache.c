@@ -0,0 +1,99 @@
+// Sequential read throughput of the stream cache, with and without prefetch
+// requests (--cache-prefetch-requests).
+//
+// Usage: bench_stream_cache [file [MiB]]
+//
+// Without a file argument, a temporary file of the given size (default 512)
+// is created. The file is evicted from the page cache before each run (if the
+// OS supports it), so the numbers reflect the storage, not memory bandwidth.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mpv_talloc.h"
+#include "common/common.h"
+#include "stream/stream.h"
+#include "test_utils.h"
+
+static void evict(const char *path)
+{
+#ifdef POSIX_FADV_DONTNEED
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+#endif
+}
+
+static char *create_file(int mib)
+{
+    char *path = talloc_strdup(NULL, "/tmp/bench_stream_cache.XXXXXX");
+    int fd = mkstemp(path);
+    TEST_CHECK(fd >= 0);
+    char *buf = malloc(1 << 20);
+    TEST_CHECK(buf);
+    for (int n = 0; n < (1 << 20); n++)
+        buf[n] = rand();
+    for (int n = 0; n < mib; n++)
+        TEST_CHECK(write(fd, buf, 1 << 20) == (1 << 20));
+    free(buf);
+    close(fd);
+    return path;
+}
+
+static double run(mpv_handle *h, const char *path, int requests)
+{
+    char val[20];
+    snprintf(val, sizeof(val), "%d", requests);
+    TEST_CHECK(mpv_set_property_string(h, "options/cache-prefetch-requests",
+                                       val) >= 0);
+    evict(path);
+
+    struct mpv_global *global = test_get_global(h);
+    struct mp_cancel *cancel = mp_cancel_new(NULL);
+    struct stream *s = stream_create(path, STREAM_READ, cancel, global);
+    TEST_CHECK(s);
+    TEST_CHECK(stream_enable_cache_defaults(&s) > 0);
+
+    double t0 = test_time();
+    int64_t bytes = 0;
+    char buf[64 * 1024];
+    int r;
+    while ((r = stream_read(s, buf, sizeof(buf))) > 0)
+        bytes += r;
+    double t = test_time() - t0;
+
+    free_stream(s);
+    talloc_free(cancel);
+    return bytes / t / (1 << 20);
+}
+
+int main(int argc, char **argv)
+{
+    int mib = argc > 2 ? atoi(argv[2]) : 512;
+    char *tmp = NULL;
+    const char *path = argc > 1 ? argv[1] : (tmp = create_file(mib));
+
+    mpv_handle *h = test_create_player((const char *[]){
+        "cache", "yes",
+        NULL});
+
+    static const int requests[] = {0, 1, 2, 4, 8, 16};
+    for (int n = 0; n < MP_ARRAY_SIZE(requests); n++) {
+        char name[80];
+        snprintf(name, sizeof(name), "cache-prefetch-requests=%d",
+                 requests[n]);
+        test_report(name, run(h, path, requests[n]), "MiB/s");
+    }
+
+    mpv_terminate_destroy(h);
+    if (tmp)
+        unlink(tmp);
+    talloc_free(tmp);
+    return 0;
+}
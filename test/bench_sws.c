@@ -0,0 +1,99 @@
+// Software conversion throughput of mp_sws_scale() per slice thread count,
+// resolution and format pair.
+//
+// Usage: bench_sws [min_seconds]
+//
+// Conversions keep the frame size (slice threading doesn't apply to vertical
+// scaling). The reported time is the average per frame, over as many frames as
+// fit into min_seconds (default 0.5). threads=0 is "auto" (number of CPUs).
+// The mp_image_swscale() rows create a new context for every frame.
+
+#include <stdlib.h>
+
+#include <libswscale/swscale.h>
+
+#include "mpv_talloc.h"
+#include "common/common.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+#include "video/sws_utils.h"
+#include "test_utils.h"
+
+static const struct { const char *name; int w, h; } sizes[] = {
+    {"1080p", 1920, 1080},
+    {"4K", 3840, 2160},
+};
+
+static const struct { const char *name; int src, dst; } convs[] = {
+    {"yuv420p->bgr0", IMGFMT_420P, IMGFMT_BGR0},
+    {"nv12->yuv420p", IMGFMT_NV12, IMGFMT_420P},
+    {"yuv420p->yuv444p", IMGFMT_420P, IMGFMT_444P},
+};
+
+static const int thread_counts[] = {1, 2, 4, 8, 0};
+
+int main(int argc, char **argv)
+{
+    double min_time = argc > 1 ? atof(argv[1]) : 0.5;
+
+    for (int s = 0; s < MP_ARRAY_SIZE(sizes); s++) {
+        for (int c = 0; c < MP_ARRAY_SIZE(convs); c++) {
+            int w = sizes[s].w, h = sizes[s].h;
+            struct mp_image *src = mp_image_alloc(convs[c].src, w, h);
+            struct mp_image *dst = mp_image_alloc(convs[c].dst, w, h);
+            TEST_CHECK(src && dst);
+            for (int p = 0; p < src->num_planes; p++) {
+                for (int y = 0; y < mp_image_plane_h(src, p); y++) {
+                    uint8_t *line = src->planes[p] + src->stride[p] * y;
+                    for (int x = 0; x < src->stride[p]; x++)
+                        line[x] = rand();
+                }
+            }
+
+            for (int t = 0; t < MP_ARRAY_SIZE(thread_counts); t++) {
+                struct mp_sws_context *ctx = mp_sws_alloc(NULL);
+                ctx->flags = SWS_BILINEAR;
+                ctx->threads = thread_counts[t];
+                TEST_CHECK(mp_sws_scale(ctx, dst, src) >= 0); // init + warm up
+
+                int frames = 0;
+                double t0 = test_time(), time;
+                do {
+                    TEST_CHECK(mp_sws_scale(ctx, dst, src) >= 0);
+                    frames++;
+                    time = test_time() - t0;
+                } while (time < min_time);
+
+                char name[80];
+                snprintf(name, sizeof(name), "%s %s threads=%d (%d slices)",
+                         sizes[s].name, convs[c].name, thread_counts[t],
+                         MPMAX(ctx->num_slices, 1));
+                test_report(name, time / frames * 1e3, "ms");
+                talloc_free(ctx);
+            }
+
+            // One-shot conversion (as for screenshots), including the setup of
+            // the libswscale contexts.
+            for (int t = 0; t < 2; t++) {
+                int threads = t ? 0 : 1;
+                int frames = 0;
+                double t0 = test_time(), time;
+                do {
+                    TEST_CHECK(mp_image_swscale(dst, src, SWS_BILINEAR,
+                                                threads) >= 0);
+                    frames++;
+                    time = test_time() - t0;
+                } while (time < min_time);
+
+                char name[80];
+                snprintf(name, sizeof(name), "%s %s mp_image_swscale threads=%d",
+                         sizes[s].name, convs[c].name, threads);
+                test_report(name, time / frames * 1e3, "ms");
+            }
+
+            talloc_free(src);
+            talloc_free(dst);
+        }
+    }
+    return 0;
+}
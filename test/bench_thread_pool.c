@@ -0,0 +1,82 @@
+// Job throughput of the thread pool under contention.
+//
+// Usage: bench_thread_pool [jobs_per_producer]
+//
+// A number of producer threads queue tiny jobs into one pool at the same
+// time, for several combinations of producer and worker counts. The reported
+// rate includes waiting until all jobs have run.
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "mpv_talloc.h"
+#include "common/common.h"
+#include "misc/thread_pool.h"
+#include "osdep/atomic.h"
+#include "test_utils.h"
+
+struct producer {
+    pthread_t thread;
+    struct mp_thread_pool *pool;
+    int num_jobs;
+    atomic_int *count;
+};
+
+static void job_fn(void *p)
+{
+    atomic_int *count = p;
+    atomic_fetch_add(count, 1);
+}
+
+static void *producer_thread(void *p)
+{
+    struct producer *pr = p;
+    for (int n = 0; n < pr->num_jobs; n++)
+        mp_thread_pool_queue(pr->pool, job_fn, pr->count);
+    return NULL;
+}
+
+static double run(int producers, int workers, int jobs_per_producer)
+{
+    atomic_int count;
+    atomic_store(&count, 0);
+    struct mp_thread_pool *pool = mp_thread_pool_create(NULL, workers);
+    TEST_CHECK(pool);
+    struct producer *pr = talloc_zero_array(NULL, struct producer, producers);
+
+    double t0 = test_time();
+    for (int n = 0; n < producers; n++) {
+        pr[n] = (struct producer){
+            .pool = pool,
+            .num_jobs = jobs_per_producer,
+            .count = &count,
+        };
+        TEST_CHECK(!pthread_create(&pr[n].thread, NULL, producer_thread,
+                                   &pr[n]));
+    }
+    for (int n = 0; n < producers; n++)
+        pthread_join(pr[n].thread, NULL);
+    talloc_free(pool); // waits for all jobs
+    double t = test_time() - t0;
+
+    TEST_CHECK(atomic_load(&count) == producers * jobs_per_producer);
+    talloc_free(pr);
+    return producers * (double)jobs_per_producer / t / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    int jobs = argc > 1 ? atoi(argv[1]) : 200000;
+
+    static const int producers[] = {1, 2, 4, 8};
+    static const int workers[] = {1, 2, 4, 8, 16};
+    for (int p = 0; p < MP_ARRAY_SIZE(producers); p++) {
+        for (int w = 0; w < MP_ARRAY_SIZE(workers); w++) {
+            char name[80];
+            snprintf(name, sizeof(name), "producers=%d workers=%d",
+                     producers[p], workers[w]);
+            test_report(name, run(producers[p], workers[w], jobs), "Mjobs/s");
+        }
+    }
+    return 0;
+}
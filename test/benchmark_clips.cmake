@@ -0,0 +1,52 @@
+# Generate the benchmark clips, and run the player's --benchmark mode on each.
+#
+#   cmake -DPLAYER=<player binary> -DOUT_DIR=<dir> -P benchmark_clips.cmake
+#
+# The clips are encoded from lavfi sources by the player itself, using only
+# FFmpeg's builtin encoders, so they can be generated on any CPU-only machine
+# and no media files need to be stored. Existing clips are reused. The JSON
+# summary of each run is written to OUT_DIR/<clip>.json, and printed.
+
+if(NOT PLAYER OR NOT OUT_DIR)
+    message(FATAL_ERROR "PLAYER and OUT_DIR must be set")
+endif()
+file(MAKE_DIRECTORY ${OUT_DIR})
+
+set(common_opts --no-config --really-quiet)
+
+# run_clip(name source [encoding options...])
+function(run_clip name source)
+    set(clip ${OUT_DIR}/${name}.mkv)
+    if(NOT EXISTS ${clip})
+        execute_process(
+            COMMAND ${PLAYER} ${common_opts} av://lavfi:${source}
+                    --o=${clip}.tmp --of=matroska ${ARGN}
+            RESULT_VARIABLE r)
+        if(NOT r EQUAL 0)
+            message(FATAL_ERROR "${name}: generating the clip failed (${r})")
+        endif()
+        file(RENAME ${clip}.tmp ${clip})
+    endif()
+
+    set(json ${OUT_DIR}/${name}.json)
+    file(REMOVE ${json})
+    execute_process(
+        COMMAND ${PLAYER} ${common_opts} --benchmark=${json} ${clip}
+        RESULT_VARIABLE r)
+    if(NOT r EQUAL 0 OR NOT EXISTS ${json})
+        message(FATAL_ERROR "${name}: benchmark run failed (${r})")
+    endif()
+    file(READ ${json} results)
+    message("${name}: ${results}")
+endfunction()
+
+run_clip(mpeg4-720p "testsrc2=size=1280x720:rate=30:duration=20"
+         --ovc=mpeg4 --ovcopts=qscale=4)
+run_clip(mjpeg-1080p "testsrc2=size=1920x1080:rate=25:duration=10"
+         --ovc=mjpeg --ovcopts=qscale=4)
+run_clip(ffv1-480p "testsrc2=size=640x480:rate=30:duration=20"
+         --ovc=ffv1)
+run_clip(flac-stereo "sine=frequency=1000:sample_rate=48000:duration=120"
+         --oac=flac)
+run_clip(aac-stereo "sine=frequency=1000:sample_rate=48000:duration=120"
+         --oac=aac)
@@ -0,0 +1,114 @@
+#ifndef MP_TEST_SCALETEMPO_UTILS_H_
+#define MP_TEST_SCALETEMPO_UTILS_H_
+
+// Shared by test_scaletempo.c and bench_scaletempo.c. The overlap search
+// functions are internal to the filter, so the filter source is compiled into
+// the program (with the filter entry renamed, so it doesn't clash with the one
+// in the player library).
+
+#define af_scaletempo af_scaletempo_test
+#include "audio/filter/af_scaletempo.c"
+#undef af_scaletempo
+
+#include "test_utils.h"
+
+struct dot_kernel {
+    const char *name;
+    int cpu_flag;
+    float (*dot_float)(const float *a, const float *b, int n);
+    int64_t (*dot_s16)(const int16_t *hi, const int16_t *lo,
+                       const int16_t *b, int n);
+};
+
+// Terminated by an entry with name==NULL.
+static const struct dot_kernel dot_kernels[] = {
+#if HAVE_DOT_X86
+    {"sse2", AV_CPU_FLAG_SSE2, dot_float_sse2, dot_s16_sse2},
+    {"avx2", AV_CPU_FLAG_AVX2, dot_float_avx2, dot_s16_avx2},
+#endif
+#if HAVE_DOT_NEON
+    {"neon", AV_CPU_FLAG_NEON, dot_float_neon, dot_s16_neon},
+#endif
+    {0}
+};
+
+static bool dot_kernel_supported(const struct dot_kernel *k)
+{
+    return (av_get_cpu_flags() & k->cpu_flag) == k->cpu_flag;
+}
+
+static uint32_t st_rnd_state = 1;
+
+static uint32_t st_rnd(void)
+{
+    st_rnd_state = st_rnd_state * 1103515245 + 12345;
+    return st_rnd_state >> 8;
+}
+
+// Uniform in [-1, 1].
+static float st_rnd_float(void)
+{
+    return (st_rnd() & 0xFFFF) / 32767.5f - 1.0f;
+}
+
+// Create the filter, and set it up for the given format with the default
+// options and the given search window. Returns the filter's private state.
+static struct priv *st_create(struct mp_filter *root, int format, int nch,
+                              float ms_search)
+{
+    struct f_opts *opts = talloc_memdup(NULL,
+        (void *)af_scaletempo_test.desc.priv_defaults, sizeof(struct f_opts));
+    opts->ms_search = ms_search;
+    struct mp_filter *f = af_scaletempo_create(root, opts);
+    TEST_CHECK(f);
+    struct priv *s = f->priv;
+
+    struct mp_chmap chmap;
+    mp_chmap_from_channels(&chmap, nch);
+    s->in = mp_aframe_create();
+    TEST_CHECK(mp_aframe_set_format(s->in, format));
+    TEST_CHECK(mp_aframe_set_chmap(s->in, &chmap));
+    TEST_CHECK(mp_aframe_set_rate(s->in, 48000));
+    TEST_CHECK(reinit(f));
+    TEST_CHECK(s->frames_search > 0);
+    return s;
+}
+
+// Fill the overlap buffer and the search window with noise. If plant_off is
+// >= 0, put the overlap buffer (plus a bit of noise) into the search window at
+// that offset, so that it is the only good match.
+static void st_fill(struct priv *s, int plant_off)
+{
+    int nch = s->num_channels;
+    int queue_samples = s->bytes_queue / (s->bytes_per_frame / nch);
+    bool is_float = s->bytes_per_frame / nch == 4;
+    float noise = plant_off >= 0 ? 0.1 : 1.0;
+
+    for (int i = 0; i < s->samples_overlap; i++) {
+        float v = st_rnd_float();
+        if (is_float) {
+            ((float *)s->buf_overlap)[i] = v;
+        } else {
+            ((int16_t *)s->buf_overlap)[i] = v * 32767;
+        }
+    }
+    for (int i = 0; i < queue_samples; i++) {
+        float v = st_rnd_float() * noise;
+        int rel = i - plant_off * nch;
+        if (plant_off >= 0 && rel >= 0 && rel < s->samples_overlap) {
+            if (is_float) {
+                v += ((float *)s->buf_overlap)[rel];
+            } else {
+                v += ((int16_t *)s->buf_overlap)[rel] / 32768.0;
+            }
+            v = MPCLAMP(v, -1.0, 1.0);
+        }
+        if (is_float) {
+            ((float *)s->buf_queue)[i] = v;
+        } else {
+            ((int16_t *)s->buf_queue)[i] = v * 32767;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,119 @@
+// Compare every SIMD blending kernel against the scalar reference.
+//
+// All alpha values, all multipliers, 8 and 16 bit, with unaligned rows whose
+// widths are not a multiple of any vector size. Results must be bit-identical.
+// Implementations the CPU doesn't support are skipped.
+
+#include <string.h>
+
+#include "common/common.h"
+#include "sub/blend.h"
+#include "test_utils.h"
+
+#define W 300 // > 256, so every alpha value occurs in a row
+#define H 3
+#define STRIDE (2 * W + 64) // bytes
+#define OFFSET 2 // bytes; unaligned start for both depths
+
+struct planes {
+    uint8_t dst[H * STRIDE + OFFSET];
+    uint8_t src[H * STRIDE + OFFSET];
+    uint8_t srca[H * STRIDE];
+};
+
+static uint32_t rnd_state = 1;
+
+static uint32_t rnd(void)
+{
+    rnd_state = rnd_state * 1103515245 + 12345;
+    return rnd_state >> 8;
+}
+
+// Random components. Every row has all alpha values, in a different order.
+static void fill(struct planes *p)
+{
+    for (int n = 0; n < sizeof(p->dst); n++) {
+        p->dst[n] = rnd();
+        p->src[n] = rnd();
+    }
+    for (int y = 0; y < H; y++) {
+        uint8_t *a = p->srca + y * STRIDE;
+        for (int x = 0; x < W; x++)
+            a[x] = (x * 97 + y * 31) & 255;
+    }
+    // The first row gets runs of 0 and 255 alpha instead, to hit the skipping
+    // of all-zero vectors and the full coverage case.
+    memset(p->srca + 40, 0, 64);
+    memset(p->srca + 120, 255, 64);
+}
+
+enum op { CONST_ALPHA, SRC_ALPHA, SRC_DST_MUL };
+
+static const char *const op_names[] = {"const_alpha", "src_alpha", "src_dst_mul"};
+
+static void run_op(struct planes *p, enum op op, int mul, int bytes)
+{
+    uint8_t *dst = p->dst + OFFSET;
+    uint8_t *src = p->src + OFFSET;
+    int srcp = (p->src[0] << 8 | p->src[1]) & (bytes == 1 ? 0xFF : 0xFFFF);
+    switch (op) {
+    case CONST_ALPHA:
+        mp_blend_const_alpha(dst, STRIDE, srcp, p->srca, STRIDE, mul,
+                             W, H, bytes);
+        break;
+    case SRC_ALPHA:
+        mp_blend_src_alpha(dst, STRIDE, src, STRIDE, p->srca, STRIDE,
+                           W, H, bytes);
+        break;
+    case SRC_DST_MUL:
+        mp_blend_src_dst_mul(dst, STRIDE, src, STRIDE, mul, W, H, bytes);
+        break;
+    }
+}
+
+static int check(int impl, const char *name)
+{
+    static struct planes ref, test;
+    int errors = 0;
+
+    for (int bytes = 1; bytes <= 2; bytes++) {
+        for (enum op op = 0; op < MP_ARRAY_SIZE(op_names); op++) {
+            // src_alpha has no multiplier.
+            int num_mul = op == SRC_ALPHA ? 1 : 256;
+            for (int mul = 0; mul < num_mul; mul++) {
+                fill(&ref);
+                test = ref;
+
+                TEST_CHECK(mp_blend_select_impl(0));
+                run_op(&ref, op, mul, bytes);
+                TEST_CHECK(mp_blend_select_impl(impl));
+                run_op(&test, op, mul, bytes);
+
+                if (memcmp(ref.dst, test.dst, sizeof(ref.dst)) != 0) {
+                    int pos = 0;
+                    while (ref.dst[pos] == test.dst[pos])
+                        pos++;
+                    printf("%s: %s %d bit, mul=%d: mismatch at byte %d\n",
+                           name, op_names[op], bytes * 8, mul, pos);
+                    errors++;
+                }
+            }
+        }
+    }
+    return errors;
+}
+
+int main(void)
+{
+    int errors = 0, tested = 0;
+    for (int impl = 1; impl < 16; impl++) {
+        const char *name = mp_blend_select_impl(impl);
+        if (!name)
+            continue;
+        printf("checking %s\n", name);
+        errors += check(impl, name);
+        tested++;
+    }
+    printf("%d implementations checked, %d mismatches\n", tested, errors);
+    return errors ? 1 : 0;
+}
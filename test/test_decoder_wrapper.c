@@ -0,0 +1,211 @@
+// Frame ordering and seek flushing of the decoder wrapper, with and without
+// decoder threads (--vd-queue-enable/--ad-queue-enable).
+//
+// The sources are fully read into the demuxer cache first, so all seeks are
+// cached seeks (lavfi sources can't seek on their own). Every frame must
+// follow the previous one without gaps or reordering. After a seek and a
+// reset, the first frame must be at the seek target, so no frame decoded
+// before the reset (e.g. still in the decoder queue) may come out.
+
+#include <pthread.h>
+#include <math.h>
+
+#include "mpv_talloc.h"
+#include "audio/aframe.h"
+#include "common/common.h"
+#include "demux/demux.h"
+#include "filters/f_async_queue.h"
+#include "filters/f_decoder_wrapper.h"
+#include "filters/filter.h"
+#include "osdep/timer.h"
+#include "stream/stream.h"
+#include "test_utils.h"
+#include "video/mp_image.h"
+
+#define DURATION 10
+#define FPS 25
+#define NUM_SEEKS 50
+
+#define VIDEO_URL "av://lavfi:testsrc2=size=64x48:rate=25:duration=10"
+#define AUDIO_URL "av://lavfi:sine=sample_rate=48000:duration=10"
+
+struct ctx {
+    struct mpv_global *global;
+    struct mp_cancel *cancel;
+    struct demuxer *demuxer;
+    struct sh_stream *sh;
+    struct mp_filter *root;
+    struct mp_decoder_wrapper *dec;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool woken;
+
+    double last_end; // end time of the last frame, or MP_NOPTS_VALUE
+};
+
+static void wakeup(void *ptr)
+{
+    struct ctx *c = ptr;
+    pthread_mutex_lock(&c->lock);
+    c->woken = true;
+    pthread_cond_signal(&c->wakeup);
+    pthread_mutex_unlock(&c->lock);
+}
+
+static double frame_end(struct mp_frame frame)
+{
+    if (frame.type == MP_FRAME_AUDIO)
+        return mp_aframe_end_pts(frame.data);
+    return mp_frame_get_pts(frame) + 1.0 / FPS;
+}
+
+// Return the next frame (or EOF), running the filter graph as needed.
+static struct mp_frame read_frame(struct ctx *c)
+{
+    double deadline = test_time() + 10;
+    while (1) {
+        struct mp_frame frame = mp_pin_out_read(c->dec->f->pins[0]);
+        if (frame.type != MP_FRAME_NONE) {
+            TEST_CHECK(frame.type == MP_FRAME_EOF ||
+                       frame.type == (c->sh->type == STREAM_VIDEO
+                                      ? MP_FRAME_VIDEO : MP_FRAME_AUDIO));
+            return frame;
+        }
+        if (mp_filter_run(c->root))
+            continue;
+        pthread_mutex_lock(&c->lock);
+        // (The timeout only guards against missed wakeups hanging the test.)
+        struct timespec ts = mp_rel_time_to_timespec(0.1);
+        if (!c->woken)
+            pthread_cond_timedwait(&c->wakeup, &c->lock, &ts);
+        c->woken = false;
+        pthread_mutex_unlock(&c->lock);
+        TEST_CHECK(test_time() < deadline);
+    }
+}
+
+// Read a frame, and check that it directly follows the previous one.
+static bool read_next(struct ctx *c)
+{
+    struct mp_frame frame = read_frame(c);
+    if (frame.type == MP_FRAME_EOF)
+        return false;
+    double pts = mp_frame_get_pts(frame);
+    TEST_CHECK(pts != MP_NOPTS_VALUE);
+    if (c->last_end != MP_NOPTS_VALUE)
+        TEST_CHECK(fabs(pts - c->last_end) < 0.001);
+    c->last_end = frame_end(frame);
+    mp_frame_unref(&frame);
+    return true;
+}
+
+static void open_source(struct ctx *c, const char *url, bool use_thread)
+{
+    c->cancel = mp_cancel_new(NULL);
+    struct demuxer_params params = {0};
+    c->demuxer = demux_open_url(url, &params, c->cancel, c->global);
+    TEST_CHECK(c->demuxer);
+    TEST_CHECK(demux_get_num_stream(c->demuxer) == 1);
+    c->sh = demux_get_stream(c->demuxer, 0);
+    demuxer_select_track(c->demuxer, c->sh, MP_NOPTS_VALUE, true);
+
+    struct demux_packet *pkt;
+    while ((pkt = demux_read_any_packet(c->demuxer)))
+        talloc_free(pkt);
+    demux_start_thread(c->demuxer);
+    TEST_CHECK(demux_seek(c->demuxer, 0, SEEK_CACHED));
+
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->wakeup, NULL);
+    c->root = mp_filter_create_root(c->global);
+    mp_filter_root_set_wakeup_cb(c->root, wakeup, c);
+    c->dec = mp_decoder_wrapper_create(c->root, c->sh);
+    TEST_CHECK(c->dec);
+    TEST_CHECK(mp_decoder_wrapper_get_queue_stats(c->dec,
+                    &(struct mp_async_queue_stats){0}) == use_thread);
+    c->last_end = MP_NOPTS_VALUE;
+}
+
+static void close_source(struct ctx *c)
+{
+    talloc_free(c->dec->f);
+    talloc_free(c->root);
+    demux_stop_thread(c->demuxer);
+    free_demuxer_and_stream(c->demuxer);
+    talloc_free(c->cancel);
+    pthread_cond_destroy(&c->wakeup);
+    pthread_mutex_destroy(&c->lock);
+}
+
+static void test_order(struct ctx *c)
+{
+    int frames = 0;
+    while (read_next(c))
+        frames++;
+    TEST_CHECK(frames > 0);
+    TEST_CHECK(fabs(c->last_end - DURATION) < 0.001);
+    if (c->sh->type == STREAM_VIDEO)
+        TEST_CHECK(frames == DURATION * FPS);
+}
+
+static void test_seek(struct ctx *c)
+{
+    srand(1);
+    for (int n = 0; n < NUM_SEEKS; n++) {
+        // Decode a bit, and give a decoder thread time to fill its queue.
+        int num = rand() % 10;
+        for (int i = 0; i < num; i++)
+            TEST_CHECK(read_next(c));
+        mp_sleep_us(5000);
+
+        double target = (DURATION - 1) * (rand() / (double)RAND_MAX);
+        TEST_CHECK(demux_seek(c->demuxer, target, SEEK_CACHED));
+        mp_filter_reset(c->root);
+
+        struct mp_frame frame = read_frame(c);
+        TEST_CHECK(frame.type != MP_FRAME_EOF);
+        double pts = mp_frame_get_pts(frame);
+        TEST_CHECK(pts <= target + 0.001 && pts > target - 0.5);
+        c->last_end = frame_end(frame);
+        mp_frame_unref(&frame);
+    }
+    // The rest must still be in order up to the end.
+    while (read_next(c)) {}
+    TEST_CHECK(fabs(c->last_end - DURATION) < 0.001);
+}
+
+static void run(mpv_handle *h, const char *url, const char *opt,
+                bool use_thread)
+{
+    TEST_CHECK(mpv_set_property_string(h, opt, use_thread ? "yes" : "no") >= 0);
+
+    struct ctx c = {.global = test_get_global(h)};
+    open_source(&c, url, use_thread);
+    test_order(&c);
+    close_source(&c);
+
+    c = (struct ctx){.global = test_get_global(h)};
+    open_source(&c, url, use_thread);
+    test_seek(&c);
+    close_source(&c);
+}
+
+int main(void)
+{
+    mpv_handle *h = test_create_player((const char *[]){
+        "demuxer-seekable-cache", "yes",
+        "demuxer-max-bytes", "2000MiB",
+        "demuxer-max-back-bytes", "2000MiB",
+        "vd-queue-max-frames", "3",
+        "ad-queue-max-frames", "16",
+        NULL});
+
+    for (int t = 0; t < 2; t++) {
+        run(h, VIDEO_URL, "options/vd-queue-enable", t);
+        run(h, AUDIO_URL, "options/ad-queue-enable", t);
+    }
+
+    mpv_terminate_destroy(h);
+    return 0;
+}
@@ -0,0 +1,181 @@
+// IPC server behavior on client EOF and on output backpressure, replies of
+// special commands, and reading from inherited fds.
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "mpv_talloc.h"
+#include "common/common.h"
+#include "misc/bstr.h"
+#include "test_utils.h"
+
+struct writer {
+    pthread_t thread;
+    int fd;
+    const char *property;
+    int num_requests;
+};
+
+static int connect_socket(const char *path)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    TEST_CHECK(fd >= 0);
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    // The IPC thread might not be listening yet.
+    for (int n = 0; connect(fd, (struct sockaddr *)&addr, sizeof(addr)); n++) {
+        TEST_CHECK(n < 500);
+        usleep(10000);
+    }
+    return fd;
+}
+
+// Send all requests, then close the write side of the socket.
+static void *writer_thread(void *p)
+{
+    struct writer *w = p;
+    for (int n = 0; n < w->num_requests; n++) {
+        char req[128];
+        int len = snprintf(req, sizeof(req), "{\"command\": [\"get_property\", "
+                           "\"%s\"], \"request_id\": %d}\n", w->property, n);
+        TEST_CHECK(write(w->fd, req, len) == len);
+    }
+    TEST_CHECK(shutdown(w->fd, SHUT_WR) == 0);
+    return NULL;
+}
+
+// Return the number of replies received until the server closes the socket.
+static int count_replies(const char *path, const char *property,
+                         int num_requests)
+{
+    struct writer w = {
+        .fd = connect_socket(path),
+        .property = property,
+        .num_requests = num_requests,
+    };
+    TEST_CHECK(!pthread_create(&w.thread, NULL, writer_thread, &w));
+
+    bstr data = {0};
+    char chunk[64 * 1024];
+    ssize_t r;
+    while ((r = read(w.fd, chunk, sizeof(chunk))) > 0)
+        bstr_xappend(NULL, &data, (bstr){chunk, r});
+    TEST_CHECK(r == 0);
+
+    pthread_join(w.thread, NULL);
+    close(w.fd);
+
+    int replies = 0;
+    bstr rest = data;
+    while (rest.len) {
+        bstr line = bstr_getline(rest, &rest);
+        if (bstr_find0(line, "\"request_id\"") >= 0)
+            replies++;
+    }
+    talloc_free(data.start);
+    return replies;
+}
+
+// Send one request line, and return the reply line (without newline).
+static char *request(const char *path, const char *req)
+{
+    int fd = connect_socket(path);
+    TEST_CHECK(write(fd, req, strlen(req)) == strlen(req));
+    bstr data = {0};
+    char chunk[4096];
+    ssize_t r;
+    while (bstr_find0(data, "\n") < 0 &&
+           (r = read(fd, chunk, sizeof(chunk))) > 0)
+        bstr_xappend(NULL, &data, (bstr){chunk, r});
+    close(fd);
+    bstr rest;
+    char *line = bstrto0(NULL, bstr_getline(data, &rest));
+    talloc_free(data.start);
+    return line;
+}
+
+static int count_substr(const char *s, const char *sub)
+{
+    int count = 0;
+    for (s = strstr(s, sub); s; s = strstr(s + 1, sub))
+        count++;
+    return count;
+}
+
+// Partial results succeed; each failed property is listed in "errors", and
+// duplicate names are read (and reported) once.
+static void test_get_properties(const char *path)
+{
+    char *reply = request(path, "{\"command\": [\"get_properties\", "
+                          "\"volume\", \"mute\", \"volume\", \"nonexistent\", "
+                          "\"nonexistent\"]}\n");
+    TEST_CHECK(count_substr(reply, "\"error\":\"success\"") == 1);
+    TEST_CHECK(count_substr(reply, "\"volume\":") == 1);
+    TEST_CHECK(count_substr(reply, "\"mute\":") == 1);
+    TEST_CHECK(count_substr(reply,
+                "\"errors\":{\"nonexistent\":\"property not found\"}") == 1);
+    talloc_free(reply);
+
+    reply = request(path, "{\"command\": [\"get_properties\", \"volume\"]}\n");
+    TEST_CHECK(count_substr(reply, "\"error\":\"success\"") == 1);
+    TEST_CHECK(count_substr(reply, "\"errors\"") == 0);
+    talloc_free(reply);
+}
+
+// Commands are read from an inherited fd (--input-file=fd://) without setting
+// O_NONBLOCK on it, since that would also affect the process it came from.
+static void test_inherited_fd(void)
+{
+    int fds[2];
+    TEST_CHECK(pipe(fds) == 0);
+    char *arg = talloc_asprintf(NULL, "fd://%d", fds[0]);
+    mpv_handle *h = test_create_player((const char *[]){
+        "input-file", arg,
+        NULL});
+
+    const char *cmd = "set volume 42\n";
+    TEST_CHECK(write(fds[1], cmd, strlen(cmd)) == strlen(cmd));
+    double volume = 0;
+    for (int n = 0; volume != 42; n++) {
+        TEST_CHECK(n < 500);
+        usleep(10000);
+        TEST_CHECK(mpv_get_property(h, "volume", MPV_FORMAT_DOUBLE, &volume) >= 0);
+    }
+    TEST_CHECK(!(fcntl(fds[0], F_GETFL) & O_NONBLOCK));
+
+    mpv_terminate_destroy(h);
+    close(fds[0]);
+    close(fds[1]);
+    talloc_free(arg);
+}
+
+int main(void)
+{
+    char path[] = "/tmp/test_ipc.XXXXXX";
+    int fd = mkstemp(path);
+    TEST_CHECK(fd >= 0);
+    close(fd);
+
+    mpv_handle *h = test_create_player((const char *[]){
+        "input-ipc-server", path,
+        NULL});
+
+    // Commands still buffered when the client closes its side must be run,
+    // and their replies written before the server closes the connection.
+    TEST_CHECK(count_replies(path, "volume", 1000) == 1000);
+
+    // Large replies exceed the output soft limit, which pauses reading
+    // commands until the output was written.
+    TEST_CHECK(count_replies(path, "property-list", 500) == 500);
+
+    test_get_properties(path);
+    test_inherited_fd();
+
+    mpv_terminate_destroy(h);
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,92 @@
+// Loading of large playlists, whose entries are added in batches while the
+// rest of the file is still being read.
+
+#include <string.h>
+#include <unistd.h>
+
+#include "common/common.h"
+#include "test_utils.h"
+
+#define NUM_ENTRIES 5000
+
+static void write_playlist(char *path, const char *header, int num)
+{
+    int fd = mkstemp(path);
+    TEST_CHECK(fd >= 0);
+    FILE *f = fdopen(fd, "w");
+    TEST_CHECK(f);
+    fprintf(f, "%s", header);
+    for (int n = 0; n < num; n++)
+        fprintf(f, "/nonexistent/file%d.mkv\n", n);
+    TEST_CHECK(fclose(f) == 0);
+}
+
+static void wait_count(mpv_handle *h, int64_t num)
+{
+    double end = test_time() + 30;
+    for (;;) {
+        int64_t count = 0;
+        TEST_CHECK(mpv_get_property(h, "playlist-count", MPV_FORMAT_INT64,
+                                    &count) >= 0);
+        TEST_CHECK(count <= num);
+        if (count == num)
+            return;
+        TEST_CHECK(test_time() < end);
+        mpv_wait_event(h, 0.1);
+    }
+}
+
+static void check_entry(mpv_handle *h, int index, const char *prefix, int n)
+{
+    char prop[40], expected[80];
+    snprintf(prop, sizeof(prop), "playlist/%d/filename", index);
+    snprintf(expected, sizeof(expected), "%s%d.mkv", prefix, n);
+    char *name = mpv_get_property_string(h, prop);
+    TEST_CHECK(name);
+    TEST_CHECK(strcmp(name, expected) == 0);
+    mpv_free(name);
+}
+
+// All entries end up in the playlist, in file order.
+static void test_order(int num)
+{
+    char path[] = "/tmp/test_playlist.XXXXXX";
+    write_playlist(path, "#EXTM3U\n", num);
+
+    mpv_handle *h = test_create_player(NULL);
+    TEST_CHECK(mpv_command(h, (const char *[]){"loadfile", path, NULL}) >= 0);
+    wait_count(h, num);
+    for (int n = 0; n < num; n += 7)
+        check_entry(h, n, "/nonexistent/file", n);
+    check_entry(h, num - 1, "/nonexistent/file", num - 1);
+
+    mpv_terminate_destroy(h);
+    unlink(path);
+}
+
+// Entries that were appended while the playlist was loading stay behind the
+// playlist's own entries.
+static void test_append(void)
+{
+    char path[] = "/tmp/test_playlist.XXXXXX";
+    write_playlist(path, "#EXTM3U\n", NUM_ENTRIES);
+
+    mpv_handle *h = test_create_player(NULL);
+    TEST_CHECK(mpv_command(h, (const char *[]){"loadfile", path, NULL}) >= 0);
+    const char *append[] = {"loadfile", "/nonexistent/x0.mkv", "append", NULL};
+    TEST_CHECK(mpv_command(h, append) >= 0);
+    wait_count(h, NUM_ENTRIES + 1);
+    check_entry(h, NUM_ENTRIES - 1, "/nonexistent/file", NUM_ENTRIES - 1);
+    check_entry(h, NUM_ENTRIES, "/nonexistent/x", 0);
+
+    mpv_terminate_destroy(h);
+    unlink(path);
+}
+
+int main(void)
+{
+    test_order(10);
+    test_order(NUM_ENTRIES);
+    test_append();
+    return 0;
+}
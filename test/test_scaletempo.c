@@ -0,0 +1,157 @@
+// Check the scaletempo overlap search paths against the original scalar
+// functions (best_overlap_offset_float/_s16).
+//
+// - dot_s16 kernels must equal the int64 sum of the split values exactly.
+// - dot_float kernels may only differ by float rounding.
+// - With a planted match, all paths (scalar, every kernel, FFT) must find it.
+// - With pure noise, s16 paths must find the same offset as the scalar code.
+//   Float paths must find it too, or an offset whose correlation is equal
+//   within rounding (near-ties can go either way with a different sum order).
+
+#include <math.h>
+
+#include "scaletempo_utils.h"
+
+static const int channel_counts[] = {1, 2, 3, 6, 8};
+
+#define TRIALS 20
+
+static void test_dot_kernels(void)
+{
+    enum { MAX_N = 5000 };
+    static int16_t hi[MAX_N], lo[MAX_N], b[MAX_N];
+    static float fa[MAX_N], fb[MAX_N];
+
+    for (const struct dot_kernel *k = dot_kernels; k->name; k++) {
+        if (!dot_kernel_supported(k))
+            continue;
+        for (int t = 0; t < 200; t++) {
+            int n = t < 100 ? t : st_rnd() % MAX_N;
+            // hi/lo cover the range of the split 17 bit pre-correlation values.
+            for (int i = 0; i < n; i++) {
+                hi[i] = (int)(st_rnd() % 512) - 256;
+                lo[i] = st_rnd() % 256;
+                b[i] = st_rnd();
+                fa[i] = st_rnd_float();
+                fb[i] = st_rnd_float();
+            }
+            int64_t ref = 0;
+            double fref = 0, fnorm = 0;
+            for (int i = 0; i < n; i++) {
+                ref += (int64_t)(256 * hi[i] + lo[i]) * b[i];
+                fref += (double)fa[i] * fb[i];
+                fnorm += fabs((double)fa[i] * fb[i]);
+            }
+            TEST_CHECK(k->dot_s16(hi, lo, b, n) == ref);
+            TEST_CHECK(fabs(k->dot_float(fa, fb, n) - fref) <= 1e-5 * fnorm + 1e-6);
+        }
+
+        // Extreme values, to check the accumulator flushing.
+        for (int i = 0; i < MAX_N; i++) {
+            hi[i] = -256;
+            lo[i] = 255;
+            b[i] = INT16_MIN;
+        }
+        TEST_CHECK(k->dot_s16(hi, lo, b, MAX_N) ==
+                   (int64_t)MAX_N * (256 * -256 + 255) * INT16_MIN);
+    }
+}
+
+// Correlation at the given offset (in frames), in double precision. Also
+// returns the sum of the absolute products in *norm.
+static double float_corr(struct priv *s, int off, double *norm)
+{
+    int n = s->samples_overlap - s->num_channels;
+    float *pw = s->table_window;
+    float *po = (float *)s->buf_overlap + s->num_channels;
+    float *ps = (float *)s->buf_queue + s->num_channels * (1 + off);
+    double corr = 0;
+    *norm = 0;
+    for (int i = 0; i < n; i++) {
+        double v = (double)pw[i] * po[i] * ps[i];
+        corr += v;
+        *norm += fabs(v);
+    }
+    return corr;
+}
+
+static void check_float(struct priv *s, int ref, int res, int planted)
+{
+    int bpf = s->bytes_per_frame;
+    if (planted >= 0) {
+        TEST_CHECK(res == planted * bpf);
+        return;
+    }
+    if (res != ref) {
+        double norm;
+        double c_ref = float_corr(s, ref / bpf, &norm);
+        double c_res = float_corr(s, res / bpf, &norm);
+        TEST_CHECK(fabs(c_ref - c_res) <= 1e-5 * norm);
+    }
+}
+
+static void test_float(struct mp_filter *root, int nch, float ms_search,
+                       bool want_fft)
+{
+    struct priv *s = st_create(root, AF_FORMAT_FLOAT, nch, ms_search);
+    TEST_CHECK(!!s->fft_bits == want_fft);
+
+    for (int t = 0; t < TRIALS; t++) {
+        int planted = t % 2 ? (int)(st_rnd() % s->frames_search) : -1;
+        st_fill(s, planted);
+
+        int ref = best_overlap_offset_float(s);
+        if (planted >= 0)
+            TEST_CHECK(ref == planted * s->bytes_per_frame);
+
+        for (const struct dot_kernel *k = dot_kernels; k->name; k++) {
+            if (!dot_kernel_supported(k))
+                continue;
+            s->dot_float = k->dot_float;
+            check_float(s, ref, best_overlap_offset_float_dot(s), planted);
+        }
+        if (s->fft_bits)
+            check_float(s, ref, best_overlap_offset_float_fft(s), planted);
+    }
+}
+
+static void test_s16(struct mp_filter *root, int nch)
+{
+    struct priv *s = st_create(root, AF_FORMAT_S16, nch, 14);
+
+    for (int t = 0; t < TRIALS; t++) {
+        int planted = t % 2 ? (int)(st_rnd() % s->frames_search) : -1;
+        st_fill(s, planted);
+
+        int ref = best_overlap_offset_s16(s);
+        if (planted >= 0)
+            TEST_CHECK(ref == planted * s->bytes_per_frame);
+
+        for (const struct dot_kernel *k = dot_kernels; k->name; k++) {
+            if (!dot_kernel_supported(k))
+                continue;
+            s->dot_s16 = k->dot_s16;
+            TEST_CHECK(s->buf_pre_corr_split);
+            TEST_CHECK(best_overlap_offset_s16_dot(s) == ref);
+        }
+    }
+}
+
+int main(void)
+{
+    mpv_handle *h = test_create_player(NULL);
+    struct mp_filter *root = mp_filter_create_root(test_get_global(h));
+
+    test_dot_kernels();
+
+    for (int n = 0; n < MP_ARRAY_SIZE(channel_counts); n++) {
+        int nch = channel_counts[n];
+        test_float(root, nch, 14, false); // default options: direct search
+        test_float(root, nch, 30, true);  // large search window: FFT
+        test_s16(root, nch);
+    }
+
+    talloc_free(root);
+    mpv_terminate_destroy(h);
+    return 0;
+}
@@ -0,0 +1,168 @@
+// Ordering and completion of thread pool jobs.
+
+#include <pthread.h>
+
+#include "mpv_talloc.h"
+#include "common/common.h"
+#include "misc/thread_pool.h"
+#include "osdep/atomic.h"
+#include "osdep/timer.h"
+#include "test_utils.h"
+
+#define NUM_JOBS 1000
+
+struct order_ctx {
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool release;
+    int order[NUM_JOBS + 1];
+    int num_order;
+};
+
+struct order_job {
+    struct order_ctx *ctx;
+    int id;
+};
+
+// Block the (single) worker until all jobs are queued.
+static void block_fn(void *p)
+{
+    struct order_ctx *ctx = p;
+    pthread_mutex_lock(&ctx->lock);
+    while (!ctx->release)
+        pthread_cond_wait(&ctx->wakeup, &ctx->lock);
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+static void order_fn(void *p)
+{
+    struct order_job *job = p;
+    struct order_ctx *ctx = job->ctx;
+    pthread_mutex_lock(&ctx->lock);
+    ctx->order[ctx->num_order++] = job->id;
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+static void release(struct order_ctx *ctx)
+{
+    pthread_mutex_lock(&ctx->lock);
+    ctx->release = true;
+    pthread_cond_broadcast(&ctx->wakeup);
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+// With one worker, jobs of the same priority run in queue order.
+static void test_fifo(void)
+{
+    struct order_ctx ctx = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .wakeup = PTHREAD_COND_INITIALIZER,
+    };
+    struct order_job jobs[NUM_JOBS];
+
+    struct mp_thread_pool *pool = mp_thread_pool_create(NULL, 1);
+    TEST_CHECK(pool);
+    mp_thread_pool_queue(pool, block_fn, &ctx);
+    for (int n = 0; n < NUM_JOBS; n++) {
+        jobs[n] = (struct order_job){&ctx, n};
+        mp_thread_pool_queue(pool, order_fn, &jobs[n]);
+    }
+    release(&ctx);
+    talloc_free(pool); // waits for all jobs
+
+    TEST_CHECK(ctx.num_order == NUM_JOBS);
+    for (int n = 0; n < NUM_JOBS; n++)
+        TEST_CHECK(ctx.order[n] == n);
+}
+
+// Higher priorities run first; within a priority, in queue order.
+static void test_priority(void)
+{
+    struct order_ctx ctx = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .wakeup = PTHREAD_COND_INITIALIZER,
+    };
+    struct order_job jobs[6];
+    struct mp_thread_pool_job *handles[6];
+    static const enum mp_thread_pool_prio prios[6] = {
+        MP_THREAD_POOL_PRIO_LOW, MP_THREAD_POOL_PRIO_NORMAL,
+        MP_THREAD_POOL_PRIO_HIGH, MP_THREAD_POOL_PRIO_LOW,
+        MP_THREAD_POOL_PRIO_NORMAL, MP_THREAD_POOL_PRIO_HIGH,
+    };
+    static const int expected[6] = {2, 5, 1, 4, 0, 3};
+
+    struct mp_thread_pool *pool = mp_thread_pool_create(NULL, 1);
+    TEST_CHECK(pool);
+    struct mp_thread_pool_job *blocker =
+        mp_thread_pool_submit(pool, MP_THREAD_POOL_PRIO_HIGH, block_fn, &ctx);
+    // (The blocker runs first even if the worker did not take it yet, as it
+    // was queued first with the highest priority.)
+    for (int n = 0; n < 6; n++) {
+        jobs[n] = (struct order_job){&ctx, n};
+        handles[n] = mp_thread_pool_submit(pool, prios[n], order_fn, &jobs[n]);
+    }
+    release(&ctx);
+    mp_thread_pool_job_wait(blocker);
+    for (int n = 0; n < 6; n++)
+        mp_thread_pool_job_wait(handles[n]);
+    talloc_free(pool);
+
+    TEST_CHECK(ctx.num_order == 6);
+    for (int n = 0; n < 6; n++)
+        TEST_CHECK(ctx.order[n] == expected[n]);
+}
+
+static void count_fn(void *p)
+{
+    atomic_int *count = p;
+    atomic_fetch_add(count, 1);
+}
+
+// All jobs run exactly once with many workers and stealing.
+static void test_all_run(void)
+{
+    atomic_int count;
+    atomic_store(&count, 0);
+    struct mp_thread_pool *pool =
+        mp_thread_pool_create_dynamic(NULL, 1, 8, 0.01);
+    TEST_CHECK(pool);
+    for (int n = 0; n < NUM_JOBS * 100; n++)
+        mp_thread_pool_queue(pool, count_fn, &count);
+    talloc_free(pool);
+    TEST_CHECK(atomic_load(&count) == NUM_JOBS * 100);
+}
+
+// With min_threads==0, all workers exit when idle, and jobs queued afterwards
+// still run (on newly started workers).
+static void test_idle_exit(void)
+{
+    atomic_int count;
+    atomic_store(&count, 0);
+    struct mp_thread_pool *pool =
+        mp_thread_pool_create_dynamic(NULL, 0, 4, 0.001);
+    TEST_CHECK(pool);
+    for (int round = 0; round < 20; round++) {
+        struct mp_thread_pool_job *jobs[8];
+        for (int n = 0; n < MP_ARRAY_SIZE(jobs); n++) {
+            jobs[n] = mp_thread_pool_submit(pool, MP_THREAD_POOL_PRIO_NORMAL,
+                                            count_fn, &count);
+        }
+        for (int n = 0; n < MP_ARRAY_SIZE(jobs); n++)
+            mp_thread_pool_job_wait(jobs[n]);
+        // Alternate between queuing while workers are idle or exiting, and
+        // after they are gone.
+        if (round % 2)
+            mp_sleep_us(10000);
+    }
+    talloc_free(pool);
+    TEST_CHECK(atomic_load(&count) == 20 * 8);
+}
+
+int main(void)
+{
+    test_fifo();
+    test_priority();
+    test_all_run();
+    test_idle_exit();
+    return 0;
+}
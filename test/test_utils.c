@@ -0,0 +1,32 @@
+#include "common/common.h"
+#include "osdep/timer.h"
+#include "player/client.h"
+#include "test_utils.h"
+
+mpv_handle *test_create_player(const char *const *opts)
+{
+    mpv_handle *h = mpv_create();
+    TEST_CHECK(h);
+    TEST_CHECK(mpv_set_option_string(h, "vo", "null") >= 0);
+    TEST_CHECK(mpv_set_option_string(h, "ao", "null") >= 0);
+    TEST_CHECK(mpv_set_option_string(h, "terminal", "no") >= 0);
+    for (int n = 0; opts && opts[n]; n += 2)
+        TEST_CHECK(mpv_set_option_string(h, opts[n], opts[n + 1]) >= 0);
+    TEST_CHECK(mpv_initialize(h) >= 0);
+    return h;
+}
+
+struct mpv_global *test_get_global(mpv_handle *h)
+{
+    return mp_client_get_global(h);
+}
+
+double test_time(void)
+{
+    return mp_time_sec();
+}
+
+void test_report(const char *name, double value, const char *unit)
+{
+    printf("%-40s %14.3f %s\n", name, value, unit);
+}
@@ -0,0 +1,33 @@
+#ifndef MP_TEST_UTILS_H_
+#define MP_TEST_UTILS_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libmpv/client.h"
+
+struct mpv_global;
+
+// Abort the test program if cond is false.
+#define TEST_CHECK(cond) do {                                           \
+        if (!(cond)) {                                                  \
+            fprintf(stderr, "%s:%d: check failed: %s\n",                \
+                    __FILE__, __LINE__, #cond);                         \
+            abort();                                                    \
+        }                                                               \
+    } while (0)
+
+// Create and initialize a player without any output. opts is NULL, or a
+// NULL-terminated list of option name/value pairs. Never returns NULL.
+mpv_handle *test_create_player(const char *const *opts);
+
+// The player's global context, for using internal APIs.
+struct mpv_global *test_get_global(mpv_handle *h);
+
+// Monotonic time in seconds.
+double test_time(void);
+
+// Print a benchmark result line in a uniform format.
+void test_report(const char *name, double value, const char *unit);
+
+#endif
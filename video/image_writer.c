@@ -328,7 +328,8 @@ struct mp_image *convert_image(struct mp_image *image, int destfmt,
 
     dst->params = p;
 
-    if (mp_image_swscale(dst, image, mp_sws_hq_flags) < 0) {
+    // Screenshots are converted on all CPUs (if the size doesn't change).
+    if (mp_image_swscale(dst, image, mp_sws_hq_flags, 0) < 0) {
         mp_err(log, "Error when converting image.\n");
         talloc_free(dst);
         return NULL;
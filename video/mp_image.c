@@ -22,6 +22,7 @@
 #include <libavutil/mem.h>
 #include <libavutil/common.h>
 #include <libavutil/bswap.h>
+#include <libavutil/cpu.h>
 #include <libavutil/hwcontext.h>
 #include <libavutil/rational.h>
 #include <libavcodec/avcodec.h>
@@ -35,11 +36,19 @@
 #include "build/config.h"
 #include "common/av_common.h"
 #include "common/common.h"
+#include "misc/thread_pool.h"
 #include "hwdec.h"
 #include "mp_image.h"
 #include "sws_utils.h"
 #include "fmt-conversion.h"
 
+#if HAVE_ASM && defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define HAVE_COPY_X86 1
+#include <immintrin.h>
+#else
+#define HAVE_COPY_X86 0
+#endif
+
 const struct m_opt_choice_alternatives mp_spherical_names[] = {
     {"auto",        MP_SPHERICAL_AUTO},
     {"none",        MP_SPHERICAL_NONE},
@@ -466,25 +475,177 @@ static void memcpy_pic_cb(void *dst, const void *src, int bytesPerLine, int heig
     }
 }
 
-static void mp_image_copy_cb(struct mp_image *dst, struct mp_image *src,
-                             memcpy_fn cpy)
+#if HAVE_COPY_X86
+// memcpy() with non-temporal stores. The caller must issue copy_fence() before
+// anyone else reads the data.
+__attribute__((target("sse2")))
+static void *memcpy_stream_sse2(void *d, const void *s, size_t size)
+{
+    uint8_t *dst = d;
+    const uint8_t *src = s;
+    size_t head = MPMIN((-(uintptr_t)dst) & 15, size);
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    size -= head;
+    size_t body = size & ~(size_t)63;
+    for (size_t x = 0; x < body; x += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + x));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + x + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(src + x + 32));
+        __m128i e = _mm_loadu_si128((const __m128i *)(src + x + 48));
+        _mm_stream_si128((__m128i *)(dst + x), a);
+        _mm_stream_si128((__m128i *)(dst + x + 16), b);
+        _mm_stream_si128((__m128i *)(dst + x + 32), c);
+        _mm_stream_si128((__m128i *)(dst + x + 48), e);
+    }
+    memcpy(dst + body, src + body, size - body);
+    return d;
+}
+
+__attribute__((target("sse2")))
+static void copy_fence_sse2(void)
+{
+    _mm_sfence();
+}
+
+// memcpy() with streaming loads. From write-combining memory (like mapped GPU
+// surfaces), these read a whole cache line at once, instead of doing a slow
+// uncached read for every access.
+__attribute__((target("sse4.1")))
+static void *memcpy_uncached_sse4(void *d, const void *s, size_t size)
+{
+    uint8_t *dst = d;
+    const uint8_t *src = s;
+    size_t head = MPMIN((-(uintptr_t)src) & 15, size);
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    size -= head;
+    size_t body = size & ~(size_t)63;
+    for (size_t x = 0; x < body; x += 64) {
+        __m128i a = _mm_stream_load_si128((__m128i *)(src + x));
+        __m128i b = _mm_stream_load_si128((__m128i *)(src + x + 16));
+        __m128i c = _mm_stream_load_si128((__m128i *)(src + x + 32));
+        __m128i e = _mm_stream_load_si128((__m128i *)(src + x + 48));
+        _mm_storeu_si128((__m128i *)(dst + x), a);
+        _mm_storeu_si128((__m128i *)(dst + x + 16), b);
+        _mm_storeu_si128((__m128i *)(dst + x + 32), c);
+        _mm_storeu_si128((__m128i *)(dst + x + 48), e);
+    }
+    memcpy(dst + body, src + body, size - body);
+    return d;
+}
+#endif
+
+// Copying large images is split into slices of at least this many bytes. Note
+// that a single thread can't saturate the memory bandwidth on most systems, but
+// a few threads can, so there's no point in using more than MAX_COPY_THREADS.
+#define MIN_COPY_SLICE_BYTES (1 << 20)
+#define MAX_COPY_THREADS 4
+
+static pthread_once_t copy_init_once = PTHREAD_ONCE_INIT;
+static memcpy_fn copy_stream_fn = memcpy;
+static memcpy_fn copy_uncached_fn = memcpy;
+static void (*copy_fence)(void);
+static struct mp_thread_pool *copy_pool;
+static int copy_threads = 1;
+
+static void copy_init(void)
+{
+    int flags = av_get_cpu_flags();
+    (void)flags;
+#if HAVE_COPY_X86
+    if (flags & AV_CPU_FLAG_SSE2) {
+        copy_stream_fn = memcpy_stream_sse2;
+        copy_fence = copy_fence_sse2;
+    }
+    if (flags & AV_CPU_FLAG_SSE4)
+        copy_uncached_fn = memcpy_uncached_sse4;
+#endif
+    // The pool is process-wide and never freed, but has no permanent threads:
+    // they are started on demand, and exit after being idle for 5 seconds.
+    int threads = MPMIN(av_cpu_count(), MAX_COPY_THREADS);
+    if (threads > 1) {
+        copy_pool = mp_thread_pool_create_dynamic(NULL, 0, threads - 1, 5.0);
+        if (copy_pool)
+            copy_threads = threads;
+    }
+}
+
+struct copy_slice {
+    struct mp_image *dst, *src;
+    int flags;
+    int index, count;
+};
+
+// Copy the rows index/count .. (index+1)/count of every plane.
+static void copy_slice(void *ptr)
+{
+    struct copy_slice *s = ptr;
+    struct mp_image *dst = s->dst, *src = s->src;
+    bool uncached = s->flags & MP_IMAGE_COPY_UNCACHED_SRC;
+    bool stream = (s->flags & MP_IMAGE_COPY_STREAM) && copy_fence && !uncached;
+    memcpy_fn cpy = uncached ? copy_uncached_fn :
+                    stream ? copy_stream_fn : memcpy;
+    for (int n = 0; n < dst->num_planes; n++) {
+        int line_bytes = (mp_image_plane_w(dst, n) * dst->fmt.bpp[n] + 7) / 8;
+        int plane_h = mp_image_plane_h(dst, n);
+        int y0 = (int64_t)plane_h * s->index / s->count;
+        int y1 = (int64_t)plane_h * (s->index + 1) / s->count;
+        void *d = dst->planes[n] + y0 * (ptrdiff_t)dst->stride[n];
+        void *sp = src->planes[n] + y0 * (ptrdiff_t)src->stride[n];
+        memcpy_pic_cb(d, sp, line_bytes, y1 - y0,
+                      dst->stride[n], src->stride[n], cpy);
+    }
+    if (stream)
+        copy_fence();
+}
+
+// Like mp_image_copy(), but flags is a combination of MP_IMAGE_COPY_* flags.
+// Large images are copied with multiple threads; this is transparent to the
+// caller, and the function returns only when the copy is complete.
+void mp_image_copy_flags(struct mp_image *dst, struct mp_image *src, int flags)
 {
     assert(dst->imgfmt == src->imgfmt);
     assert(dst->w == src->w && dst->h == src->h);
     assert(mp_image_is_writeable(dst));
+
+    pthread_once(&copy_init_once, copy_init);
+
+    int64_t bytes = 0;
     for (int n = 0; n < dst->num_planes; n++) {
         int line_bytes = (mp_image_plane_w(dst, n) * dst->fmt.bpp[n] + 7) / 8;
-        int plane_h = mp_image_plane_h(dst, n);
-        memcpy_pic_cb(dst->planes[n], src->planes[n], line_bytes, plane_h,
-                      dst->stride[n], src->stride[n], cpy);
+        bytes += line_bytes * (int64_t)mp_image_plane_h(dst, n);
+    }
+    int count = MPCLAMP(bytes / MIN_COPY_SLICE_BYTES, 1, copy_threads);
+
+    struct copy_slice slices[MAX_COPY_THREADS];
+    struct mp_thread_pool_job *jobs[MAX_COPY_THREADS] = {0};
+    for (int n = 0; n < count; n++) {
+        slices[n] = (struct copy_slice){dst, src, flags, n, count};
+        // Run slice 0 on the calling thread (or all if queuing fails).
+        if (n > 0) {
+            jobs[n] = mp_thread_pool_submit(copy_pool,
+                                            MP_THREAD_POOL_PRIO_NORMAL,
+                                            copy_slice, &slices[n]);
+            if (!jobs[n])
+                copy_slice(&slices[n]);
+        }
     }
+    copy_slice(&slices[0]);
+    for (int n = 1; n < count; n++) {
+        if (jobs[n])
+            mp_thread_pool_job_wait(jobs[n]);
+    }
+
     if (dst->fmt.flags & MP_IMGFLAG_PAL)
         memcpy(dst->planes[1], src->planes[1], AVPALETTE_SIZE);
 }
 
 void mp_image_copy(struct mp_image *dst, struct mp_image *src)
 {
-    mp_image_copy_cb(dst, src, memcpy);
+    mp_image_copy_flags(dst, src, 0);
 }
 
 static enum mp_csp mp_image_params_get_forced_csp(struct mp_image_params *params)
@@ -142,6 +142,17 @@ struct mp_image *mp_image_from_buffer(int imgfmt, int w, int h, int stride_align
 
 struct mp_image *mp_image_alloc(int fmt, int w, int h);
 void mp_image_copy(struct mp_image *dmpi, struct mp_image *mpi);
+
+enum {
+    // dst is not going to be read by the CPU soon (e.g. because it's mapped
+    // GPU memory, or is passed to another thread); use non-temporal stores if
+    // they are available, so that the copy doesn't evict the CPU caches.
+    MP_IMAGE_COPY_STREAM = 1 << 0,
+    // src is uncached memory (e.g. a mapped GPU surface); read it with
+    // streaming loads if they are available. Overrides MP_IMAGE_COPY_STREAM.
+    MP_IMAGE_COPY_UNCACHED_SRC = 1 << 1,
+};
+void mp_image_copy_flags(struct mp_image *dmpi, struct mp_image *mpi, int flags);
 void mp_image_copy_attributes(struct mp_image *dmpi, struct mp_image *mpi);
 struct mp_image *mp_image_new_copy(struct mp_image *img);
 struct mp_image *mp_image_new_ref(struct mp_image *img);
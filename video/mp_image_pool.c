@@ -254,6 +254,54 @@ void mp_image_pool_set_lru(struct mp_image_pool *pool)
 }
 
 
+// Hardware surface types that are downloaded by mapping them, and copying them
+// with mp_image_copy() (which uses multiple threads for large images). All
+// others use av_hwframe_transfer_data(), because their mappings may be slower
+// to read than the driver's own transfer path.
+static const struct {
+    enum AVHWDeviceType type;
+    int copy_flags;     // MP_IMAGE_COPY_* flags for mp_image_copy_flags()
+} hw_download_map_types[] = {
+    // libavutil's transfer maps the surface the same way, and then copies it
+    // with plain memcpy() on one thread. The mapping (vaDeriveImage) is
+    // usually uncached.
+    {AV_HWDEVICE_TYPE_VAAPI, MP_IMAGE_COPY_UNCACHED_SRC},
+    // Mapping locks the CVPixelBuffer, which is in cached system memory.
+    {AV_HWDEVICE_TYPE_VIDEOTOOLBOX, 0},
+};
+
+// Map the hw surface, and copy it into a new image of the format imgfmt.
+// Returns NULL if mapping is not enabled for the surface type, not supported,
+// or fails.
+static struct mp_image *hw_download_mapped(AVHWFramesContext *fctx,
+                                           AVFrame *srcav, int imgfmt,
+                                           struct mp_image_pool *swpool)
+{
+    int copy_flags = -1;
+    for (int n = 0; n < MP_ARRAY_SIZE(hw_download_map_types); n++) {
+        if (hw_download_map_types[n].type == fctx->device_ctx->type)
+            copy_flags = hw_download_map_types[n].copy_flags;
+    }
+    if (copy_flags < 0)
+        return NULL;
+
+    AVFrame *mapav = av_frame_alloc();
+    if (!mapav)
+        return NULL;
+    struct mp_image *dst = NULL;
+    if (av_hwframe_map(mapav, srcav, AV_HWFRAME_MAP_READ) >= 0) {
+        struct mp_image *map = mp_image_from_av_frame(mapav);
+        if (map && map->imgfmt == imgfmt && !map->hwctx) {
+            dst = mp_image_pool_get(swpool, imgfmt, map->w, map->h);
+            if (dst)
+                mp_image_copy_flags(dst, map, copy_flags);
+        }
+        talloc_free(map);
+    }
+    av_frame_free(&mapav);
+    return dst;
+}
+
 // Copies the contents of the HW surface img to system memory and retuns it.
 // If swpool is not NULL, it's used to allocate the target image.
 // img must be a hw surface with a AVHWFramesContext attached.
@@ -282,26 +330,33 @@ struct mp_image *mp_image_hw_download(struct mp_image *src,
     if (!imgfmt)
         return NULL;
 
-    struct mp_image *dst =
-        mp_image_pool_get(swpool, imgfmt, fctx->width, fctx->height);
-    if (!dst)
+    AVFrame *srcav = mp_image_to_av_frame(src);
+    if (!srcav)
         return NULL;
 
-    // Target image must be writable, so unref it.
-    AVFrame *dstav = mp_image_to_av_frame_and_unref(dst);
-    if (!dstav)
-        return NULL;
+    // Prefer mapping the surface where it's known to be faster (see
+    // hw_download_map_types). Otherwise let libavutil do it.
+    int res = 0;
+    struct mp_image *dst = hw_download_mapped(fctx, srcav, imgfmt, swpool);
+    if (!dst) {
+        dst = mp_image_pool_get(swpool, imgfmt, fctx->width, fctx->height);
+        if (!dst) {
+            av_frame_free(&srcav);
+            return NULL;
+        }
 
-    AVFrame *srcav = mp_image_to_av_frame(src);
-    if (!srcav) {
-        av_frame_unref(dstav);
-        return NULL;
-    }
+        // Target image must be writable, so unref it.
+        AVFrame *dstav = mp_image_to_av_frame_and_unref(dst);
+        if (!dstav) {
+            av_frame_free(&srcav);
+            return NULL;
+        }
 
-    int res = av_hwframe_transfer_data(dstav, srcav, 0);
+        res = av_hwframe_transfer_data(dstav, srcav, 0);
+        dst = mp_image_from_av_frame(dstav);
+        av_frame_free(&dstav);
+    }
     av_frame_free(&srcav);
-    dst = mp_image_from_av_frame(dstav);
-    av_frame_free(&dstav);
     if (res >= 0 && dst) {
         mp_image_set_size(dst, src->w, src->h);
         mp_image_copy_attributes(dst, src);
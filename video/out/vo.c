@@ -38,8 +38,10 @@
 #include "dr_helper.h"
 #include "input/input.h"
 #include "options/m_config.h"
+#include "common/bench.h"
 #include "common/msg.h"
 #include "common/global.h"
+#include "common/trace.h"
 #include "video/hwdec.h"
 #include "video/mp_image.h"
 #include "sub/sub_osd.h"
@@ -159,6 +161,7 @@ struct vo_internal {
 
     bool rendering;                 // true if an image is being rendered
     struct vo_frame *frame_queued;  // should be drawn next
+    int64_t frame_queued_time;      // for --benchmark
     int req_frames;                 // VO's requested value of num_frames
     uint64_t current_frame_id;
 
@@ -811,6 +814,8 @@ void vo_queue_frame(struct vo *vo, struct vo_frame *frame)
     in->hasframe = true;
     frame->frame_id = ++(in->current_frame_id);
     in->frame_queued = frame;
+    in->frame_queued_time = mp_bench_start(vo->global);
+    mp_trace_instant(vo->global, "vo-queue-frame", frame->frame_id);
     in->wakeup_pts = frame->display_synced
                    ? 0 : frame->pts + MPMAX(frame->duration, 0);
     wakeup_locked(vo);
@@ -858,6 +863,7 @@ bool vo_render_frame_external(struct vo *vo)
     pthread_mutex_lock(&in->lock);
 
     if (in->frame_queued) {
+        mp_bench_end(vo->global, MP_BENCH_VO_QUEUE, in->frame_queued_time);
         talloc_free(in->current_frame);
         in->current_frame = in->frame_queued;
         in->frame_queued = NULL;
@@ -922,22 +928,35 @@ bool vo_render_frame_external(struct vo *vo)
 
         MP_STATS(vo, "start video-draw");
 
+        int64_t bench_start = mp_bench_start(vo->global);
+        int64_t trace_start = mp_trace_begin(vo->global);
+
         if (vo->driver->draw_frame) {
             vo->driver->draw_frame(vo, frame);
         } else {
             vo->driver->draw_image(vo, mp_image_new_ref(frame->current));
         }
 
+        mp_trace_end(vo->global, "vo-draw", trace_start);
+
         MP_STATS(vo, "end video-draw");
 
+        // Don't count the time waiting for the display as VO time.
+        int64_t bench_wait = mp_bench_start(vo->global);
         wait_until(vo, target);
+        bench_start += mp_bench_start(vo->global) - bench_wait;
 
         MP_STATS(vo, "start video-flip");
 
+        trace_start = mp_trace_begin(vo->global);
         vo->driver->flip_page(vo);
+        mp_trace_end(vo->global, "vo-flip", trace_start);
 
         MP_STATS(vo, "end video-flip");
 
+        mp_bench_end(vo->global, MP_BENCH_VO, bench_start);
+        mp_bench_add(vo->global, MP_BENCH_VO_FRAMES, 1);
+
         pthread_mutex_lock(&in->lock);
         in->dropped_frame = prev_drop_count < vo->in->drop_count;
         in->rendering = false;
@@ -952,6 +971,7 @@ bool vo_render_frame_external(struct vo *vo)
 
     if (in->dropped_frame) {
         MP_STATS(vo, "drop-vo");
+        mp_trace_instant(vo->global, "vo-drop", frame->frame_id);
     } else {
         in->request_redraw = false;
     }
@@ -1409,7 +1409,7 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
     if (!get_video_buffer(priv, &buffer))
         goto done;
 
-    mp_image_copy(&buffer, mpi);
+    mp_image_copy_flags(&buffer, mpi, MP_IMAGE_COPY_STREAM);
 
     d3d_unlock_video_objects(priv);
 
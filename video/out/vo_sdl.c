@@ -871,7 +871,7 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
             return;
         }
 
-        mp_image_copy(&texmpi, mpi);
+        mp_image_copy_flags(&texmpi, mpi, MP_IMAGE_COPY_STREAM);
 
         SDL_UnlockTexture(vc->tex);
 
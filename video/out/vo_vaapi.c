@@ -365,7 +365,7 @@ static int va_surface_upload(struct priv *priv, struct mp_image *va_dst,
         return -1;
     assert(sw_src->w <= img.w && sw_src->h <= img.h);
     mp_image_set_size(&img, sw_src->w, sw_src->h); // copy only visible part
-    mp_image_copy(&img, sw_src);
+    mp_image_copy_flags(&img, sw_src, MP_IMAGE_COPY_STREAM);
     va_image_unmap(p->ctx, &p->image);
 
     if (!p->is_derived) {
@@ -675,7 +675,7 @@ static void draw_osd_cb(void *pctx, struct sub_bitmaps *imgs)
                 if (!tmp)
                     goto error;
 
-                mp_image_swscale(tmp, &src, mp_sws_fast_flags);
+                mp_image_swscale(tmp, &src, mp_sws_fast_flags, 1);
 
                 bmp = tmp;
             }
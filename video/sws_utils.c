@@ -16,10 +16,12 @@
  */
 
 #include <assert.h>
+#include <pthread.h>
 
 #include <libswscale/swscale.h>
 #include <libavcodec/avcodec.h>
 #include <libavutil/bswap.h>
+#include <libavutil/cpu.h>
 #include <libavutil/opt.h>
 
 #include "config.h"
@@ -34,6 +36,7 @@
 #include "fmt-conversion.h"
 #include "csputils.h"
 #include "common/msg.h"
+#include "misc/thread_pool.h"
 #include "osdep/endian.h"
 
 //global sws_flags from the command line
@@ -45,6 +48,7 @@ struct sws_opts {
     int chr_hshift;
     float chr_sharpen;
     float lum_sharpen;
+    int threads;
 };
 
 #define OPT_BASE_STRUCT struct sws_opts
@@ -68,11 +72,13 @@ const struct m_sub_options sws_conf = {
         OPT_INT("chs", chr_hshift, 0),
         OPT_FLOATRANGE("ls", lum_sharpen, 0, -100.0, 100.0),
         OPT_FLOATRANGE("cs", chr_sharpen, 0, -100.0, 100.0),
+        OPT_CHOICE_OR_INT("threads", threads, 0, 1, 64, ({"auto", 0})),
         {0}
     },
     .size = sizeof(struct sws_opts),
     .defaults = &(const struct sws_opts){
         .scaler = SWS_BICUBIC,
+        .threads = 1,
     },
 };
 
@@ -97,6 +103,7 @@ void mp_sws_set_from_cmdline(struct mp_sws_context *ctx, struct mpv_global *g)
 
     ctx->flags = SWS_PRINT_INFO;
     ctx->flags |= opts->scaler;
+    ctx->threads = opts->threads;
 
     talloc_free(opts);
 }
@@ -124,14 +131,32 @@ static bool cache_valid(struct mp_sws_context *ctx)
     return mp_image_params_equal(&ctx->src, &old->src) &&
            mp_image_params_equal(&ctx->dst, &old->dst) &&
            ctx->flags == old->flags &&
+           ctx->threads == old->threads &&
            ctx->brightness == old->brightness &&
            ctx->contrast == old->contrast &&
            ctx->saturation == old->saturation;
 }
 
+struct mp_sws_slice {
+    struct SwsContext *sws;
+    int y0, y1;
+    // Set by mp_sws_scale() for the duration of the call.
+    struct mp_image src, dst;
+    struct mp_thread_pool_job *job;
+};
+
+static void free_slices(struct mp_sws_context *ctx)
+{
+    for (int n = 0; n < ctx->num_slices; n++)
+        sws_freeContext(ctx->slices[n].sws);
+    TA_FREEP(&ctx->slices);
+    ctx->num_slices = 0;
+}
+
 static void free_mp_sws(void *p)
 {
     struct mp_sws_context *ctx = p;
+    free_slices(ctx);
     sws_freeContext(ctx->sws);
     sws_freeFilter(ctx->src_filter);
     sws_freeFilter(ctx->dst_filter);
@@ -145,6 +170,7 @@ struct mp_sws_context *mp_sws_alloc(void *talloc_ctx)
     *ctx = (struct mp_sws_context) {
         .log = mp_null_log,
         .flags = SWS_BILINEAR,
+        .threads = 1,
         .contrast = 1 << 16,    // 1.0 in 16.16 fixed point
         .saturation = 1 << 16,
         .force_reload = true,
@@ -155,46 +181,23 @@ struct mp_sws_context *mp_sws_alloc(void *talloc_ctx)
     return ctx;
 }
 
-// Reinitialize (if needed) - return error code.
-// Optional, but possibly useful to avoid having to handle mp_sws_scale errors.
-int mp_sws_reinit(struct mp_sws_context *ctx)
+// Create a libswscale context for ctx->src/dst, with the heights replaced by
+// src_h/dst_h, and flags instead of ctx->flags. The formats must have been
+// checked by the caller.
+static struct SwsContext *create_sws(struct mp_sws_context *ctx,
+                                     int src_h, int dst_h, int flags)
 {
     struct mp_image_params *src = &ctx->src;
     struct mp_image_params *dst = &ctx->dst;
 
-    // Neutralize unsupported or ignored parameters.
-    src->p_w = dst->p_w = 0;
-    src->p_h = dst->p_h = 0;
-
-    if (cache_valid(ctx))
-        return 0;
-
-    sws_freeContext(ctx->sws);
-    ctx->sws = sws_alloc_context();
-    if (!ctx->sws)
-        return -1;
-
-    mp_image_params_guess_csp(src); // sanitize colorspace/colorlevels
-    mp_image_params_guess_csp(dst);
+    struct SwsContext *sws = sws_alloc_context();
+    if (!sws)
+        return NULL;
 
     struct mp_imgfmt_desc src_fmt = mp_imgfmt_get_desc(src->imgfmt);
     struct mp_imgfmt_desc dst_fmt = mp_imgfmt_get_desc(dst->imgfmt);
-    if (!src_fmt.id || !dst_fmt.id)
-        return -1;
-
     enum AVPixelFormat s_fmt = imgfmt2pixfmt(src->imgfmt);
-    if (s_fmt == AV_PIX_FMT_NONE || sws_isSupportedInput(s_fmt) < 1) {
-        MP_ERR(ctx, "Input image format %s not supported by libswscale.\n",
-               mp_imgfmt_to_name(src->imgfmt));
-        return -1;
-    }
-
     enum AVPixelFormat d_fmt = imgfmt2pixfmt(dst->imgfmt);
-    if (d_fmt == AV_PIX_FMT_NONE || sws_isSupportedOutput(d_fmt) < 1) {
-        MP_ERR(ctx, "Output image format %s not supported by libswscale.\n",
-               mp_imgfmt_to_name(dst->imgfmt));
-        return -1;
-    }
 
     int s_csp = mp_csp_to_sws_colorspace(src->color.space);
     int s_range = src->color.levels == MP_CSP_LEVELS_PC;
@@ -208,49 +211,199 @@ int mp_sws_reinit(struct mp_sws_context *ctx)
     s_range = s_range && (src_fmt.flags & MP_IMGFLAG_YUV);
     d_range = d_range && (dst_fmt.flags & MP_IMGFLAG_YUV);
 
-    av_opt_set_int(ctx->sws, "sws_flags", ctx->flags, 0);
+    av_opt_set_int(sws, "sws_flags", flags, 0);
 
-    av_opt_set_int(ctx->sws, "srcw", src->w, 0);
-    av_opt_set_int(ctx->sws, "srch", src->h, 0);
-    av_opt_set_int(ctx->sws, "src_format", s_fmt, 0);
+    av_opt_set_int(sws, "srcw", src->w, 0);
+    av_opt_set_int(sws, "srch", src_h, 0);
+    av_opt_set_int(sws, "src_format", s_fmt, 0);
 
-    av_opt_set_int(ctx->sws, "dstw", dst->w, 0);
-    av_opt_set_int(ctx->sws, "dsth", dst->h, 0);
-    av_opt_set_int(ctx->sws, "dst_format", d_fmt, 0);
+    av_opt_set_int(sws, "dstw", dst->w, 0);
+    av_opt_set_int(sws, "dsth", dst_h, 0);
+    av_opt_set_int(sws, "dst_format", d_fmt, 0);
 
-    av_opt_set_double(ctx->sws, "param0", ctx->params[0], 0);
-    av_opt_set_double(ctx->sws, "param1", ctx->params[1], 0);
+    av_opt_set_double(sws, "param0", ctx->params[0], 0);
+    av_opt_set_double(sws, "param1", ctx->params[1], 0);
 
 #if LIBAVCODEC_VERSION_MICRO >= 100
     int cr_src = mp_chroma_location_to_av(src->chroma_location);
     int cr_dst = mp_chroma_location_to_av(dst->chroma_location);
     int cr_xpos, cr_ypos;
     if (avcodec_enum_to_chroma_pos(&cr_xpos, &cr_ypos, cr_src) >= 0) {
-        av_opt_set_int(ctx->sws, "src_h_chr_pos", cr_xpos, 0);
-        av_opt_set_int(ctx->sws, "src_v_chr_pos", cr_ypos, 0);
+        av_opt_set_int(sws, "src_h_chr_pos", cr_xpos, 0);
+        av_opt_set_int(sws, "src_v_chr_pos", cr_ypos, 0);
     }
     if (avcodec_enum_to_chroma_pos(&cr_xpos, &cr_ypos, cr_dst) >= 0) {
-        av_opt_set_int(ctx->sws, "dst_h_chr_pos", cr_xpos, 0);
-        av_opt_set_int(ctx->sws, "dst_v_chr_pos", cr_ypos, 0);
+        av_opt_set_int(sws, "dst_h_chr_pos", cr_xpos, 0);
+        av_opt_set_int(sws, "dst_v_chr_pos", cr_ypos, 0);
     }
 #endif
 
     // This can fail even with normal operation, e.g. if a conversion path
     // simply does not support these settings.
     int r =
-        sws_setColorspaceDetails(ctx->sws, sws_getCoefficients(s_csp), s_range,
+        sws_setColorspaceDetails(sws, sws_getCoefficients(s_csp), s_range,
                                  sws_getCoefficients(d_csp), d_range,
                                  ctx->brightness, ctx->contrast, ctx->saturation);
     ctx->supports_csp = r >= 0;
 
-    if (sws_init_context(ctx->sws, ctx->src_filter, ctx->dst_filter) < 0)
+    if (sws_init_context(sws, ctx->src_filter, ctx->dst_filter) < 0) {
+        sws_freeContext(sws);
+        return NULL;
+    }
+
+    return sws;
+}
+
+// Slices with fewer pixels than this are not worth a separate job.
+#define MIN_SLICE_PIXELS (256 * 1024)
+// The maximum number of slices (see the "threads" option).
+#define MAX_SLICES 64
+
+// Slices are converted on a process-wide pool, so short-lived contexts (like
+// the one in mp_image_swscale()) don't create threads. The pool is never
+// freed, but has no permanent threads: they are started on demand, and exit
+// after being idle for 5 seconds.
+static pthread_once_t slice_pool_once = PTHREAD_ONCE_INIT;
+static struct mp_thread_pool *slice_pool;
+
+static void slice_pool_init(void)
+{
+    slice_pool = mp_thread_pool_create_dynamic(NULL, 0, MAX_SLICES - 1, 5.0);
+}
+
+// Set up slice threading according to ctx->threads, if possible. The frame is
+// split into horizontal stripes, each converted by its own libswscale context.
+// This requires the same height on input and output, as there is no vertical
+// scaling that could be split exactly. The stripes are converted independently,
+// so if the chroma is resampled vertically (e.g. 4:2:0 to RGB), rows next to
+// the stripe borders can differ slightly from an unsliced conversion. This is
+// not done if SWS_BITEXACT is set. On failure, it falls back to unsliced
+// conversion (ctx->num_slices is 0).
+static void init_slices(struct mp_sws_context *ctx)
+{
+    struct mp_image_params *src = &ctx->src;
+    struct mp_image_params *dst = &ctx->dst;
+
+    int threads = ctx->threads > 0 ? ctx->threads : av_cpu_count();
+    int num = MPMIN(threads, (int64_t)dst->w * dst->h / MIN_SLICE_PIXELS);
+    num = MPMIN(num, MAX_SLICES);
+    if (num < 2 || src->h != dst->h)
+        return;
+
+    pthread_once(&slice_pool_once, slice_pool_init);
+    if (!slice_pool)
+        goto fail;
+
+    struct mp_imgfmt_desc src_fmt = mp_imgfmt_get_desc(src->imgfmt);
+    struct mp_imgfmt_desc dst_fmt = mp_imgfmt_get_desc(dst->imgfmt);
+    if ((ctx->flags & SWS_BITEXACT) && src_fmt.chroma_ys != dst_fmt.chroma_ys)
+        return;
+
+    int align = MPMAX(src_fmt.align_y, dst_fmt.align_y);
+    ctx->slices = talloc_zero_array(ctx, struct mp_sws_slice, num);
+    for (int n = 0; n < num; n++) {
+        struct mp_sws_slice *slice = &ctx->slices[ctx->num_slices];
+        slice->y0 = MP_ALIGN_DOWN(dst->h * (int64_t)n / num, align);
+        slice->y1 = n == num - 1
+                  ? dst->h : MP_ALIGN_DOWN(dst->h * (int64_t)(n + 1) / num, align);
+        int h = slice->y1 - slice->y0;
+        // Print the libswscale info (if requested) only once.
+        int flags = n ? ctx->flags & ~SWS_PRINT_INFO : ctx->flags;
+        slice->sws = create_sws(ctx, h, h, flags);
+        if (!slice->sws)
+            goto fail;
+        ctx->num_slices++;
+    }
+
+    MP_VERBOSE(ctx, "Using %d slices.\n", num);
+    return;
+
+fail:
+    MP_WARN(ctx, "Could not set up slice threading.\n");
+    free_slices(ctx);
+}
+
+// Reinitialize (if needed) - return error code.
+// Optional, but possibly useful to avoid having to handle mp_sws_scale errors.
+int mp_sws_reinit(struct mp_sws_context *ctx)
+{
+    struct mp_image_params *src = &ctx->src;
+    struct mp_image_params *dst = &ctx->dst;
+
+    // Neutralize unsupported or ignored parameters.
+    src->p_w = dst->p_w = 0;
+    src->p_h = dst->p_h = 0;
+
+    if (cache_valid(ctx))
+        return 0;
+
+    free_slices(ctx);
+    sws_freeContext(ctx->sws);
+    ctx->sws = NULL;
+
+    mp_image_params_guess_csp(src); // sanitize colorspace/colorlevels
+    mp_image_params_guess_csp(dst);
+
+    struct mp_imgfmt_desc src_fmt = mp_imgfmt_get_desc(src->imgfmt);
+    struct mp_imgfmt_desc dst_fmt = mp_imgfmt_get_desc(dst->imgfmt);
+    if (!src_fmt.id || !dst_fmt.id)
         return -1;
 
+    enum AVPixelFormat s_fmt = imgfmt2pixfmt(src->imgfmt);
+    if (s_fmt == AV_PIX_FMT_NONE || sws_isSupportedInput(s_fmt) < 1) {
+        MP_ERR(ctx, "Input image format %s not supported by libswscale.\n",
+               mp_imgfmt_to_name(src->imgfmt));
+        return -1;
+    }
+
+    enum AVPixelFormat d_fmt = imgfmt2pixfmt(dst->imgfmt);
+    if (d_fmt == AV_PIX_FMT_NONE || sws_isSupportedOutput(d_fmt) < 1) {
+        MP_ERR(ctx, "Output image format %s not supported by libswscale.\n",
+               mp_imgfmt_to_name(dst->imgfmt));
+        return -1;
+    }
+
+    init_slices(ctx);
+    if (!ctx->num_slices) {
+        ctx->sws = create_sws(ctx, src->h, dst->h, ctx->flags);
+        if (!ctx->sws)
+            return -1;
+    }
+
     ctx->force_reload = false;
     *ctx->cached = *ctx;
     return 1;
 }
 
+static void scale_slice(void *p)
+{
+    struct mp_sws_slice *slice = p;
+    sws_scale(slice->sws, (const uint8_t *const *) slice->src.planes,
+              slice->src.stride, 0, slice->src.h,
+              slice->dst.planes, slice->dst.stride);
+}
+
+static void scale_slices(struct mp_sws_context *ctx, struct mp_image *dst,
+                         struct mp_image *src)
+{
+    for (int n = 0; n < ctx->num_slices; n++) {
+        struct mp_sws_slice *slice = &ctx->slices[n];
+        slice->src = *src;
+        mp_image_crop(&slice->src, 0, slice->y0, src->w, slice->y1);
+        slice->dst = *dst;
+        mp_image_crop(&slice->dst, 0, slice->y0, dst->w, slice->y1);
+    }
+
+    // The first slice is done on the calling thread.
+    for (int n = 1; n < ctx->num_slices; n++) {
+        ctx->slices[n].job = mp_thread_pool_submit(slice_pool,
+                    MP_THREAD_POOL_PRIO_NORMAL, scale_slice, &ctx->slices[n]);
+    }
+    scale_slice(&ctx->slices[0]);
+    for (int n = 1; n < ctx->num_slices; n++)
+        mp_thread_pool_job_wait(ctx->slices[n].job);
+}
+
 // Scale from src to dst - if src/dst have different parameters from previous
 // calls, the context is reinitialized. Return error code. (It can fail if
 // reinitialization was necessary, and swscale returned an error.)
@@ -266,16 +419,23 @@ int mp_sws_scale(struct mp_sws_context *ctx, struct mp_image *dst,
         return r;
     }
 
+    if (ctx->num_slices) {
+        scale_slices(ctx, dst, src);
+        return 0;
+    }
+
     sws_scale(ctx->sws, (const uint8_t *const *) src->planes, src->stride,
               0, src->h, dst->planes, dst->stride);
     return 0;
 }
 
+// threads is as in mp_sws_context.threads.
 int mp_image_swscale(struct mp_image *dst, struct mp_image *src,
-                     int my_sws_flags)
+                     int my_sws_flags, int threads)
 {
     struct mp_sws_context *ctx = mp_sws_alloc(NULL);
     ctx->flags = my_sws_flags;
+    ctx->threads = threads;
     int res = mp_sws_scale(ctx, dst, src);
     talloc_free(ctx);
     return res;
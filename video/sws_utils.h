@@ -19,7 +19,7 @@ extern const int mp_sws_fast_flags;
 bool mp_sws_supported_format(int imgfmt);
 
 int mp_image_swscale(struct mp_image *dst, struct mp_image *src,
-                     int my_sws_flags);
+                     int my_sws_flags, int threads);
 
 int mp_image_sw_blur_scale(struct mp_image *dst, struct mp_image *src,
                            float gblur);
@@ -31,6 +31,9 @@ struct mp_sws_context {
     // mp_sws_scale() will handle the changes transparently.
     int flags;
     int brightness, contrast, saturation;
+    // Number of slices to convert in parallel (0 means number of CPUs). This
+    // is used only for large frames without vertical scaling. Default: 1.
+    int threads;
     bool force_reload;
     // These are also implicitly set by mp_sws_scale(), and thus optional.
     // Setting them before that call makes sense when using mp_sws_reinit().
@@ -42,10 +45,14 @@ struct mp_sws_context {
     struct SwsFilter *src_filter, *dst_filter;
     double params[2];
 
-    // Cached context (if any)
+    // Cached context (if any, and if slice threading is not used)
     struct SwsContext *sws;
     bool supports_csp;
 
+    // Per-slice contexts (if slice threading is used)
+    struct mp_sws_slice *slices;
+    int num_slices;
+
     // Contains parameters for which sws is valid
     struct mp_sws_context *cached;
 };